@@ -12,6 +12,7 @@
 #ifndef BASE_H
 #define BASE_H
 
+#include <cstdint>
 #include <string>
 #include <sstream>
 
@@ -65,6 +66,18 @@ namespace crossword_backend {
    */
   constexpr int kNO_NUMBER = -1;
 
+  /**
+   * @brief Scramble 64 bits with the splitmix64 finalizer, so that nearby inputs give unrelated outputs.
+   *
+   * @param z
+   * @return std::uint64_t
+   */
+  inline std::uint64_t Mix64(std::uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+
   /**
    * @brief A 2-tuple representing the coordinates of an array of rows indexed by (row, col).
    *
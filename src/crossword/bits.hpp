@@ -0,0 +1,85 @@
+/**
+ * @file bits.hpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Portable bit manipulation helpers.
+ * @version 0.1
+ * @date 2022-04-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef BITS_HPP
+#define BITS_HPP
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+
+#include <intrin.h>
+
+#endif
+
+namespace crossword_backend {
+  /**
+   * @brief Number of set bits in a 32-bit value.
+   *
+   * @param value
+   * @return int
+   */
+  inline int PopCount(const std::uint32_t value) {
+#if defined(_MSC_VER)
+    return static_cast<int>(__popcnt(value));
+#else
+    return __builtin_popcount(value);
+#endif
+  }
+
+  /**
+   * @brief Number of set bits in a 64-bit value.
+   *
+   * @param value
+   * @return int
+   */
+  inline int PopCount64(const std::uint64_t value) {
+#if defined(_MSC_VER)
+    return static_cast<int>(__popcnt64(value));
+#else
+    return __builtin_popcountll(value);
+#endif
+  }
+
+  /**
+   * @brief Index of the lowest set bit of a non-zero 64-bit value.
+   *
+   * @param value must be non-zero
+   * @return int
+   */
+  inline int CountTrailingZeros64(const std::uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(value);
+#endif
+  }
+
+  /**
+   * @brief Index of the highest set bit of a non-zero 64-bit value.
+   *
+   * @param value must be non-zero
+   * @return int
+   */
+  inline int HighestSetBit64(const std::uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+  }
+}
+
+#endif
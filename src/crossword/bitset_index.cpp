@@ -0,0 +1,232 @@
+/**
+ * @file bitset_index.cpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Bitset-per-position wildcard index implementation
+ * @version 0.1
+ * @date 2022-04-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "crossword/database.hpp"
+
+#include <algorithm>
+#include <functional>
+
+using namespace crossword_backend;
+
+/**
+ * @brief Build the bitsets from a list of entries, which must all be of length word_length and ranked.
+ *
+ * @param entries
+ * @param word_length
+ */
+void WordBitsetIndex::Build(FrozenArray<DatabaseEntry> const &entries, const std::size_t word_length) {
+  word_length_ = word_length;
+
+  std::vector<int> sorted_scores(entries.size());
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    sorted_scores[i] = entries[i].frequency_score;
+  }
+  assert(std::is_sorted(sorted_scores.begin(), sorted_scores.end(), std::greater<int>()));
+
+  limb_count_ = (entries.size() + 63) / 64;
+  std::vector<std::uint64_t> bits(word_length * kATOM_COUNT * limb_count_, 0);
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    Word const &word = entries[i].entry;
+    for (std::size_t position = 0; position < word_length; ++position) {
+      std::uint64_t *row = bits.data() + (position * kATOM_COUNT + word[position].GetCode()) * limb_count_;
+      row[i / 64] |= std::uint64_t{1} << (i % 64);
+    }
+  }
+  bits_.Assign(std::move(bits));
+  sorted_scores_.Assign(std::move(sorted_scores));
+}
+
+/**
+ * @brief Write the compiled bitsets.
+ *
+ * @param writer
+ */
+void WordBitsetIndex::Save(BlobWriter &writer) const {
+  writer.WriteArray(bits_);
+  writer.WriteArray(sorted_scores_);
+}
+
+/**
+ * @brief View bitsets written by Save.
+ *
+ * Marks the reader failed if the arrays do not have consistent sizes.
+ *
+ * @param reader
+ * @param word_length
+ */
+void WordBitsetIndex::Load(BlobReader &reader, const std::size_t word_length) {
+  word_length_ = word_length;
+  reader.ReadArray(bits_);
+  reader.ReadArray(sorted_scores_);
+  limb_count_ = (sorted_scores_.size() + 63) / 64;
+  if (bits_.size() != word_length * kATOM_COUNT * limb_count_)
+    reader.Fail();
+}
+
+/**
+ * @brief Number of indexed words with a frequency score of at least score_min.
+ *
+ * @param score_min
+ * @return std::size_t
+ */
+std::size_t WordBitsetIndex::PrefixSize(const int score_min) const {
+  auto cut = std::partition_point(sorted_scores_.begin(), sorted_scores_.end(),
+                                  [score_min](int score) { return score >= score_min; });
+  return static_cast<std::size_t>(cut - sorted_scores_.begin());
+}
+
+/**
+ * @brief Gather the rows for every filled position of a partial word.
+ *
+ * @param partial
+ * @param rows output
+ * @return std::size_t number of rows gathered
+ */
+std::size_t
+WordBitsetIndex::CollectRows(Word const &partial, std::array<std::uint64_t const *, kMAX_DIM> &rows) const {
+  assert(partial.size() == word_length_);
+  std::size_t row_count = 0;
+  for (std::size_t position = 0; position < word_length_; ++position) {
+    const Atom atom = partial[position];
+    if (!atom.IsEmpty())
+      rows[row_count++] = Row(position, atom.GetCode());
+  }
+  return row_count;
+}
+
+/**
+ * @brief True iff some word with frequency score at least score_min fits the partial word.
+ *
+ * Exits on the first non-zero limb.
+ *
+ * @param partial
+ * @param score_min
+ * @return true
+ * @return false
+ */
+bool WordBitsetIndex::Contains(Word const &partial, const int score_min) const {
+  const std::size_t prefix = PrefixSize(score_min);
+  if (prefix == 0)
+    return false;
+
+  std::array<std::uint64_t const *, kMAX_DIM> rows{};
+  const std::size_t row_count = CollectRows(partial, rows);
+  if (row_count == 0)
+    return true;
+
+  const std::size_t full_limbs = prefix / 64;
+  for (std::size_t limb = 0; limb < full_limbs; ++limb) {
+    std::uint64_t acc = rows[0][limb];
+    for (std::size_t k = 1; k < row_count && acc != 0; ++k)
+      acc &= rows[k][limb];
+    if (acc != 0)
+      return true;
+  }
+
+  if (prefix % 64 != 0) {
+    std::uint64_t acc = (std::uint64_t{1} << (prefix % 64)) - 1;
+    for (std::size_t k = 0; k < row_count; ++k)
+      acc &= rows[k][full_limbs];
+    return acc != 0;
+  }
+  return false;
+}
+
+/**
+ * @brief Collect the entry indices of all words with frequency score at least score_min fitting the partial word.
+ *
+ * Results are in entry order, i.e. best ranked first.
+ *
+ * @param partial
+ * @param score_min
+ * @param result entry indices are appended here
+ */
+void WordBitsetIndex::Find(Word const &partial, const int score_min, std::vector<std::uint32_t> &result) const {
+  const std::size_t prefix = PrefixSize(score_min);
+  std::array<std::uint64_t const *, kMAX_DIM> rows{};
+  const std::size_t row_count = CollectRows(partial, rows);
+
+  const std::size_t limbs = (prefix + 63) / 64;
+  for (std::size_t limb = 0; limb < limbs; ++limb) {
+    std::uint64_t acc = ~std::uint64_t{0};
+    if (limb == limbs - 1 && prefix % 64 != 0)
+      acc = (std::uint64_t{1} << (prefix % 64)) - 1;
+    for (std::size_t k = 0; k < row_count && acc != 0; ++k)
+      acc &= rows[k][limb];
+    while (acc != 0) {
+      result.push_back(static_cast<std::uint32_t>(limb * 64 + CountTrailingZeros64(acc)));
+      acc &= acc - 1;
+    }
+  }
+}
+
+/**
+ * @brief Number of words with frequency score at least score_min fitting the partial word.
+ *
+ * @param partial
+ * @param score_min
+ * @return std::size_t
+ */
+std::size_t WordBitsetIndex::Count(Word const &partial, const int score_min) const {
+  const std::size_t prefix = PrefixSize(score_min);
+  std::array<std::uint64_t const *, kMAX_DIM> rows{};
+  const std::size_t row_count = CollectRows(partial, rows);
+  if (row_count == 0)
+    return prefix;
+
+  std::size_t count = 0;
+  const std::size_t limbs = (prefix + 63) / 64;
+  for (std::size_t limb = 0; limb < limbs; ++limb) {
+    std::uint64_t acc = ~std::uint64_t{0};
+    if (limb == limbs - 1 && prefix % 64 != 0)
+      acc = (std::uint64_t{1} << (prefix % 64)) - 1;
+    for (std::size_t k = 0; k < row_count && acc != 0; ++k)
+      acc &= rows[k][limb];
+    count += static_cast<std::size_t>(PopCount64(acc));
+  }
+  return count;
+}
+
+/**
+ * @brief Start a scan over the words fitting partial with frequency score at least score_min.
+ *
+ * @param index
+ * @param partial
+ * @param score_min
+ */
+WordBitsetIndex::Cursor::Cursor(WordBitsetIndex const &index, Word const &partial, const int score_min)
+        : index_(&index), rows_{}, row_count_(0), prefix_(index.PrefixSize(score_min)), limb_(0), acc_(0) {
+  row_count_ = index.CollectRows(partial, rows_);
+}
+
+/**
+ * @brief Advance to the next fitting entry.
+ *
+ * @param index output
+ * @return true
+ * @return false there are no more
+ */
+bool WordBitsetIndex::Cursor::Next(std::uint32_t &index) {
+  const std::size_t limbs = (prefix_ + 63) / 64;
+  while (acc_ == 0) {
+    if (limb_ >= limbs)
+      return false;
+    acc_ = ~std::uint64_t{0};
+    if (limb_ == limbs - 1 && prefix_ % 64 != 0)
+      acc_ = (std::uint64_t{1} << (prefix_ % 64)) - 1;
+    for (std::size_t k = 0; k < row_count_ && acc_ != 0; ++k)
+      acc_ &= rows_[k][limb_];
+    limb_++;
+  }
+  index = static_cast<std::uint32_t>((limb_ - 1) * 64 + CountTrailingZeros64(acc_));
+  acc_ &= acc_ - 1;
+  return true;
+}
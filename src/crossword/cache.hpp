@@ -0,0 +1,535 @@
+/**
+ * @file cache.hpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Fixed-capacity LRU caches used for dictionary query results.
+ * @version 0.1
+ * @date 2022-04-21
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <algorithm>
+
+namespace crossword_backend {
+  /**
+   * @brief Hit and miss counters of a cache.
+   *
+   */
+  struct CacheStatistics {
+    /**
+     * @brief Lookups that found a value.
+     *
+     */
+    std::uint64_t hits;
+
+    /**
+     * @brief Lookups that found nothing.
+     *
+     */
+    std::uint64_t misses;
+
+    /**
+     * @brief Entries dropped to make room for new ones.
+     *
+     */
+    std::uint64_t evictions;
+
+    /**
+     * @brief Fraction of lookups that hit, in [0, 1].
+     *
+     * @return double
+     */
+    [[nodiscard]] double HitRate() const {
+      std::uint64_t total = hits + misses;
+      return total == 0 ? 0. : static_cast<double>(hits) / static_cast<double>(total);
+    }
+
+    CacheStatistics &operator+=(CacheStatistics const &other) {
+      hits += other.hits;
+      misses += other.misses;
+      evictions += other.evictions;
+      return *this;
+    }
+
+    CacheStatistics() : hits(0), misses(0), evictions(0) {};
+  };
+
+  /**
+   * @brief Least-recently-used cache with a fixed number of slots.
+   *
+   * Slots live in one array and are chained into a recency list by index. Keys are found through an
+   * open-addressed table of slot indices (linear probing, backward-shift deletion), so lookups never
+   * allocate, and once the cache is full an insertion reuses the storage of the evicted slot.
+   *
+   * Not thread-safe.
+   *
+   * @tparam Key
+   * @tparam Value
+   * @tparam Hash
+   */
+  template<typename Key, typename Value, typename Hash>
+  class LruCache {
+  public:
+    /**
+     * @brief Look up a key, marking it as most recently used.
+     *
+     * @param key
+     * @return Value const* pointer to the cached value, or nullptr. Invalidated by the next Insert.
+     */
+    Value const *Find(Key const &key) {
+      std::size_t bucket = FindBucket(key, Hash()(key));
+      if (table_[bucket] == kEMPTY) {
+        statistics_.misses++;
+        return nullptr;
+      }
+      statistics_.hits++;
+      std::uint32_t slot = table_[bucket];
+      Unlink(slot);
+      PushFront(slot);
+      return &slots_[slot].value;
+    }
+
+    /**
+     * @brief Insert or overwrite a value, evicting the least recently used entry if full.
+     *
+     * @param key
+     * @param value
+     */
+    void Insert(Key const &key, Value const &value) {
+      if (capacity_ == 0)
+        return;
+      const std::size_t hash = Hash()(key);
+      std::size_t bucket = FindBucket(key, hash);
+      std::uint32_t slot;
+      if (table_[bucket] != kEMPTY) {
+        slot = table_[bucket];
+        Unlink(slot);
+      } else {
+        if (size_ == capacity_) {
+          slot = tail_;
+          Unlink(slot);
+          EraseBucket(FindBucket(slots_[slot].key, slots_[slot].hash));
+          statistics_.evictions++;
+          bucket = FindBucket(key, hash);
+        } else {
+          // Slots [0, size_) are in use; storage past that is left over from before a Clear.
+          slot = static_cast<std::uint32_t>(size_++);
+          if (slot == slots_.size())
+            slots_.push_back(Slot());
+        }
+        table_[bucket] = slot;
+        slots_[slot].key = key;
+        slots_[slot].hash = hash;
+      }
+      slots_[slot].value = value;
+      PushFront(slot);
+    }
+
+    /**
+     * @brief Drop the entries for which predicate(key, value) is true. Not counted as evictions.
+     *
+     * @tparam Predicate
+     * @param predicate
+     * @return std::size_t number of entries dropped
+     */
+    template<typename Predicate>
+    std::size_t EraseIf(Predicate predicate) {
+      std::size_t erased = 0;
+      for (std::uint32_t slot = 0; slot < size_;) {
+        if (!predicate(slots_[slot].key, slots_[slot].value)) {
+          slot++;
+          continue;
+        }
+        Unlink(slot);
+        EraseBucket(FindBucket(slots_[slot].key, slots_[slot].hash));
+        // Keep slots [0, size_) in use by moving the last one into the hole; the moved slot is checked next.
+        const std::uint32_t last = static_cast<std::uint32_t>(--size_);
+        if (slot != last) {
+          Slot &moved = slots_[slot];
+          moved = slots_[last];
+          if (moved.prev != kEMPTY) slots_[moved.prev].next = slot;
+          else head_ = slot;
+          if (moved.next != kEMPTY) slots_[moved.next].prev = slot;
+          else tail_ = slot;
+          table_[FindBucket(moved.key, moved.hash)] = slot;
+        }
+        erased++;
+      }
+      return erased;
+    }
+
+    /**
+     * @brief Drop every entry. Keeps allocated storage and statistics.
+     *
+     */
+    void Clear() {
+      std::fill(table_.begin(), table_.end(), kEMPTY);
+      size_ = 0;
+      head_ = kEMPTY;
+      tail_ = kEMPTY;
+    }
+
+    /**
+     * @brief Change the number of entries held. Clears the cache.
+     *
+     * @param capacity
+     */
+    void SetCapacity(const std::size_t capacity) {
+      capacity_ = capacity;
+      slots_.clear();
+      slots_.reserve(capacity);
+      std::size_t buckets = 1;
+      while (buckets < 2 * capacity)
+        buckets <<= 1;
+      table_.assign(buckets, kEMPTY);
+      size_ = 0;
+      head_ = kEMPTY;
+      tail_ = kEMPTY;
+    }
+
+    /**
+     * @brief Number of entries currently held.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t size() const { return size_; }
+
+    /**
+     * @brief Hit, miss and eviction counts since construction or the last ResetStatistics.
+     *
+     * @return CacheStatistics const&
+     */
+    [[nodiscard]] CacheStatistics const &GetStatistics() const { return statistics_; }
+
+    /**
+     * @brief Zero the hit, miss and eviction counters.
+     *
+     */
+    void ResetStatistics() { statistics_ = CacheStatistics(); }
+
+    explicit LruCache(const std::size_t capacity) : capacity_(0), size_(0), head_(kEMPTY), tail_(kEMPTY) {
+      SetCapacity(capacity);
+    }
+
+  private:
+    /**
+     * @brief Marks an unused bucket or the end of the recency list.
+     *
+     */
+    static constexpr std::uint32_t kEMPTY = 0xFFFFFFFF;
+
+    /**
+     * @brief Storage for one entry.
+     *
+     */
+    struct Slot {
+      Key key;
+      Value value;
+      std::size_t hash;
+      std::uint32_t prev;
+      std::uint32_t next;
+
+      Slot() : key(), value(), hash(0), prev(kEMPTY), next(kEMPTY) {};
+    };
+
+    /**
+     * @brief Bucket holding key, or the empty bucket where it would be inserted.
+     *
+     * @param key
+     * @param hash
+     * @return std::size_t
+     */
+    std::size_t FindBucket(Key const &key, const std::size_t hash) const {
+      const std::size_t mask = table_.size() - 1;
+      std::size_t bucket = hash & mask;
+      while (table_[bucket] != kEMPTY) {
+        Slot const &slot = slots_[table_[bucket]];
+        if (slot.hash == hash && slot.key == key)
+          return bucket;
+        bucket = (bucket + 1) & mask;
+      }
+      return bucket;
+    }
+
+    /**
+     * @brief Remove a bucket, shifting back later members of its probe run.
+     *
+     * @param bucket
+     */
+    void EraseBucket(std::size_t bucket) {
+      const std::size_t mask = table_.size() - 1;
+      std::size_t next = (bucket + 1) & mask;
+      while (table_[next] != kEMPTY) {
+        std::size_t home = slots_[table_[next]].hash & mask;
+        // Move the entry back iff its home is not cyclically within (bucket, next].
+        if (((next - home) & mask) >= ((next - bucket) & mask)) {
+          table_[bucket] = table_[next];
+          bucket = next;
+        }
+        next = (next + 1) & mask;
+      }
+      table_[bucket] = kEMPTY;
+    }
+
+    /**
+     * @brief Remove a slot from the recency list.
+     *
+     * @param slot
+     */
+    void Unlink(const std::uint32_t slot) {
+      Slot &s = slots_[slot];
+      if (s.prev != kEMPTY) slots_[s.prev].next = s.next;
+      else head_ = s.next;
+      if (s.next != kEMPTY) slots_[s.next].prev = s.prev;
+      else tail_ = s.prev;
+      s.prev = kEMPTY;
+      s.next = kEMPTY;
+    }
+
+    /**
+     * @brief Make a slot the most recently used.
+     *
+     * @param slot
+     */
+    void PushFront(const std::uint32_t slot) {
+      Slot &s = slots_[slot];
+      s.prev = kEMPTY;
+      s.next = head_;
+      if (head_ != kEMPTY) slots_[head_].prev = slot;
+      head_ = slot;
+      if (tail_ == kEMPTY) tail_ = slot;
+    }
+
+    /**
+     * @brief Entry storage; only the first size_ slots are live.
+     *
+     */
+    std::vector<Slot> slots_;
+
+    /**
+     * @brief Open-addressed index from key hash to slot.
+     *
+     */
+    std::vector<std::uint32_t> table_;
+
+    /**
+     * @brief Maximum number of entries.
+     *
+     */
+    std::size_t capacity_;
+
+    /**
+     * @brief Current number of entries.
+     *
+     */
+    std::size_t size_;
+
+    /**
+     * @brief Most recently used slot.
+     *
+     */
+    std::uint32_t head_;
+
+    /**
+     * @brief Least recently used slot; evicted first.
+     *
+     */
+    std::uint32_t tail_;
+
+    /**
+     * @brief Running counters.
+     *
+     */
+    CacheStatistics statistics_;
+  };
+
+  /**
+   * @brief Number of independently locked shards in a ConcurrentLruCache.
+   *
+   */
+  constexpr std::size_t kCACHE_SHARDS = 16;
+
+  /**
+   * @brief Thread-safe LRU cache, split into kCACHE_SHARDS LruCaches each behind its own mutex.
+   *
+   * Keys are spread over the shards by hash, so threads querying different keys rarely wait on each other.
+   * Each shard evicts on its own, holding an equal share of the capacity.
+   *
+   * @tparam Key
+   * @tparam Value
+   * @tparam Hash
+   */
+  template<typename Key, typename Value, typename Hash>
+  class ConcurrentLruCache {
+  public:
+    /**
+     * @brief Look up a key, marking it as most recently used.
+     *
+     * @param key
+     * @param value receives a copy of the cached value, if any
+     * @return true the key was cached
+     * @return false
+     */
+    bool Find(Key const &key, Value &value) {
+      Shard &shard = ShardOf(key);
+      std::lock_guard<std::mutex> guard(shard.lock);
+      Value const *cached = shard.cache.Find(key);
+      if (cached == nullptr)
+        return false;
+      value = *cached;
+      return true;
+    }
+
+    /**
+     * @brief Insert or overwrite a value, evicting the least recently used entry of its shard if full.
+     *
+     * @param key
+     * @param value
+     */
+    void Insert(Key const &key, Value const &value) {
+      Shard &shard = ShardOf(key);
+      std::lock_guard<std::mutex> guard(shard.lock);
+      shard.cache.Insert(key, value);
+    }
+
+    /**
+     * @brief Insert or overwrite a value only if condition() is true, checked while holding its shard.
+     *
+     * An EraseIf running concurrently either drops the value or finishes its shard before condition() is checked.
+     *
+     * @tparam Condition
+     * @param key
+     * @param value
+     * @param condition
+     */
+    template<typename Condition>
+    void InsertIf(Key const &key, Value const &value, Condition condition) {
+      Shard &shard = ShardOf(key);
+      std::lock_guard<std::mutex> guard(shard.lock);
+      if (condition())
+        shard.cache.Insert(key, value);
+    }
+
+    /**
+     * @brief Drop the entries for which predicate(key, value) is true, one shard at a time.
+     *
+     * @tparam Predicate
+     * @param predicate
+     * @return std::size_t number of entries dropped
+     */
+    template<typename Predicate>
+    std::size_t EraseIf(Predicate predicate) {
+      std::size_t erased = 0;
+      for (auto &shard: shards_) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        erased += shard.cache.EraseIf(predicate);
+      }
+      return erased;
+    }
+
+    /**
+     * @brief Drop every entry. Keeps allocated storage and statistics.
+     *
+     */
+    void Clear() {
+      for (auto &shard: shards_) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.cache.Clear();
+      }
+    }
+
+    /**
+     * @brief Change the total number of entries held. Clears the cache.
+     *
+     * @param capacity
+     */
+    void SetCapacity(const std::size_t capacity) {
+      for (auto &shard: shards_) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.cache.SetCapacity((capacity + kCACHE_SHARDS - 1) / kCACHE_SHARDS);
+      }
+    }
+
+    /**
+     * @brief Number of entries currently held.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t size() const {
+      std::size_t total = 0;
+      for (auto const &shard: shards_) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        total += shard.cache.size();
+      }
+      return total;
+    }
+
+    /**
+     * @brief Hit, miss and eviction counts summed over the shards.
+     *
+     * @return CacheStatistics
+     */
+    [[nodiscard]] CacheStatistics GetStatistics() const {
+      CacheStatistics total;
+      for (auto const &shard: shards_) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        total += shard.cache.GetStatistics();
+      }
+      return total;
+    }
+
+    /**
+     * @brief Zero the hit, miss and eviction counters.
+     *
+     */
+    void ResetStatistics() {
+      for (auto &shard: shards_) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.cache.ResetStatistics();
+      }
+    }
+
+    explicit ConcurrentLruCache(const std::size_t capacity) { SetCapacity(capacity); }
+
+  private:
+    /**
+     * @brief One independently locked part of the cache.
+     *
+     */
+    struct Shard {
+      mutable std::mutex lock;
+      LruCache<Key, Value, Hash> cache;
+
+      Shard() : cache(0) {};
+    };
+
+    /**
+     * @brief Shard responsible for a key. Uses the top bits of the mixed hash, which the shard's own
+     * table (indexed by the low bits) does not depend on.
+     *
+     * @param key
+     * @return Shard&
+     */
+    Shard &ShardOf(Key const &key) {
+      const std::uint64_t mixed = static_cast<std::uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ull;
+      return shards_[static_cast<std::size_t>(mixed >> 60) % kCACHE_SHARDS];
+    }
+
+    /**
+     * @brief The shards.
+     *
+     */
+    std::array<Shard, kCACHE_SHARDS> shards_;
+  };
+}
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * @file cancellation.hpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Cancellation tokens and deadlines for long-running work.
+ * @version 0.1
+ * @date 2022-04-23
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef CANCELLATION_HPP
+#define CANCELLATION_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace crossword_backend {
+  /**
+   * @brief Number of IsReached calls between clock reads in a SearchLimit.
+   *
+   */
+  constexpr std::uint32_t kDEADLINE_CHECK_INTERVAL = 256;
+
+  /**
+   * @brief One-shot signal that work should stop, which can be polled cheaply or waited on.
+   *
+   * Thread-safe.
+   *
+   */
+  class CancellationToken {
+  public:
+    /**
+     * @brief Signal cancellation, waking every waiter.
+     *
+     */
+    void Cancel() {
+      std::lock_guard<std::mutex> guard(lock_);
+      cancelled_ = true;
+      changed_.notify_all();
+    }
+
+    /**
+     * @brief Clear the signal, so that the token can be used again.
+     *
+     */
+    void Reset() {
+      std::lock_guard<std::mutex> guard(lock_);
+      cancelled_ = false;
+    }
+
+    /**
+     * @brief True iff cancelled. A single atomic load.
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsCancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Block until cancelled or until a time point passes, whichever is first.
+     *
+     * @param deadline
+     * @return true cancelled
+     * @return false the deadline passed
+     */
+    bool WaitUntil(const std::chrono::steady_clock::time_point deadline) {
+      std::unique_lock<std::mutex> guard(lock_);
+      return changed_.wait_until(guard, deadline, [this] { return cancelled_.load(); });
+    }
+
+    /**
+     * @brief Block until cancelled or for a duration, whichever is shorter.
+     *
+     * @param duration
+     * @return true cancelled
+     * @return false the duration passed
+     */
+    bool WaitFor(const std::chrono::steady_clock::duration duration) {
+      return WaitUntil(std::chrono::steady_clock::now() + duration);
+    }
+
+    CancellationToken() : cancelled_(false) {};
+
+  private:
+    /**
+     * @brief The signal. Only written under lock_, so that waiters cannot miss it.
+     *
+     */
+    std::atomic<bool> cancelled_;
+
+    /**
+     * @brief Guards writes to cancelled_ against waiters.
+     *
+     */
+    std::mutex lock_;
+
+    /**
+     * @brief Notified on cancellation.
+     *
+     */
+    std::condition_variable changed_;
+  };
+
+  /**
+   * @brief A cancellation token together with a deadline, for polling from a hot loop.
+   *
+   * The token is checked on every call, and the clock only every kDEADLINE_CHECK_INTERVAL calls.
+   * Not thread-safe; give each thread its own copy.
+   *
+   */
+  class SearchLimit {
+  public:
+    /**
+     * @brief True iff the work should stop: cancelled, or (checked at a cadence) past the deadline.
+     *
+     * @return true
+     * @return false
+     */
+    bool IsReached() {
+      if (token_ != nullptr && token_->IsCancelled())
+        return true;
+      if (--countdown_ != 0)
+        return expired_;
+      countdown_ = kDEADLINE_CHECK_INTERVAL;
+      expired_ = std::chrono::steady_clock::now() >= deadline_;
+      return expired_;
+    }
+
+    /**
+     * @brief True iff the token was cancelled, as opposed to the deadline passing.
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsCancelled() const { return token_ != nullptr && token_->IsCancelled(); }
+
+    /**
+     * @brief The deadline.
+     *
+     * @return std::chrono::steady_clock::time_point
+     */
+    [[nodiscard]] std::chrono::steady_clock::time_point GetDeadline() const { return deadline_; }
+
+    /**
+     * @brief Construct a limit. The first IsReached call reads the clock.
+     *
+     * @param token may be nullptr
+     * @param deadline
+     */
+    SearchLimit(CancellationToken const *token, const std::chrono::steady_clock::time_point deadline)
+            : token_(token), deadline_(deadline), countdown_(1), expired_(false) {};
+
+  private:
+    /**
+     * @brief External cancellation, if any.
+     *
+     */
+    CancellationToken const *token_;
+
+    /**
+     * @brief Time after which the work should stop.
+     *
+     */
+    std::chrono::steady_clock::time_point deadline_;
+
+    /**
+     * @brief Calls left until the next clock read.
+     *
+     */
+    std::uint32_t countdown_;
+
+    /**
+     * @brief Result of the last clock read.
+     *
+     */
+    bool expired_;
+  };
+}
+
+#endif
@@ -11,8 +11,6 @@
 
 #include "crossword/crossword.hpp"
 
-#include <map>
-
 using namespace crossword_backend;
 
 /**
@@ -37,109 +35,49 @@ bool Clue::SameCoords(Clue const &other) const {
 }
 
 /**
- * @brief Produce a list of clue objects for the current puzzle.
+ * @brief Slots of size at least 3 in one row (across) or column (down), in order, with their lock state.
  *
- * Runtime: O(mn), where (m x n) is the dimension of the puzzle.
- * In other words, linear in the number of cells.
+ * Numbers are left unset. Runtime: linear in the length of the line.
  *
- * @return std::vector<Clue> 
+ * @param direction
+ * @param line row if across, column if down
+ * @return std::vector<Clue>
  */
-std::vector<Clue> Crossword::Clues_() const {
-  std::vector<Clue> clue_vector;
-  std::vector<Clue> across = UnfilteredClues(kACROSS);
-  std::vector<Clue> down = UnfilteredClues(kDOWN);
-  clue_vector.reserve(across.size() + down.size());
-
-  std::map<Coord, std::vector<std::size_t>> start_table;
-
-  std::size_t index = 0;
-  for (auto it = std::begin(across); it != std::end(across); ++it) {
-    if (it->GetSize() >= 3) {
-      clue_vector.push_back(*it);
-      start_table[it->GetStart()].push_back(index++);
-    }
-  }
-  for (auto it = std::begin(down); it != std::end(down); ++it) {
-    if (it->GetSize() >= 3) {
-      clue_vector.push_back(*it);
-      start_table[it->GetStart()].push_back(index++);
-    }
-  }
-
-  for (auto it = std::begin(clue_vector); it != std::end(clue_vector); ++it) {
-    bool locked = true;
-    for (auto coord = std::begin(it->coord_list_); coord != std::end(it->coord_list_); ++coord) {
-      if (!IsLocked(*coord) || Get(*coord).GetContents().IsEmpty()) {
-        locked = false;
-      }
-    }
-    it->SetLocked(locked);
-  }
-
-  // Give each clue its number in context of puzzle
-  int cn = 1;
-  for (std::size_t i = 0; i < height_; i++) {
-    for (std::size_t j = 0; j < width_; j++) {
-      Coord c(i, j);
-      if (start_table.find(c) != start_table.end() && start_table[c].size() > 0) {
-        for (std::size_t k = 0; k < start_table[c].size(); k++) {
-          int index = start_table[c][k];
-          clue_vector[index].SetNumber(cn);
-        }
-        cn++;
-      }
-    }
-  }
-
-  return clue_vector;
-}
-
-/**
- * @brief Returns a vector of pointers to clues at a particular coordinate coord.
- * 
- * @param all_clues 
- * @param coord 
- * @return std::vector<Clue*> 
- */
-std::vector<Clue *> Crossword::CluesStartingAt_(std::vector<Clue> &all_clues, const Coord coord) const {
-  assert(InBounds(coord));
-  std::vector<Clue *> result;
-  for (auto cl = std::begin(all_clues); cl != std::end(all_clues); ++cl) {
-    for (auto it = std::begin(cl->coord_list_); it != std::end(cl->coord_list_); ++it) {
-      if (*it == coord) {
-        result.push_back(&(*cl));
+std::vector<Clue> Crossword::LineClues_(const WordDirection direction, const std::size_t line) const {
+  std::vector<Clue> clues;
+  const std::size_t length = direction == kACROSS ? width_ : height_;
+  Word constraints;
+  std::vector<Coord> coord_vector;
+  for (std::size_t k = 0; k <= length; ++k) {
+    const Coord c = direction == kACROSS ? Coord(line, k) : Coord(k, line);
+    if (k == length || Get(c).IsBarrier()) {
+      if (coord_vector.size() >= 3) {
+        clues.emplace_back(direction, coord_vector.front(), coord_vector.size(), constraints, coord_vector);
+        clues.back().SetLocked(IsClueLocked_(clues.back()));
       }
+      constraints = Word();
+      coord_vector.clear();
+    } else {
+      constraints.push_back(Get(c).GetContents());
+      coord_vector.push_back(c);
     }
   }
-  assert(result.size() <= 2);
-  return result;
+  return clues;
 }
 
 /**
- * @brief Get the clue identifier (i.e, 1 as in 1-ACROSS) starting at coordinate c.
- * 
- * If the coordinate is not the start of a clue, then return kNO_NUMBER.
- * 
- * @param all_clues 
- * @param coord 
- * @return ClueNumber 
+ * @brief True iff every cell of a clue is locked and filled.
+ *
+ * @param clue
+ * @return true
+ * @return false
  */
-ClueNumber Crossword::GetClueNumber_(std::vector<Clue> &all_clues, const Coord coord) const {
-  std::vector<Clue *> clues = CluesStartingAt_(all_clues, coord);
-  if (clues.size() == 2) {
-    if (clues[0]->GetStart() == coord) {
-      return clues[0]->GetNumber();
-    } else if (clues[1]->GetStart() == coord) {
-      return clues[1]->GetNumber();
-    } else {
-      return kNO_NUMBER;
-    }
-  } else if (clues.size() == 0) {
-    return kNO_NUMBER;
-  } else if (clues[0]->GetStart() == coord) {
-    return clues[0]->GetNumber();
+bool Crossword::IsClueLocked_(Clue const &clue) const {
+  for (auto const &coord: clue.coord_list_) {
+    if (!IsLocked(coord) || Get(coord).GetContents().IsEmpty())
+      return false;
   }
-  return kNO_NUMBER;
+  return true;
 }
 
 /**
@@ -159,14 +97,7 @@ bool Clue::IsLocked() const {
  * @return false 
  */
 bool Clue::IsFilled() const {
-  if (size_ == 0)
-    return false;
-  for (auto const &value: constraints_.atoms_) {
-    if (value.IsEmpty()) {
-      return false;
-    }
-  }
-  return true;
+  return size_ != 0 && constraints_.CountEmpty() == 0;
 }
 
 /**
@@ -178,14 +109,7 @@ bool Clue::IsFilled() const {
  */
 bool Clue::FitsWord(Word const &word) const {
   assert(size_ == constraints_.size());
-
-  for (std::size_t i = 0; i < size_; i++) {
-    const Atom &current_atom = constraints_[i];
-    if (!current_atom.IsEmpty() && current_atom != word[i]) {
-      return false;
-    }
-  }
-  return true;
+  return word.Matches(constraints_);
 }
 
 /**
@@ -205,8 +129,8 @@ bool Clue::FitsWord(Word const &word) const {
   }
 
   s << ", constraints=|";
-  for (auto it = std::begin(constraints_.atoms_); it != std::end(constraints_.atoms_); ++it) {
-    std::string val = it->ToString();
+  for (std::size_t i = 0; i < constraints_.size(); ++i) {
+    std::string val = constraints_[i].ToString();
     if (val == "")
       s << " ";
     s << val << "|";
@@ -275,12 +199,7 @@ int Clue::IndexOfCoord(const Coord coord) const {
  * @return std::size_t 
  */
 std::size_t Clue::GetOpenSpots() const {
-  std::size_t val = 0;
-  for (std::size_t i = 0; i < size_; i++) {
-    if (constraints_[i].IsEmpty())
-      val++;
-  }
-  return val;
+  return constraints_.CountEmpty();
 }
 
 /**
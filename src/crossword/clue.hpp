@@ -116,7 +116,7 @@ namespace crossword_backend {
      *
      * @param index
      */
-    void SetConstraint(const std::size_t index, const Atom new_value) { constraints_.atoms_[index] = new_value; }
+    void SetConstraint(const std::size_t index, const Atom new_value) { constraints_.Set(index, new_value); }
 
     /**
      * @brief Construct a new Clue object from parameters.
@@ -127,7 +127,7 @@ namespace crossword_backend {
      * @param constraints
      * @param coords
      */
-    Clue(WordDirection direction, Coord start, std::size_t size, std::vector<Atom> constraints,
+    Clue(WordDirection direction, Coord start, std::size_t size, Word const &constraints,
          std::vector<Coord> coords)
             : direction_(direction), start_(start), size_(size),
               coord_list_(std::move(coords)), clue_number_(kNO_NUMBER),
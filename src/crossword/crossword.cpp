@@ -11,24 +11,66 @@
 
 #include "crossword/crossword.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace crossword_backend;
 
+/**
+ * @brief Zobrist key of a letter at a cell, derived with Mix64 rather than stored in a table.
+ *
+ * Keys depend on the cell's coordinate, not its index, so they survive resizes. Empty cells key to 0.
+ *
+ * @param coord
+ * @param atom
+ * @return std::uint64_t
+ */
+static std::uint64_t ZobristKey(const Coord coord, const Atom atom) {
+  if (atom.IsEmpty())
+    return 0;
+  return Mix64(((coord.row * kMAX_DIM + coord.col) * kATOM_COUNT + atom.GetCode()) * 0x9E3779B97F4A7C15ull);
+}
+
 /**
  * @brief Returns true iff the pattern of barriers is a valid crossword puzzle.
  *
  */
 bool Crossword::IsValidPattern() const {
-  std::vector<Clue> across = UnfilteredClues(kACROSS);
-  std::vector<Clue> down = UnfilteredClues(kDOWN);
-  for (auto it = std::begin(across); it != std::end(across); ++it) {
-    if (it->GetSize() == 2)
-      return false;
+  return GetPattern().CountRunsOfLength(2) == 0;
+}
+
+/**
+ * @brief The grid's barriers as a bitboard.
+ *
+ * @return PatternBoard
+ */
+PatternBoard Crossword::GetPattern() const {
+  PatternBoard pattern(height_, width_);
+  for (std::size_t r = 0; r < height_; ++r) {
+    for (std::size_t c = 0; c < width_; ++c) {
+      if (CellAt_(Coord(r, c)).IsBarrier())
+        pattern.SetBarrier(Coord(r, c), true);
+    }
   }
-  for (auto it = std::begin(down); it != std::end(down); ++it) {
-    if (it->GetSize() == 2)
-      return false;
+  return pattern;
+}
+
+/**
+ * @brief Resize the grid to a pattern and set every cell's barrier from it, rebuilding the clue structure
+ * once. Letters stay under the barriers, as with SetBarrier.
+ *
+ * @param pattern at least 3 by 3
+ */
+void Crossword::SetPattern(PatternBoard const &pattern) {
+  BeginBatchEdit();
+  if (pattern.GetHeight() != height_ || pattern.GetWidth() != width_)
+    SetDimensions(pattern.GetHeight(), pattern.GetWidth());
+  for (std::size_t r = 0; r < height_; ++r) {
+    for (std::size_t c = 0; c < width_; ++c)
+      SetCellBarrier_(Coord(r, c), pattern.IsBarrier(Coord(r, c)));
   }
-  return true;
+  DirtyClueStructure();
+  EndBatchEdit();
 }
 
 /**
@@ -161,7 +203,7 @@ void Crossword::SetHint(const Coord coord, const WordDirection direction, std::s
 Cell Crossword::Get(const Coord coord) const {
   assert(InBounds(coord));
 
-  return grid_[coord.row][coord.col];
+  return CellAt_(coord);
 }
 
 /**
@@ -178,7 +220,7 @@ Cell Crossword::Get(const std::size_t row, const std::size_t col) const {
 /**
  * @brief Set the value of cell at coordinate c.
  *
- * Indirectly creates a new CrosswordSetAction object and pushes it to the stack.
+ * Recorded as one edit in the undo history.
  *
  * @param val new cell value
  * @param coord coordinate to set
@@ -187,7 +229,9 @@ void Crossword::Set(const Atom val, const Coord coord) {
   assert(InBounds(coord));
   assert(!Get(coord).IsBarrier());
 
-  ApplyAction(new CrosswordSetAction(val, Get(coord).GetContents(), coord));
+  history_.BeginEdit();
+  SetRecorded_(val, coord);
+  history_.EndEdit();
 }
 
 /**
@@ -200,23 +244,44 @@ void Crossword::Set_(const Atom val, const Coord coord) {
   assert(InBounds(coord));
   assert(!Get(coord).IsBarrier());
 
-  grid_[coord.row][coord.col].SetContents(val);
-  for (auto const &clue_pointer: clue_cache_.cell_mapping[coord.row][coord.col]) {
-    std::size_t index = clue_pointer->IndexOfCoord(coord); // indexOfCoord is linear... TODO make it constant
-    clue_pointer->SetConstraint(index, val);
+  Cell &cell = CellAt_(coord);
+  fill_hash_ ^= ZobristKey(coord, cell.GetContents()) ^ ZobristKey(coord, val);
+  cell.SetContents(val);
+  BumpGridVersion_();
+  for (WordDirection direction: {kACROSS, kDOWN}) {
+    const std::uint16_t slot = clue_cache_.slot_ids[direction][coord.row][coord.col];
+    if (slot == kNO_SLOT)
+      continue;
+    clue_cache_.clues[slot].SetConstraint(clue_cache_.slot_offsets[direction][coord.row][coord.col], val);
+    if (search_state_ != nullptr)
+      search_state_->Touch(slot);
   }
 }
 
 /**
- * @brief Apply an action and push it to the stack.
- *
- * Takes unique ownership of action. As such, best practice is directly call `new` in invocation.
+ * @brief Set the value of a cell, recording the change in the open edit of the undo history.
  *
- * @param action pointer to an action
+ * @param val
+ * @param coord
  */
-void Crossword::ApplyAction(CrosswordAction *action) {
-  action->Apply(*this);
-  action_stack_.Push(action);
+void Crossword::SetRecorded_(const Atom val, const Coord coord) {
+  history_.Record(coord, CellAt_(coord).GetContents(), val);
+  Set_(val, coord);
+}
+
+/**
+ * @brief Write a word into the empty cells of a clue, in the open edit of the undo history.
+ *
+ * @param clue
+ * @param word
+ */
+void Crossword::FillClue_(Clue const &clue, Word const &word) {
+  assert(clue.GetSize() == word.size());
+  for (std::size_t i = 0; i < word.size(); ++i) {
+    assert(CellAt_(clue.coord_list_[i]).GetContents() == clue.GetConstraint(i));
+    if (clue.GetConstraint(i).IsEmpty())
+      SetRecorded_(word[i], clue.coord_list_[i]);
+  }
 }
 
 /**
@@ -226,7 +291,7 @@ void Crossword::ApplyAction(CrosswordAction *action) {
  * @return false action was not undone
  */
 bool Crossword::Undo() {
-  return action_stack_.Pop(*this);
+  return history_.Undo(*this);
 }
 
 /**
@@ -236,7 +301,16 @@ bool Crossword::Undo() {
  * @return false action was not redone
  */
 bool Crossword::Redo() {
-  return action_stack_.Replace(*this);
+  return history_.Redo(*this);
+}
+
+/**
+ * @brief Set how many cell changes the undo history keeps before dropping its oldest edits.
+ *
+ * @param changes
+ */
+void Crossword::SetHistoryLimit(const std::size_t changes) {
+  history_.SetLimit(changes);
 }
 
 /**
@@ -246,7 +320,7 @@ bool Crossword::Redo() {
  * @param enforce_symmetry true iff we want to enforce rotational symmetry.
  */
 void Crossword::ToggleBarrier(const Coord coord, const bool enforce_symmetry) {
-  SetBarrier(!grid_[coord.row][coord.col].IsBarrier(), coord, enforce_symmetry);
+  SetBarrier(!CellAt_(coord).IsBarrier(), coord, enforce_symmetry);
 }
 
 /**
@@ -257,19 +331,58 @@ void Crossword::ToggleBarrier(const Coord coord, const bool enforce_symmetry) {
  * @param enforce_symmetry true iff we want to enforce rotational symmetry.
  */
 void Crossword::SetBarrier(const bool val, const Coord coord, bool enforce_symmetry) {
-  DirtyClueStructure();
-
-  grid_[coord.row][coord.col].SetBarrier(val);
+  SetCellBarrier_(coord, val);
+  DirtyClueLines(coord);
   if (enforce_symmetry) {
     Coord pair = GetRotationalPair(coord);
     if (pair.row != coord.row || pair.col != coord.col) {
-      grid_[pair.row][pair.col].SetBarrier(val);
+      SetCellBarrier_(pair, val);
+      DirtyClueLines(pair);
     }
   }
 
   PopulateClueStructure();
 }
 
+/**
+ * @brief Set the barrier bit of one cell, keeping the fill hash in step.
+ *
+ * A barrier keeps the letter underneath, but only letters that are shown count towards the hash.
+ *
+ * @param coord
+ * @param val
+ */
+void Crossword::SetCellBarrier_(const Coord coord, const bool val) {
+  Cell &cell = CellAt_(coord);
+  if (cell.IsBarrier() == val)
+    return;
+  BumpGridVersion_();
+  if (val) {
+    fill_hash_ ^= ZobristKey(coord, cell.GetContents());
+    cell.SetBarrier(true);
+  } else {
+    cell.SetBarrier(false);
+    fill_hash_ ^= ZobristKey(coord, cell.GetContents());
+  }
+}
+
+/**
+ * @brief Recompute the fill hash from scratch.
+ *
+ * @return std::uint64_t
+ */
+std::uint64_t Crossword::ComputeFillHash_() const {
+  std::uint64_t hash = 0;
+  for (std::size_t r = 0; r < height_; ++r) {
+    for (std::size_t c = 0; c < width_; ++c) {
+      Cell const &cell = CellAt_(Coord(r, c));
+      if (!cell.IsBarrier())
+        hash ^= ZobristKey(Coord(r, c), cell.GetContents());
+    }
+  }
+  return hash;
+}
+
 /**
  * @brief Returns all possible words of direction direction.
  *
@@ -284,7 +397,7 @@ std::vector<Clue> Crossword::UnfilteredClues(const WordDirection direction) cons
   int state = 0; // 0, ended, 1, collecting
   std::size_t size = 0;
   std::size_t startk = 0;
-  std::vector<Atom> constraint_vector;
+  Word constraints;
   std::vector<Coord> coord_vector;
   std::size_t iMax = height_;
   std::size_t kMax = width_;
@@ -296,7 +409,7 @@ std::vector<Clue> Crossword::UnfilteredClues(const WordDirection direction) cons
     state = 0;
     size = 0;
     startk = 0;
-    constraint_vector.clear();
+    constraints = Word();
     coord_vector.clear();
     for (std::size_t k = 0; k < kMax + 1; k++) {
       Coord c = Coord(i, k);
@@ -305,22 +418,22 @@ std::vector<Clue> Crossword::UnfilteredClues(const WordDirection direction) cons
       }
       if (k == kMax || Get(c).IsBarrier()) {
         if (state == 1) {
-          assert(size = constraint_vector.size());
-          assert(coord_vector.size() == constraint_vector.size());
+          assert(size = constraints.size());
+          assert(coord_vector.size() == constraints.size());
           Coord start_coord = Coord(i, startk);
           if (direction == kDOWN) {
             start_coord = Coord(startk, i);
           }
           vec.push_back(Clue(
-                  direction, start_coord, size, constraint_vector, coord_vector));
+                  direction, start_coord, size, constraints, coord_vector));
         }
-        constraint_vector.clear();
+        constraints = Word();
         coord_vector.clear();
         size = 0;
         state = 0;
       } else {
         size += 1;
-        constraint_vector.push_back(Get(c).GetContents());
+        constraints.push_back(Get(c).GetContents());
         coord_vector.push_back(c);
         if (state == 0) {
           state = 1;
@@ -364,8 +477,9 @@ bool Crossword::InBounds(const Coord coord) const {
 void Crossword::SetClue(Clue const &clue, Word const &word) {
   assert(clue.FitsWord(word));
 
-  CrosswordActionGroup *group = new CrosswordActionGroup(*this, clue, word);
-  ApplyAction(group);
+  history_.BeginEdit();
+  FillClue_(clue, word);
+  history_.EndEdit();
 }
 
 /**
@@ -374,28 +488,77 @@ void Crossword::SetClue(Clue const &clue, Word const &word) {
  * @param clue the clue in question
  */
 void Crossword::ClearClue(Clue const &clue) {
-  CrosswordActionGroup *group = new CrosswordActionGroup();
+  history_.BeginEdit();
   for (std::size_t i = 0; i < clue.GetSize(); i++) {
-    Coord c = clue.coord_list_[i];
-    group->AddAction(new CrosswordSetAction(Atom(), Get(c).GetContents(), c));
+    SetRecorded_(Atom(), clue.coord_list_[i]);
   }
-  ApplyAction(group);
+  history_.EndEdit();
 }
 
 /**
- * @brief Load the clue cache up and set the dirty flag to false.
+ * @brief Load the clue cache up and set the dirty flag to false. Does nothing during a batch edit.
+ *
+ * Only the dirty lines are recalculated from the grid; the slots of the other lines are kept, contents and
+ * all. Numbers and the cell mapping are then redone in one pass, linear in the number of cells.
  *
  */
 void Crossword::PopulateClueStructure() {
-  assert(clue_cache_.dirty);
-
-  clue_cache_.clues = Clues_();
+  if (clue_cache_.batch_depth > 0 || !clue_cache_.dirty)
+    return;
+
+  // Slots come ordered by direction, then line, so the kept ones of each line are found in a single sweep.
+  std::vector<Clue> const &old_clues = clue_cache_.clues;
+  std::vector<Clue> clues;
+  clues.reserve(old_clues.size() + 2 * kMAX_DIM);
+  std::size_t next = 0;
+  for (WordDirection direction: {kACROSS, kDOWN}) {
+    const std::size_t lines = direction == kACROSS ? height_ : width_;
+    for (std::size_t line = 0; line < lines; ++line) {
+      const std::size_t begin = next;
+      while (!clue_cache_.rebuild && next < old_clues.size() && old_clues[next].GetDirection() == direction &&
+             (direction == kACROSS ? old_clues[next].GetStart().row : old_clues[next].GetStart().col) == line)
+        next++;
+      if (clue_cache_.rebuild || clue_cache_.dirty_lines[direction][line]) {
+        std::vector<Clue> line_clues = LineClues_(direction, line);
+        clues.insert(clues.end(), line_clues.begin(), line_clues.end());
+      } else {
+        clues.insert(clues.end(), old_clues.begin() + static_cast<std::ptrdiff_t>(begin),
+                     old_clues.begin() + static_cast<std::ptrdiff_t>(next));
+      }
+    }
+  }
+  clue_cache_.clues = std::move(clues);
+
+  // Give each clue its number in context of puzzle
+  for (auto &row: clue_cache_.numberings)
+    row.fill(kNO_NUMBER);
+  for (auto &slots: clue_cache_.slot_ids) {
+    for (auto &row: slots)
+      row.fill(kNO_SLOT);
+  }
+  for (auto const &clue: clue_cache_.clues)
+    clue_cache_.numberings[clue.GetStart().row][clue.GetStart().col] = 0;
+  int cn = 1;
   for (std::size_t r = 0; r < height_; ++r) {
     for (std::size_t c = 0; c < width_; ++c) {
-      clue_cache_.numberings[r][c] = GetClueNumber_(clue_cache_.clues, Coord(r, c));
-      clue_cache_.cell_mapping[r][c] = CluesStartingAt_(clue_cache_.clues, Coord(r, c));
+      if (clue_cache_.numberings[r][c] == 0)
+        clue_cache_.numberings[r][c] = cn++;
+    }
+  }
+  for (std::size_t slot = 0; slot < clue_cache_.clues.size(); ++slot) {
+    Clue &clue = clue_cache_.clues[slot];
+    clue.SetNumber(clue_cache_.numberings[clue.GetStart().row][clue.GetStart().col]);
+    clue.SetLocked(IsClueLocked_(clue));
+    for (std::size_t offset = 0; offset < clue.coord_list_.size(); ++offset) {
+      Coord const &coord = clue.coord_list_[offset];
+      clue_cache_.slot_ids[clue.GetDirection()][coord.row][coord.col] = static_cast<std::uint16_t>(slot);
+      clue_cache_.slot_offsets[clue.GetDirection()][coord.row][coord.col] = static_cast<std::uint8_t>(offset);
     }
   }
+
+  for (auto &lines: clue_cache_.dirty_lines)
+    lines.fill(false);
+  clue_cache_.rebuild = false;
   clue_cache_.dirty = false;
 }
 
@@ -420,8 +583,10 @@ std::vector<Clue> const &Crossword::Clues() const {
 std::vector<Clue> Crossword::CluesStartingAt(const Coord coord) const {
   assert(clue_cache_.dirty == false);
   std::vector<Clue> clue_copies;
-  for (auto const &pointer: clue_cache_.cell_mapping[coord.row][coord.col]) {
-    clue_copies.push_back(*pointer);
+  for (WordDirection direction: {kACROSS, kDOWN}) {
+    const std::uint16_t slot = clue_cache_.slot_ids[direction][coord.row][coord.col];
+    if (slot != kNO_SLOT)
+      clue_copies.push_back(clue_cache_.clues[slot]);
   }
   return clue_copies;
 }
@@ -437,21 +602,45 @@ ClueNumber Crossword::GetClueNumber(const Coord coord) const {
   return clue_cache_.numberings[coord.row][coord.col];
 }
 
+/**
+ * @brief Index in Clues() of the slot through a cell in a direction.
+ *
+ * @param direction
+ * @param coord
+ * @return std::size_t kNO_SLOT if no slot passes through the cell that way
+ */
+std::size_t Crossword::SlotAt(const WordDirection direction, const Coord coord) const {
+  assert(clue_cache_.dirty == false);
+  return clue_cache_.slot_ids[direction][coord.row][coord.col];
+}
+
+/**
+ * @brief Position of a cell within its slot in a direction. The slot must exist.
+ *
+ * @param direction
+ * @param coord
+ * @return std::size_t
+ */
+std::size_t Crossword::SlotOffsetAt(const WordDirection direction, const Coord coord) const {
+  assert(SlotAt(direction, coord) != kNO_SLOT);
+  return clue_cache_.slot_offsets[direction][coord.row][coord.col];
+}
+
 /**
  * @brief Clear the elements of a puzzle. Leave barriers and clues.
  *
  */
 void Crossword::ClearAtoms() {
-  CrosswordActionGroup *group = new CrosswordActionGroup();
+  history_.BeginEdit();
   for (std::size_t i = 0; i < height_; i++) {
     for (std::size_t k = 0; k < width_; k++) {
       Coord c = Coord(i, k);
       if (!Get(c).IsBarrier()) {
-        group->AddAction(new CrosswordSetAction(Atom(), Get(c).GetContents(), c));
+        SetRecorded_(Atom(), c);
       }
     }
   }
-  ApplyAction(group);
+  history_.EndEdit();
 }
 
 /**
@@ -466,8 +655,17 @@ void Crossword::SetDimensions(const std::size_t height, const std::size_t width)
 
   DirtyClueStructure();
 
+  // Cells keep their coordinates; those newly in bounds start out empty.
+  std::array<Cell, kMAX_DIM * kMAX_DIM> resized{};
+  for (std::size_t r = 0; r < std::min(height, height_); ++r) {
+    std::copy_n(grid_.begin() + static_cast<std::ptrdiff_t>(r * width_), std::min(width, width_),
+                resized.begin() + static_cast<std::ptrdiff_t>(r * width));
+  }
+  grid_ = resized;
   height_ = height;
   width_ = width;
+  fill_hash_ = ComputeFillHash_();
+  BumpGridVersion_();
 
   PopulateClueStructure();
 }
@@ -475,16 +673,81 @@ void Crossword::SetDimensions(const std::size_t height, const std::size_t width)
 /**
  * @brief Lock or unlock a cell.
  *
- * TODO: incrementally update this as this is kind of dumb ATM
+ * Only the lock state of the clues crossing the cell is updated.
  *
  * @param coord
  * @param value
  */
 void Crossword::LockCell(const Coord coord, const bool value) {
   assert(InBounds(coord));
-  DirtyClueStructure();
-  grid_[coord.row][coord.col].Lock(value);
-  PopulateClueStructure();
+  CellAt_(coord).Lock(value);
+  BumpGridVersion_();
+  for (WordDirection direction: {kACROSS, kDOWN}) {
+    const std::uint16_t slot = clue_cache_.slot_ids[direction][coord.row][coord.col];
+    if (slot != kNO_SLOT)
+      clue_cache_.clues[slot].SetLocked(IsClueLocked_(clue_cache_.clues[slot]));
+  }
+}
+
+/**
+ * @brief Make this grid a copy of another's: dimensions, barriers, contents and locks.
+ *
+ * Hints and the undo history are left alone.
+ *
+ * @param other
+ */
+void Crossword::CopyGridFrom(Crossword const &other) {
+  GridSnapshot snapshot;
+  other.SaveSnapshot(snapshot);
+  RestoreSnapshot(snapshot);
+}
+
+/**
+ * @brief Copy the grid's dimensions, cells and fill hash into a snapshot.
+ *
+ * @param snapshot overwritten
+ */
+void Crossword::SaveSnapshot(GridSnapshot &snapshot) const {
+  snapshot.height_ = height_;
+  snapshot.width_ = width_;
+  std::memcpy(snapshot.cells_.data(), grid_.data(), height_ * width_ * sizeof(Cell));
+  snapshot.fill_hash_ = fill_hash_;
+}
+
+/**
+ * @brief Make the grid what it was when a snapshot was saved, from this or any other crossword.
+ *
+ * If the dimensions and barriers match, only the clues' letters and lock flags are refreshed;
+ * otherwise the clue structure is rebuilt. Hints and the undo history are left alone.
+ *
+ * @param snapshot
+ */
+void Crossword::RestoreSnapshot(GridSnapshot const &snapshot) {
+  const std::size_t cells = snapshot.height_ * snapshot.width_;
+  bool same_pattern = snapshot.height_ == height_ && snapshot.width_ == width_ && clue_cache_.batch_depth == 0 &&
+                      !clue_cache_.dirty;
+  for (std::size_t i = 0; same_pattern && i < cells; ++i)
+    same_pattern = grid_[i].IsBarrier() == snapshot.cells_[i].IsBarrier();
+
+  std::memcpy(grid_.data(), snapshot.cells_.data(), cells * sizeof(Cell));
+  fill_hash_ = snapshot.fill_hash_;
+  BumpGridVersion_();
+  if (!same_pattern) {
+    DirtyClueStructure();
+    height_ = snapshot.height_;
+    width_ = snapshot.width_;
+    PopulateClueStructure();
+    return;
+  }
+
+  for (std::size_t slot = 0; slot < clue_cache_.clues.size(); ++slot) {
+    Clue &clue = clue_cache_.clues[slot];
+    for (std::size_t offset = 0; offset < clue.coord_list_.size(); ++offset)
+      clue.SetConstraint(offset, CellAt_(clue.coord_list_[offset]).GetContents());
+    clue.SetLocked(IsClueLocked_(clue));
+    if (search_state_ != nullptr)
+      search_state_->Touch(slot);
+  }
 }
 
 /**
@@ -498,11 +761,43 @@ void Crossword::ToggleLockCell(const Coord coord) {
 }
 
 /**
- * @brief Signal that the clue cache is dirty.
+ * @brief Signal that the clue cache is dirty, all of it.
  *
  */
 void Crossword::DirtyClueStructure() {
   clue_cache_.dirty = true;
+  clue_cache_.rebuild = true;
+}
+
+/**
+ * @brief Signal that the slots of the row and column through a cell are dirty.
+ *
+ * @param coord
+ */
+void Crossword::DirtyClueLines(const Coord coord) {
+  clue_cache_.dirty = true;
+  clue_cache_.dirty_lines[kACROSS][coord.row] = true;
+  clue_cache_.dirty_lines[kDOWN][coord.col] = true;
+}
+
+/**
+ * @brief Start a batch of barrier, dimension or grid edits, recalculating the clues once when the batch ends.
+ *
+ * Batches nest. Until the outermost ends, the clue getters must not be used.
+ *
+ */
+void Crossword::BeginBatchEdit() {
+  clue_cache_.batch_depth++;
+}
+
+/**
+ * @brief End a batch started with BeginBatchEdit.
+ *
+ */
+void Crossword::EndBatchEdit() {
+  assert(clue_cache_.batch_depth > 0);
+  clue_cache_.batch_depth--;
+  PopulateClueStructure();
 }
 
 /**
@@ -514,7 +809,7 @@ void Crossword::DirtyClueStructure() {
  */
 bool Crossword::IsLocked(const Coord coord) const {
   assert(InBounds(coord));
-  return grid_[coord.row][coord.col].IsLocked();
+  return CellAt_(coord).IsLocked();
 }
 
 /**
@@ -18,13 +18,17 @@
 #include <memory>
 #include <iostream>
 #include <mutex>
+#include <atomic>
 #include <cassert>
+#include <unordered_map>
+#include <cstdint>
 
 #include "crossword/logging.hpp"
 #include "crossword/base.hpp"
 #include "crossword/database.hpp"
 #include "crossword/clue.hpp"
 #include "crossword/crossword_action.hpp"
+#include "crossword/pattern.hpp"
 #include "crossword/search.hpp"
 
 /**
@@ -32,23 +36,99 @@
  * 
  */
 namespace crossword_backend {
+  /**
+   * @brief Bits of a packed Cell holding the code of its contents.
+   *
+   */
+  constexpr std::uint8_t kCELL_CODE_MASK = 0x1F;
+
+  /**
+   * @brief Bit of a packed Cell set iff it is a barrier.
+   *
+   */
+  constexpr std::uint8_t kCELL_BARRIER_BIT = 0x20;
+
+  /**
+   * @brief Bit of a packed Cell set iff it is locked.
+   *
+   */
+  constexpr std::uint8_t kCELL_LOCKED_BIT = 0x40;
+
+  static_assert(kATOM_COUNT <= kCELL_CODE_MASK + 1, "atom codes must fit in a cell");
+
   /**
    * @brief Object representing the state of a crossword grid cell.
    *
+   * Packed into a single byte: the contents' code, a barrier bit and a lock bit.
+   *
    */
   class Cell {
   public:
-    [[nodiscard]] Atom GetContents() const;
+    /**
+     * @brief Get the contents of a cell.
+     *
+     * @return Atom
+     */
+    [[nodiscard]] Atom GetContents() const {
+      assert(!IsBarrier());
+      return Atom::FromCode(bits & kCELL_CODE_MASK);
+    }
 
-    [[nodiscard]] bool IsBarrier() const;
+    /**
+     * @brief True iff cell is a barrier.
+     *
+     * @return bool
+     */
+    [[nodiscard]] bool IsBarrier() const { return (bits & kCELL_BARRIER_BIT) != 0; }
 
-    [[nodiscard]] bool IsLocked() const;
+    /**
+     * @brief Get whether a cell is locked or not.
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsLocked() const { return (bits & kCELL_LOCKED_BIT) != 0; }
 
-    void SetBarrier(bool val);
+    /**
+     * @brief Set the cell to be a barrier cell. The contents are kept underneath.
+     *
+     * @param val
+     */
+    void SetBarrier(const bool val) { SetBit(kCELL_BARRIER_BIT, val); }
 
-    void SetContents(Atom atom);
+    /**
+     * @brief Set the contents of a cell.
+     *
+     * @param atom new contents
+     */
+    void SetContents(const Atom atom) {
+      bits = static_cast<std::uint8_t>((bits & ~kCELL_CODE_MASK) | atom.GetCode());
+    }
 
-    void Lock(bool value);
+    /**
+     * @brief Lock or unlock a cell.
+     *
+     * @param value
+     */
+    void Lock(const bool value) { SetBit(kCELL_LOCKED_BIT, value); }
+
+    /**
+     * @brief True iff two cells have the same contents, barrier bit and lock bit.
+     *
+     * @param other
+     * @return true
+     * @return false
+     */
+    bool operator==(Cell const &other) const { return bits == other.bits; }
+
+    /**
+     * @brief True iff two cells differ in contents, barrier bit or lock bit.
+     *
+     * @param other
+     * @return true
+     * @return false
+     */
+    bool operator!=(Cell const &other) const { return bits != other.bits; }
 
     [[nodiscard]] std::string ToString() const;
 
@@ -60,25 +140,118 @@ namespace crossword_backend {
      * By default, initialized to an empty, non-barrier cell.
      *
      */
-    Cell() : is_barrier(false), contents(Atom()), locked(false) {};
+    Cell() : bits(kEMPTY_CODE) {};
 
   private:
     /**
-     * @brief True iff this cell is a barrier (blacked-out) cell.
+     * @brief Set or clear one flag bit.
+     *
+     * @param bit
+     * @param value
+     */
+    void SetBit(const std::uint8_t bit, const bool value) {
+      bits = static_cast<std::uint8_t>(value ? bits | bit : bits & ~bit);
+    }
+
+    /**
+     * @brief Contents code, barrier bit and lock bit.
+     *
+     */
+    std::uint8_t bits;
+  };
+
+  static_assert(sizeof(Cell) == 1, "cells are packed into a byte");
+
+  /**
+   * @brief Leading bytes of a binary puzzle.
+   *
+   */
+  constexpr char kPUZZLE_MAGIC[4] = {'C', 'W', 'P', 'Z'};
+
+  /**
+   * @brief Version of the binary puzzle format written by Crossword::WritePuzzle.
+   *
+   */
+  constexpr std::uint8_t kPUZZLE_VERSION = 1;
+
+  /**
+   * @brief File extension of binary puzzles.
+   *
+   */
+  constexpr char kPUZZLE_EXTENSION[] = ".cwpz";
+
+  /**
+   * @brief A copy of a grid's dimensions, cells and fill hash, cheap to take and to restore.
+   *
+   * Does not include hints, the clue structure or the undo history.
+   *
+   */
+  class GridSnapshot {
+  public:
+    /**
+     * @brief Height of the grid.
+     *
+     * @return std::size_t
      */
-    bool is_barrier;
+    [[nodiscard]] std::size_t GetHeight() const { return height_; }
 
     /**
-     * @brief True iff this cell is locked.
+     * @brief Width of the grid.
      *
+     * @return std::size_t
      */
-    bool locked;
+    [[nodiscard]] std::size_t GetWidth() const { return width_; }
 
     /**
-     * @brief The value of the cell.
+     * @brief Fill hash of the grid, as from Crossword::GetFillHash.
      *
+     * @return std::uint64_t
      */
-    Atom contents;
+    [[nodiscard]] std::uint64_t GetFillHash() const { return fill_hash_; }
+
+    /**
+     * @brief Get the cell at a coordinate.
+     *
+     * @param coord must be within the snapshot's dimensions
+     * @return Cell
+     */
+    [[nodiscard]] Cell Get(const Coord coord) const {
+      assert(coord.row < height_ && coord.col < width_);
+      return cells_[coord.row * width_ + coord.col];
+    }
+
+    /**
+     * @brief Construct an empty snapshot, to be filled by Crossword::SaveSnapshot.
+     *
+     */
+    GridSnapshot() : height_(0), width_(0), cells_{}, fill_hash_(0) {};
+
+  private:
+    friend class Crossword;
+
+    /**
+     * @brief Height of the grid.
+     *
+     */
+    std::size_t height_;
+
+    /**
+     * @brief Width of the grid.
+     *
+     */
+    std::size_t width_;
+
+    /**
+     * @brief Cells in row-major order. Only the first height_ * width_ are meaningful.
+     *
+     */
+    std::array<Cell, kMAX_DIM * kMAX_DIM> cells_;
+
+    /**
+     * @brief Fill hash of the grid.
+     *
+     */
+    std::uint64_t fill_hash_;
   };
 
   /**
@@ -118,6 +291,15 @@ namespace crossword_backend {
     Weak,
   };
 
+  /**
+   * @brief Slot id of a cell that no slot passes through in some direction.
+   *
+   */
+  constexpr std::uint16_t kNO_SLOT = 0xFFFF;
+
+  static_assert(kMAX_DIM * kMAX_DIM < kNO_SLOT, "slot ids must fit in 16 bits");
+  static_assert(kMAX_DIM <= 0xFF, "slot offsets must fit in 8 bits");
+
   /**
    * @brief Cache that holds clues.
    *
@@ -143,56 +325,196 @@ namespace crossword_backend {
     std::array<std::array<ClueNumber, kMAX_DIM>, kMAX_DIM> numberings;
 
     /**
-     * @brief Mapping from coordinate to list of pointers to clues starting at that location.
+     * @brief Index in clues of the slot through each cell, by direction, then row and column, or kNO_SLOT.
+     *
+     */
+    std::array<std::array<std::array<std::uint16_t, kMAX_DIM>, kMAX_DIM>, 2> slot_ids;
+
+    /**
+     * @brief Position of each cell within its slot, by direction, then row and column.
+     *
+     * Only meaningful where slot_ids is not kNO_SLOT.
      *
      */
-    std::array<std::array<std::vector<Clue *>, kMAX_DIM>, kMAX_DIM> cell_mapping;
+    std::array<std::array<std::array<std::uint8_t, kMAX_DIM>, kMAX_DIM>, 2> slot_offsets;
 
     /**
-     * @brief True iff the structure needs to be recalculated.
+     * @brief True iff the structure needs to be recalculated, in whole or in part.
      *
      */
     bool dirty;
 
+    /**
+     * @brief True iff every line must be recalculated, e.g. after a resize. Otherwise only the dirty lines are.
+     *
+     */
+    bool rebuild;
+
+    /**
+     * @brief Lines whose slots must be recalculated, indexed by direction, then by row (across) or column (down).
+     *
+     */
+    std::array<std::array<bool, kMAX_DIM>, 2> dirty_lines;
+
+    /**
+     * @brief Number of open batch edits. Recalculation waits until the last one ends.
+     *
+     */
+    std::size_t batch_depth;
+
     /**
      * @brief Default constructor.
      *
      */
-    ClueStructure() : numberings{}, dirty(true) {};
+    ClueStructure() : numberings{}, slot_ids{}, slot_offsets{}, dirty(true), rebuild(true), dirty_lines{},
+                      batch_depth(0) {};
   };
 
   /**
-   * @brief Class representing a single crossword puzzle.
+   * @brief Per-slot state of an autofill search, updated incrementally as cells change.
+   *
+   * Slots are indexed like Crossword::Clues(). While a search is running, Crossword::Set_ marks the
+   * slots crossing each changed cell as touched, and Crossword::RefreshSearchState re-checks only those.
    *
    */
-  class Crossword {
-  public:
+  struct SearchState {
     /**
-     * @brief Owned logging object.
+     * @brief Verdict of IsInvalidPartial for each slot on its own, ignoring duplicates.
      *
      */
-    Logger logger;
+    std::vector<Solvability> status;
 
     /**
-     * @brief Flags search interruption.
+     * @brief Whether each slot is filled with a dictionary word.
      *
      */
-    std::atomic<bool> stop_searching;
+    std::vector<bool> solved;
 
     /**
-     * @brief Flags completion of search.
+     * @brief Word held by each slot, if it is filled.
      *
      */
-    std::atomic<bool> done_searching;
+    std::vector<Word> words;
+
+    /**
+     * @brief Whether each slot's word is counted in word_counts.
+     *
+     */
+    std::vector<bool> counted;
+
+    /**
+     * @brief Multiset of the words in filled slots.
+     *
+     */
+    std::unordered_map<Word, int, WordHash> word_counts;
+
+    /**
+     * @brief Slots touched since the last refresh, each listed once.
+     *
+     */
+    std::vector<std::size_t> touched;
+
+    /**
+     * @brief Whether each slot is in touched.
+     *
+     */
+    std::vector<bool> is_touched;
+
+    /**
+     * @brief Slots in the order they are filled.
+     *
+     */
+    std::vector<std::size_t> fill_order;
+
+    /**
+     * @brief Number of slots whose status is not Solvable.
+     *
+     */
+    std::size_t rejected_count;
+
+    /**
+     * @brief Number of slots that are not solved.
+     *
+     */
+    std::size_t unsolved_count;
+
+    /**
+     * @brief Number of word occurrences beyond the first, over all words.
+     *
+     */
+    std::size_t duplicate_count;
+
+    /**
+     * @brief Score threshold the statuses were computed with.
+     *
+     */
+    int score_min;
+
+    /**
+     * @brief Mark a slot as needing a re-check.
+     *
+     * @param slot
+     */
+    void Touch(const std::size_t slot) {
+      if (!is_touched[slot]) {
+        is_touched[slot] = true;
+        touched.push_back(slot);
+      }
+    }
+
+    /**
+     * @brief Equivalent to IsInvalidPartial(...) != Solvability::Solvable.
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsRejected() const { return rejected_count != 0 || duplicate_count != 0; }
+
+    /**
+     * @brief Equivalent to IsSolved(...).
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsSolved() const { return unsolved_count == 0; }
+
+    SearchState() : rejected_count(0), unsolved_count(0), duplicate_count(0), score_min(0) {};
+  };
+
+  /**
+   * @brief Class representing a single crossword puzzle.
+   *
+   */
+  class Crossword {
+  public:
+    /**
+     * @brief Owned logging object.
+     *
+     */
+    Logger logger;
 
     /* Autofill related */
-    void Autofill(AutofillParams &params);
+    AutofillStatistics Autofill(AutofillParams &params);
 
     void StopAutofill();
 
     [[nodiscard]] std::vector<CrosswordActionGroup *>
     GetWordFills(std::vector<Clue> const &all_clues, AutofillParams const &params) const;
 
+    [[nodiscard]] std::vector<CrosswordActionGroup *>
+    GetWordFills(std::vector<Clue> const &all_clues, std::vector<std::size_t> const &fill_order,
+                 AutofillParams const &params) const;
+
+    [[nodiscard]] std::size_t
+    GetWordCandidates(std::vector<Clue> const &all_clues, std::vector<std::size_t> const &fill_order,
+                      AutofillParams const &params, std::vector<Word> &words) const;
+
+    [[nodiscard]] std::vector<std::size_t> FillOrder(std::vector<Clue> const &all_clues) const;
+
+    void ResetSearchState(SearchState &state, WordDatabase &db, int score_min) const;
+
+    void RefreshSearchState(SearchState &state, WordDatabase &db) const;
+
     bool IsSolved(std::vector<Clue> const &all_clues, WordDatabase &db) const;
 
     Solvability IsInvalidPartial(std::vector<Clue> const &all_clues, WordDatabase &db, int score_min) const;
@@ -215,12 +537,20 @@ namespace crossword_backend {
 
     void SetDimensions(std::size_t height, std::size_t width);
 
+    void SetPattern(PatternBoard const &pattern);
+
     void LockCell(Coord coord, bool value);
 
     void ToggleBarrier(Coord coord, bool enforce_symmetry);
 
     void ToggleLockCell(Coord coord);
 
+    void BeginBatchEdit();
+
+    void EndBatchEdit();
+
+    void SetHistoryLimit(std::size_t changes);
+
     /* Fundamental action methods that don't affect stack */
     void Set_(Atom val, Coord coord);
 
@@ -233,6 +563,8 @@ namespace crossword_backend {
 
     [[nodiscard]] bool IsValidPattern() const;
 
+    [[nodiscard]] PatternBoard GetPattern() const;
+
     [[nodiscard]] Cell Get(Coord coord) const;
 
     [[nodiscard]] Cell Get(std::size_t row, std::size_t col) const;
@@ -258,6 +590,10 @@ namespace crossword_backend {
 
     [[nodiscard]] ClueNumber GetClueNumber(Coord coord) const;
 
+    [[nodiscard]] std::size_t SlotAt(WordDirection direction, Coord coord) const;
+
+    [[nodiscard]] std::size_t SlotOffsetAt(WordDirection direction, Coord coord) const;
+
     /* Hint-related TODO: make private certain overloads and cleanup API */
     [[nodiscard]] std::string GetHint(ClueNumber num, WordDirection direction) const;
 
@@ -271,10 +607,38 @@ namespace crossword_backend {
 
     void SetHint(Coord coord, WordDirection direction, std::string const &hint);
 
+    void CopyGridFrom(Crossword const &other);
+
+    void SaveSnapshot(GridSnapshot &snapshot) const;
+
+    void RestoreSnapshot(GridSnapshot const &snapshot);
+
+    /**
+     * @brief Zobrist hash of the letters in the grid, updated incrementally on every cell write.
+     *
+     * Equal fills of the same grid hash equal; an empty grid hashes to 0.
+     *
+     * @return std::uint64_t
+     */
+    [[nodiscard]] std::uint64_t GetFillHash() const { return fill_hash_; }
+
+    /**
+     * @brief Counter bumped by every change to the dimensions or to any cell's contents, barrier or lock.
+     *
+     * May be read from another thread, which can skip redrawing while it stays put.
+     *
+     * @return std::uint64_t
+     */
+    [[nodiscard]] std::uint64_t GetGridVersion() const { return grid_version_.load(std::memory_order_acquire); }
+
     /* Import/Export related */
     [[nodiscard]] std::vector<std::string> Serialize() const;
 
-    void Unserialize(std::vector<std::string> &lines);
+    bool Unserialize(std::vector<std::string> &lines);
+
+    bool WritePuzzle(std::ostream &out) const;
+
+    bool ReadPuzzle(std::istream &in);
 
     /**
      * @brief Construct a new Crossword object.
@@ -283,7 +647,8 @@ namespace crossword_backend {
      * height of kSTART_HEIGHT.
      *
      */
-    Crossword() : height_(kSTART_HEIGHT), width_(kSTART_WIDTH), done_searching{false}, stop_searching{false} {
+    Crossword() : grid_{}, height_(kSTART_HEIGHT), width_(kSTART_WIDTH), fill_hash_(0), grid_version_(0),
+                  search_state_(nullptr), nogoods_(nullptr), domains_(nullptr) {
       PopulateClueStructure();
     }
 
@@ -292,8 +657,10 @@ namespace crossword_backend {
      * @brief An array that stores underlying Cell objects
      * that comprise the crossword puzzle.
      *
+     * Row-major with a stride of width_, so only the first height_ * width_ cells are in use.
+     *
      */
-    std::array<std::array<Cell, kMAX_DIM>, kMAX_DIM> grid_;
+    std::array<Cell, kMAX_DIM * kMAX_DIM> grid_;
 
     /**
      * @brief The height of the crossword puzzle.
@@ -307,6 +674,18 @@ namespace crossword_backend {
      */
     std::size_t width_;
 
+    /**
+     * @brief Zobrist hash of the letters in the grid.
+     *
+     */
+    std::uint64_t fill_hash_;
+
+    /**
+     * @brief Changes to the grid so far. Only written by the thread editing the grid.
+     *
+     */
+    std::atomic<std::uint64_t> grid_version_;
+
     /**
      * @brief Owned clue cache.
      *
@@ -325,23 +704,127 @@ namespace crossword_backend {
             clue_strings_;
 
     /**
-     * @brief Action stack object for the crossword.
+     * @brief Undo history of the crossword's letters.
      *
      */
-    CrosswordActionStack action_stack_;
+    CrosswordHistory history_;
+
+    /**
+     * @brief State of the running autofill, told about every cell change; nullptr when not searching.
+     *
+     */
+    SearchState *search_state_;
+
+    /**
+     * @brief Grids refuted so far by the running autofill; nullptr when not searching or when disabled.
+     *
+     */
+    NogoodTable *nogoods_;
+
+    /**
+     * @brief Candidates propagation left to each slot in the running pass; nullptr when not searching or when
+     * not propagating.
+     *
+     */
+    SlotDomains const *domains_;
+
+    /**
+     * @brief Signalled by StopAutofill to interrupt the running autofill.
+     *
+     */
+    CancellationToken stop_searching_;
+
+    void UpdateSlotState(SearchState &state, std::size_t slot, WordDatabase &db) const;
+
+    [[nodiscard]] std::size_t
+    MostConstrainedSlot(std::vector<Clue> const &all_clues, std::vector<std::size_t> const &fill_order,
+                        WordDatabase &db, int score_min) const;
+
+    void OrderLeastConstraining(Clue const &clue, std::vector<Word> &words, WordDatabase &db, int score_min) const;
+
+    bool PropagateDomains(PropagationState &state, SlotDomains &domains, WordDatabase &db, int score_min,
+                          SearchLimit &limit, std::uint64_t &pruned) const;
+
+    SearchOutcome SearchInParallel(AutofillParams const &params, SearchLimit const &limit,
+                                   std::uint64_t &nodes_searched, std::uint64_t &frames_backjumped);
+
+    void SearchSubtrees(ParallelSearch &search, std::size_t worker, AutofillParams const &params, SearchLimit limit);
+
+    SearchOutcome SearchFrom(SearchTrail &trail, SearchState &state, AutofillParams const &params, SearchLimit &limit,
+                             std::uint64_t &nodes, ParallelSearch *parallel, std::size_t worker);
+
+    bool Expand(SearchTrail &trail, SearchState const &state, AutofillParams const &params) const;
+
+    bool Refill(SearchTrail &trail, AutofillParams const &params) const;
+
+    [[nodiscard]] std::size_t FirstOpenSlot(std::vector<Clue> const &all_clues,
+                                            std::vector<std::size_t> const &fill_order) const;
+
+    [[nodiscard]] std::uint64_t NogoodKey(SearchState const &state, std::vector<std::size_t> &open_slots) const;
+
+    void OpenConflictSet(SearchTrail &trail, AutofillParams const &params) const;
+
+    void BlameSlot(SearchTrail &trail, std::size_t frame, std::size_t slot) const;
+
+    void BlameNeighborhood(SearchTrail &trail, std::size_t frame, std::size_t slot) const;
+
+    void BlameRejection(SearchTrail &trail, SearchState const &state, std::size_t frame) const;
+
+    void BlameNogood(SearchTrail &trail, SearchState const &state, std::size_t frame) const;
+
+    void Backjump(SearchTrail &trail);
+
+    void Place(SearchTrail &trail, Placement const &placement);
+
+    void Unplace(SearchTrail &trail);
+
+    void ApplyPlacements(SearchTask const &placements);
 
     void PopulateClueStructure();
 
     void DirtyClueStructure();
 
+    void DirtyClueLines(Coord coord);
+
     /* Raw clue calculation methods */
-    [[nodiscard]] std::vector<Clue> Clues_() const;
+    [[nodiscard]] std::vector<Clue> LineClues_(WordDirection direction, std::size_t line) const;
+
+    [[nodiscard]] bool IsClueLocked_(Clue const &clue) const;
+
+    void SetRecorded_(Atom val, Coord coord);
+
+    void FillClue_(Clue const &clue, Word const &word);
+
+    /**
+     * @brief The cell at a coordinate, which must be in bounds.
+     *
+     * @param coord
+     * @return Cell&
+     */
+    Cell &CellAt_(const Coord coord) { return grid_[coord.row * width_ + coord.col]; }
+
+    /**
+     * @brief The cell at a coordinate, which must be in bounds.
+     *
+     * @param coord
+     * @return Cell const&
+     */
+    [[nodiscard]] Cell const &CellAt_(const Coord coord) const { return grid_[coord.row * width_ + coord.col]; }
+
+    /**
+     * @brief Record a change to the grid. A load and a store rather than an atomic increment, as the
+     * only writer is the thread editing the grid.
+     *
+     */
+    void BumpGridVersion_() {
+      grid_version_.store(grid_version_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
 
-    std::vector<Clue *> CluesStartingAt_(std::vector<Clue> &all_clues, Coord coord) const;
+    void SetCellBarrier_(Coord coord, bool val);
 
-    ClueNumber GetClueNumber_(std::vector<Clue> &all_clues, Coord coord) const;
+    void LoadGrid_(std::size_t height, std::size_t width, std::array<Cell, kMAX_DIM * kMAX_DIM> const &cells);
 
-    void ApplyAction(CrosswordAction *action);
+    [[nodiscard]] std::uint64_t ComputeFillHash_() const;
 
     [[nodiscard]] Coord GetRotationalPair(Coord coord) const;
 
@@ -66,65 +66,186 @@ void CrosswordActionGroup::AddAction(CrosswordAction *action) {
 }
 
 /**
- * @brief Add action to the stack
+ * @brief Open an edit. Changes recorded until EndEdit are undone and redone together.
  *
- * Takes unique ownership of reference.
+ */
+void CrosswordHistory::BeginEdit() {
+  assert(!is_editing_);
+  is_editing_ = true;
+  edit_begin_ = changes_.size();
+}
+
+/**
+ * @brief Record a change of a cell's contents in the open edit. The first change of an edit discards
+ * the edits that could be redone.
+ *
+ * @param coord
+ * @param old_value
+ * @param new_value
+ */
+void CrosswordHistory::Record(const Coord coord, const Atom old_value, const Atom new_value) {
+  assert(is_editing_);
+  std::uint16_t &position = edit_positions_[coord.row * kMAX_DIM + coord.col];
+  if (position != 0) {
+    changes_[edit_begin_ + position - 1].new_code = new_value.GetCode();
+    return;
+  }
+  if (old_value == new_value)
+    return;
+
+  if (changes_.size() == edit_begin_) {
+    DropRedo();
+    edit_begin_ = changes_.size();
+  }
+  changes_.push_back(CellEdit{static_cast<std::uint8_t>(coord.row), static_cast<std::uint8_t>(coord.col),
+                                old_value.GetCode(), new_value.GetCode()});
+  position = static_cast<std::uint16_t>(changes_.size() - edit_begin_);
+}
+
+/**
+ * @brief Close the open edit, making it the latest one to undo unless it changed nothing.
  *
- * @param action
  */
-void CrosswordActionStack::Push(CrosswordAction *action) {
-  if (stack_.size() > index_) {
-    // erase+insert because we want to ensure object destruction
-    stack_.erase(stack_.begin() + index_, stack_.end());
-    stack_.insert(stack_.begin() + index_, std::unique_ptr<CrosswordAction>(action));
+void CrosswordHistory::EndEdit() {
+  assert(is_editing_);
+  is_editing_ = false;
+
+  // Drop changes undone within the edit itself.
+  std::size_t kept = edit_begin_;
+  for (std::size_t i = edit_begin_; i < changes_.size(); ++i) {
+    CellEdit const &change = changes_[i];
+    edit_positions_[change.row * kMAX_DIM + change.col] = 0;
+    if (change.old_code != change.new_code)
+      changes_[kept++] = change;
+  }
+  changes_.resize(kept);
+  if (changes_.size() == edit_begin_)
+    return;
 
-    index_++;
-  } else {
-    stack_.push_back(std::unique_ptr<CrosswordAction>(action));
-    index_++;
+  // A single cell edited again: extend the previous edit instead.
+  if (changes_.size() == edit_begin_ + 1 && index_ > 0 && EditBegin(index_ - 1) + 1 == edit_begin_) {
+    CellEdit &previous = changes_[edit_begin_ - 1];
+    CellEdit const &change = changes_[edit_begin_];
+    if (previous.row == change.row && previous.col == change.col) {
+      previous.new_code = change.new_code;
+      changes_.pop_back();
+      if (previous.old_code == previous.new_code) {
+        changes_.pop_back();
+        edit_ends_.pop_back();
+        index_--;
+      }
+      return;
+    }
   }
+
+  edit_ends_.push_back(changes_.size());
+  index_++;
+  if (changes_.size() > limit_)
+    DropOldest();
 }
 
 /**
- * @brief Moves back one action in history.
+ * @brief Undo the latest applied edit.
  *
- * Returns true iff there is an action to undo.
+ * Cells since barred or cut off by a resize are skipped.
  *
+ * @param crossword
+ * @return true
+ * @return false there is no edit to undo
  */
-bool CrosswordActionStack::Pop(Crossword &crossword) {
-  if (IsEmpty()) {
+bool CrosswordHistory::Undo(Crossword &crossword) {
+  assert(!is_editing_);
+  if (index_ == 0)
     return false;
-  }
   index_--;
-  stack_[index_]->Invert(crossword);
+  for (std::size_t i = edit_ends_[index_]; i > EditBegin(index_); --i) {
+    CellEdit const &change = changes_[i - 1];
+    const Coord coord(change.row, change.col);
+    if (crossword.InBounds(coord) && !crossword.Get(coord).IsBarrier())
+      crossword.Set_(Atom::FromCode(change.old_code), coord);
+  }
   return true;
 }
 
 /**
- * @brief Goes forward one action in history.
+ * @brief Redo the earliest undone edit.
  *
- * Returns true iff there is an action to redo.
+ * Cells since barred or cut off by a resize are skipped.
  *
  * @param crossword
+ * @return true
+ * @return false there is no edit to redo
  */
-bool CrosswordActionStack::Replace(Crossword &crossword) {
-  if (stack_.size() > index_) {
-    stack_[index_]->Apply(crossword);
-    index_++;
-    return true;
-  } else {
+bool CrosswordHistory::Redo(Crossword &crossword) {
+  assert(!is_editing_);
+  if (index_ == edit_ends_.size())
     return false;
+  for (std::size_t i = EditBegin(index_); i < edit_ends_[index_]; ++i) {
+    CellEdit const &change = changes_[i];
+    const Coord coord(change.row, change.col);
+    if (crossword.InBounds(coord) && !crossword.Get(coord).IsBarrier())
+      crossword.Set_(Atom::FromCode(change.new_code), coord);
   }
+  index_++;
+  return true;
 }
 
 /**
- * @brief Checks whether the stack is empty.
+ * @brief Forget every edit, to undo or to redo.
+ *
+ */
+void CrosswordHistory::Clear() {
+  assert(!is_editing_);
+  changes_.clear();
+  changes_.shrink_to_fit();
+  edit_ends_.clear();
+  edit_ends_.shrink_to_fit();
+  index_ = 0;
+}
+
+/**
+ * @brief Set how many cell changes are kept before the oldest edits are dropped. The latest edit is
+ * always kept, however large.
+ *
+ * @param changes
+ */
+void CrosswordHistory::SetLimit(const std::size_t changes) {
+  assert(!is_editing_);
+  limit_ = changes;
+  if (changes_.size() > limit_) {
+    DropRedo();
+    DropOldest();
+  }
+}
+
+/**
+ * @brief Discard the edits after index_.
+ *
+ */
+void CrosswordHistory::DropRedo() {
+  changes_.resize(EditBegin(index_));
+  edit_ends_.resize(index_);
+}
+
+/**
+ * @brief Drop the oldest edits until at most three quarters of the limit are kept, so that dropping is
+ * amortized over many edits. Only called when nothing can be redone.
  *
- * @return true
- * @return false
  */
-bool CrosswordActionStack::IsEmpty() const {
-  return index_ == 0;
+void CrosswordHistory::DropOldest() {
+  assert(index_ == edit_ends_.size());
+  const std::size_t target = limit_ - limit_ / 4;
+  std::size_t dropped = 0;
+  while (dropped + 1 < index_ && changes_.size() - EditBegin(dropped) > target)
+    dropped++;
+  if (dropped == 0)
+    return;
+  const std::size_t begin = edit_ends_[dropped - 1];
+  changes_.erase(changes_.begin(), changes_.begin() + static_cast<std::ptrdiff_t>(begin));
+  edit_ends_.erase(edit_ends_.begin(), edit_ends_.begin() + static_cast<std::ptrdiff_t>(dropped));
+  for (auto &end: edit_ends_)
+    end -= begin;
+  index_ -= dropped;
 }
 
 /**
@@ -3,6 +3,8 @@
 
 #include "crossword/clue.hpp"
 
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <memory>
 
@@ -134,47 +136,151 @@ namespace crossword_backend {
   };
 
   /**
-   * @brief Data structure representing the history and future of actions applied to a crossword.
+   * @brief Cell changes a CrosswordHistory keeps by default before dropping its oldest edits.
    *
    */
-  class CrosswordActionStack {
+  constexpr std::size_t kHISTORY_MAX_CHANGES = 1 << 20;
+
+  /**
+   * @brief One cell's change of contents, as kept by CrosswordHistory.
+   *
+   */
+  struct CellEdit {
+    /**
+     * @brief Row of the cell.
+     *
+     */
+    std::uint8_t row;
+
+    /**
+     * @brief Column of the cell.
+     *
+     */
+    std::uint8_t col;
+
+    /**
+     * @brief Code of the contents before the change.
+     *
+     */
+    std::uint8_t old_code;
+
+    /**
+     * @brief Code of the contents after the change.
+     *
+     */
+    std::uint8_t new_code;
+  };
+
+  static_assert(sizeof(CellEdit) == 4, "cell edits are packed into four bytes");
+
+  /**
+   * @brief The history and future of edits to a crossword's letters, for Undo and Redo.
+   *
+   * An edit is the cell changes recorded between BeginEdit and EndEdit, and is undone or redone as
+   * one step. Every edit's changes sit in one contiguous buffer, indexed by where each edit ends.
+   * Changes to the same cell within an edit are merged and changes with no net effect are dropped.
+   * Consecutive edits of a single, same cell are coalesced into one, so retyping a cell takes one
+   * undo to get back to what it held before.
+   *
+   * Once more than a limit of changes is kept, the oldest edits are dropped: the grid as it was
+   * after them becomes the earliest state reachable by undoing.
+   *
+   */
+  class CrosswordHistory {
   public:
-    void Push(CrosswordAction *action);
+    void BeginEdit();
+
+    void Record(Coord coord, Atom old_value, Atom new_value);
+
+    void EndEdit();
+
+    bool Undo(Crossword &crossword);
 
-    bool Pop(Crossword &crossword);
+    bool Redo(Crossword &crossword);
 
-    bool Replace(Crossword &crossword);
+    void Clear();
 
-    [[nodiscard]] bool IsEmpty() const;
+    void SetLimit(std::size_t changes);
 
     /**
-     * @brief Get the current size of the stack.
+     * @brief True iff there is no edit to undo.
      *
-     * @return int
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsEmpty() const { return index_ == 0; }
+
+    /**
+     * @brief Edits that can be undone.
+     *
+     * @return std::size_t
      */
     [[nodiscard]] std::size_t GetSize() const { return index_; };
 
     /**
-     * @brief Construct a new Crossword Action Stack object
+     * @brief Cell changes kept, to undo and to redo.
      *
+     * @return std::size_t
      */
-    CrosswordActionStack() : index_(0) {};
+    [[nodiscard]] std::size_t GetChangeCount() const { return changes_.size(); }
+
+    CrosswordHistory() : index_(0), limit_(kHISTORY_MAX_CHANGES), is_editing_(false), edit_begin_(0),
+                         edit_positions_{} {};
 
   private:
     /**
-     * @brief Head index of stack.
+     * @brief Index of the first change of an edit.
+     *
+     * @param edit
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t EditBegin(const std::size_t edit) const { return edit == 0 ? 0 : edit_ends_[edit - 1]; }
+
+    void DropRedo();
+
+    void DropOldest();
+
+    /**
+     * @brief Every kept change, edit after edit.
+     *
+     */
+    std::vector<CellEdit> changes_;
+
+    /**
+     * @brief Index in changes_ one past the last change of each edit.
      *
-     * Equal to current number of elements in the stack, and points to one beyond the current final element.
-     * Initialized at zero.
+     */
+    std::vector<std::size_t> edit_ends_;
+
+    /**
+     * @brief Edits applied; those after it can be redone.
      *
      */
     std::size_t index_;
 
     /**
-     * @brief Underlying stack, implemented with a vector.
+     * @brief Changes kept at most, bar the latest edit.
+     *
+     */
+    std::size_t limit_;
+
+    /**
+     * @brief Between BeginEdit and EndEdit.
+     *
+     */
+    bool is_editing_;
+
+    /**
+     * @brief Index in changes_ of the first change of the open edit.
+     *
+     */
+    std::size_t edit_begin_;
+
+    /**
+     * @brief For each cell, one plus the offset of its change in the open edit, or 0 if it has none.
      *
      */
-    std::vector<std::unique_ptr<CrosswordAction>> stack_;
+    std::array<std::uint16_t, kMAX_DIM * kMAX_DIM> edit_positions_;
   };
 }
 
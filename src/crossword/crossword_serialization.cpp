@@ -11,6 +11,10 @@
 
 #include "crossword/crossword.hpp"
 
+#include <array>
+#include <cstring>
+#include <utility>
+
 using namespace crossword_backend;
 
 static std::string const &DELIM = ",";
@@ -40,50 +44,227 @@ std::vector<std::string> Crossword::Serialize() const {
   return vec;
 }
 
+/**
+ * @brief Parse a whole line as a grid dimension.
+ *
+ * @param line
+ * @param value output
+ * @return true
+ * @return false not a number in (2, kMAX_DIM]
+ */
+static bool ParseDimension(std::string const &line, int &value) {
+  if (line.empty() || line.size() > 3)
+    return false;
+  value = 0;
+  for (char c: line) {
+    if (c < '0' || c > '9')
+      return false;
+    value = value * 10 + (c - '0');
+  }
+  return value > 2 && value <= static_cast<int>(kMAX_DIM);
+}
+
 /**
  * @brief Unserialize from a vector of lines.
  *
- * @param lines
+ * The whole grid is parsed first and loaded in one pass, as by LoadGrid_.
+ *
+ * @param lines width, height, then one row per line: exactly width cells, each a letter A-Z, BARRIER or
+ * BLANK, optionally separated by DELIM
+ * @return true
+ * @return false the lines are malformed; the crossword is left unchanged
+ */
+bool Crossword::Unserialize(std::vector<std::string> &lines) {
+  int w;
+  int h;
+  if (lines.size() < 2 || !ParseDimension(lines[0], w) || !ParseDimension(lines[1], h) ||
+      lines.size() < 2 + static_cast<std::size_t>(h))
+    return false;
+
+  std::array<Cell, kMAX_DIM * kMAX_DIM> cells{};
+  for (int row = 0; row < h; row++) {
+    // Assume each atom is 1 character
+    int col = 0;
+    for (char val: lines[2 + row]) {
+      if (val == DELIM[0])
+        continue;
+      if (col == w)
+        return false;
+      Cell &cell = cells[row * w + col];
+      if (val == BARRIER[0])
+        cell.SetBarrier(true);
+      else if (val >= 'A' && val <= 'Z')
+        cell.SetContents(Atom(std::string(1, val)));
+      else if (val != BLANK[0])
+        return false;
+      col++;
+    }
+    if (col != w)
+      return false;
+  }
+
+  LoadGrid_(h, w, cells);
+  return true;
+}
+
+/**
+ * @brief Longest hint ReadPuzzle accepts, so that a corrupt length cannot exhaust memory.
+ *
+ */
+static const std::uint32_t kMAX_HINT_LENGTH = 1 << 16;
+
+/**
+ * @brief Bits that a cell byte of a binary puzzle may have set.
+ *
  */
-void Crossword::Unserialize(std::vector<std::string> &lines) {
-  // TODO: some kind of regex validation...
-  // For now, just throw exception if malformatted.
+static const std::uint8_t kPUZZLE_CELL_BITS = kCELL_CODE_MASK | kCELL_BARRIER_BIT | kCELL_LOCKED_BIT;
 
-  // Clear to get ready to load
+/**
+ * @brief Write an integer as four little-endian bytes.
+ *
+ * @param out
+ * @param value
+ */
+static void WriteUint32(std::ostream &out, const std::uint32_t value) {
+  const char bytes[4] = {static_cast<char>(value & 0xFF), static_cast<char>((value >> 8) & 0xFF),
+                         static_cast<char>((value >> 16) & 0xFF), static_cast<char>((value >> 24) & 0xFF)};
+  out.write(bytes, sizeof(bytes));
+}
+
+/**
+ * @brief Read an integer written by WriteUint32.
+ *
+ * @param in
+ * @param value output
+ * @return true
+ * @return false the stream ended
+ */
+static bool ReadUint32(std::istream &in, std::uint32_t &value) {
+  unsigned char bytes[4];
+  if (!in.read(reinterpret_cast<char *>(bytes), sizeof(bytes)))
+    return false;
+  value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<std::uint32_t>(bytes[3]) << 24);
+  return true;
+}
+
+/**
+ * @brief Write the puzzle in the binary format: dimensions, cells with their lock bits, and hints.
+ *
+ * The format is kPUZZLE_MAGIC, then one byte each of kPUZZLE_VERSION, height, width and zero; then a byte
+ * per cell in row-major order, holding the contents' code, kCELL_BARRIER_BIT and kCELL_LOCKED_BIT; then the
+ * number of non-empty hints, and for each its row, column and direction bytes, its length and its text.
+ * Lengths and counts are four little-endian bytes. Puzzles can be written back to back on one stream.
+ *
+ * @param out
+ * @return true
+ * @return false the stream failed
+ */
+bool Crossword::WritePuzzle(std::ostream &out) const {
+  const char header[8] = {kPUZZLE_MAGIC[0], kPUZZLE_MAGIC[1], kPUZZLE_MAGIC[2], kPUZZLE_MAGIC[3],
+                          static_cast<char>(kPUZZLE_VERSION), static_cast<char>(height_), static_cast<char>(width_), 0};
+  out.write(header, sizeof(header));
+  out.write(reinterpret_cast<char const *>(grid_.data()), static_cast<std::streamsize>(height_ * width_));
+
+  std::uint32_t hints = 0;
+  for (std::size_t r = 0; r < height_; r++) {
+    for (std::size_t c = 0; c < width_; c++)
+      hints += !clue_strings_[r][c][kACROSS].empty() + !clue_strings_[r][c][kDOWN].empty();
+  }
+  WriteUint32(out, hints);
   for (std::size_t r = 0; r < height_; r++) {
     for (std::size_t c = 0; c < width_; c++) {
-      SetBarrier(false, Coord(r, c), false);
+      for (WordDirection direction: {kACROSS, kDOWN}) {
+        std::string const &hint = clue_strings_[r][c][direction];
+        if (hint.empty())
+          continue;
+        assert(hint.size() <= kMAX_HINT_LENGTH);
+        const char position[3] = {static_cast<char>(r), static_cast<char>(c), static_cast<char>(direction)};
+        out.write(position, sizeof(position));
+        WriteUint32(out, static_cast<std::uint32_t>(hint.size()));
+        out.write(hint.data(), static_cast<std::streamsize>(hint.size()));
+      }
     }
   }
-  ClearAtoms();
+  return out.good();
+}
 
-  assert((int) lines.size() >= 2);
+/**
+ * @brief Read one puzzle written by WritePuzzle, replacing the grid, its hints and the undo history.
+ *
+ * Reads exactly the puzzle's bytes, so that the puzzles of a stream can be read one after another. The
+ * clue structure is built once, and nothing is recorded for undo.
+ *
+ * @param in
+ * @return true
+ * @return false the stream ended early or did not hold a valid puzzle; the crossword is left unchanged
+ */
+bool Crossword::ReadPuzzle(std::istream &in) {
+  unsigned char header[8];
+  if (!in.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+      std::memcmp(header, kPUZZLE_MAGIC, sizeof(kPUZZLE_MAGIC)) != 0 || header[4] != kPUZZLE_VERSION)
+    return false;
+  const std::size_t height = header[5];
+  const std::size_t width = header[6];
+  if (height <= 2 || width <= 2 || height > kMAX_DIM || width > kMAX_DIM)
+    return false;
 
-  int w = std::stoi(lines[0]);
-  int h = std::stoi(lines[1]);
+  std::array<std::uint8_t, kMAX_DIM * kMAX_DIM> bytes{};
+  if (!in.read(reinterpret_cast<char *>(bytes.data()), static_cast<std::streamsize>(height * width)))
+    return false;
+  for (std::size_t i = 0; i < height * width; i++) {
+    if ((bytes[i] & ~kPUZZLE_CELL_BITS) != 0 || (bytes[i] & kCELL_CODE_MASK) >= kATOM_COUNT)
+      return false;
+  }
 
-  SetDimensions(h, w);
+  std::uint32_t count;
+  if (!ReadUint32(in, count) || count > 2 * height * width)
+    return false;
+  std::vector<std::pair<std::array<unsigned char, 3>, std::string>> hints(count);
+  for (auto &hint: hints) {
+    std::uint32_t length;
+    if (!in.read(reinterpret_cast<char *>(hint.first.data()), 3) || hint.first[0] >= height ||
+        hint.first[1] >= width || hint.first[2] > kDOWN || !ReadUint32(in, length) || length > kMAX_HINT_LENGTH)
+      return false;
+    hint.second.resize(length);
+    if (!in.read(&hint.second[0], length))
+      return false;
+  }
 
-  assert((int) lines.size() >= 2 + h);
+  std::array<Cell, kMAX_DIM * kMAX_DIM> cells;
+  static_assert(sizeof(cells) == sizeof(bytes), "cells are stored as their packed bytes");
+  std::memcpy(cells.data(), bytes.data(), sizeof(cells));
+  LoadGrid_(height, width, cells);
+  for (auto &hint: hints)
+    clue_strings_[hint.first[0]][hint.first[1]][hint.first[2]] = std::move(hint.second);
+  return true;
+}
 
-  for (int i = 2; i < 2 + h; i++) {
-    // Assume each atom is 1 character
-    int col = 0;
-    int row = i - 2;
-    for (int k = 0; k < (int) lines[i].size(); k++) {
-      std::string const &val = lines[i].substr(k, 1);
-      Coord coord(row, col);
-      if (val == DELIM) {
-        // do nothing
-      } else if (val == BARRIER) {
-        SetBarrier(true, coord, false);
-        col++;
-      } else {
-        if (val != BLANK) {
-          Set(Atom(val), coord);
-        }
-        col++;
-      }
+/**
+ * @brief Replace the whole grid in a single pass: the clue structure is rebuilt once and the undo history
+ * and hints are cleared, as the history and hints of the previous grid no longer apply.
+ *
+ * @param height
+ * @param width
+ * @param cells row-major with a stride of width; the rest empty
+ */
+void Crossword::LoadGrid_(const std::size_t height, const std::size_t width,
+                          std::array<Cell, kMAX_DIM * kMAX_DIM> const &cells) {
+  assert(height > 2 && width > 2 && height <= kMAX_DIM && width <= kMAX_DIM);
+  assert(search_state_ == nullptr);
+
+  DirtyClueStructure();
+  grid_ = cells;
+  height_ = height;
+  width_ = width;
+  fill_hash_ = ComputeFillHash_();
+  BumpGridVersion_();
+  for (auto &row: clue_strings_) {
+    for (auto &hints: row) {
+      hints[kACROSS].clear();
+      hints[kDOWN].clear();
     }
   }
-}
\ No newline at end of file
+  history_.Clear();
+
+  PopulateClueStructure();
+}
@@ -10,8 +10,12 @@
  */
 
 #include "crossword/database.hpp"
+#include "crossword/tracing.hpp"
 
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <numeric>
 #include <random>
 #include <thread>
 #include <sstream>
@@ -37,10 +41,70 @@ static const std::array<const double, kATOM_COUNT> ATOM_SCORES = {
         0.009132871887421193, 0.014259541096753555, 0.002845289711797423,
         0.017204776957966794, 0.002612639143257596};
 
+/**
+ * @brief Snapshot pinned for this thread by the innermost live DictionaryPin, or nullptr.
+ *
+ */
+static thread_local DictionarySnapshot const *pinned_snapshot = nullptr;
+
+/**
+ * @brief The snapshot pinned for the calling thread, or nullptr.
+ *
+ * @return DictionarySnapshot const*
+ */
+DictionarySnapshot const *DictionaryPin::Current() {
+  return pinned_snapshot;
+}
+
+/**
+ * @brief Pin a snapshot for the calling thread.
+ *
+ * @param snapshot must outlive the pin; nullptr to read the latest versions again
+ */
+DictionaryPin::DictionaryPin(DictionarySnapshot const *snapshot) : previous_(pinned_snapshot) {
+  pinned_snapshot = snapshot;
+}
+
+/**
+ * @brief Restore the snapshot pinned before this one. Pins must be destroyed on the thread that made them.
+ *
+ */
+DictionaryPin::~DictionaryPin() {
+  pinned_snapshot = previous_;
+}
+
+/**
+ * @brief Version queries on the calling thread should read.
+ *
+ * The pinned snapshot's, if it was taken of this sub-database's owner; the latest otherwise.
+ *
+ * @param hold receives the latest version if the thread has none pinned, so that it stays alive
+ * @return DictionaryVersion const&
+ */
+DictionaryVersion const &FixedSizeWordDatabase::View_(std::shared_ptr<DictionaryVersion const> &hold) const {
+  DictionarySnapshot const *pinned = DictionaryPin::Current();
+  if (pinned != nullptr) {
+    DictionaryVersion const *version = pinned->GetVersion(size_).get();
+    if (version != nullptr && version->owner == this)
+      return *version;
+  }
+  hold = std::atomic_load(&current_);
+  return *hold;
+}
+
+/**
+ * @brief Latest published version.
+ *
+ * @return std::shared_ptr<DictionaryVersion const>
+ */
+std::shared_ptr<DictionaryVersion const> FixedSizeWordDatabase::GetVersion() const {
+  return std::atomic_load(&current_);
+}
+
 /**
  * @brief Return true if the clue (partially filled) exists in the database, with score greater or equal to score_min.
  *
- * TODO: this code is incorrect as we ignore the score_min parameter; needs to hit the map
+ * Results are cached per (partial word, score_min).
  *
  * @param clue
  * @param score_min
@@ -48,21 +112,180 @@ static const std::array<const double, kATOM_COUNT> ATOM_SCORES = {
  * @return false
  */
 bool FixedSizeWordDatabase::HasSolution(Clue const &clue, const int score_min) {
-  Word const &clue_partial = clue.ToWord();
-  int count = partial_word_cache_.count(clue_partial);
-  if (count == 1) {
-    return partial_word_cache_[clue_partial];
+  std::shared_ptr<DictionaryVersion const> hold;
+  DictionaryVersion const &version = View_(hold);
+  const ScoredPattern key{clue.ToWord(), score_min};
+  VersionedResult<bool> cached;
+  // Results computed on later versions may not hold for a version pinned before them.
+  if (partial_word_cache_.Find(key, cached) && cached.version <= version.number) {
+    CROSSWORD_TRACE(kTRACE_CACHE, TraceEventType::CacheHit, kTRACE_EXISTENCE_CACHE, 0);
+    return cached.value;
   }
+  CROSSWORD_TRACE(kTRACE_CACHE, TraceEventType::CacheMiss, kTRACE_EXISTENCE_CACHE, 0);
+
+  const bool contains_word = Contains_(version, key.partial, score_min);
+  partial_word_cache_.InsertIf(key, VersionedResult<bool>(contains_word, version.number),
+                               [this, &version]() { return IsCacheable_(version); });
+  if (query_log_ != nullptr)
+    query_log_->Record(key);
+  return contains_word;
+}
 
-  //Enter trie instead?
-  bool trie_contains_word = trie_.Contains(clue_partial);
-  if (trie_contains_word) {
-    partial_word_cache_.insert(clue_partial, true);
+/**
+ * @brief True iff an entry of a version with score at least score_min fits a partial word. Uncached.
+ *
+ * With nothing hidden the indices answer directly; otherwise a cursor steps over the hidden entries.
+ *
+ * @param version
+ * @param partial
+ * @param score_min
+ * @return true
+ * @return false
+ */
+bool FixedSizeWordDatabase::Contains_(DictionaryVersion const &version, Word const &partial,
+                                      const int score_min) const {
+  if (!version.hidden.empty()) {
+    Word word;
+    return SolutionCursor(nullptr, version, partial, score_min).Next(word);
+  }
+  CompiledWords const &base = *version.base;
+  if (backend_.load(std::memory_order_relaxed) == MatcherBackend::Bitset
+      ? base.bitset_index.Contains(partial, score_min) : base.trie.Contains(partial, score_min))
     return true;
-  } else {
-    partial_word_cache_.insert(clue_partial, false);
+  return version.added_trie.Contains(partial, score_min);
+}
+
+/**
+ * @brief Start a resumable query for the entries with score greater or equal to score_min that fit a partial word.
+ *
+ * @param partial
+ * @param score_min
+ * @return SolutionCursor
+ */
+SolutionCursor FixedSizeWordDatabase::OpenCursor(Word const &partial, const int score_min) const {
+  if (query_log_ != nullptr)
+    query_log_->Record(ScoredPattern{partial, score_min});
+  std::shared_ptr<DictionaryVersion const> hold;
+  DictionaryVersion const &version = View_(hold);
+  return SolutionCursor(std::move(hold), version, partial, score_min);
+}
+
+/**
+ * @brief Open a cursor over a version's base and rank the fitting added entries.
+ *
+ * @param hold owns version, or empty if something else keeps it alive
+ * @param version
+ * @param partial
+ * @param score_min
+ */
+SolutionCursor::SolutionCursor(std::shared_ptr<DictionaryVersion const> hold, DictionaryVersion const &version,
+                               Word const &partial, const int score_min)
+        : hold_(std::move(hold)), version_(&version), base_cursor_(version.base->bitset_index, partial, score_min),
+          pending_(0), has_pending_(false), added_next_(0) {
+  if (version.added.empty())
+    return;
+  version.added_trie.Find(partial, score_min, added_);
+  const auto base_size = static_cast<std::uint32_t>(version.base->entries.size());
+  for (auto &index: added_)
+    index += base_size;
+  std::stable_sort(added_.begin(), added_.end(), [&version](std::uint32_t a, std::uint32_t b) {
+    return version.Entry(a).RanksBefore(version.Entry(b));
+  });
+}
+
+/**
+ * @brief Advance to the next word, skipping hidden entries.
+ *
+ * @param word output
+ * @return true
+ * @return false there are no more
+ */
+bool SolutionCursor::Next(Word &word) {
+  std::uint32_t index;
+  if (!NextIndex(index))
     return false;
+  word = version_->Entry(index).entry;
+  return true;
+}
+
+/**
+ * @brief Advance to the index of the next entry in the cursor's version, skipping hidden entries.
+ *
+ * Merges base and added entries as Find_ does: an added entry goes first only if it ranks strictly before.
+ *
+ * @param index output
+ * @return true
+ * @return false there are no more
+ */
+bool SolutionCursor::NextIndex(std::uint32_t &index) {
+  if (version_ == nullptr)
+    return false;
+  while (true) {
+    if (!has_pending_)
+      has_pending_ = base_cursor_.Next(pending_);
+    if (added_next_ < added_.size() &&
+        (!has_pending_ || version_->Entry(added_[added_next_]).RanksBefore(version_->Entry(pending_)))) {
+      index = added_[added_next_++];
+    } else if (has_pending_) {
+      index = pending_;
+      has_pending_ = false;
+    } else {
+      return false;
+    }
+    if (!version_->IsHidden(index))
+      return true;
+  }
+}
+
+/**
+ * @brief Number of entries with score greater or equal to score_min that fit a partial word.
+ *
+ * Results are cached per (partial word, score_min).
+ *
+ * @param partial
+ * @param score_min
+ * @return std::size_t
+ */
+std::size_t FixedSizeWordDatabase::CountSolutions(Word const &partial, const int score_min) {
+  std::shared_ptr<DictionaryVersion const> hold;
+  DictionaryVersion const &version = View_(hold);
+  const ScoredPattern key{partial, score_min};
+  VersionedResult<std::size_t> cached;
+  if (count_cache_.Find(key, cached) && cached.version <= version.number) {
+    CROSSWORD_TRACE(kTRACE_CACHE, TraceEventType::CacheHit, kTRACE_COUNT_CACHE, 0);
+    return cached.value;
   }
+  CROSSWORD_TRACE(kTRACE_CACHE, TraceEventType::CacheMiss, kTRACE_COUNT_CACHE, 0);
+
+  const std::size_t count = Count_(version, partial, score_min);
+  count_cache_.InsertIf(key, VersionedResult<std::size_t>(count, version.number),
+                        [this, &version]() { return IsCacheable_(version); });
+  if (query_log_ != nullptr)
+    query_log_->Record(key);
+  return count;
+}
+
+/**
+ * @brief Number of entries of a version with score at least score_min that fit a partial word. Uncached.
+ *
+ * @param version
+ * @param partial
+ * @param score_min
+ * @return std::size_t
+ */
+std::size_t FixedSizeWordDatabase::Count_(DictionaryVersion const &version, Word const &partial,
+                                          const int score_min) const {
+  CompiledWords const &base = *version.base;
+  const MatcherBackend backend = backend_.load(std::memory_order_relaxed);
+  std::size_t count = backend == MatcherBackend::Bitset ? base.bitset_index.Count(partial, score_min)
+                                                        : base.trie.Count(partial, score_min);
+  count += version.added_trie.Count(partial, score_min);
+  for (auto const index: version.hidden) {
+    DatabaseEntry const &entry = version.Entry(index);
+    if (entry.frequency_score >= score_min && entry.entry.Matches(partial))
+      count--;
+  }
+  return count;
 }
 
 /**
@@ -77,45 +300,19 @@ bool FixedSizeWordDatabase::HasSolution(Clue const &clue, const int score_min) {
  */
 int WordDatabase::GetLetterScore(Word const &word) const {
   double score = 0;
-  std::vector<Atom> unique;
-  for (auto const &atom: word.atoms_) {
+  std::uint32_t unique = 0; // Bit c is set iff atom code c occurs in the word.
+  for (std::size_t i = 0; i < word.size(); ++i) {
+    const Atom atom = word[i];
     score += ATOM_SCORES[atom.GetCode()] * 1000.;
-    bool flag = true;
-    for (auto const &found: unique) {
-      if (found == atom) {
-        flag = false;
-        break;
-      }
-    }
-    if (flag)
-      unique.push_back(atom);
+    unique |= 1u << atom.GetCode();
   }
-  score *= unique.size();
+  score *= PopCount(unique);
   return static_cast<int>(score);
 }
 
-/**
- * @brief Add a new entry to the sub-database.
- *
- * TODO: weighted average of score and letter score?
- * TODO: should we add some partials ...?
- *
- * @param entry
- * @param score
- */
-void FixedSizeWordDatabase::AddEntry(Word const &entry, const int frequency_score, const int letter_score) {
-  assert(entry.size() == size_);
-  auto db_entry = DatabaseEntry(entry, frequency_score, letter_score);
-  entries_.push_back(db_entry);
-  word_set_[entry] = frequency_score;
-  trie_.Insert(db_entry.entry);
-}
-
 /**
  * @brief Reverse search the database for a word.
  *
- * Fast, because it checks a set.
- *
  * @param word
  * @return true contains word
  * @return false does not contain word
@@ -125,37 +322,46 @@ bool WordDatabase::ContainsEntry(Word const &word) const {
 }
 
 /**
- * @brief Reverse search the database for a word.
+ * @brief Reverse search the sub-database for a word.
  *
- * Fast because it uses a map.
+ * Walks one path of each compiled trie.
  *
  * @param word
  * @return true
  * @return false
  */
 bool FixedSizeWordDatabase::ContainsEntry(Word const &word) const {
-  return word_set_.find(word) != word_set_.end();
+  std::shared_ptr<DictionaryVersion const> hold;
+  return View_(hold).IndexOf(word) != kNO_ENTRY;
 }
 
 /**
- * @brief
+ * @brief Get the frequency score for a word in the database.
  *
- * @param entry
- * @param score
+ * @param word
+ * @return int
  */
-void WordDatabase::AddEntry(Word const &entry, const int frequency_score, const int letter_score) {
-  databases_[entry.size()].AddEntry(entry, frequency_score, letter_score);
+int FixedSizeWordDatabase::GetFrequencyScore(Word const &word) const {
+  std::shared_ptr<DictionaryVersion const> hold;
+  DictionaryVersion const &version = View_(hold);
+  const std::uint32_t index = version.IndexOf(word);
+  assert(index != kNO_ENTRY);
+  return version.Entry(index).frequency_score;
 }
 
 /**
- * @brief Get the frequency score for a word in the database.
+ * @brief Get the frequency score for a word, if it is in the sub-database.
+ *
+ * One lookup for what ContainsEntry and GetFrequencyScore would find with two.
  *
  * @param word
- * @return int
+ * @return int kNO_NUMBER if the word is absent
  */
-int FixedSizeWordDatabase::GetFrequencyScore(Word const &word) const {
-  assert(ContainsEntry(word));
-  return word_set_.find(word)->second;
+int FixedSizeWordDatabase::FindFrequencyScore(Word const &word) const {
+  std::shared_ptr<DictionaryVersion const> hold;
+  DictionaryVersion const &version = View_(hold);
+  const std::uint32_t index = version.IndexOf(word);
+  return index == kNO_ENTRY ? kNO_NUMBER : version.Entry(index).frequency_score;
 }
 
 /**
@@ -168,6 +374,16 @@ int WordDatabase::GetFrequencyScore(Word const &word) const {
   return databases_[word.size()].GetFrequencyScore(word);
 }
 
+/**
+ * @brief Get the frequency score for a word, if it is in the database.
+ *
+ * @param word
+ * @return int kNO_NUMBER if the word is absent
+ */
+int WordDatabase::FindFrequencyScore(Word const &word) const {
+  return databases_[word.size()].FindFrequencyScore(word);
+}
+
 /**
  * @brief Returns true iff one or more solutions to the clue exist in the database, with score greater than or equal to score_min.
  *
@@ -180,20 +396,45 @@ bool WordDatabase::HasSolution(Clue const &clue, const int score_min) {
 }
 
 /**
- * @brief Normalize word frequency scores to [1, 100].
+ * @brief Start a resumable query for the words fitting a partial word, with score greater than or equal to score_min.
+ *
+ * @param partial
+ * @param score_min
+ * @return SolutionCursor
+ */
+SolutionCursor WordDatabase::OpenCursor(Word const &partial, const int score_min) const {
+  return databases_[partial.size()].OpenCursor(partial, score_min);
+}
+
+/**
+ * @brief Returns the number of words fitting a partial word, with score greater than or equal to score_min.
+ *
+ * @param partial
+ * @param score_min
+ * @return std::size_t
+ */
+std::size_t WordDatabase::CountSolutions(Word const &partial, const int score_min) {
+  return databases_[partial.size()].CountSolutions(partial, score_min);
+}
+
+/**
+ * @brief Normalize the raw frequency scores of a batch of entries to [1, 100].
+ *
+ * Only the batch's own distribution is used, so entries already in the database keep their scores.
  *
  * TODO: Fix to make distribution better.
  *
+ * @param batch
  */
-void FixedSizeWordDatabase::NormalizeFrequencyScores() {
-  if (entries_.empty())
+void FixedSizeWordDatabase::NormalizeFrequencyScores(std::vector<DatabaseEntry> &batch) {
+  if (batch.empty())
     return;
 
   double total_raw = 0;
   int max_raw = 0;
-  double N = static_cast<double>(entries_.size());
+  double N = static_cast<double>(batch.size());
   Word max_word = Word();
-  for (auto it = std::begin(entries_); it != std::end(entries_); ++it) {
+  for (auto it = std::begin(batch); it != std::end(batch); ++it) {
     total_raw += it->frequency_score;
     if (max_raw < it->frequency_score)
       max_word = it->entry;
@@ -202,7 +443,7 @@ void FixedSizeWordDatabase::NormalizeFrequencyScores() {
   double mean = total_raw / N;
 
   double total_sq_dev = 0;
-  for (auto it = std::begin(entries_); it != std::end(entries_); ++it) {
+  for (auto it = std::begin(batch); it != std::end(batch); ++it) {
     double sq_dev = std::pow(static_cast<double>(it->frequency_score) - mean, 2);
     total_sq_dev += sq_dev;
   }
@@ -216,7 +457,7 @@ void FixedSizeWordDatabase::NormalizeFrequencyScores() {
   double max_sigma = 1;
   double min_sigma = 2; // divide by more to make the left side of the distribution closer to avg.
 
-  for (auto it = std::begin(entries_); it != std::end(entries_); ++it) {
+  for (auto it = std::begin(batch); it != std::end(batch); ++it) {
     double sigma = (static_cast<double>(it->frequency_score) - mean) / sd;
     if (sigma > 0)
       sigma = sigma / max_sigma;
@@ -233,24 +474,24 @@ void FixedSizeWordDatabase::NormalizeFrequencyScores() {
     new_score = std::min(100., std::max(1., new_score));
 
     it->frequency_score = static_cast<int>(new_score);
-    word_set_[it->entry] = it->frequency_score;
   }
 }
 
 /**
- * @brief Get solutions for a given clue.
+ * @brief Get solutions for a given clue, best ranked first: by frequency score, ties going to the higher
+ * letter score.
  *
  * @param clue
- * @param limit
+ * @param limit most solutions returned; kNO_NUMBER for all
  * @param score_min
  * @return std::vector<Word>
  */
-std::vector<Word> WordDatabase::GetSolutions(Clue const &clue, const int limit, const int score_min) const {
+std::vector<Word> WordDatabase::GetSolutions(Clue const &clue, const int limit, const int score_min) {
   return databases_[clue.GetSize()].GetSolutions(clue, limit, score_min);
 }
 
 /**
- * @brief Get solutions for a given clue, for a sub-database.
+ * @brief Get solutions for a given clue, for a sub-database, best ranked first.
  *
  * #1 hotspot for 5x5 puzzle.
  *
@@ -260,21 +501,78 @@ std::vector<Word> WordDatabase::GetSolutions(Clue const &clue, const int limit,
  *
  *
  * @param clue
- * @param limit
+ * @param limit most solutions returned, the best ranked; kNO_NUMBER for all
  * @param score_min
  * @return std::vector<DatabaseEntry>
  */
 std::vector<Word>
-FixedSizeWordDatabase::GetSolutions(Clue const &clue, const int limit, const int score_min) const {
-  const Word clue_partial = clue.ToWord();
-  std::vector<Word> all_solutions = trie_.Find(clue_partial);
-  std::vector<Word> passing_solutions{}; //TODO: optimize; this method is still kinda chunky
+FixedSizeWordDatabase::GetSolutions(Clue const &clue, const int limit, const int score_min) {
+  std::shared_ptr<DictionaryVersion const> hold;
+  DictionaryVersion const &version = View_(hold);
+  const ScoredPattern key{clue.ToWord(), score_min};
+  VersionedResult<std::vector<std::uint32_t>> cached;
+  if (solution_cache_.Find(key, cached) && cached.version <= version.number) {
+    CROSSWORD_TRACE(kTRACE_CACHE, TraceEventType::CacheHit, kTRACE_SOLUTION_CACHE, 0);
+  } else {
+    CROSSWORD_TRACE(kTRACE_CACHE, TraceEventType::CacheMiss, kTRACE_SOLUTION_CACHE, 0);
+    cached = VersionedResult<std::vector<std::uint32_t>>(std::vector<std::uint32_t>(), version.number);
+    Find_(version, key.partial, score_min, cached.value);
+    solution_cache_.InsertIf(key, cached, [this, &version]() { return IsCacheable_(version); });
+    if (query_log_ != nullptr)
+      query_log_->Record(key);
+  }
 
-  for (auto const &solution_word : all_solutions) {
-    if (GetFrequencyScore(solution_word) >= score_min) passing_solutions.push_back(solution_word);
+  std::size_t count = cached.value.size();
+  if (limit != kNO_NUMBER)
+    count = std::min(count, static_cast<std::size_t>(limit));
+  std::vector<Word> solutions;
+  solutions.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    solutions.push_back(version.Entry(cached.value[i]).entry);
   }
+  return solutions;
+}
 
-  return passing_solutions;
+/**
+ * @brief Indices of the entries of a version with score at least score_min that fit a partial word. Uncached.
+ *
+ * Best ranked first, entries added since the base was compiled going after base entries of equal rank.
+ * Base indices are ranks already, so the trie's alphabetical matches only need sorting, and the few added
+ * matches are ranked and merged in.
+ *
+ * @param version
+ * @param partial
+ * @param score_min
+ * @param indices output, appended to
+ */
+void FixedSizeWordDatabase::Find_(DictionaryVersion const &version, Word const &partial, const int score_min,
+                                  std::vector<std::uint32_t> &indices) const {
+  CompiledWords const &base = *version.base;
+  const std::size_t begin = indices.size();
+  if (backend_.load(std::memory_order_relaxed) == MatcherBackend::Bitset) {
+    base.bitset_index.Find(partial, score_min, indices); // Already ordered best first.
+  } else {
+    base.trie.Find(partial, score_min, indices); // The trie prunes subtrees below score_min.
+    std::sort(indices.begin() + static_cast<std::ptrdiff_t>(begin), indices.end());
+  }
+  if (!version.added.empty()) {
+    const std::size_t middle = indices.size();
+    version.added_trie.Find(partial, score_min, indices);
+    const auto base_size = static_cast<std::uint32_t>(base.entries.size());
+    for (std::size_t i = middle; i < indices.size(); ++i)
+      indices[i] += base_size;
+    auto ranks_before = [&version](std::uint32_t a, std::uint32_t b) {
+      return version.Entry(a).RanksBefore(version.Entry(b));
+    };
+    std::stable_sort(indices.begin() + static_cast<std::ptrdiff_t>(middle), indices.end(), ranks_before);
+    std::inplace_merge(indices.begin() + static_cast<std::ptrdiff_t>(begin),
+                       indices.begin() + static_cast<std::ptrdiff_t>(middle), indices.end(), ranks_before);
+  }
+  if (!version.hidden.empty()) {
+    indices.erase(std::remove_if(indices.begin(), indices.end(),
+                                 [&version](std::uint32_t index) { return version.IsHidden(index); }),
+                  indices.end());
+  }
 }
 
 /**
@@ -282,7 +580,8 @@ FixedSizeWordDatabase::GetSolutions(Clue const &clue, const int limit, const int
  *
  */
 void WordDatabase::WaitForLock() {
-  const std::lock_guard<std::mutex> lock(db_lock_);
+  std::unique_lock<std::mutex> lock(db_lock_);
+  loads_done_.wait(lock, [this] { return pending_loads_ == 0; });
 }
 
 /**
@@ -290,12 +589,47 @@ void WordDatabase::WaitForLock() {
  *
  */
 void FixedSizeWordDatabase::FlushPartialCache() {
-  partial_word_cache_.clear();
+  partial_word_cache_.Clear();
+  solution_cache_.Clear();
+  count_cache_.Clear();
+}
+
+/**
+ * @brief Resize the query caches. Clears them.
+ *
+ * @param existence_capacity number of HasSolution results kept, and likewise of CountSolutions results
+ * @param solution_capacity number of GetSolutions results kept
+ */
+void FixedSizeWordDatabase::SetCacheCapacity(const std::size_t existence_capacity,
+                                             const std::size_t solution_capacity) {
+  partial_word_cache_.SetCapacity(existence_capacity);
+  count_cache_.SetCapacity(existence_capacity);
+  solution_cache_.SetCapacity(solution_capacity);
+}
+
+/**
+ * @brief Counters of the HasSolution cache.
+ *
+ * @return CacheStatistics
+ */
+CacheStatistics FixedSizeWordDatabase::GetExistenceCacheStatistics() const {
+  return partial_word_cache_.GetStatistics();
+}
+
+/**
+ * @brief Counters of the GetSolutions cache.
+ *
+ * @return CacheStatistics
+ */
+CacheStatistics FixedSizeWordDatabase::GetSolutionCacheStatistics() const {
+  return solution_cache_.GetStatistics();
 }
 
 /**
  * @brief Flush all partial word caches.
  *
+ * Only needed for benchmarking: every write drops the cached results it makes stale.
+ *
  */
 void WordDatabase::FlushCaches() {
   const std::lock_guard<std::mutex> lock(db_lock_);
@@ -304,67 +638,375 @@ void WordDatabase::FlushCaches() {
   }
 }
 
+/**
+ * @brief Record every query that misses the caches of any sub-database into log, or stop recording with nullptr.
+ *
+ * Not to be called while queries are running.
+ *
+ * @param log must outlive the recording
+ */
+void WordDatabase::SetQueryLog(QueryLog *log) {
+  const std::lock_guard<std::mutex> lock(db_lock_);
+  for (std::size_t i = 0; i < kMAX_DIM; ++i) {
+    databases_[i].SetQueryLog(log);
+  }
+}
+
+/**
+ * @brief Resize the query caches of every sub-database. Clears them.
+ *
+ * @param existence_capacity number of HasSolution results kept per word length
+ * @param solution_capacity number of GetSolutions results kept per word length
+ */
+void WordDatabase::SetCacheCapacity(const std::size_t existence_capacity, const std::size_t solution_capacity) {
+  const std::lock_guard<std::mutex> lock(db_lock_);
+  for (std::size_t i = 0; i < kMAX_DIM; ++i) {
+    databases_[i].SetCacheCapacity(existence_capacity, solution_capacity);
+  }
+}
+
+/**
+ * @brief Counters of the HasSolution caches, summed over word lengths.
+ *
+ * @return CacheStatistics
+ */
+CacheStatistics WordDatabase::GetExistenceCacheStatistics() {
+  const std::lock_guard<std::mutex> lock(db_lock_);
+  CacheStatistics total;
+  for (std::size_t i = 0; i < kMAX_DIM; ++i) {
+    total += databases_[i].GetExistenceCacheStatistics();
+  }
+  return total;
+}
+
+/**
+ * @brief Counters of the GetSolutions caches, summed over word lengths.
+ *
+ * @return CacheStatistics
+ */
+CacheStatistics WordDatabase::GetSolutionCacheStatistics() {
+  const std::lock_guard<std::mutex> lock(db_lock_);
+  CacheStatistics total;
+  for (std::size_t i = 0; i < kMAX_DIM; ++i) {
+    total += databases_[i].GetSolutionCacheStatistics();
+  }
+  return total;
+}
+
+/**
+ * @brief Choose the index used by every sub-database to answer wildcard queries.
+ *
+ * Both indices are always built, so this can be changed at any time, even while queries run.
+ *
+ * @param backend
+ */
+void WordDatabase::SetMatcherBackend(const MatcherBackend backend) {
+  const std::lock_guard<std::mutex> lock(db_lock_);
+  for (std::size_t i = 0; i < kMAX_DIM; ++i) {
+    databases_[i].SetMatcherBackend(backend);
+  }
+}
+
+/**
+ * @brief Entries parsed by one loader thread, bucketed by word length.
+ *
+ */
+using LoadBatch = std::array<std::vector<DatabaseEntry>, kMAX_DIM>;
+
+/**
+ * @brief Bytes a loader thread parses between progress reports.
+ *
+ */
+static constexpr std::size_t kLOAD_PROGRESS_STRIDE = 1 << 18;
+
+/**
+ * @brief Smallest share of a file worth giving its own loader thread.
+ *
+ */
+static constexpr std::size_t kMIN_BYTES_PER_LOADER = 1 << 16;
+
+/**
+ * @brief Progress of one LoadFromFile call, shared by its threads.
+ *
+ * Parsing accounts for the first half of the progress and building the per-length tables for the
+ * second. Reports are serialized, at least a percent apart, and never go backwards.
+ *
+ */
+class LoadProgress {
+public:
+  /**
+   * @brief Record bytes parsed by some thread.
+   *
+   * @param bytes
+   */
+  void AddParsed(const std::size_t bytes) {
+    const std::size_t parsed = parsed_ += bytes;
+    Report(0.5 * static_cast<double>(parsed) / static_cast<double>(std::max<std::size_t>(total_bytes_, 1)));
+  }
+
+  /**
+   * @brief Record entries added to the per-length tables. Only valid once parsing is done.
+   *
+   * @param entries
+   */
+  void AddBuilt(const std::size_t entries) {
+    const std::size_t built = built_ += entries;
+    Report(0.5 + 0.5 * static_cast<double>(built) / static_cast<double>(std::max<std::size_t>(total_entries_, 1)));
+  }
+
+  /**
+   * @brief Set the number of entries to be built, once parsing is done.
+   *
+   * @param entries
+   */
+  void SetTotalEntries(const std::size_t entries) { total_entries_ = entries; }
+
+  LoadProgress(LoadProgressCallback const &callback, const std::size_t total_bytes)
+          : callback_(callback), total_bytes_(total_bytes), total_entries_(0), parsed_(0), built_(0),
+            reported_(-1) {};
+
+private:
+  /**
+   * @brief Pass a fraction to the callback if it is an improvement.
+   *
+   * @param fraction
+   */
+  void Report(double fraction) {
+    if (!callback_)
+      return;
+    const std::lock_guard<std::mutex> lock(mutex_);
+    fraction = std::min(1., fraction);
+    if (fraction < 1. ? fraction < reported_ + 0.01 : reported_ == 1.)
+      return; // Only whole-percent steps, and completion once.
+    reported_ = fraction;
+    callback_(fraction);
+  }
+
+  /**
+   * @brief Receives the reports; may be empty.
+   *
+   */
+  LoadProgressCallback const &callback_;
+
+  /**
+   * @brief Size of the file being parsed.
+   *
+   */
+  const std::size_t total_bytes_;
+
+  /**
+   * @brief Number of entries parsed, known once parsing is done.
+   *
+   */
+  std::size_t total_entries_;
+
+  /**
+   * @brief Bytes parsed so far, over all threads.
+   *
+   */
+  std::atomic<std::size_t> parsed_;
+
+  /**
+   * @brief Entries added to tables so far, over all threads.
+   *
+   */
+  std::atomic<std::size_t> built_;
+
+  /**
+   * @brief Last fraction passed to the callback.
+   *
+   */
+  double reported_;
+
+  /**
+   * @brief Serializes calls to the callback.
+   *
+   */
+  std::mutex mutex_;
+};
+
+/**
+ * @brief Parse one "WORD SCORE" line into its length's bucket.
+ *
+ * Lowercase letters are accepted; lines with other characters in the word,
+ * no score, or a word too long for a grid are skipped.
+ *
+ * @param db used for letter scores
+ * @param line
+ * @param line_end
+ * @param batch
+ */
+static void ParseLine(WordDatabase const &db, char const *line, char const *line_end, LoadBatch &batch) {
+  char const *space = static_cast<char const *>(std::memchr(line, ' ', static_cast<std::size_t>(line_end - line)));
+  if (space == nullptr || space == line || static_cast<std::size_t>(space - line) >= kMAX_DIM)
+    return;
+
+  Word word;
+  for (char const *c = line; c != space; ++c) {
+    const char upper = (*c >= 'a' && *c <= 'z') ? static_cast<char>(*c - 'a' + 'A') : *c;
+    if (upper < 'A' || upper > 'Z')
+      return;
+    word.push_back(Atom::FromCode(static_cast<unsigned char>(upper - 'A' + 1)));
+  }
+
+  char const *score_begin = space;
+  while (score_begin != line_end && *score_begin == ' ')
+    score_begin++;
+  int score;
+  if (std::from_chars(score_begin, line_end, score).ec != std::errc())
+    return;
+
+  batch[word.size()].emplace_back(word, score, db.GetLetterScore(word));
+}
+
+/**
+ * @brief Parse every line in [begin, end), which must start at a line boundary.
+ *
+ * @param db
+ * @param begin
+ * @param end
+ * @param batch
+ * @param progress
+ */
+static void ParseRange(WordDatabase const &db, char const *begin, char const *end, LoadBatch &batch,
+                       LoadProgress &progress) {
+  char const *reported = begin;
+  char const *line = begin;
+  while (line < end) {
+    char const *line_end = static_cast<char const *>(std::memchr(line, '\n', static_cast<std::size_t>(end - line)));
+    if (line_end == nullptr)
+      line_end = end;
+    ParseLine(db, line, line_end, batch);
+    line = line_end + 1;
+    if (static_cast<std::size_t>(line - reported) >= kLOAD_PROGRESS_STRIDE) {
+      progress.AddParsed(static_cast<std::size_t>(line - reported));
+      reported = line;
+    }
+  }
+  progress.AddParsed(static_cast<std::size_t>(std::min(line, end) - reported));
+}
+
 /**
  * @brief Load thread function
  *
  * @param db
  * @param filename
+ * @param progress
  */
-void WordDatabase::LoadThread(WordDatabase *db, std::string const filename) {
+void WordDatabase::LoadThread(WordDatabase *db, std::string const filename, LoadProgressCallback const progress) {
+  const bool loaded = db->LoadFromFile(filename, progress);
   const std::lock_guard<std::mutex> lock(db->db_lock_);
-  db->LoadFromFile(filename);
+  db->pending_loads_--;
+  if (loaded && db->pending_loads_ == 0)
+    db->is_finished_loading_ = true;
+  // Notify under the lock: a waiter may destroy the database as soon as it can reacquire it.
+  db->loads_done_.notify_all();
 }
 
 /**
  * @brief Load entries in a new std::thread which we detach.
  *
+ * WaitForLock blocks until every deferred load has finished.
+ *
+ * @param filename
+ * @param progress
  */
-void WordDatabase::LoadDeferred(std::string const &filename) {
-  is_finished_loading_ = false;
-  std::thread loader(LoadThread, this, filename);
+void WordDatabase::LoadDeferred(std::string const &filename, LoadProgressCallback progress) {
+  {
+    const std::lock_guard<std::mutex> lock(db_lock_);
+    pending_loads_++;
+    is_finished_loading_ = false;
+  }
+  std::thread loader(LoadThread, this, filename, std::move(progress));
   loader.detach();
 }
 
 /**
- * @brief Load entries from file to the database.
+ * @brief Load entries from a CSV file of "WORD SCORE" lines, adding them to the database.
  *
- * TODO: error checking.
+ * The file is split into byte ranges at line boundaries, which are parsed on separate threads.
+ * Then the per-length tables are built in parallel: each length's new entries are normalized as
+ * one batch, appended, and compiled. db_lock_ is only held for that second step.
  *
  * @param filename
+ * @param progress optional; called as the load advances
+ * @return true
+ * @return false the file could not be read
  */
-void WordDatabase::LoadFromFile(std::string const &filename) {
-  std::string line;
-  std::ifstream db(filename);
-  if (db.is_open()) {
-    while (std::getline(db, line)) {
-      for (std::size_t i = 0; i < line.size(); i++) {
-        if (line.at(i) == ' ') {
-          std::size_t size = i;
-          std::string word = line.substr(0, i);
-          int score = std::stoi(line.substr(i + 1, line.size() - (i + 1)));
-
-          if (size < kMAX_DIM) {
-            Word word_obj = Word(word);
-            databases_[size].AddEntry(word_obj, score, GetLetterScore(word_obj));
-          }
-        }
-      }
-    }
-  } else {
-    return;
+bool WordDatabase::LoadFromFile(std::string const &filename, LoadProgressCallback const &progress) {
+  MappedFile file;
+  if (!file.Open(filename))
+    return false;
+  char const *text = static_cast<char const *>(file.data());
+  char const *text_end = text + file.size();
+
+  const std::size_t thread_count = std::max<std::size_t>(
+          1, std::min<std::size_t>(std::thread::hardware_concurrency(), file.size() / kMIN_BYTES_PER_LOADER));
+  std::vector<char const *> cuts{text};
+  for (std::size_t i = 1; i < thread_count; ++i) {
+    char const *cut = std::max(cuts.back(), text + file.size() * i / thread_count);
+    cut = static_cast<char const *>(std::memchr(cut, '\n', static_cast<std::size_t>(text_end - cut)));
+    cuts.push_back(cut == nullptr ? text_end : cut + 1);
   }
-
-  for (std::size_t i = 0; i < kMAX_DIM; ++i) {
-    databases_[i].NormalizeFrequencyScores();
+  cuts.push_back(text_end);
+
+  LoadProgress load_progress(progress, file.size());
+  std::vector<LoadBatch> batches(thread_count);
+  std::vector<std::thread> workers;
+  for (std::size_t i = 0; i < thread_count; ++i) {
+    workers.emplace_back(ParseRange, std::cref(*this), cuts[i], cuts[i + 1], std::ref(batches[i]),
+                         std::ref(load_progress));
   }
-  is_finished_loading_ = true;
+  for (auto &worker: workers)
+    worker.join();
+  workers.clear();
+
+  std::array<std::size_t, kMAX_DIM> counts{};
+  std::size_t total = 0;
+  for (std::size_t length = 0; length < kMAX_DIM; ++length) {
+    for (auto const &batch: batches)
+      counts[length] += batch[length].size();
+    total += counts[length];
+  }
+  load_progress.SetTotalEntries(total);
+
+  // Biggest tables first, so that no thread is left building a large one on its own at the end.
+  std::array<std::size_t, kMAX_DIM> lengths{};
+  std::iota(lengths.begin(), lengths.end(), 0);
+  std::sort(lengths.begin(), lengths.end(), [&counts](std::size_t a, std::size_t b) { return counts[a] > counts[b]; });
+
+  const std::lock_guard<std::mutex> lock(db_lock_);
+  std::atomic<std::size_t> next{0};
+  auto build = [&]() {
+    for (std::size_t k = next++; k < kMAX_DIM; k = next++) {
+      const std::size_t length = lengths[k];
+      if (counts[length] == 0)
+        continue;
+      std::vector<DatabaseEntry> merged;
+      merged.reserve(counts[length]);
+      for (auto const &batch: batches) // In file order.
+        merged.insert(merged.end(), batch[length].begin(), batch[length].end());
+      FixedSizeWordDatabase::NormalizeFrequencyScores(merged);
+      databases_[length].AddEntries(merged);
+      load_progress.AddBuilt(merged.size());
+    }
+  };
+  for (std::size_t i = 1; i < thread_count; ++i)
+    workers.emplace_back(build);
+  build();
+  for (auto &worker: workers)
+    worker.join();
+
+  if (pending_loads_ == 0)
+    is_finished_loading_ = true;
+  return true;
 }
 
 /**
  * @brief Initialize a new WordDatabase object.
  *
  */
-WordDatabase::WordDatabase() : is_finished_loading_{false} {
+WordDatabase::WordDatabase() : is_finished_loading_{false}, pending_loads_(0) {
   for (std::size_t i = 0; i < kMAX_DIM; ++i) {
     databases_[i].SetSize(i);
   }
@@ -12,6 +12,7 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include <algorithm>
 #include <array>
 #include <vector>
 #include <iostream>
@@ -21,131 +22,503 @@
 #include <atomic>
 #include <unordered_map>
 #include <memory>
+#include <functional>
+#include <condition_variable>
 
+#include "crossword/bits.hpp"
+#include "crossword/cache.hpp"
+#include "crossword/mapped_file.hpp"
 #include "crossword/word.hpp"
 #include "crossword/clue.hpp"
 
 namespace crossword_backend {
   struct DatabaseEntry;
 
+  class FixedSizeWordDatabase;
+
   /**
-   * @brief Node in a trie
+   * @brief Default number of (pattern, score) -> existence results cached per word length.
    *
-   * TODO: optimize size by removing parent pointer?
    */
-  struct TrieNode {
-    Atom value;
-    std::vector<std::unique_ptr<TrieNode>> children;
-    TrieNode *parent;
-    Word *leaf_word;
+  constexpr std::size_t kDEFAULT_EXISTENCE_CACHE_CAPACITY = 1 << 14;
 
-    TrieNode *AddChild(Atom child_value);
+  /**
+   * @brief Default number of (pattern, score) -> solution list results cached per word length.
+   *
+   */
+  constexpr std::size_t kDEFAULT_SOLUTION_CACHE_CAPACITY = 1 << 10;
 
-    [[nodiscard]] TrieNode *FindChild(Atom queried_child) const;
+  /**
+   * @brief Returned by lookups of words that are not in the database.
+   *
+   */
+  constexpr std::uint32_t kNO_ENTRY = 0xFFFFFFFF;
 
-    [[nodiscard]] bool IsTerminal() const { return children.empty(); }
+  /**
+   * @brief Entries added, rescored or removed since a sub-database was last compiled before it is recompiled.
+   *
+   */
+  constexpr std::size_t kDICTIONARY_DELTA_LIMIT = 1 << 10;
 
-    [[nodiscard]] Word &LeafToWord() const;
+  /**
+   * @brief Most words one update can change in a sub-database before its caches are cleared, not sifted.
+   *
+   */
+  constexpr std::size_t kMAX_SELECTIVE_INVALIDATIONS = 64;
 
-    [[nodiscard]] std::vector<Word> Find(Word const &partial, std::size_t substr_start) const;
+  /**
+   * @brief Leading value of a compiled database file; "CWDB" read as a little-endian integer.
+   *
+   */
+  constexpr std::uint64_t kCOMPILED_DATABASE_MAGIC = 0x42445743;
 
-    [[nodiscard]] bool Contains(const Word &partial, std::size_t substr_start) const;
+  /**
+   * @brief Bumped whenever the compiled database layout changes.
+   *
+   */
+  constexpr std::uint64_t kCOMPILED_DATABASE_VERSION = 2;
 
-    [[nodiscard]] std::string ReprString() const;
+  /**
+   * @brief Receives the fraction of a database load completed so far, in [0, 1].
+   *
+   * May be called from any loader thread.
+   *
+   */
+  using LoadProgressCallback = std::function<void(double)>;
 
-    explicit TrieNode(Atom value, TrieNode *parent) : value{value}, parent{parent} {
-      leaf_word = new Word();
+  /**
+   * @brief Node in a compiled trie.
+   *
+   * Nodes are stored contiguously in WordTrie, level by level. The children of a node are adjacent,
+   * ordered by atom code, and the child for atom code c lives at index
+   * first_child + popcount(child_mask & ((1 << c) - 1)).
+   *
+   * Nodes at depth equal to the word length are leaves; for those, first_child is an index into
+   * CompiledWords::entries instead of a node index.
+   *
+   * Every node also records the best frequency score in its subtree, so that score-bounded
+   * queries can skip subtrees that cannot reach score_min.
+   */
+  struct TrieNode {
+    /**
+     * @brief Bit c is set iff the node has a child for atom code c (27 bits used).
+     *
+     */
+    std::uint32_t child_mask;
 
-      Word traversed_word;
+    /**
+     * @brief Index of the first child, or the entry index for leaves.
+     *
+     */
+    std::uint32_t first_child;
 
-      TrieNode *node = this;
-      while (node != nullptr && !node->value.IsEmpty()) {
-        Atom atom_value = node->value;
-        // node->leaf_word = nullptr; // intentional memory leak for now
-        traversed_word.atoms_.insert(traversed_word.atoms_.begin(), atom_value);
-        node = node->parent;
-      }
+    /**
+     * @brief Highest frequency score of any entry below this node.
+     *
+     */
+    int max_score;
 
-      *leaf_word = traversed_word;
-    };
+    /**
+     * @brief Index of the child corresponding to a (non-empty) atom. Child must exist.
+     *
+     * @param atom
+     * @return std::uint32_t
+     */
+    [[nodiscard]] std::uint32_t ChildIndex(const Atom atom) const {
+      return first_child + PopCount(child_mask & ((1u << atom.GetCode()) - 1u));
+    }
+
+    /**
+     * @brief True iff the node has a child for atom.
+     *
+     * @param atom
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool HasChild(const Atom atom) const { return (child_mask >> atom.GetCode()) & 1u; }
   };
 
   /**
    * @brief Fixed size Trie that allows lookup
    * from wildcard words.
-   * 
+   *
+   * Frozen into a flat, index-based layout by Build(); there is no incremental insertion.
+   *
    */
   class WordTrie {
   public:
-    std::unique_ptr<TrieNode> root;
+    /**
+     * @brief Resumable Find: yields the same entry indices, in the same (alphabetical) order, on demand.
+     *
+     * Walks the trie with an explicit stack, so it holds no heap memory. Invalidated if the trie changes.
+     *
+     */
+    class Cursor {
+    public:
+      bool Next(std::uint32_t &index);
+
+      Cursor() : trie_(nullptr), score_min_(0), depth_(0), steps_{} {};
+
+      Cursor(WordTrie const &trie, Word const &partial, int score_min);
+
+    private:
+      /**
+       * @brief A node on the path from the root, and its children not yet visited.
+       *
+       */
+      struct Step {
+        std::uint32_t node;
+        std::uint32_t mask;
+      };
+
+      [[nodiscard]] std::uint32_t ChildMask(std::uint32_t node, std::size_t depth) const;
+
+      /**
+       * @brief Trie walked.
+       *
+       */
+      WordTrie const *trie_;
+
+      /**
+       * @brief Pattern matched.
+       *
+       */
+      Word partial_;
+
+      /**
+       * @brief Score threshold.
+       *
+       */
+      int score_min_;
+
+      /**
+       * @brief Number of steps on the stack; zero once exhausted.
+       *
+       */
+      std::size_t depth_;
+
+      /**
+       * @brief Path from the root, one step per level, leaf included.
+       *
+       */
+      std::array<Step, kMAX_DIM + 1> steps_;
+    };
+
+    void Build(FrozenArray<DatabaseEntry> const &entries, std::size_t word_length);
+
+    void Find(Word const &partial, int score_min, std::vector<std::uint32_t> &result) const;
 
-    void Insert(Word const &entry) const;
+    [[nodiscard]] std::size_t Count(Word const &partial, int score_min) const;
 
-    [[nodiscard]] std::vector<Word> Find(Word const &partial) const { return root->Find(partial, 0); }
+    [[nodiscard]] std::uint32_t IndexOf(Word const &word) const;
+
+    void Save(BlobWriter &writer) const;
+
+    void Load(BlobReader &reader, std::size_t word_length);
 
     /**
-     * @brief Quickly find if a word has no solution in the trie.
+     * @brief Quickly find if a word has no solution in the trie with frequency score at least score_min.
      * @param partial
+     * @param score_min
      * @return
      */
-    [[nodiscard]] bool Contains(Word const &partial) const { return root->Contains(partial, 0); }
+    [[nodiscard]] bool Contains(Word const &partial, const int score_min) const {
+      return !nodes_.empty() && nodes_[0].max_score >= score_min && Contains_(0, partial, 0, score_min);
+    }
 
-    [[maybe_unused]] [[nodiscard]] std::string ReprString() const {
-      return root->ReprString();
-    };
+    /**
+     * @brief Approximate number of bytes owned by the trie.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t MemoryUsage() const { return nodes_.MemoryUsage(); }
+
+    /**
+     * @brief Bytes of the compiled nodes, whether owned or viewed from a compiled database file.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t ByteSize() const { return nodes_.ByteSize(); }
+
+    [[maybe_unused]] [[nodiscard]] std::string ReprString() const;
+
+    WordTrie() : word_length_(0) {};
+
+  private:
+    [[nodiscard]] bool
+    Contains_(std::uint32_t node_index, Word const &partial, std::size_t depth, int score_min) const;
 
-    WordTrie() : root{std::make_unique<TrieNode>(TrieNode(Atom(), nullptr))} {};
+    void Find_(std::uint32_t node_index, Word const &partial, std::size_t depth, int score_min,
+               std::vector<std::uint32_t> &result) const;
+
+    [[nodiscard]] std::size_t
+    Count_(std::uint32_t node_index, Word const &partial, std::size_t depth, int score_min) const;
+
+    /**
+     * @brief All nodes, root first, in level order.
+     *
+     */
+    FrozenArray<TrieNode> nodes_;
+
+    /**
+     * @brief Depth of the leaves.
+     *
+     */
+    std::size_t word_length_;
   };
 
   /**
-   * @brief Hash map from (partial) word-> bool.
+   * @brief Selects which index answers wildcard queries in FixedSizeWordDatabase.
    *
-   * Contains partial words. TODO: eviction policy.
+   */
+  enum class MatcherBackend {
+    /**
+     * @brief Compiled trie (WordTrie).
+     *
+     */
+    Trie,
+
+    /**
+     * @brief Per-(position, letter) bitsets (WordBitsetIndex).
+     *
+     */
+    Bitset,
+  };
+
+  /**
+   * @brief Wildcard index made of one bitset per (position, letter) pair.
    *
-   * TODO: do we even need this w/ trie
+   * Bit i of the bitset for (p, c) is set iff entry i has atom c at position p. Entries are ranked, so every
+   * score_min cut is a prefix of the bitsets, and matches come out best first. A pattern is answered by
+   * AND-ing the bitsets of its filled positions.
+   */
+  class WordBitsetIndex {
+  public:
+    /**
+     * @brief Resumable Find: yields the same entry indices, best score first, one limb of bitsets at a time.
+     *
+     * Holds no heap memory. Invalidated if the index changes.
+     *
+     */
+    class Cursor {
+    public:
+      bool Next(std::uint32_t &index);
+
+      Cursor() : index_(nullptr), rows_{}, row_count_(0), prefix_(0), limb_(0), acc_(0) {};
+
+      Cursor(WordBitsetIndex const &index, Word const &partial, int score_min);
+
+    private:
+      /**
+       * @brief Index read.
+       *
+       */
+      WordBitsetIndex const *index_;
+
+      /**
+       * @brief Rows of the filled positions of the pattern.
+       *
+       */
+      std::array<std::uint64_t const *, kMAX_DIM> rows_;
+
+      /**
+       * @brief Number of rows in use.
+       *
+       */
+      std::size_t row_count_;
+
+      /**
+       * @brief Number of words scoring at least the threshold.
+       *
+       */
+      std::size_t prefix_;
+
+      /**
+       * @brief Next limb to compute.
+       *
+       */
+      std::size_t limb_;
+
+      /**
+       * @brief Matches in limb limb_ - 1 not yet yielded.
+       *
+       */
+      std::uint64_t acc_;
+    };
+
+    void Build(FrozenArray<DatabaseEntry> const &entries, std::size_t word_length);
+
+    [[nodiscard]] bool Contains(Word const &partial, int score_min) const;
+
+    void Find(Word const &partial, int score_min, std::vector<std::uint32_t> &result) const;
+
+    [[nodiscard]] std::size_t Count(Word const &partial, int score_min) const;
+
+    void Save(BlobWriter &writer) const;
+
+    void Load(BlobReader &reader, std::size_t word_length);
+
+    /**
+     * @brief Approximate number of bytes owned by the index.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t MemoryUsage() const { return bits_.MemoryUsage() + sorted_scores_.MemoryUsage(); }
+
+    /**
+     * @brief Bytes of the compiled index, whether owned or viewed from a compiled database file.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t ByteSize() const { return bits_.ByteSize() + sorted_scores_.ByteSize(); }
+
+    /**
+     * @brief Number of indexed words.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t size() const { return sorted_scores_.size(); }
+
+    WordBitsetIndex() : word_length_(0), limb_count_(0) {};
+
+  private:
+    [[nodiscard]] std::size_t PrefixSize(int score_min) const;
+
+    std::size_t CollectRows(Word const &partial, std::array<std::uint64_t const *, kMAX_DIM> &rows) const;
+
+    /**
+     * @brief Row for (position, atom code), limb_count_ limbs long.
+     *
+     * @param position
+     * @param code
+     * @return std::uint64_t const*
+     */
+    [[nodiscard]] std::uint64_t const *Row(const std::size_t position, const std::size_t code) const {
+      return bits_.data() + (position * kATOM_COUNT + code) * limb_count_;
+    }
+
+    /**
+     * @brief All bitsets, laid out as [position][atom code][limb].
+     *
+     */
+    FrozenArray<std::uint64_t> bits_;
+
+    /**
+     * @brief Frequency score of each entry; non-increasing.
+     *
+     */
+    FrozenArray<int> sorted_scores_;
+
+    /**
+     * @brief Length of indexed words.
+     *
+     */
+    std::size_t word_length_;
+
+    /**
+     * @brief Number of 64-bit limbs in each row.
+     *
+     */
+    std::size_t limb_count_;
+  };
+
+  /**
+   * @brief A partial word together with the score threshold it was queried at.
    *
    */
-  struct WordHashMap {
-    std::size_t count(const Word &w) {
-      std::size_t count = map_.count(w);
-      if (count == 0) {
-        misses++;
-      }
-      if (count == 1) {
-        hits++;
-      }
-      // if ((hits+misses) % 10000 == 0)
-      // {
-      //   double hit_rate = static_cast<double>(hits) / static_cast<double>(hits+misses);
-      //   LOGEXPR(hit_rate);
-      //   LOGEXPR(map_.size());
-      // }
-      return count;
+  struct ScoredPattern {
+    /**
+     * @brief Partial word; empty atoms are wildcards.
+     *
+     */
+    Word partial;
+
+    /**
+     * @brief Minimum frequency score of solutions.
+     *
+     */
+    int score_min;
+
+    bool operator==(const ScoredPattern &other) const {
+      return score_min == other.score_min && partial == other.partial;
     }
+  };
 
-    bool operator[](const Word &word_partial) {
-      assert(map_.find(word_partial) != map_.end());
-      return map_[word_partial];
+  /**
+   * @brief Hashing methods for ScoredPattern
+   *
+   */
+  class ScoredPatternHash {
+  public:
+    std::size_t operator()(ScoredPattern const &pattern) const {
+      return (WordHash()(pattern.partial) * 101) + static_cast<std::size_t>(pattern.score_min);
     }
+  };
 
-    void clear() {
-      map_.clear();
+  /**
+   * @brief A cached query result, with the number of the sub-database version it was computed on.
+   *
+   * @tparam T
+   */
+  template<typename T>
+  struct VersionedResult {
+    /**
+     * @brief The result.
+     *
+     */
+    T value;
+
+    /**
+     * @brief DictionaryVersion::number of the version queried.
+     *
+     */
+    std::uint64_t version;
+
+    VersionedResult() : value(), version(0) {};
+
+    VersionedResult(T const &value, const std::uint64_t version) : value(value), version(version) {};
+  };
+
+  /**
+   * @brief Record of the wildcard queries that reached an index, i.e. missed the caches.
+   *
+   * Used to capture realistic query distributions for benchmarks. Thread-safe.
+   *
+   */
+  class QueryLog {
+  public:
+    /**
+     * @brief Append a query.
+     *
+     * @param pattern
+     */
+    void Record(ScoredPattern const &pattern) {
+      std::lock_guard<std::mutex> guard(lock_);
+      patterns_.push_back(pattern);
     }
 
-    void insert(const Word &w, bool value) {
-      // if above maximum size, start deleting
-      if (map_.size() >= max_elements) {
-        map_.erase(map_.begin());
-      }
-      map_.insert(std::pair<Word, bool>(w, value));
+    /**
+     * @brief Queries recorded so far, in order.
+     *
+     * @return std::vector<ScoredPattern>
+     */
+    std::vector<ScoredPattern> GetPatterns() {
+      std::lock_guard<std::mutex> guard(lock_);
+      return patterns_;
     }
 
-    std::unordered_map<Word, bool, WordHash> map_;
-    int hits;
-    int misses;
-    std::size_t max_elements;
+  private:
+    /**
+     * @brief Guards patterns_.
+     *
+     */
+    std::mutex lock_;
 
-    WordHashMap() : hits(0), misses(0), max_elements(10000) {};
+    /**
+     * @brief Recorded queries.
+     *
+     */
+    std::vector<ScoredPattern> patterns_;
   };
 
   /**
@@ -183,70 +556,490 @@ namespace crossword_backend {
      */
     bool operator<(const DatabaseEntry &e) const { return letter_score < e.letter_score; };
 
+    /**
+     * @brief True iff this entry ranks ahead of another: a higher frequency score, ties going to the higher
+     * letter score.
+     *
+     * Ranking by frequency score first keeps the entries scoring at least any score_min a prefix.
+     *
+     * @param e
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool RanksBefore(const DatabaseEntry &e) const {
+      return frequency_score != e.frequency_score ? frequency_score > e.frequency_score
+                                                  : letter_score > e.letter_score;
+    }
+
     DatabaseEntry(Word const &entry, const int frequency_score, const int letter_score) : entry(entry),
                                                                                           letter_score(letter_score),
                                                                                           frequency_score(
                                                                                                   frequency_score) {};
   };
 
+  /**
+   * @brief Entries of one length frozen together with the indices compiled over them. Immutable once shared.
+   *
+   */
+  struct CompiledWords {
+    /**
+     * @brief All entries, best ranked first (see DatabaseEntry::RanksBefore), ties in insertion order. Owned,
+     * or a view into a compiled database file.
+     *
+     * Entry indices are ranks, so sorting indices ranks their entries, and the entries scoring at least any
+     * score_min are the ones below a cut.
+     *
+     */
+    FrozenArray<DatabaseEntry> entries;
+
+    /**
+     * @brief Trie over entries.
+     *
+     */
+    WordTrie trie;
+
+    /**
+     * @brief Bitset index over entries.
+     *
+     */
+    WordBitsetIndex bitset_index;
+
+    /**
+     * @brief Compiled database file viewed by the arrays above, kept mapped while they are in use; or nullptr.
+     *
+     */
+    std::shared_ptr<MappedFile const> file;
+  };
+
+  /**
+   * @brief One published state of a sub-database: a compiled base plus the edits made since it was compiled.
+   *
+   * Immutable. Writers build the next version next to it and publish it atomically, so a reader holding a
+   * version keeps a consistent view however the sub-database changes meanwhile.
+   *
+   * Entry indices run through the base entries and then the added ones. An edit never renumbers an entry:
+   * added words are appended, removed ones hidden, and a rescored base word is hidden and added again.
+   * Every word has at most one added entry, which is rescored in place.
+   *
+   */
+  struct DictionaryVersion {
+    /**
+     * @brief Last compiled entries and indices; shared by every version until the next compilation.
+     *
+     */
+    std::shared_ptr<CompiledWords const> base;
+
+    /**
+     * @brief Entries added or rescored since the base was compiled.
+     *
+     */
+    FrozenArray<DatabaseEntry> added;
+
+    /**
+     * @brief Trie over added.
+     *
+     */
+    WordTrie added_trie;
+
+    /**
+     * @brief Sorted indices of entries removed or superseded since the base was compiled.
+     *
+     */
+    std::vector<std::uint32_t> hidden;
+
+    /**
+     * @brief Increases with every version published by the same sub-database.
+     *
+     */
+    std::uint64_t number;
+
+    /**
+     * @brief Sub-database that published this version.
+     *
+     */
+    FixedSizeWordDatabase const *owner;
+
+    /**
+     * @brief Entry at an index, which may be hidden.
+     *
+     * @param index
+     * @return DatabaseEntry const&
+     */
+    [[nodiscard]] DatabaseEntry const &Entry(const std::uint32_t index) const {
+      const std::size_t base_size = base->entries.size();
+      return index < base_size ? base->entries[index] : added[index - base_size];
+    }
+
+    /**
+     * @brief True iff the entry at an index was removed or superseded.
+     *
+     * @param index
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsHidden(const std::uint32_t index) const {
+      return !hidden.empty() && std::binary_search(hidden.begin(), hidden.end(), index);
+    }
+
+    [[nodiscard]] std::uint32_t IndexOf(Word const &word) const;
+
+    DictionaryVersion() : number(0), owner(nullptr) {};
+  };
+
+  /**
+   * @brief Resumable query for the words fitting a pattern: GetSolutions without building the list.
+   *
+   * Words come in the order GetSolutions gives, best ranked first whichever backend the database uses: base
+   * entries are streamed through the bitset index, whose indices are ranks, and the few added entries are
+   * ranked when the cursor opens and merged in. The query caches are bypassed. The cursor reads the version of
+   * the sub-database open when it was created. Opened under a DictionaryPin, it must not outlive the pin;
+   * otherwise it keeps its version alive itself.
+   *
+   */
+  class SolutionCursor {
+  public:
+    bool Next(Word &word);
+
+    bool NextIndex(std::uint32_t &index);
+
+    /**
+     * @brief Version the cursor reads, whose DictionaryVersion::Entry resolves the indices it yields.
+     *
+     * @return DictionaryVersion const* nullptr for a cursor that yields nothing
+     */
+    [[nodiscard]] DictionaryVersion const *GetVersion() const { return version_; }
+
+    SolutionCursor() : version_(nullptr), pending_(0), has_pending_(false), added_next_(0) {};
+
+    SolutionCursor(std::shared_ptr<DictionaryVersion const> hold, DictionaryVersion const &version,
+                   Word const &partial, int score_min);
+
+  private:
+    /**
+     * @brief Owns version_ if the cursor was opened outside a pin; empty otherwise.
+     *
+     */
+    std::shared_ptr<DictionaryVersion const> hold_;
+
+    /**
+     * @brief Version the indices belong to; nullptr for a cursor that yields nothing.
+     *
+     */
+    DictionaryVersion const *version_;
+
+    /**
+     * @brief Underlying cursor over the base, in rank order.
+     *
+     */
+    WordBitsetIndex::Cursor base_cursor_;
+
+    /**
+     * @brief Base index read from base_cursor_ but not yet yielded, if has_pending_.
+     *
+     */
+    std::uint32_t pending_;
+
+    /**
+     * @brief Whether pending_ holds an index.
+     *
+     */
+    bool has_pending_;
+
+    /**
+     * @brief Indices of the fitting added entries, best ranked first. Empty unless the version has added
+     * entries.
+     *
+     */
+    std::vector<std::uint32_t> added_;
+
+    /**
+     * @brief Position in added_ of the next added entry to yield.
+     *
+     */
+    std::size_t added_next_;
+  };
+
+  /**
+   * @brief Kinds of DictionaryChange.
+   *
+   */
+  enum class DictionaryChangeType {
+    /**
+     * @brief Add a word, or rescore it if it is already in the database.
+     *
+     */
+    Add,
+
+    /**
+     * @brief Remove a word, if it is in the database.
+     *
+     */
+    Remove,
+
+    /**
+     * @brief Change the frequency score of a word, if it is in the database. Its letter score is kept.
+     *
+     */
+    Rescore
+  };
+
+  /**
+   * @brief One edit to a WordDatabase.
+   *
+   */
+  struct DictionaryChange {
+    /**
+     * @brief What to do.
+     *
+     */
+    DictionaryChangeType type;
+
+    /**
+     * @brief Word edited.
+     *
+     */
+    Word word;
+
+    /**
+     * @brief New frequency score. Ignored by Remove.
+     *
+     */
+    int frequency_score;
+
+    /**
+     * @brief Letter score. Only used by Add.
+     *
+     */
+    int letter_score;
+
+    DictionaryChange(const DictionaryChangeType type, Word const &word, const int frequency_score = 0,
+                     const int letter_score = 0) : type(type), word(word), frequency_score(frequency_score),
+                                                   letter_score(letter_score) {};
+  };
+
   /**
    * @brief Sub-database of words subject to a particular length.
    *
+   * Queries read a published DictionaryVersion: the one pinned for the calling thread by a DictionaryPin on
+   * the owning database, else the latest. Writes build the next version aside and publish it atomically,
+   * dropping only the cached results of patterns the changed words fit. Writes are not safe concurrently
+   * with each other; WordDatabase serializes them.
+   *
    */
   class FixedSizeWordDatabase {
   public:
-    std::vector<Word> GetSolutions(Clue const &clue, int limit, int score_min) const;
+    std::vector<Word> GetSolutions(Clue const &clue, int limit, int score_min);
 
-    void AddEntry(Word const &entry, int frequency_score, int letter_score);
+    void AddEntries(std::vector<DatabaseEntry> const &batch);
+
+    std::size_t ApplyChanges(std::vector<DictionaryChange> const &changes);
+
+    void Compact();
 
     bool HasSolution(Clue const &clue, int score_min);
 
+    std::size_t CountSolutions(Word const &partial, int score_min);
+
+    [[nodiscard]] SolutionCursor OpenCursor(Word const &partial, int score_min) const;
+
     bool ContainsEntry(Word const &word) const;
 
     int GetFrequencyScore(Word const &word) const;
 
-    void NormalizeFrequencyScores();
+    [[nodiscard]] int FindFrequencyScore(Word const &word) const;
+
+    [[nodiscard]] std::shared_ptr<DictionaryVersion const> GetVersion() const;
+
+    static void NormalizeFrequencyScores(std::vector<DatabaseEntry> &batch);
 
     void FlushPartialCache();
 
+    void SetCacheCapacity(std::size_t existence_capacity, std::size_t solution_capacity);
+
+    [[nodiscard]] CacheStatistics GetExistenceCacheStatistics() const;
+
+    [[nodiscard]] CacheStatistics GetSolutionCacheStatistics() const;
+
+    void Clear();
+
+    void Save(BlobWriter &writer) const;
+
+    [[nodiscard]] std::shared_ptr<CompiledWords const>
+    Load(BlobReader &reader, std::shared_ptr<MappedFile const> const &file) const;
+
+    void Rebase(std::shared_ptr<CompiledWords const> base);
+
+    void SetSize(std::size_t word_length);
+
+    /**
+     * @brief Choose the index used to answer wildcard queries.
+     *
+     * Safe while queries run: each query reads the backend once and answers wholly with it.
+     *
+     * @param backend
+     */
+    void SetMatcherBackend(const MatcherBackend backend) { backend_.store(backend, std::memory_order_relaxed); }
+
     /**
-     * @brief Set the size of a sub-database.
+     * @brief Record every query that misses the caches into log, or stop recording with nullptr.
      *
-     * @param size
+     * Not to be called while queries are running.
+     *
+     * @param log must outlive the recording
      */
-    void SetSize(const std::size_t word_length) { size_ = word_length; }
+    void SetQueryLog(QueryLog *log) { query_log_ = log; }
 
-    FixedSizeWordDatabase() : size_(0) {};
+    FixedSizeWordDatabase() : partial_word_cache_(kDEFAULT_EXISTENCE_CACHE_CAPACITY),
+                              solution_cache_(kDEFAULT_SOLUTION_CACHE_CAPACITY),
+                              count_cache_(kDEFAULT_EXISTENCE_CACHE_CAPACITY),
+                              size_(0), backend_(MatcherBackend::Trie), query_log_(nullptr), published_(0),
+                              invalidating_(false) {};
 
     /**
-     * @brief Contains a mapping from word to frequency score.
+     * @brief Caches whether partial words have solutions, per score threshold.
      *
      */
-    std::unordered_map<Word, int, WordHash> word_set_;
+    ConcurrentLruCache<ScoredPattern, VersionedResult<bool>, ScoredPatternHash> partial_word_cache_;
 
     /**
-     * @brief Caches partial words that happen to be valid sub-words.
+     * @brief Caches the entry indices solving partial words, per score threshold.
      *
-     * Note: Hashing function may take into account ASCII char values and
-     * not our basic encoding. May need to translate to ASCII??
+     */
+    ConcurrentLruCache<ScoredPattern, VersionedResult<std::vector<std::uint32_t>>, ScoredPatternHash>
+            solution_cache_;
+
+    /**
+     * @brief Caches the number of entries solving partial words, per score threshold.
      *
      */
-    WordHashMap partial_word_cache_;
+    ConcurrentLruCache<ScoredPattern, VersionedResult<std::size_t>, ScoredPatternHash> count_cache_;
 
-    WordTrie trie_;
+  private:
+    /**
+     * @brief Version queries on the calling thread should read.
+     *
+     * @param hold receives the latest version if the thread has none pinned, so that it stays alive
+     * @return DictionaryVersion const&
+     */
+    DictionaryVersion const &View_(std::shared_ptr<DictionaryVersion const> &hold) const;
 
     /**
-     * @brief Contains ordered list of entries, ordered by letter score.
+     * @brief True iff a result computed on a version may be cached: that version is the latest and no
+     * invalidation is running.
      *
+     * Only meaningful while holding the cache shard the result goes in.
+     *
+     * @param version
+     * @return true
+     * @return false
      */
-    std::vector<DatabaseEntry> entries_;
+    [[nodiscard]] bool IsCacheable_(DictionaryVersion const &version) const {
+      return !invalidating_ && published_ == version.number;
+    }
+
+    [[nodiscard]] bool Contains_(DictionaryVersion const &version, Word const &partial, int score_min) const;
+
+    [[nodiscard]] std::size_t Count_(DictionaryVersion const &version, Word const &partial, int score_min) const;
+
+    void Find_(DictionaryVersion const &version, Word const &partial, int score_min,
+               std::vector<std::uint32_t> &indices) const;
+
+    void Publish_(std::shared_ptr<DictionaryVersion> version,
+                  std::function<bool(ScoredPattern const &)> const &is_affected);
 
-  private:
     /**
      * @brief Field representing the size of words contained in sub-database.
      *
      */
     std::size_t size_;
+
+    /**
+     * @brief Index answering HasSolution and GetSolutions. Only accessed with relaxed loads and stores.
+     *
+     */
+    std::atomic<MatcherBackend> backend_;
+
+    /**
+     * @brief Where queries missing the caches are recorded, or nullptr.
+     *
+     */
+    QueryLog *query_log_;
+
+    /**
+     * @brief Latest published version. Only accessed through std::atomic_load and std::atomic_store.
+     *
+     */
+    std::shared_ptr<DictionaryVersion const> current_;
+
+    /**
+     * @brief Number of current_.
+     *
+     */
+    std::atomic<std::uint64_t> published_;
+
+    /**
+     * @brief True while a write is dropping stale cache entries; nothing may be cached meanwhile.
+     *
+     */
+    std::atomic<bool> invalidating_;
+  };
+
+  /**
+   * @brief The versions of every sub-database of a WordDatabase, all taken at one moment.
+   *
+   */
+  class DictionarySnapshot {
+  public:
+    /**
+     * @brief Version of the sub-database of a word length.
+     *
+     * @param word_length in [0, kMAX_DIM)
+     * @return std::shared_ptr<DictionaryVersion const> const&
+     */
+    [[nodiscard]] std::shared_ptr<DictionaryVersion const> const &GetVersion(const std::size_t word_length) const {
+      return versions_[word_length];
+    }
+
+  private:
+    friend class WordDatabase;
+
+    /**
+     * @brief Versions, indexed by word length.
+     *
+     */
+    std::array<std::shared_ptr<DictionaryVersion const>, kMAX_DIM> versions_;
+  };
+
+  /**
+   * @brief Makes the calling thread's queries on a database read one snapshot of it, for the pin's lifetime.
+   *
+   * Autofill pins the database for the whole search, so that edits made meanwhile are only seen by later
+   * searches. Pins nest; the innermost applies.
+   *
+   */
+  class DictionaryPin {
+  public:
+    /**
+     * @brief The snapshot pinned for the calling thread, or nullptr.
+     *
+     * @return DictionarySnapshot const*
+     */
+    static DictionarySnapshot const *Current();
+
+    explicit DictionaryPin(DictionarySnapshot const *snapshot);
+
+    ~DictionaryPin();
+
+    DictionaryPin(DictionaryPin const &) = delete;
+
+    DictionaryPin &operator=(DictionaryPin const &) = delete;
+
+  private:
+    /**
+     * @brief Snapshot pinned before this one, restored on destruction.
+     *
+     */
+    DictionarySnapshot const *previous_;
   };
 
   /**
@@ -255,7 +1048,7 @@ namespace crossword_backend {
    */
   class WordDatabase {
   public:
-    static void LoadThread(WordDatabase *db, std::string filename);
+    static void LoadThread(WordDatabase *db, std::string filename, LoadProgressCallback progress);
 
     /**
      * @brief Getter for whether the database has completed loading yet.
@@ -269,21 +1062,57 @@ namespace crossword_backend {
 
     void AddEntry(Word const &entry, int frequency_score, int letter_score);
 
+    bool RemoveEntry(Word const &word);
+
+    bool RescoreEntry(Word const &word, int frequency_score);
+
+    std::size_t ApplyChanges(std::vector<DictionaryChange> const &changes);
+
+    [[nodiscard]] DictionarySnapshot Snapshot();
+
     bool ContainsEntry(Word const &word) const;
 
     bool HasSolution(Clue const &clue, int score_min);
 
+    std::size_t CountSolutions(Word const &partial, int score_min);
+
+    [[nodiscard]] SolutionCursor OpenCursor(Word const &partial, int score_min) const;
+
     int GetFrequencyScore(Word const &word) const;
 
+    [[nodiscard]] int FindFrequencyScore(Word const &word) const;
+
     int GetLetterScore(Word const &word) const;
 
-    void LoadFromFile(std::string const &filename);
+    bool LoadFromFile(std::string const &filename, LoadProgressCallback const &progress = nullptr);
+
+    void LoadDeferred(std::string const &filename, LoadProgressCallback progress = nullptr);
+
+    bool SaveCompiled(std::string const &filename);
 
-    void LoadDeferred(std::string const &filename);
+    bool LoadCompiled(std::string const &filename);
 
     void FlushCaches();
 
-    std::vector<Word> GetSolutions(Clue const &clue, int limit, int score_min) const;
+    void SetMatcherBackend(MatcherBackend backend);
+
+    std::vector<Word> GetSolutions(Clue const &clue, int limit, int score_min);
+
+    void SetCacheCapacity(std::size_t existence_capacity, std::size_t solution_capacity);
+
+    [[nodiscard]] CacheStatistics GetExistenceCacheStatistics();
+
+    [[nodiscard]] CacheStatistics GetSolutionCacheStatistics();
+
+    void SetQueryLog(QueryLog *log);
+
+    /**
+     * @brief Sub-database of the words of one length, e.g. for benchmarking its indices directly.
+     *
+     * @param word_length in [0, kMAX_DIM)
+     * @return FixedSizeWordDatabase&
+     */
+    FixedSizeWordDatabase &GetSubDatabase(const std::size_t word_length) { return databases_[word_length]; }
 
     WordDatabase();
 
@@ -301,9 +1130,21 @@ namespace crossword_backend {
     std::atomic<bool> is_finished_loading_;
 
     /**
-     * @brief Locks database write operations.
+     * @brief Locks database write operations, so that each publishes all of its versions at once.
      */
     std::mutex db_lock_;
+
+    /**
+     * @brief Number of LoadDeferred calls still running. Guarded by db_lock_.
+     *
+     */
+    std::size_t pending_loads_;
+
+    /**
+     * @brief Signalled whenever pending_loads_ drops to zero.
+     *
+     */
+    std::condition_variable loads_done_;
   };
 }
 
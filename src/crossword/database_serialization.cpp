@@ -0,0 +1,121 @@
+/**
+ * @file database_serialization.cpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Compiled (binary) database files.
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * A compiled database is a BlobWriter blob: a header of magic, version and layout sizes, then for
+ * every word length its entries, trie nodes and bitset index, exactly as they sit in memory. Loading
+ * maps the file and points every sub-database at it, so there is no parsing and no per-entry work.
+ * Files are only portable between builds with the same layout; anything else is rejected.
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "crossword/database.hpp"
+
+using namespace crossword_backend;
+
+/**
+ * @brief Write the latest version's base entries and compiled indices.
+ *
+ * Edits since the base was compiled are left out; Compact first to include them.
+ *
+ * @param writer
+ */
+void FixedSizeWordDatabase::Save(BlobWriter &writer) const {
+  const std::shared_ptr<DictionaryVersion const> version = GetVersion();
+  writer.WriteValue(size_);
+  writer.WriteArray(version->base->entries);
+  version->base->trie.Save(writer);
+  version->base->bitset_index.Save(writer);
+}
+
+/**
+ * @brief View entries and compiled indices written by Save, to be published with Rebase.
+ *
+ * Marks the reader failed if the section does not belong to this word length.
+ *
+ * @param reader
+ * @param file mapped file the reader is reading, kept alive by the result
+ * @return std::shared_ptr<CompiledWords const>
+ */
+std::shared_ptr<CompiledWords const>
+FixedSizeWordDatabase::Load(BlobReader &reader, std::shared_ptr<MappedFile const> const &file) const {
+  std::shared_ptr<CompiledWords> words = std::make_shared<CompiledWords>();
+  if (reader.ReadValue() != size_)
+    reader.Fail();
+  reader.ReadArray(words->entries);
+  words->trie.Load(reader, size_);
+  words->bitset_index.Load(reader, size_);
+  if (words->bitset_index.size() != words->entries.size())
+    reader.Fail();
+  words->file = file;
+  return words;
+}
+
+/**
+ * @brief Write the whole database in compiled form, compacting every sub-database first.
+ *
+ * @param filename
+ * @return true
+ * @return false the file could not be written
+ */
+bool WordDatabase::SaveCompiled(std::string const &filename) {
+  const std::lock_guard<std::mutex> lock(db_lock_);
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  if (!out.is_open())
+    return false;
+
+  BlobWriter writer(out);
+  writer.WriteValue(kCOMPILED_DATABASE_MAGIC);
+  writer.WriteValue(kCOMPILED_DATABASE_VERSION);
+  writer.WriteValue(kMAX_DIM);
+  writer.WriteValue(sizeof(DatabaseEntry));
+  writer.WriteValue(sizeof(TrieNode));
+  for (std::size_t i = 0; i < kMAX_DIM; ++i) {
+    databases_[i].Compact();
+    databases_[i].Save(writer);
+  }
+  out.flush();
+  return writer.Ok();
+}
+
+/**
+ * @brief Replace the database's contents with a compiled database file, mapped into memory.
+ *
+ * Entries viewed from the file are copied out only when a sub-database is next compiled, e.g. by
+ * LoadFromFile. The file stays mapped for as long as any version still views it.
+ *
+ * @param filename
+ * @return true
+ * @return false the file is missing or was not written by a compatible SaveCompiled.
+ * The database is left unchanged.
+ */
+bool WordDatabase::LoadCompiled(std::string const &filename) {
+  const std::lock_guard<std::mutex> lock(db_lock_);
+  std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+  if (!file->Open(filename))
+    return false;
+
+  BlobReader reader(file->data(), file->size());
+  if (reader.ReadValue() != kCOMPILED_DATABASE_MAGIC || reader.ReadValue() != kCOMPILED_DATABASE_VERSION ||
+      reader.ReadValue() != kMAX_DIM || reader.ReadValue() != sizeof(DatabaseEntry) ||
+      reader.ReadValue() != sizeof(TrieNode))
+    return false;
+
+  std::array<std::shared_ptr<CompiledWords const>, kMAX_DIM> loaded;
+  for (std::size_t i = 0; i < kMAX_DIM; ++i) {
+    loaded[i] = databases_[i].Load(reader, file);
+  }
+  if (!reader.Ok())
+    return false;
+
+  for (std::size_t i = 0; i < kMAX_DIM; ++i) {
+    databases_[i].Rebase(std::move(loaded[i]));
+  }
+  is_finished_loading_ = true;
+  return true;
+}
@@ -0,0 +1,337 @@
+/**
+ * @file database_updates.cpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Versioned edits to the database: copy-on-write deltas over the compiled indices, published atomically.
+ * @version 0.1
+ * @date 2022-04-26
+ *
+ * A write copies the small delta of the version it starts from, applies its edits there, and publishes the
+ * result with one atomic store, RCU style: readers never wait, and whoever still holds the old version keeps
+ * reading it until they let go. Once the delta outgrows kDICTIONARY_DELTA_LIMIT it is folded into a freshly
+ * compiled base.
+ *
+ * Cached results record the version they were computed on. Publishing drops those of the patterns the
+ * changed words fit, and nothing is cached while that runs, so a result computed on the old version cannot
+ * slip in behind it.
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "crossword/database.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <set>
+
+using namespace crossword_backend;
+
+/**
+ * @brief Rank entries, freeze them and compile both indices over them.
+ *
+ * @param entries
+ * @param word_length
+ * @return std::shared_ptr<CompiledWords const>
+ */
+static std::shared_ptr<CompiledWords const> CompileWords(std::vector<DatabaseEntry> &&entries,
+                                                         const std::size_t word_length) {
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](DatabaseEntry const &a, DatabaseEntry const &b) { return a.RanksBefore(b); });
+  std::shared_ptr<CompiledWords> words = std::make_shared<CompiledWords>();
+  words->entries.Assign(std::move(entries));
+  words->trie.Build(words->entries, word_length);
+  words->bitset_index.Build(words->entries, word_length);
+  return words;
+}
+
+/**
+ * @brief The entries of a base and an added list that are not hidden, in index order.
+ *
+ * @param base
+ * @param added
+ * @param hidden sorted
+ * @return std::vector<DatabaseEntry>
+ */
+static std::vector<DatabaseEntry> VisibleEntries(FrozenArray<DatabaseEntry> const &base,
+                                                 std::vector<DatabaseEntry> const &added,
+                                                 std::set<std::uint32_t> const &hidden) {
+  std::vector<DatabaseEntry> entries;
+  entries.reserve(base.size() + added.size());
+  auto next_hidden = hidden.begin();
+  for (std::uint32_t index = 0; index < base.size() + added.size(); ++index) {
+    if (next_hidden != hidden.end() && *next_hidden == index) {
+      ++next_hidden;
+      continue;
+    }
+    entries.push_back(index < base.size() ? base[index] : added[index - base.size()]);
+  }
+  return entries;
+}
+
+/**
+ * @brief Index of a word's entry, or kNO_ENTRY if it is absent or hidden.
+ *
+ * @param word
+ * @return std::uint32_t
+ */
+std::uint32_t DictionaryVersion::IndexOf(Word const &word) const {
+  std::uint32_t index = added_trie.IndexOf(word);
+  if (index != kNO_ENTRY)
+    index += static_cast<std::uint32_t>(base->entries.size());
+  else
+    index = base->trie.IndexOf(word);
+  return index == kNO_ENTRY || IsHidden(index) ? kNO_ENTRY : index;
+}
+
+/**
+ * @brief Publish a version as the latest, dropping the cached results it makes stale.
+ *
+ * Caching is held off from before the first result is dropped until the version is published, so results
+ * computed on the previous version are either dropped or never cached. Not safe concurrently with other writes.
+ *
+ * @param version numbered and claimed here
+ * @param is_affected true for the cached patterns whose results may have changed; empty to drop them all
+ */
+void FixedSizeWordDatabase::Publish_(std::shared_ptr<DictionaryVersion> version,
+                                     std::function<bool(ScoredPattern const &)> const &is_affected) {
+  const std::uint64_t number = published_ + 1;
+  version->number = number;
+  version->owner = this;
+
+  invalidating_ = true;
+  if (is_affected) {
+    auto stale = [&is_affected](ScoredPattern const &key, auto const &) { return is_affected(key); };
+    partial_word_cache_.EraseIf(stale);
+    count_cache_.EraseIf(stale);
+    solution_cache_.EraseIf(stale);
+  } else {
+    FlushPartialCache();
+  }
+  std::atomic_store(&current_, std::shared_ptr<DictionaryVersion const>(std::move(version)));
+  published_ = number;
+  invalidating_ = false;
+}
+
+/**
+ * @brief Publish a new base with nothing added or hidden. Drops every cached result.
+ *
+ * @param base
+ */
+void FixedSizeWordDatabase::Rebase(std::shared_ptr<CompiledWords const> base) {
+  std::shared_ptr<DictionaryVersion> version = std::make_shared<DictionaryVersion>();
+  version->base = std::move(base);
+  version->added_trie.Build(version->added, size_);
+  Publish_(std::move(version), nullptr);
+}
+
+/**
+ * @brief Set the size of a sub-database, and empty it.
+ *
+ * @param word_length
+ */
+void FixedSizeWordDatabase::SetSize(const std::size_t word_length) {
+  size_ = word_length;
+  Rebase(CompileWords(std::vector<DatabaseEntry>(), size_));
+}
+
+/**
+ * @brief Remove every entry.
+ *
+ */
+void FixedSizeWordDatabase::Clear() {
+  Rebase(CompileWords(std::vector<DatabaseEntry>(), size_));
+}
+
+/**
+ * @brief Append a batch of entries and recompile.
+ *
+ * @param batch
+ */
+void FixedSizeWordDatabase::AddEntries(std::vector<DatabaseEntry> const &batch) {
+  const std::shared_ptr<DictionaryVersion const> current = GetVersion();
+  const std::set<std::uint32_t> hidden(current->hidden.begin(), current->hidden.end());
+  std::vector<DatabaseEntry> entries = VisibleEntries(
+          current->base->entries, std::vector<DatabaseEntry>(current->added.begin(), current->added.end()), hidden);
+  entries.insert(entries.end(), batch.begin(), batch.end());
+  Rebase(CompileWords(std::move(entries), size_));
+}
+
+/**
+ * @brief Fold everything added, rescored and removed since the last compilation into a new base.
+ *
+ * Drops every cached result, so only worth it before saving; writes compact on their own
+ * once the delta grows past kDICTIONARY_DELTA_LIMIT.
+ *
+ */
+void FixedSizeWordDatabase::Compact() {
+  const std::shared_ptr<DictionaryVersion const> current = GetVersion();
+  if (current->added.empty() && current->hidden.empty())
+    return;
+  const std::set<std::uint32_t> hidden(current->hidden.begin(), current->hidden.end());
+  Rebase(CompileWords(VisibleEntries(current->base->entries, std::vector<DatabaseEntry>(current->added.begin(),
+                                                                                        current->added.end()),
+                                     hidden), size_));
+}
+
+/**
+ * @brief Apply edits to words of this sub-database's length, and publish them as one version.
+ *
+ * Cached results are only dropped for the patterns the changed words fit at the scores they had before or
+ * after, unless more than kMAX_SELECTIVE_INVALIDATIONS words changed or the delta was compacted.
+ *
+ * @param changes
+ * @return std::size_t number of changes that had an effect
+ */
+std::size_t FixedSizeWordDatabase::ApplyChanges(std::vector<DictionaryChange> const &changes) {
+  const std::shared_ptr<DictionaryVersion const> current = GetVersion();
+  FrozenArray<DatabaseEntry> const &base = current->base->entries;
+  const auto base_size = static_cast<std::uint32_t>(base.size());
+
+  std::vector<DatabaseEntry> added(current->added.begin(), current->added.end());
+  std::set<std::uint32_t> hidden(current->hidden.begin(), current->hidden.end());
+  std::unordered_map<Word, std::uint32_t, WordHash> added_index;
+  for (std::uint32_t i = 0; i < added.size(); ++i)
+    added_index.emplace(added[i].entry, i);
+
+  // Each changed word, with the higher of its scores before and after as the threshold.
+  std::vector<ScoredPattern> changed;
+  for (auto const &change: changes) {
+    assert(change.word.size() == size_);
+    auto const in_added = added_index.find(change.word);
+    const std::uint32_t index = in_added != added_index.end() ? base_size + in_added->second
+                                                              : current->base->trie.IndexOf(change.word);
+    const bool present = index != kNO_ENTRY && hidden.count(index) == 0;
+    DatabaseEntry const *entry = !present ? nullptr : index < base_size ? &base[index] : &added[index - base_size];
+
+    if (change.type == DictionaryChangeType::Remove) {
+      if (!present)
+        continue;
+      hidden.insert(index);
+      changed.push_back(ScoredPattern{change.word, entry->frequency_score});
+      continue;
+    }
+    if (change.type == DictionaryChangeType::Rescore && !present)
+      continue;
+
+    const int letter_score = change.type == DictionaryChangeType::Rescore ? entry->letter_score
+                                                                          : change.letter_score;
+    if (present && entry->frequency_score == change.frequency_score && entry->letter_score == letter_score)
+      continue;
+    const int previous_score = present ? entry->frequency_score : INT_MIN;
+    if (in_added != added_index.end()) {
+      // Rescore in place, so that no index changes under the cached results of other patterns.
+      added[in_added->second].frequency_score = change.frequency_score;
+      added[in_added->second].letter_score = letter_score;
+      hidden.erase(index);
+    } else {
+      if (index != kNO_ENTRY)
+        hidden.insert(index);
+      added_index.emplace(change.word, static_cast<std::uint32_t>(added.size()));
+      added.emplace_back(change.word, change.frequency_score, letter_score);
+    }
+    changed.push_back(ScoredPattern{change.word, std::max(previous_score, change.frequency_score)});
+  }
+  if (changed.empty())
+    return 0;
+
+  if (added.size() + hidden.size() > kDICTIONARY_DELTA_LIMIT) {
+    Rebase(CompileWords(VisibleEntries(base, added, hidden), size_));
+    return changed.size();
+  }
+
+  std::shared_ptr<DictionaryVersion> version = std::make_shared<DictionaryVersion>();
+  version->base = current->base;
+  version->added.Assign(std::move(added));
+  version->added_trie.Build(version->added, size_);
+  version->hidden.assign(hidden.begin(), hidden.end());
+  if (changed.size() > kMAX_SELECTIVE_INVALIDATIONS) {
+    Publish_(std::move(version), nullptr);
+  } else {
+    Publish_(std::move(version), [&changed](ScoredPattern const &key) {
+      return std::any_of(changed.begin(), changed.end(), [&key](ScoredPattern const &word) {
+        return word.score_min >= key.score_min && word.partial.Matches(key.partial);
+      });
+    });
+  }
+  return changed.size();
+}
+
+/**
+ * @brief Add a word to the database, or rescore it if it is already there.
+ *
+ * Safe while other threads query the database.
+ *
+ * @param entry
+ * @param frequency_score
+ * @param letter_score
+ */
+void WordDatabase::AddEntry(Word const &entry, const int frequency_score, const int letter_score) {
+  ApplyChanges({DictionaryChange(DictionaryChangeType::Add, entry, frequency_score, letter_score)});
+}
+
+/**
+ * @brief Remove a word from the database.
+ *
+ * Safe while other threads query the database.
+ *
+ * @param word
+ * @return true
+ * @return false the word was not in the database
+ */
+bool WordDatabase::RemoveEntry(Word const &word) {
+  return ApplyChanges({DictionaryChange(DictionaryChangeType::Remove, word)}) == 1;
+}
+
+/**
+ * @brief Change the frequency score of a word in the database.
+ *
+ * Safe while other threads query the database.
+ *
+ * @param word
+ * @param frequency_score
+ * @return true
+ * @return false the word was not in the database, or already had that score
+ */
+bool WordDatabase::RescoreEntry(Word const &word, const int frequency_score) {
+  return ApplyChanges({DictionaryChange(DictionaryChangeType::Rescore, word, frequency_score)}) == 1;
+}
+
+/**
+ * @brief Apply a batch of edits, e.g. a curated word list or a blocklist, in order.
+ *
+ * Each word length affected gets one new version. All of them are published under db_lock_, so a Snapshot
+ * sees either none of the batch or all of it. Safe while other threads query the database.
+ *
+ * @param changes words must be shorter than kMAX_DIM
+ * @return std::size_t number of changes that had an effect
+ */
+std::size_t WordDatabase::ApplyChanges(std::vector<DictionaryChange> const &changes) {
+  std::array<std::vector<DictionaryChange>, kMAX_DIM> by_length;
+  for (auto const &change: changes) {
+    assert(change.word.size() < kMAX_DIM);
+    by_length[change.word.size()].push_back(change);
+  }
+
+  const std::lock_guard<std::mutex> lock(db_lock_);
+  std::size_t applied = 0;
+  for (std::size_t length = 0; length < kMAX_DIM; ++length) {
+    if (!by_length[length].empty())
+      applied += databases_[length].ApplyChanges(by_length[length]);
+  }
+  return applied;
+}
+
+/**
+ * @brief The latest version of every sub-database, taken between writes.
+ *
+ * Pin it with a DictionaryPin to make a thread's queries read it.
+ *
+ * @return DictionarySnapshot
+ */
+DictionarySnapshot WordDatabase::Snapshot() {
+  const std::lock_guard<std::mutex> lock(db_lock_);
+  DictionarySnapshot snapshot;
+  for (std::size_t length = 0; length < kMAX_DIM; ++length)
+    snapshot.versions_[length] = databases_[length].GetVersion();
+  return snapshot;
+}
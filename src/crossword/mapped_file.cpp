@@ -0,0 +1,118 @@
+/**
+ * @file mapped_file.cpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Memory mapped file implementation
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "crossword/mapped_file.hpp"
+
+#include <utility>
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#endif
+
+using namespace crossword_backend;
+
+/**
+ * @brief Map a whole file read-only, replacing any current mapping.
+ *
+ * @param filename
+ * @return true the file is mapped
+ * @return false the file could not be opened or is empty
+ */
+bool MappedFile::Open(std::string const &filename) {
+  Close();
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr)
+    return false;
+  void const *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping); // The view keeps the mapping alive.
+  if (data == nullptr)
+    return false;
+  data_ = data;
+  size_ = static_cast<std::size_t>(file_size.QuadPart);
+#else
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat info{};
+  if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+  void *data = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // The mapping keeps the file alive.
+  if (data == MAP_FAILED)
+    return false;
+  data_ = data;
+  size_ = static_cast<std::size_t>(info.st_size);
+#endif
+  return true;
+}
+
+/**
+ * @brief Release the mapping, if any.
+ *
+ */
+void MappedFile::Close() {
+  if (data_ == nullptr)
+    return;
+#if defined(_WIN32)
+  UnmapViewOfFile(data_);
+#else
+  ::munmap(const_cast<void *>(data_), size_);
+#endif
+  data_ = nullptr;
+  size_ = 0;
+}
+
+/**
+ * @brief Take over another file's mapping.
+ *
+ * @param other left with no mapping
+ */
+MappedFile::MappedFile(MappedFile &&other) noexcept: data_(other.data_), size_(other.size_) {
+  other.data_ = nullptr;
+  other.size_ = 0;
+}
+
+/**
+ * @brief Release the current mapping and take over another file's.
+ *
+ * @param other left with no mapping
+ * @return MappedFile&
+ */
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    Close();
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+  }
+  return *this;
+}
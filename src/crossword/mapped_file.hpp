@@ -0,0 +1,468 @@
+/**
+ * @file mapped_file.hpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Read-only memory mapped files, and arrays that can live inside them.
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <type_traits>
+
+namespace crossword_backend {
+  /**
+   * @brief Alignment of every array in a blob, relative to the start of the blob.
+   *
+   */
+  constexpr std::size_t kBLOB_ALIGNMENT = 64;
+
+  /**
+   * @brief A whole file mapped read-only into memory.
+   *
+   * Movable, not copyable; the mapping is released on destruction.
+   *
+   */
+  class MappedFile {
+  public:
+    bool Open(std::string const &filename);
+
+    void Close();
+
+    /**
+     * @brief Start of the mapping, or nullptr if nothing is mapped.
+     *
+     * @return void const*
+     */
+    [[nodiscard]] void const *data() const { return data_; }
+
+    /**
+     * @brief Number of mapped bytes.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t size() const { return size_; }
+
+    /**
+     * @brief True iff a file is currently mapped.
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsOpen() const { return data_ != nullptr; }
+
+    MappedFile() : data_(nullptr), size_(0) {};
+
+    MappedFile(MappedFile &&other) noexcept;
+
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    MappedFile(MappedFile const &) = delete;
+
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    ~MappedFile() { Close(); }
+
+  private:
+    /**
+     * @brief Start of the mapping.
+     *
+     */
+    void const *data_;
+
+    /**
+     * @brief Length of the mapping.
+     *
+     */
+    std::size_t size_;
+  };
+
+  /**
+   * @brief Read-only array that either owns its elements or views memory owned by someone else,
+   * typically a MappedFile.
+   *
+   * Views are never written to; the mutating methods first copy the viewed elements into owned storage.
+   *
+   * @tparam T trivially copyable element type
+   */
+  template<typename T>
+  class FrozenArray {
+  public:
+    /**
+     * @brief Pointer to the first element.
+     *
+     * @return T const*
+     */
+    [[nodiscard]] T const *data() const { return data_; }
+
+    /**
+     * @brief Number of elements.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t size() const { return size_; }
+
+    /**
+     * @brief True iff there are no elements.
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool empty() const { return size_ == 0; }
+
+    [[nodiscard]] T const *begin() const { return data_; }
+
+    [[nodiscard]] T const *end() const { return data_ + size_; }
+
+    T const &operator[](const std::size_t index) const { return data_[index]; }
+
+    /**
+     * @brief Replace the elements with owned ones.
+     *
+     * @param elements
+     */
+    void Assign(std::vector<T> &&elements) {
+      owned_ = std::move(elements);
+      Own();
+    }
+
+    /**
+     * @brief Append an element, copying a view into owned storage first.
+     *
+     * @param element
+     */
+    void PushBack(T const &element) {
+      Thaw();
+      owned_.push_back(element);
+      Own();
+    }
+
+    /**
+     * @brief Append a range of elements, copying a view into owned storage first.
+     *
+     * @param begin
+     * @param end
+     */
+    void Append(T const *begin, T const *end) {
+      Thaw();
+      owned_.insert(owned_.end(), begin, end);
+      Own();
+    }
+
+    /**
+     * @brief Writable pointer to the elements, copying a view into owned storage first.
+     *
+     * Valid until the next Assign, PushBack, View or Clear.
+     *
+     * @return T*
+     */
+    T *MutableData() {
+      Thaw();
+      return owned_.data();
+    }
+
+    /**
+     * @brief Point at size elements owned elsewhere, releasing any owned storage.
+     *
+     * @param data must outlive the view
+     * @param size
+     */
+    void View(T const *data, const std::size_t size) {
+      std::vector<T>().swap(owned_);
+      is_view_ = true;
+      data_ = data;
+      size_ = size;
+    }
+
+    /**
+     * @brief Drop all elements.
+     *
+     */
+    void Clear() {
+      owned_.clear();
+      Own();
+    }
+
+    /**
+     * @brief True iff the elements are a view.
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsView() const { return is_view_; }
+
+    /**
+     * @brief Bytes of heap storage held, not counting views.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t MemoryUsage() const { return owned_.capacity() * sizeof(T); }
+
+    /**
+     * @brief Bytes of the elements, owned or viewed.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t ByteSize() const { return size_ * sizeof(T); }
+
+    FrozenArray() : data_(nullptr), size_(0), is_view_(false) {};
+
+    FrozenArray(FrozenArray const &other) : owned_(other.owned_), data_(other.data_), size_(other.size_),
+                                            is_view_(other.is_view_) {
+      if (!is_view_)
+        Own();
+    }
+
+    FrozenArray &operator=(FrozenArray const &other) {
+      if (this != &other) {
+        owned_ = other.owned_;
+        data_ = other.data_;
+        size_ = other.size_;
+        is_view_ = other.is_view_;
+        if (!is_view_)
+          Own();
+      }
+      return *this;
+    }
+
+  private:
+    /**
+     * @brief Copy a view into owned storage.
+     *
+     */
+    void Thaw() {
+      if (is_view_) {
+        owned_.assign(data_, data_ + size_);
+        Own();
+      }
+    }
+
+    /**
+     * @brief Point data_ and size_ back at owned storage.
+     *
+     */
+    void Own() {
+      is_view_ = false;
+      data_ = owned_.data();
+      size_ = owned_.size();
+    }
+
+    /**
+     * @brief Elements, when owned.
+     *
+     */
+    std::vector<T> owned_;
+
+    /**
+     * @brief First element, owned or viewed.
+     *
+     */
+    T const *data_;
+
+    /**
+     * @brief Number of elements.
+     *
+     */
+    std::size_t size_;
+
+    /**
+     * @brief Whether data_ points outside owned_.
+     *
+     */
+    bool is_view_;
+  };
+
+  /**
+   * @brief Writes a sequence of integers and aligned arrays, to be read back with BlobReader.
+   *
+   */
+  class BlobWriter {
+  public:
+    /**
+     * @brief Write one integer.
+     *
+     * @param value
+     */
+    void WriteValue(const std::uint64_t value) {
+      Pad(sizeof(std::uint64_t));
+      Write(&value, sizeof(value));
+    }
+
+    /**
+     * @brief Write an element count followed by the elements, aligned to kBLOB_ALIGNMENT.
+     *
+     * @tparam T
+     * @param data
+     * @param size
+     */
+    template<typename T>
+    void WriteArray(T const *data, const std::size_t size) {
+      static_assert(std::is_trivially_copyable<T>::value, "blob arrays are copied bytewise");
+      WriteValue(size);
+      Pad(kBLOB_ALIGNMENT);
+      Write(data, size * sizeof(T));
+    }
+
+    template<typename T>
+    void WriteArray(FrozenArray<T> const &array) { WriteArray(array.data(), array.size()); }
+
+    /**
+     * @brief True iff every write so far succeeded.
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool Ok() const { return out_.good(); }
+
+    explicit BlobWriter(std::ostream &out) : out_(out), offset_(0) {};
+
+  private:
+    /**
+     * @brief Write zeros up to the next multiple of alignment.
+     *
+     * @param alignment
+     */
+    void Pad(const std::size_t alignment) {
+      static const char kZEROS[kBLOB_ALIGNMENT] = {};
+      Write(kZEROS, (alignment - offset_ % alignment) % alignment);
+    }
+
+    /**
+     * @brief Write raw bytes.
+     *
+     * @param data
+     * @param size
+     */
+    void Write(void const *data, const std::size_t size) {
+      out_.write(static_cast<char const *>(data), static_cast<std::streamsize>(size));
+      offset_ += size;
+    }
+
+    /**
+     * @brief Destination stream.
+     *
+     */
+    std::ostream &out_;
+
+    /**
+     * @brief Bytes written so far.
+     *
+     */
+    std::size_t offset_;
+  };
+
+  /**
+   * @brief Reads back what a BlobWriter wrote, in place, from a block of memory such as a MappedFile.
+   *
+   * Reading past the end puts the reader in a failed state, after which every read yields zero or
+   * an empty array.
+   *
+   */
+  class BlobReader {
+  public:
+    /**
+     * @brief Read one integer.
+     *
+     * @return std::uint64_t
+     */
+    std::uint64_t ReadValue() {
+      std::uint64_t value = 0;
+      void const *at = Take(sizeof(std::uint64_t), sizeof(value));
+      if (at != nullptr)
+        std::memcpy(&value, at, sizeof(value));
+      return value;
+    }
+
+    /**
+     * @brief Make array a view of the next array in the blob. The blob must outlive it.
+     *
+     * @tparam T
+     * @param array
+     */
+    template<typename T>
+    void ReadArray(FrozenArray<T> &array) {
+      static_assert(std::is_trivially_copyable<T>::value, "blob arrays are copied bytewise");
+      const std::uint64_t size = ReadValue();
+      void const *at = size > (size_ - offset_) / sizeof(T) ? nullptr : Take(kBLOB_ALIGNMENT, size * sizeof(T));
+      if (at == nullptr) {
+        failed_ = true;
+        array.View(nullptr, 0);
+        return;
+      }
+      array.View(static_cast<T const *>(at), static_cast<std::size_t>(size));
+    }
+
+    /**
+     * @brief True iff every read so far was in bounds.
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool Ok() const { return !failed_; }
+
+    /**
+     * @brief Mark the blob as invalid, for readers that find inconsistent contents.
+     *
+     */
+    void Fail() { failed_ = true; }
+
+    BlobReader(void const *data, const std::size_t size) : data_(static_cast<unsigned char const *>(data)),
+                                                           size_(size), offset_(0), failed_(false) {};
+
+  private:
+    /**
+     * @brief Skip to the next multiple of alignment and consume size bytes.
+     *
+     * @param alignment
+     * @param size
+     * @return void const* start of the consumed bytes, or nullptr if out of bounds
+     */
+    void const *Take(const std::size_t alignment, const std::size_t size) {
+      if (failed_)
+        return nullptr;
+      const std::size_t start = offset_ + (alignment - offset_ % alignment) % alignment;
+      if (start > size_ || size > size_ - start) {
+        failed_ = true;
+        return nullptr;
+      }
+      offset_ = start + size;
+      return data_ + start;
+    }
+
+    /**
+     * @brief Start of the blob.
+     *
+     */
+    unsigned char const *data_;
+
+    /**
+     * @brief Length of the blob.
+     *
+     */
+    std::size_t size_;
+
+    /**
+     * @brief Bytes consumed so far.
+     *
+     */
+    std::size_t offset_;
+
+    /**
+     * @brief Set by the first out of bounds read.
+     *
+     */
+    bool failed_;
+  };
+}
+
+#endif
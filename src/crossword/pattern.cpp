@@ -0,0 +1,463 @@
+/**
+ * @file pattern.cpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Pattern analysis, fillability estimates and the pattern generator.
+ * @version 0.1
+ * @date 2022-04-25
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "crossword/pattern.hpp"
+#include "crossword/bits.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_set>
+
+using namespace crossword_backend;
+
+/**
+ * @brief Chance that a generator worker takes a move that makes its layout worse, to escape local minima.
+ *
+ */
+static const double kPATTERN_UPHILL_CHANCE = 0.01;
+
+/**
+ * @brief Chance that a generator worker toggles a cell that breaks a constraint, rather than any cell.
+ *
+ */
+static const double kPATTERN_REPAIR_CHANCE = 0.75;
+
+/**
+ * @brief Mask of the low bits of a line.
+ *
+ * @param length
+ * @return std::uint64_t
+ */
+static std::uint64_t LineMask(const std::size_t length) {
+  return (std::uint64_t{1} << length) - 1;
+}
+
+/**
+ * @brief Call f on the mask of each run of set bits in a line, lowest first.
+ *
+ * @tparam F
+ * @param open
+ * @param f
+ */
+template<typename F>
+static void ForEachRun(std::uint64_t open, F f) {
+  while (open != 0) {
+    const std::uint64_t carry = open + (open & (~open + 1)); // Clears the lowest run, sets the bit above it.
+    f(open & ~carry);
+    open &= carry;
+  }
+}
+
+/**
+ * @brief Analyze the pattern: its slots, the runs too short to be slots, and whether the open cells are
+ * connected.
+ *
+ * @param min_length shortest slot allowed
+ * @param allow_unchecked whether runs of one cell are allowed
+ * @return PatternAnalysis
+ */
+PatternAnalysis PatternBoard::Analyze(const std::size_t min_length, const bool allow_unchecked) const {
+  PatternAnalysis analysis;
+  const std::uint64_t row_mask = LineMask(width_);
+  const std::uint64_t col_mask = LineMask(height_);
+  const auto is_short = [&](const std::uint64_t run) {
+    const std::size_t length = static_cast<std::size_t>(PopCount64(run));
+    if (length >= min_length) {
+      analysis.slots++;
+      return false;
+    }
+    return length > 1 || !allow_unchecked;
+  };
+
+  for (std::size_t r = 0; r < height_; ++r) {
+    analysis.barriers += static_cast<std::size_t>(PopCount64(rows_[r]));
+    ForEachRun(~rows_[r] & row_mask, [&](const std::uint64_t run) {
+      if (!is_short(run))
+        return;
+      analysis.short_runs++;
+      analysis.violations[r] |= (run | run << 1 | run >> 1) & row_mask;
+    });
+  }
+  for (std::size_t c = 0; c < width_; ++c) {
+    ForEachRun(~cols_[c] & col_mask, [&](const std::uint64_t run) {
+      if (!is_short(run))
+        return;
+      analysis.short_runs++;
+      for (std::uint64_t cells = (run | run << 1 | run >> 1) & col_mask; cells != 0; cells &= cells - 1)
+        analysis.violations[CountTrailingZeros64(cells)] |= std::uint64_t{1} << c;
+    });
+  }
+
+  // Flood fill from the first open cell, a whole run at a time, sweeping down and up until nothing changes.
+  PatternLines open{};
+  PatternLines reached{};
+  std::size_t first = height_;
+  for (std::size_t r = 0; r < height_; ++r) {
+    open[r] = ~rows_[r] & row_mask;
+    if (first == height_ && open[r] != 0)
+      first = r;
+  }
+  if (first == height_)
+    return analysis;
+  reached[first] = open[first] & (~open[first] + 1);
+  const auto grow = [&](const std::size_t r) {
+    std::uint64_t seeds = reached[r];
+    if (r > 0)
+      seeds |= reached[r - 1];
+    if (r + 1 < height_)
+      seeds |= reached[r + 1];
+    seeds &= open[r];
+    if (seeds == 0 || (seeds & ~reached[r]) == 0)
+      return false;
+    std::uint64_t runs = 0;
+    ForEachRun(open[r], [&](const std::uint64_t run) {
+      if ((run & seeds) != 0)
+        runs |= run;
+    });
+    const bool changed = runs != reached[r];
+    reached[r] = runs;
+    return changed;
+  };
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (std::size_t r = 0; r < height_; ++r)
+      changed |= grow(r);
+    for (std::size_t r = height_; r-- > 0;)
+      changed |= grow(r);
+  }
+  for (std::size_t r = 0; r < height_; ++r) {
+    const std::uint64_t cut_off = open[r] & ~reached[r];
+    analysis.disconnected += static_cast<std::size_t>(PopCount64(cut_off));
+    analysis.violations[r] |= cut_off;
+  }
+  return analysis;
+}
+
+/**
+ * @brief Number of runs of open cells of exactly a length, across and down.
+ *
+ * @param length
+ * @return std::size_t
+ */
+std::size_t PatternBoard::CountRunsOfLength(const std::size_t length) const {
+  std::size_t count = 0;
+  const auto count_run = [&](const std::uint64_t run) {
+    count += static_cast<std::size_t>(PopCount64(run)) == length;
+  };
+  for (std::size_t r = 0; r < height_; ++r)
+    ForEachRun(~rows_[r] & LineMask(width_), count_run);
+  for (std::size_t c = 0; c < width_; ++c)
+    ForEachRun(~cols_[c] & LineMask(height_), count_run);
+  return count;
+}
+
+/**
+ * @brief Hash of the dimensions and barriers.
+ *
+ * @return std::uint64_t
+ */
+std::uint64_t PatternBoard::Hash() const {
+  std::uint64_t hash = height_ * kMAX_DIM + width_;
+  for (std::size_t r = 0; r < height_; ++r) {
+    hash = (hash ^ rows_[r]) * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+/**
+ * @brief Tally a dictionary's word counts and letter frequencies, for words up to a length.
+ *
+ * Takes about 26 count queries per letter position, so build one model and reuse it.
+ *
+ * @param db
+ * @param score_min words scoring lower are not counted
+ * @param max_length longest slot to expect
+ */
+FillabilityModel::FillabilityModel(WordDatabase &db, const int score_min, const std::size_t max_length)
+        : frequencies_((kMAX_DIM + 1) * kMAX_DIM * kATOM_COUNT, 0.f) {
+  assert(max_length <= kMAX_DIM);
+  log_words_.fill(kUNFILLABLE);
+  for (std::size_t length = 1; length <= max_length; ++length) {
+    Word blank;
+    for (std::size_t i = 0; i < length; ++i)
+      blank.push_back(Atom());
+    const std::size_t words = db.CountSolutions(blank, score_min);
+    if (words == 0)
+      continue;
+    log_words_[length] = std::log10(static_cast<double>(words));
+    for (std::size_t offset = 0; offset < length; ++offset) {
+      for (std::size_t code = 1; code < kATOM_COUNT; ++code) {
+        Word partial = blank;
+        partial.Set(offset, Atom::FromCode(static_cast<unsigned char>(code)));
+        frequencies_[(length * kMAX_DIM + offset) * kATOM_COUNT + code] =
+                static_cast<float>(db.CountSolutions(partial, score_min)) / static_cast<float>(words);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Base 10 logarithm of the expected number of fills of a pattern. Runs of one cell are not slots.
+ *
+ * @param board
+ * @return double kUNFILLABLE if some slot or crossing cannot be filled at all
+ */
+double FillabilityModel::Estimate(PatternBoard const &board) const {
+  // Length of, and offset in, the slot through each cell in each direction; 0 length for none.
+  std::array<std::array<std::array<std::uint8_t, kMAX_DIM>, kMAX_DIM>, 2> lengths{};
+  std::array<std::array<std::array<std::uint8_t, kMAX_DIM>, kMAX_DIM>, 2> offsets{};
+  double estimate = 0;
+  for (WordDirection direction: {kACROSS, kDOWN}) {
+    const std::size_t lines = direction == kACROSS ? board.GetHeight() : board.GetWidth();
+    const std::size_t cells = direction == kACROSS ? board.GetWidth() : board.GetHeight();
+    for (std::size_t line = 0; line < lines; ++line) {
+      std::size_t start = 0;
+      for (std::size_t k = 0; k <= cells; ++k) {
+        const Coord coord = direction == kACROSS ? Coord(line, k) : Coord(k, line);
+        if (k < cells && !board.IsBarrier(coord))
+          continue;
+        const std::size_t length = k - start;
+        if (length > 1) {
+          if (log_words_[length] == kUNFILLABLE)
+            return kUNFILLABLE;
+          estimate += log_words_[length];
+          for (std::size_t i = start; i < k; ++i) {
+            const Coord cell = direction == kACROSS ? Coord(line, i) : Coord(i, line);
+            lengths[direction][cell.row][cell.col] = static_cast<std::uint8_t>(length);
+            offsets[direction][cell.row][cell.col] = static_cast<std::uint8_t>(i - start);
+          }
+        }
+        start = k + 1;
+      }
+    }
+  }
+
+  for (std::size_t r = 0; r < board.GetHeight(); ++r) {
+    for (std::size_t c = 0; c < board.GetWidth(); ++c) {
+      const std::size_t across = lengths[kACROSS][r][c];
+      const std::size_t down = lengths[kDOWN][r][c];
+      if (across == 0 || down == 0)
+        continue;
+      double agree = 0;
+      for (std::size_t code = 1; code < kATOM_COUNT; ++code)
+        agree += static_cast<double>(Frequency(across, offsets[kACROSS][r][c], code)) *
+                 Frequency(down, offsets[kDOWN][r][c], code);
+      if (agree <= 0)
+        return kUNFILLABLE;
+      estimate += std::log10(agree);
+    }
+  }
+  return estimate;
+}
+
+/**
+ * @brief How far an analyzed layout is from meeting the parameters; 0 iff it meets them.
+ *
+ * @param analysis
+ * @param params
+ * @return std::size_t
+ */
+static std::size_t PatternCost(PatternAnalysis const &analysis, PatternParams const &params) {
+  std::size_t cost = 4 * analysis.short_runs + analysis.disconnected;
+  if (params.max_words > 0 && analysis.slots > params.max_words)
+    cost += analysis.slots - params.max_words;
+  if (analysis.barriers > params.max_barriers)
+    cost += 2 * (analysis.barriers - params.max_barriers);
+  return cost;
+}
+
+/**
+ * @brief A uniformly random set bit of some lines.
+ *
+ * @param lines
+ * @param height lines in use
+ * @param rng
+ * @param coord output
+ * @return true
+ * @return false no bit is set
+ */
+static bool RandomSetBit(PatternLines const &lines, const std::size_t height, std::mt19937_64 &rng, Coord &coord) {
+  std::size_t total = 0;
+  for (std::size_t r = 0; r < height; ++r)
+    total += static_cast<std::size_t>(PopCount64(lines[r]));
+  if (total == 0)
+    return false;
+  std::size_t pick = std::uniform_int_distribution<std::size_t>(0, total - 1)(rng);
+  for (std::size_t r = 0;; ++r) {
+    const std::size_t count = static_cast<std::size_t>(PopCount64(lines[r]));
+    if (pick >= count) {
+      pick -= count;
+      continue;
+    }
+    std::uint64_t bits = lines[r];
+    for (; pick > 0; --pick)
+      bits &= bits - 1;
+    coord = Coord(r, static_cast<std::size_t>(CountTrailingZeros64(bits)));
+    return true;
+  }
+}
+
+/**
+ * @brief Shared state of a pattern generator run.
+ *
+ */
+struct PatternSearch {
+  /**
+   * @brief What to generate.
+   *
+   */
+  PatternParams const &params;
+
+  /**
+   * @brief Fillability scores, or nullptr when not scoring.
+   *
+   */
+  FillabilityModel const *model;
+
+  /**
+   * @brief Set once enough patterns are found.
+   *
+   */
+  std::atomic<bool> done;
+
+  /**
+   * @brief Guards found and hashes.
+   *
+   */
+  std::mutex lock;
+
+  /**
+   * @brief Distinct patterns found so far.
+   *
+   */
+  std::vector<GeneratedPattern> found;
+
+  /**
+   * @brief Hashes of the boards in found.
+   *
+   */
+  std::unordered_set<std::uint64_t> hashes;
+
+  PatternSearch(PatternParams const &params, FillabilityModel const *model) : params(params), model(model),
+                                                                              done(false) {};
+};
+
+/**
+ * @brief Score a valid pattern and keep it if it is new and fillable enough.
+ *
+ * @param search
+ * @param board
+ * @param analysis
+ */
+static void OfferPattern(PatternSearch &search, PatternBoard const &board, PatternAnalysis const &analysis) {
+  const double fillability = search.model != nullptr ? search.model->Estimate(board) : 0;
+  if (search.model != nullptr && fillability < search.params.min_fillability)
+    return;
+  std::lock_guard<std::mutex> guard(search.lock);
+  if (search.done.load(std::memory_order_relaxed) || !search.hashes.insert(board.Hash()).second)
+    return;
+  search.found.emplace_back(board, analysis.slots, analysis.barriers, fillability);
+  if (search.found.size() >= search.params.count)
+    search.done.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Worker loop: local search over symmetric layouts, restarting from a random one after each pattern
+ * found or kPATTERN_STEPS_PER_RESTART moves.
+ *
+ * Each move toggles a symmetric pair of cells, usually one breaking a constraint, and is kept unless it
+ * moves the layout further from the constraints, bar the odd uphill move.
+ *
+ * @param search
+ * @param seed
+ * @param limit
+ */
+static void SearchPatterns(PatternSearch &search, const std::uint64_t seed, SearchLimit limit) {
+  PatternParams const &params = search.params;
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> chance(0, 1);
+  std::uniform_int_distribution<std::size_t> random_row(0, params.height - 1);
+  std::uniform_int_distribution<std::size_t> random_col(0, params.width - 1);
+  std::uniform_int_distribution<std::size_t> random_barriers(params.max_barriers / 2, params.max_barriers);
+
+  while (!search.done.load(std::memory_order_relaxed) && !limit.IsReached()) {
+    PatternBoard board(params.height, params.width);
+    for (std::size_t barriers = random_barriers(rng), placed = 0; placed + 1 < barriers; placed += 2)
+      board.SetSymmetricBarrier(Coord(random_row(rng), random_col(rng)), true);
+    PatternAnalysis analysis = board.Analyze(params.min_slot_length, params.allow_unchecked);
+    std::size_t cost = PatternCost(analysis, params);
+
+    for (std::size_t step = 0; step < kPATTERN_STEPS_PER_RESTART; ++step) {
+      if (cost == 0) {
+        OfferPattern(search, board, analysis);
+        break;
+      }
+      if (search.done.load(std::memory_order_relaxed) || limit.IsReached())
+        return;
+      Coord coord(random_row(rng), random_col(rng));
+      if (chance(rng) < kPATTERN_REPAIR_CHANCE)
+        RandomSetBit(analysis.violations, params.height, rng, coord);
+      const bool barrier = board.IsBarrier(coord);
+      board.SetSymmetricBarrier(coord, !barrier);
+      PatternAnalysis next = board.Analyze(params.min_slot_length, params.allow_unchecked);
+      const std::size_t next_cost = PatternCost(next, params);
+      if (next_cost <= cost || chance(rng) < kPATTERN_UPHILL_CHANCE) {
+        analysis = next;
+        cost = next_cost;
+      } else {
+        board.SetSymmetricBarrier(coord, barrier);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Search for distinct rotationally symmetric barrier patterns meeting the parameters, in parallel.
+ *
+ * Every open cell of a pattern is in an across and a down slot (unless unchecked cells are allowed), every
+ * slot is at least the minimum length, the open cells are connected, and the word and barrier limits hold.
+ *
+ * @param params
+ * @param token may be nullptr
+ * @return std::vector<GeneratedPattern> up to params.count patterns, most fillable first; fewer if time ran out
+ */
+std::vector<GeneratedPattern> crossword_backend::GeneratePatterns(PatternParams const &params,
+                                                                  CancellationToken const *token) {
+  assert(params.height > 2 && params.width > 2 && params.height <= kMAX_DIM && params.width <= kMAX_DIM);
+  assert(params.min_slot_length > 1);
+
+  std::unique_ptr<FillabilityModel> model;
+  if (params.db != nullptr)
+    model.reset(new FillabilityModel(*params.db, params.score_min, std::max(params.height, params.width)));
+
+  PatternSearch search(params, model.get());
+  const SearchLimit limit(token, std::chrono::steady_clock::now() + std::chrono::seconds(params.seconds_limit));
+  const std::size_t threads = params.threads > 0 ? static_cast<std::size_t>(params.threads)
+                                                 : std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::thread> workers;
+  for (std::size_t i = 1; i < threads; ++i)
+    workers.emplace_back(SearchPatterns, std::ref(search), params.seed + i, limit);
+  SearchPatterns(search, params.seed, limit);
+  for (auto &worker: workers)
+    worker.join();
+
+  std::stable_sort(search.found.begin(), search.found.end(), [](GeneratedPattern const &a, GeneratedPattern const &b) {
+    return a.fillability > b.fillability;
+  });
+  return search.found;
+}
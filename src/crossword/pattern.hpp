@@ -0,0 +1,379 @@
+/**
+ * @file pattern.hpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Bitboard barrier patterns, and a parallel generator of valid symmetric ones.
+ * @version 0.1
+ * @date 2022-04-25
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef PATTERN_HPP
+#define PATTERN_HPP
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "crossword/base.hpp"
+#include "crossword/cancellation.hpp"
+#include "crossword/database.hpp"
+
+namespace crossword_backend {
+  static_assert(kMAX_DIM < 64, "pattern rows must fit in a 64-bit word");
+
+  /**
+   * @brief Shortest slot allowed in generated patterns by default.
+   *
+   */
+  constexpr std::size_t kPATTERN_MIN_SLOT = 3;
+
+  /**
+   * @brief Moves a generator worker tries on one starting layout before restarting from a new one.
+   *
+   */
+  constexpr std::size_t kPATTERN_STEPS_PER_RESTART = 4000;
+
+  /**
+   * @brief Fillability of a pattern with a slot length the dictionary has no words for.
+   *
+   */
+  constexpr double kUNFILLABLE = -1e300;
+
+  /**
+   * @brief One row or column of a pattern per 64-bit word.
+   *
+   */
+  typedef std::array<std::uint64_t, kMAX_DIM> PatternLines;
+
+  /**
+   * @brief What PatternBoard::Analyze found.
+   *
+   */
+  struct PatternAnalysis {
+    /**
+     * @brief Runs of open cells at least the minimum slot length, across and down.
+     *
+     */
+    std::size_t slots;
+
+    /**
+     * @brief Runs of open cells shorter than the minimum slot length, across and down.
+     *
+     */
+    std::size_t short_runs;
+
+    /**
+     * @brief Barrier cells.
+     *
+     */
+    std::size_t barriers;
+
+    /**
+     * @brief Open cells not connected to the first open cell. 0 iff the open cells are connected.
+     *
+     */
+    std::size_t disconnected;
+
+    /**
+     * @brief Cells in short runs or disconnected, by row; what has to change for the pattern to be valid.
+     *
+     */
+    PatternLines violations;
+
+    PatternAnalysis() : slots(0), short_runs(0), barriers(0), disconnected(0), violations{} {};
+  };
+
+  /**
+   * @brief A grid's barriers as bitboards, one bit per cell, kept both by row and by column.
+   *
+   * Cheap to copy and to analyze: slots are found with a few bit
+   * operations per run rather than cell by cell, and connectivity by flood filling whole rows at once.
+   *
+   */
+  class PatternBoard {
+  public:
+    /**
+     * @brief Height of the grid.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t GetHeight() const { return height_; }
+
+    /**
+     * @brief Width of the grid.
+     *
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t GetWidth() const { return width_; }
+
+    /**
+     * @brief True iff a cell is a barrier.
+     *
+     * @param coord must be in bounds
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsBarrier(const Coord coord) const {
+      assert(coord.row < height_ && coord.col < width_);
+      return (rows_[coord.row] >> coord.col & 1) != 0;
+    }
+
+    /**
+     * @brief Make a cell a barrier or open.
+     *
+     * @param coord must be in bounds
+     * @param value
+     */
+    void SetBarrier(const Coord coord, const bool value) {
+      assert(coord.row < height_ && coord.col < width_);
+      if (value) {
+        rows_[coord.row] |= std::uint64_t{1} << coord.col;
+        cols_[coord.col] |= std::uint64_t{1} << coord.row;
+      } else {
+        rows_[coord.row] &= ~(std::uint64_t{1} << coord.col);
+        cols_[coord.col] &= ~(std::uint64_t{1} << coord.row);
+      }
+    }
+
+    /**
+     * @brief Make a cell and its rotationally symmetric pair barriers or open.
+     *
+     * @param coord must be in bounds
+     * @param value
+     */
+    void SetSymmetricBarrier(const Coord coord, const bool value) {
+      SetBarrier(coord, value);
+      SetBarrier(Coord(height_ - 1 - coord.row, width_ - 1 - coord.col), value);
+    }
+
+    [[nodiscard]] PatternAnalysis Analyze(std::size_t min_length, bool allow_unchecked) const;
+
+    [[nodiscard]] std::size_t CountRunsOfLength(std::size_t length) const;
+
+    [[nodiscard]] std::uint64_t Hash() const;
+
+    /**
+     * @brief True iff the boards have the same dimensions and barriers.
+     *
+     * @param other
+     * @return true
+     * @return false
+     */
+    bool operator==(PatternBoard const &other) const {
+      return height_ == other.height_ && width_ == other.width_ && rows_ == other.rows_;
+    }
+
+    /**
+     * @brief Construct an open board.
+     *
+     * @param height in [1, kMAX_DIM]
+     * @param width in [1, kMAX_DIM]
+     */
+    PatternBoard(const std::size_t height, const std::size_t width) : height_(height), width_(width), rows_{},
+                                                                      cols_{} {
+      assert(height > 0 && width > 0 && height <= kMAX_DIM && width <= kMAX_DIM);
+    };
+
+  private:
+    /**
+     * @brief Height of the grid.
+     *
+     */
+    std::size_t height_;
+
+    /**
+     * @brief Width of the grid.
+     *
+     */
+    std::size_t width_;
+
+    /**
+     * @brief Bit c of rows_[r] is set iff (r, c) is a barrier.
+     *
+     */
+    PatternLines rows_;
+
+    /**
+     * @brief Bit r of cols_[c] is set iff (r, c) is a barrier.
+     *
+     */
+    PatternLines cols_;
+  };
+
+  /**
+   * @brief Estimates how fillable a pattern is from how many words the dictionary has per slot length and
+   * how often each letter appears at each position.
+   *
+   * The estimate is the base 10 logarithm of the expected number of fills if words were drawn independently
+   * per slot: the product of the word counts of every slot, times, for every checked cell, the probability
+   * that the words crossing there agree on its letter.
+   *
+   */
+  class FillabilityModel {
+  public:
+    [[nodiscard]] double Estimate(PatternBoard const &board) const;
+
+    FillabilityModel(WordDatabase &db, int score_min, std::size_t max_length);
+
+  private:
+    /**
+     * @brief Fraction of the words of a length with a letter at a position.
+     *
+     * @param length
+     * @param offset
+     * @param code
+     * @return float
+     */
+    [[nodiscard]] float Frequency(const std::size_t length, const std::size_t offset, const std::size_t code) const {
+      return frequencies_[(length * kMAX_DIM + offset) * kATOM_COUNT + code];
+    }
+
+    /**
+     * @brief Base 10 logarithm of the number of words of each length, or kUNFILLABLE if there are none.
+     *
+     */
+    std::array<double, kMAX_DIM + 1> log_words_;
+
+    /**
+     * @brief Letter frequencies, indexed by length, position and atom code.
+     *
+     */
+    std::vector<float> frequencies_;
+  };
+
+  /**
+   * @brief What patterns to generate, and how.
+   *
+   */
+  struct PatternParams {
+    /**
+     * @brief Height of the grid.
+     *
+     */
+    std::size_t height;
+
+    /**
+     * @brief Width of the grid.
+     *
+     */
+    std::size_t width;
+
+    /**
+     * @brief Shortest slot allowed.
+     *
+     */
+    std::size_t min_slot_length;
+
+    /**
+     * @brief Whether open cells may belong to only one slot, i.e. sit in a run of one in the other direction.
+     *
+     */
+    bool allow_unchecked;
+
+    /**
+     * @brief Most slots allowed, across and down. 0 for no limit.
+     *
+     */
+    std::size_t max_words;
+
+    /**
+     * @brief Most barriers allowed.
+     *
+     */
+    std::size_t max_barriers;
+
+    /**
+     * @brief Number of distinct patterns wanted.
+     *
+     */
+    std::size_t count;
+
+    /**
+     * @brief Worker threads. 0 for one per hardware thread.
+     *
+     */
+    int threads;
+
+    /**
+     * @brief Seed of worker i's random generator is seed + i.
+     *
+     */
+    unsigned int seed;
+
+    /**
+     * @brief Seconds to search for at most.
+     *
+     */
+    int seconds_limit;
+
+    /**
+     * @brief Dictionary to score fillability with, or nullptr to skip scoring.
+     *
+     */
+    WordDatabase *db;
+
+    /**
+     * @brief Minimum word score counted by the fillability model.
+     *
+     */
+    int score_min;
+
+    /**
+     * @brief Patterns scoring lower are discarded. Only with a db.
+     *
+     */
+    double min_fillability;
+
+    /**
+     * @brief Construct parameters for a grid, with barriers limited to a sixth of the cells.
+     *
+     * @param height
+     * @param width
+     */
+    PatternParams(const std::size_t height, const std::size_t width)
+            : height(height), width(width), min_slot_length(kPATTERN_MIN_SLOT), allow_unchecked(false),
+              max_words(0), max_barriers(height * width / 6), count(1), threads(0), seed(0), seconds_limit(10),
+              db(nullptr), score_min(50), min_fillability(kUNFILLABLE) {};
+  };
+
+  /**
+   * @brief A generated pattern and its statistics.
+   *
+   */
+  struct GeneratedPattern {
+    /**
+     * @brief The barriers.
+     *
+     */
+    PatternBoard board;
+
+    /**
+     * @brief Slots, across and down.
+     *
+     */
+    std::size_t words;
+
+    /**
+     * @brief Barrier cells.
+     *
+     */
+    std::size_t barriers;
+
+    /**
+     * @brief FillabilityModel::Estimate, or 0 when not scored.
+     *
+     */
+    double fillability;
+
+    GeneratedPattern(PatternBoard const &board, const std::size_t words, const std::size_t barriers,
+                     const double fillability) : board(board), words(words), barriers(barriers),
+                                                 fillability(fillability) {};
+  };
+
+  std::vector<GeneratedPattern> GeneratePatterns(PatternParams const &params, CancellationToken const *token);
+}
+
+#endif
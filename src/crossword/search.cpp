@@ -10,15 +10,22 @@
  */
 
 #include "crossword/crossword.hpp"
+#include "crossword/search_progress.hpp"
 
 #include <thread>
 #include <chrono>
 #include <atomic>
-#include <map>
+#include <unordered_set>
 #include <algorithm>
 #include <random>
 
-#if defined(__gnu_linux__)
+#if defined(__gnu_linux__) && defined(__has_include)
+#if __has_include("valgrind/callgrind.h")
+#define CROSSWORD_HAS_CALLGRIND
+#endif
+#endif
+
+#if defined(CROSSWORD_HAS_CALLGRIND)
 
 #include "valgrind/callgrind.h"
 
@@ -67,12 +74,12 @@ Crossword::IsInvalidPartial(std::vector<Clue> const &all_clues, WordDatabase &db
     if (it->IsFilled()) {
       if (it->IsLocked())
         continue; // filled and locked is OK
-      if (!it->IsSolved(db)) {
+      const int score = db.FindFrequencyScore(it->ToWord());
+      if (score == kNO_NUMBER) {
         return Solvability::Invalid; // clue is solved incorrectly
       } else {
         // solved correctly, but we want to eliminate words with worse score than score_min
-        Word w = it->ToWord();
-        if (db.GetFrequencyScore(w) < score_min) {
+        if (score < score_min) {
           return Solvability::Weak; // solved with an unsatisfactory score
         }
       }
@@ -88,16 +95,11 @@ Crossword::IsInvalidPartial(std::vector<Clue> const &all_clues, WordDatabase &db
 
   // create set to eliminate solutions with duplicate words
   // do we want to do this before or after the previous? guessing after
-  // if this ends up being hotspot we can TODO: make it incrementally updated
-  std::map<Word, int> word_set;
+  // the search itself keeps this incrementally in SearchState::word_counts
+  std::unordered_set<Word, WordHash> word_set;
   for (auto it = std::begin(all_clues); it != std::end(all_clues); ++it) {
     if (it->IsFilled()) {
-      Word word = it->ToWord();
-      if (word_set.find(word) == word_set.end()) {
-        word_set[word] = 0;
-      }
-      word_set[word] += 1;
-      if (word_set[word] >= 2) {
+      if (!word_set.insert(it->ToWord()).second) {
         return Solvability::Duplicate;
       }
     }
@@ -106,6 +108,133 @@ Crossword::IsInvalidPartial(std::vector<Clue> const &all_clues, WordDatabase &db
   return Solvability::Solvable;
 }
 
+/**
+ * @brief Recompute one slot's entry in a search state, keeping the counters and word multiset in step.
+ *
+ * The status follows the per-clue checks of IsInvalidPartial exactly.
+ *
+ * @param state
+ * @param slot index into Clues()
+ * @param db
+ */
+void Crossword::UpdateSlotState(SearchState &state, const std::size_t slot, WordDatabase &db) const {
+  Clue const &clue = Clues()[slot];
+
+  if (state.status[slot] != Solvability::Solvable)
+    state.rejected_count--;
+  if (!state.solved[slot])
+    state.unsolved_count--;
+  if (state.counted[slot]) {
+    int &count = state.word_counts[state.words[slot]];
+    if (--count > 0)
+      state.duplicate_count--;
+    state.counted[slot] = false;
+  }
+
+  Solvability status = Solvability::Solvable;
+  bool solved = false;
+  if (clue.IsFilled()) {
+    state.words[slot] = clue.ToWord();
+    const int score = db.FindFrequencyScore(state.words[slot]);
+    solved = score != kNO_NUMBER;
+    if (!clue.IsLocked()) {
+      if (!solved)
+        status = Solvability::Invalid;
+      else if (score < state.score_min)
+        status = Solvability::Weak;
+    }
+    state.counted[slot] = true;
+    if (++state.word_counts[state.words[slot]] > 1)
+      state.duplicate_count++;
+  } else if (!db.HasSolution(clue, state.score_min)) {
+    status = Solvability::Overdetermined;
+  }
+
+  state.status[slot] = status;
+  state.solved[slot] = solved;
+  if (status != Solvability::Solvable)
+    state.rejected_count++;
+  if (!solved)
+    state.unsolved_count++;
+}
+
+/**
+ * @brief Check every slot from scratch, starting a search state for the current grid.
+ *
+ * @param state
+ * @param db
+ * @param score_min threshold for the Weak and Overdetermined checks
+ */
+void Crossword::ResetSearchState(SearchState &state, WordDatabase &db, const int score_min) const {
+  std::vector<Clue> const &all_clues = Clues();
+  const std::size_t count = all_clues.size();
+
+  // Every slot starts out counted as rejected and unsolved, so UpdateSlotState can take it back.
+  state.status.assign(count, Solvability::Invalid);
+  state.solved.assign(count, false);
+  state.words.assign(count, Word());
+  state.counted.assign(count, false);
+  state.word_counts.clear();
+  state.touched.clear();
+  state.is_touched.assign(count, false);
+  state.fill_order = FillOrder(all_clues);
+  state.rejected_count = count;
+  state.unsolved_count = count;
+  state.duplicate_count = 0;
+  state.score_min = score_min;
+
+  for (std::size_t slot = 0; slot < count; ++slot)
+    UpdateSlotState(state, slot, db);
+}
+
+/**
+ * @brief Re-check the slots touched since the last refresh.
+ *
+ * @param state
+ * @param db
+ */
+void Crossword::RefreshSearchState(SearchState &state, WordDatabase &db) const {
+  for (std::size_t slot: state.touched) {
+    state.is_touched[slot] = false;
+    UpdateSlotState(state, slot, db);
+  }
+  state.touched.clear();
+}
+
+/**
+ * @brief Indices of the clues in the order the search fills them: by distance to the upper left.
+ *
+ * @param all_clues
+ * @return std::vector<std::size_t>
+ */
+std::vector<std::size_t> Crossword::FillOrder(std::vector<Clue> const &all_clues) const {
+  std::vector<std::size_t> order(all_clues.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+
+  // TODO: Manhattan or Euclidean? and break ties properly
+  std::sort(order.begin(), order.end(), [&all_clues](std::size_t index_a, std::size_t index_b) {
+    Clue const &clue_a = all_clues[index_a];
+    Clue const &clue_b = all_clues[index_b];
+    Coord a = clue_a.GetStart();
+    Coord b = clue_b.GetStart();
+    if (a == b) return clue_a.GetDirection() == kACROSS;
+
+    double da = a.row + a.col;//std::sqrt(static_cast<double>(a.row*a.row + a.col*a.col));
+    double db = b.row + b.col;//std::sqrt(static_cast<double>(b.row*b.row + b.col*b.col));
+
+    if (da == db) {
+      if (a.row == b.row) {
+        return clue_a.GetDirection() == kACROSS;
+      }
+      return a.row < b.row;
+    }
+
+    return da < db;
+  });
+  return order;
+}
+
 /**
  * @brief Returns actions corresponding to possible word fills, subject to a minimum score.
  *
@@ -122,87 +251,1069 @@ Crossword::IsInvalidPartial(std::vector<Clue> const &all_clues, WordDatabase &db
  */
 std::vector<CrosswordActionGroup *>
 Crossword::GetWordFills(std::vector<Clue> const &all_clues, AutofillParams const &params) const {
+  return GetWordFills(all_clues, FillOrder(all_clues), params);
+}
+
+/**
+ * @brief Returns actions corresponding to possible word fills, taking clues in a precomputed order.
+ *
+ * @param all_clues
+ * @param fill_order indices into all_clues, as returned by FillOrder
+ * @param params
+ * @return std::vector<CrosswordActionGroup *>
+ */
+std::vector<CrosswordActionGroup *>
+Crossword::GetWordFills(std::vector<Clue> const &all_clues, std::vector<std::size_t> const &fill_order,
+                        AutofillParams const &params) const {
+  std::vector<Word> words;
+  const std::size_t slot = GetWordCandidates(all_clues, fill_order, params, words);
+
+  std::vector<CrosswordActionGroup *> actions;
+  actions.reserve(words.size());
+  for (auto const &word: words) {
+    actions.push_back(new CrosswordActionGroup(*this, all_clues[slot], word));
+  }
+  return actions;
+}
+
+/**
+ * @brief Picks the open slot to fill next and the words to try in it, in order, subject to a minimum score.
+ *
+ * @param all_clues
+ * @param fill_order indices into all_clues, as returned by FillOrder
+ * @param params
+ * @param words output; left empty if every slot is filled
+ * @return std::size_t index of the slot in all_clues, or all_clues.size() if every slot is filled
+ */
+std::size_t
+Crossword::GetWordCandidates(std::vector<Clue> const &all_clues, std::vector<std::size_t> const &fill_order,
+                             AutofillParams const &params, std::vector<Word> &words) const {
   double entropy = params.entropy;
   int limit = params.branching_factor_limit;
   WordDatabase &db = *params.db;
   int score_min = params.score_min;
 
   assert(0 <= entropy && entropy <= 100);
+  assert(fill_order.size() == all_clues.size());
 
   // TODO: move this to global
   auto rng = std::default_random_engine{};
   //rng.seed(static_cast<unsigned int>(time(0)));
-  rng.seed(0); // deterministic for debugging
+  rng.seed(params.seed); // deterministic for debugging
 
-  std::vector<Clue> clues = all_clues;
+  words.clear();
 
-  // Sort by distance to upper left. TODO: put this in the GetClues method and cache it.
-  // TODO: Manhattan or Euclidean? and break ties properly
-  std::sort(clues.begin(), clues.end(), [](Clue const &clue_a, Clue const &clue_b) {
-    Coord a = clue_a.GetStart();
-    Coord b = clue_b.GetStart();
-    if (a == b) return clue_a.GetDirection() == kACROSS;
+  // Only allow one open slot to be filled, as noted above.
+  std::size_t slot = all_clues.size();
+  if (params.ordering == SlotOrdering::MostConstrained) {
+    slot = MostConstrainedSlot(all_clues, fill_order, db, score_min);
+  } else {
+    slot = FirstOpenSlot(all_clues, fill_order);
+  }
+  if (slot == all_clues.size())
+    return slot;
+  Clue const &clue = all_clues[slot];
 
-    double da = a.row + a.col;//std::sqrt(static_cast<double>(a.row*a.row + a.col*a.col));
-    double db = b.row + b.col;//std::sqrt(static_cast<double>(b.row*b.row + b.col*b.col));
+  words = db.GetSolutions(clue, kNO_NUMBER, score_min); // Best ranked first.
+  if (domains_ != nullptr) {
+    words.erase(std::remove_if(words.begin(), words.end(), [&](Word const &word) {
+      return !domains_->Allows(slot, word);
+    }), words.end());
+  }
 
-    if (da == db) {
-      if (a.row == b.row) {
-        return clue_a.GetDirection() == kACROSS;
+  // Apply randomness as parameterized by entropy
+  std::size_t shuffle_count = static_cast<std::size_t>(std::min(1., entropy / 100.) *
+                                                       static_cast<double>(words.size()));
+  assert(shuffle_count <= words.size());
+  std::shuffle(std::begin(words), std::begin(words) + shuffle_count, rng);
+
+  if (params.ordering == SlotOrdering::MostConstrained)
+    OrderLeastConstraining(clue, words, db, score_min); // Stable, so the shuffle still breaks ties.
+
+  // The limit has always let one word past it.
+  if (limit != kNO_NUMBER && words.size() > static_cast<std::size_t>(limit) + 1)
+    words.resize(static_cast<std::size_t>(limit) + 1);
+  return slot;
+}
+
+/**
+ * @brief First open slot in fill_order.
+ *
+ * @param all_clues
+ * @param fill_order
+ * @return std::size_t index into all_clues, or all_clues.size() if every slot is filled
+ */
+std::size_t Crossword::FirstOpenSlot(std::vector<Clue> const &all_clues,
+                                     std::vector<std::size_t> const &fill_order) const {
+  for (std::size_t index: fill_order) {
+    if (!all_clues[index].IsFilled())
+      return index;
+  }
+  return all_clues.size();
+}
+
+/**
+ * @brief Open slot with the fewest candidate words, ties going to the slot crossing the most open slots,
+ * then to the earliest in fill_order.
+ *
+ * @param all_clues
+ * @param fill_order
+ * @param db
+ * @param score_min
+ * @return std::size_t index into all_clues, or all_clues.size() if every slot is filled
+ */
+std::size_t Crossword::MostConstrainedSlot(std::vector<Clue> const &all_clues,
+                                           std::vector<std::size_t> const &fill_order, WordDatabase &db,
+                                           const int score_min) const {
+  std::size_t best = all_clues.size();
+  std::size_t best_count = 0;
+  std::size_t best_degree = 0;
+  for (std::size_t index: fill_order) {
+    Clue const &clue = all_clues[index];
+    if (clue.IsFilled())
+      continue;
+
+    const std::size_t count = db.CountSolutions(clue.ToWord(), score_min);
+    std::size_t degree = 0;
+    for (std::size_t position = 0; position < clue.GetSize(); ++position) {
+      if (!clue.GetConstraint(position).IsEmpty())
+        continue;
+      Coord coord = clue.coord_list_[position];
+      const WordDirection other = clue.GetDirection() == kACROSS ? kDOWN : kACROSS;
+      if (clue_cache_.slot_ids[other][coord.row][coord.col] != kNO_SLOT)
+        degree++;
+    }
+
+    if (best == all_clues.size() || count < best_count || (count == best_count && degree > best_degree)) {
+      best = index;
+      best_count = count;
+      best_degree = degree;
+    }
+    if (count == 0)
+      break; // Dead end; nothing can be more constrained.
+  }
+  return best;
+}
+
+/**
+ * @brief Sort candidate words for a clue so that those leaving the most candidates to the crossing slots
+ * come first, and drop those leaving some crossing slot with none.
+ *
+ * Dropped words would only be rejected by the search after being placed.
+ *
+ * @param clue open slot the words are for
+ * @param words candidates, sorted in place
+ * @param db
+ * @param score_min
+ */
+void Crossword::OrderLeastConstraining(Clue const &clue, std::vector<Word> &words, WordDatabase &db,
+                                       const int score_min) const {
+  /**
+   * @brief Open position of the clue and the slot crossing it there.
+   */
+  struct Crossing {
+    std::size_t position;
+    Clue const *clue;
+    std::size_t index;
+  };
+
+  /**
+   * @brief Candidate word and the candidates it leaves to the crossing slots.
+   */
+  struct Candidate {
+    Word word;
+    std::size_t options;
+  };
+
+  std::vector<Crossing> crossings;
+  for (std::size_t position = 0; position < clue.GetSize(); ++position) {
+    if (!clue.GetConstraint(position).IsEmpty())
+      continue;
+    Coord coord = clue.coord_list_[position];
+    const WordDirection other = clue.GetDirection() == kACROSS ? kDOWN : kACROSS;
+    const std::uint16_t slot = clue_cache_.slot_ids[other][coord.row][coord.col];
+    if (slot != kNO_SLOT)
+      crossings.push_back(Crossing{position, &clue_cache_.clues[slot],
+                                   clue_cache_.slot_offsets[other][coord.row][coord.col]});
+  }
+
+  std::vector<Candidate> candidates;
+  candidates.reserve(words.size());
+  for (auto const &word: words) {
+    std::size_t options = 0;
+    bool viable = true;
+    for (auto const &crossing: crossings) {
+      Word pattern = crossing.clue->ToWord();
+      pattern.Set(crossing.index, word[crossing.position]);
+      const std::size_t count = db.CountSolutions(pattern, score_min);
+      if (count == 0) {
+        viable = false;
+        break;
       }
-      return a.row < b.row;
+      options += count;
     }
+    if (viable)
+      candidates.push_back(Candidate{word, options});
+  }
 
-    return da < db;
+  std::stable_sort(candidates.begin(), candidates.end(), [](Candidate const &a, Candidate const &b) {
+    return a.options > b.options;
   });
+  words.clear();
+  for (auto const &candidate: candidates)
+    words.push_back(candidate.word);
+}
 
-  std::vector<CrosswordActionGroup *> actions;
-  if (limit != kNO_NUMBER)
-    actions.reserve(limit);
-  else
-    actions.reserve(100); // TODO: fix pre allocation
+/**
+ * @brief Narrow the candidates of every open slot to the words whose letter at each checked cell some candidate
+ * of the crossing slot shares (AC-3 over the slot crossings).
+ *
+ * Each slot's candidates are extended with the words its cursor yields at score_min past the ones state holds
+ * from earlier passes, and all of them are restored before revising. Only empty cells crossed by two open
+ * slots are checked; letters already in the grid are part of both patterns. Whenever a slot loses words, the
+ * letters it can still offer each cell are recomputed, and the slots crossing a cell that lost a letter are
+ * revised again. Removed words cannot be part of any fill of the current grid, so skipping them loses no
+ * solutions.
+ *
+ * @param state candidates of the earlier passes over this grid, extended
+ * @param domains output, indexed like Clues()
+ * @param db
+ * @param score_min no higher than in earlier calls with the same state
+ * @param limit polled once per word streamed in and once per revision; once reached, propagation stops and
+ * restricts nothing, keeping the words streamed in so far for the next pass
+ * @param pruned incremented by the number of words removed
+ * @return true
+ * @return false some slot was left without candidates, so the grid has no fill at score_min
+ */
+bool Crossword::PropagateDomains(PropagationState &state, SlotDomains &domains, WordDatabase &db,
+                                 const int score_min, SearchLimit &limit, std::uint64_t &pruned) const {
+  static_assert(kATOM_COUNT <= 32, "letter sets must fit in 32 bits");
+
+  /**
+   * @brief Position of a slot and the slot crossing it there.
+   */
+  struct Crossing {
+    std::size_t position;
+    std::size_t slot;
+    std::size_t offset;
+  };
+
+  std::vector<Clue> const &clues = Clues();
+  const std::size_t slot_count = clues.size();
+  state.candidates.resize(slot_count);
+  domains.checks.assign(slot_count, std::vector<LetterCheck>());
+  std::vector<std::vector<Crossing>> crossings(slot_count);
+  std::vector<DictionaryVersion const *> versions(slot_count, nullptr);
+  std::vector<std::size_t> survivors(slot_count, 0);
+  std::vector<std::array<std::uint32_t, kMAX_DIM>> letters(slot_count);
+
+  // Letters each slot's surviving candidates offer at each checked position.
+  auto gather = [&](const std::size_t slot) {
+    letters[slot].fill(0);
+    std::vector<std::uint32_t> const &candidates = state.candidates[slot];
+    for (std::size_t i = 0; i < survivors[slot]; ++i) {
+      Word const &word = versions[slot]->Entry(candidates[i]).entry;
+      for (auto const &crossing: crossings[slot])
+        letters[slot][crossing.position] |= std::uint32_t{1} << word[crossing.position].GetCode();
+    }
+  };
 
-  int i = 0;
-  for (auto clue_it = std::begin(clues); clue_it != std::end(clues); ++clue_it) {
-    if (clue_it->IsFilled())
+  for (std::size_t slot = 0; slot < slot_count; ++slot) {
+    Clue const &clue = clues[slot];
+    if (clue.IsFilled())
       continue;
+    const Word pattern = clue.ToWord();
+    const WordDirection other = clue.GetDirection() == kACROSS ? kDOWN : kACROSS;
+    for (std::size_t position = 0; position < clue.GetSize(); ++position) {
+      Coord coord = clue.coord_list_[position];
+      const std::uint16_t crossing = clue_cache_.slot_ids[other][coord.row][coord.col];
+      if (crossing != kNO_SLOT && pattern[position].IsEmpty())
+        crossings[slot].push_back(Crossing{position, crossing,
+                                           clue_cache_.slot_offsets[other][coord.row][coord.col]});
+    }
 
-    std::vector<Word> sols = db.GetSolutions(*clue_it, kNO_NUMBER, score_min);
-    // assume sorted; should be guranteed...
+    std::vector<std::uint32_t> &candidates = state.candidates[slot];
+    SolutionCursor cursor = db.OpenCursor(pattern, score_min);
+    versions[slot] = cursor.GetVersion();
+    std::uint32_t index;
+    for (std::size_t held = 0; held < candidates.size() && cursor.NextIndex(index); ++held) {}
+    while (cursor.NextIndex(index)) {
+      if (limit.IsReached())
+        return true;
+      candidates.push_back(index);
+    }
+    survivors[slot] = candidates.size();
+    if (candidates.empty())
+      return false;
+  }
+  for (std::size_t slot = 0; slot < slot_count; ++slot)
+    gather(slot);
+  const std::vector<std::array<std::uint32_t, kMAX_DIM>> initial = letters;
+
+  std::vector<std::size_t> queue;
+  std::vector<bool> queued(slot_count, false);
+  for (std::size_t slot = 0; slot < slot_count; ++slot) {
+    if (!crossings[slot].empty()) {
+      queue.push_back(slot);
+      queued[slot] = true;
+    }
+  }
+  for (std::size_t next = 0; next < queue.size(); ++next) {
+    if (limit.IsReached())
+      return true;
+    const std::size_t slot = queue[next];
+    queued[slot] = false;
+
+    // Survivors are kept in front; the order the words were streamed in does not matter.
+    auto begin = state.candidates[slot].begin();
+    auto kept = std::partition(begin, begin + static_cast<std::ptrdiff_t>(survivors[slot]),
+                               [&](const std::uint32_t index) {
+      Word const &word = versions[slot]->Entry(index).entry;
+      for (auto const &crossing: crossings[slot]) {
+        if ((letters[crossing.slot][crossing.offset] >> word[crossing.position].GetCode() & 1) == 0)
+          return false;
+      }
+      return true;
+    });
+    const auto left = static_cast<std::size_t>(kept - begin);
+    if (left == survivors[slot])
+      continue;
+    pruned += survivors[slot] - left;
+    survivors[slot] = left;
+    if (left == 0)
+      return false;
+
+    const std::array<std::uint32_t, kMAX_DIM> previous = letters[slot];
+    gather(slot);
+    for (auto const &crossing: crossings[slot]) {
+      if (letters[slot][crossing.position] != previous[crossing.position] && !queued[crossing.slot]) {
+        queued[crossing.slot] = true;
+        queue.push_back(crossing.slot);
+      }
+    }
+  }
+
+  // A candidate the database offers a slot survived iff the crossing slots still offer each of its letters.
+  for (std::size_t slot = 0; slot < slot_count; ++slot) {
+    for (auto const &crossing: crossings[slot]) {
+      const std::uint32_t allowed = letters[crossing.slot][crossing.offset];
+      if ((initial[slot][crossing.position] & ~allowed) != 0)
+        domains.checks[slot].push_back(LetterCheck{crossing.position, allowed});
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Key of a cell of an open slot with its contents, for NogoodKey.
+ *
+ * @param coord
+ * @param atom
+ * @return std::uint64_t
+ */
+static std::uint64_t OpenCellKey(const Coord coord, const Atom atom) {
+  return Mix64(((coord.row * kMAX_DIM + coord.col) * kATOM_COUNT + atom.GetCode() + 1) * 0x9E3779B97F4A7C15ull);
+}
 
-    // Apply randomness as parameterized by entropy
-    std::size_t shuffle_count = static_cast<std::size_t>(std::min(1., entropy / 100.) *
-                                                         static_cast<double>(sols.size()));
-    assert(shuffle_count <= sols.size());
-    std::shuffle(std::begin(sols), std::begin(sols) + shuffle_count, rng);
+/**
+ * @brief Key of a word that may not be used again, for NogoodKey.
+ *
+ * @param word
+ * @return std::uint64_t
+ */
+static std::uint64_t UsedWordKey(Word const &word) {
+  return Mix64(static_cast<std::uint64_t>(WordHash()(word)) ^ 0xD6E8FEB86659FD93ull);
+}
 
-    for (auto entry = std::begin(sols); entry != std::end(sols); ++entry) {
-      CrosswordActionGroup *group = new CrosswordActionGroup(*this, *clue_it, *entry);
-      actions.push_back(group);
+/**
+ * @brief Key of the current grid for the nogood table.
+ *
+ * The search below a grid depends only on the cells of its open slots, with their contents, and on the words
+ * of filled slots that fit some open slot, as those may not be used again. Grids agreeing on these have the
+ * same fills of their open slots, so they share a key even where their other slots differ.
+ *
+ * Only grids with few open slots are keyed: larger subproblems rarely recur, and keying them would cost
+ * more than the lookups save.
+ *
+ * @param state in step with the current grid
+ * @param open_slots scratch
+ * @return std::uint64_t kNO_NOGOOD_KEY if more than kNOGOOD_MAX_OPEN_SLOTS slots are open
+ */
+std::uint64_t Crossword::NogoodKey(SearchState const &state, std::vector<std::size_t> &open_slots) const {
+  std::vector<Clue> const &all_clues = Clues();
+  std::uint64_t key = 0;
+  open_slots.clear();
+  for (std::size_t slot = 0; slot < all_clues.size(); ++slot) {
+    if (!all_clues[slot].IsFilled())
+      open_slots.push_back(slot);
+  }
+  if (open_slots.size() > kNOGOOD_MAX_OPEN_SLOTS)
+    return kNO_NOGOOD_KEY;
+  for (std::size_t slot: open_slots) {
+    Clue const &clue = all_clues[slot];
+    for (auto const &coord: clue.coord_list_) {
+      // A cell of two open slots counts once, with the across one.
+      const std::uint16_t across = clue_cache_.slot_ids[kACROSS][coord.row][coord.col];
+      if (clue.GetDirection() == kDOWN && across != kNO_SLOT && !all_clues[across].IsFilled())
+        continue;
+      key ^= OpenCellKey(coord, CellAt_(coord).GetContents());
+    }
+  }
 
-      if (limit != kNO_NUMBER && i >= limit)
+  for (std::size_t slot = 0; slot < all_clues.size(); ++slot) {
+    if (!all_clues[slot].IsFilled())
+      continue;
+    Word const &word = state.words[slot];
+    for (std::size_t open: open_slots) {
+      if (all_clues[open].GetSize() == word.size() && all_clues[open].FitsWord(word)) {
+        key ^= UsedWordKey(word);
         break;
-      i++;
+      }
     }
-    break; // Only allow the first open slot to be filled, as noted above.
   }
-  return actions;
+  return key != kNO_NOGOOD_KEY ? key : ~kNO_NOGOOD_KEY;
+}
+
+/**
+ * @brief Fill a slot with a word, recording the cells written on the trail.
+ *
+ * @param trail
+ * @param placement
+ */
+void Crossword::Place(SearchTrail &trail, Placement const &placement) {
+  Clue const &clue = Clues()[placement.slot];
+  assert(clue.FitsWord(placement.word));
+  trail.marks.push_back(trail.changes.size());
+  for (std::size_t i = 0; i < clue.GetSize(); ++i) {
+    const Coord coord = clue.coord_list_[i];
+    const Atom previous = CellAt_(coord).GetContents();
+    const Atom next = placement.word[i];
+    if (previous != next) {
+      trail.changes.push_back(CellChange{coord, previous, next});
+      Set_(next, coord);
+    }
+  }
+  trail.path.push_back(placement);
+}
+
+/**
+ * @brief Take back the latest placement on the trail.
+ *
+ * @param trail
+ */
+void Crossword::Unplace(SearchTrail &trail) {
+  assert(!trail.marks.empty());
+  const std::size_t mark = trail.marks.back();
+  trail.marks.pop_back();
+  while (trail.changes.size() > mark) {
+    Set_(trail.changes.back().previous, trail.changes.back().coord);
+    trail.changes.pop_back();
+  }
+  trail.path.pop_back();
+}
+
+/**
+ * @brief Add culprit to the conflict set of frame, if it is an earlier frame.
+ *
+ * @param trail
+ * @param frame
+ * @param culprit index in trail.frames, or kNO_FRAME
+ */
+static void BlameFrame(SearchTrail &trail, const std::size_t frame, const std::uint32_t culprit) {
+  if (culprit < frame)
+    trail.conflicts[frame * trail.conflict_words + culprit / 64] |= std::uint64_t{1} << (culprit % 64);
+}
+
+/**
+ * @brief Add every earlier frame to the conflict set of frame, for failures with no better explanation.
+ *
+ * @param trail
+ * @param frame
+ */
+static void BlameAll(SearchTrail &trail, const std::size_t frame) {
+  for (std::size_t culprit = 0; culprit < frame; ++culprit)
+    BlameFrame(trail, frame, static_cast<std::uint32_t>(culprit));
+}
+
+/**
+ * @brief Latest frame in the conflict set of frame.
+ *
+ * @param trail
+ * @param frame
+ * @return std::size_t index in trail.frames, or kNO_FRAME if the set is empty
+ */
+static std::size_t LatestCulprit(SearchTrail const &trail, const std::size_t frame) {
+  std::uint64_t const *conflicts = &trail.conflicts[frame * trail.conflict_words];
+  for (std::size_t word = trail.conflict_words; word-- > 0;) {
+    if (conflicts[word] != 0)
+      return word * 64 + static_cast<std::size_t>(HighestSetBit64(conflicts[word]));
+  }
+  return kNO_FRAME;
+}
+
+/**
+ * @brief Drop the top frame, which must not have a candidate placed, and its candidates.
+ *
+ * @param trail
+ */
+static void PopFrame(SearchTrail &trail) {
+  if (!trail.slot_frames.empty())
+    trail.slot_frames[trail.frames.back().slot] = kNO_FRAME;
+  trail.candidates.resize(trail.frames.back().start);
+  trail.frames.pop_back();
 }
 
 /**
- * @brief Thread function that stops searching the crossword after some time.
+ * @brief Start the conflict set of a newly pushed top frame with the frames that narrowed its candidates.
  *
- * Exits early if done_searching becomes true.
+ * Those are the frames whose words cross its slot, and under SlotOrdering::MostConstrained, which drops
+ * words leaving a crossing slot no candidates, also those crossing the crossing slots.
  *
- * @param args
+ * @param trail
+ * @param params
  */
-void StopSearchingAfterTime(Crossword *crossword, int msecs) {
-  for (int i = 0; i < msecs; ++i) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    if (crossword->done_searching || crossword->stop_searching)
+void Crossword::OpenConflictSet(SearchTrail &trail, AutofillParams const &params) const {
+  const std::size_t frame = trail.frames.size() - 1;
+  const std::size_t slot = trail.frames.back().slot;
+  trail.conflicts.resize((frame + 1) * trail.conflict_words);
+  std::fill(trail.conflicts.begin() + static_cast<std::ptrdiff_t>(frame * trail.conflict_words),
+            trail.conflicts.end(), 0);
+  trail.slot_frames[slot] = static_cast<std::uint32_t>(frame);
+  if (params.ordering == SlotOrdering::MostConstrained)
+    BlameNeighborhood(trail, frame, slot);
+  else
+    BlameSlot(trail, frame, slot);
+}
+
+/**
+ * @brief Add to the conflict set of frame every earlier frame that wrote a cell of slot: the one filling
+ * the slot itself, and those filling the slots crossing it.
+ *
+ * @param trail
+ * @param frame
+ * @param slot index into Clues()
+ */
+void Crossword::BlameSlot(SearchTrail &trail, const std::size_t frame, const std::size_t slot) const {
+  Clue const &clue = Clues()[slot];
+  const WordDirection other = clue.GetDirection() == kACROSS ? kDOWN : kACROSS;
+  BlameFrame(trail, frame, trail.slot_frames[slot]);
+  for (auto const &coord: clue.coord_list_) {
+    const std::uint16_t crossing = clue_cache_.slot_ids[other][coord.row][coord.col];
+    if (crossing != kNO_SLOT)
+      BlameFrame(trail, frame, trail.slot_frames[crossing]);
+  }
+}
+
+/**
+ * @brief BlameSlot for a slot and each slot crossing it.
+ *
+ * @param trail
+ * @param frame
+ * @param slot index into Clues()
+ */
+void Crossword::BlameNeighborhood(SearchTrail &trail, const std::size_t frame, const std::size_t slot) const {
+  Clue const &clue = Clues()[slot];
+  const WordDirection other = clue.GetDirection() == kACROSS ? kDOWN : kACROSS;
+  BlameSlot(trail, frame, slot);
+  for (auto const &coord: clue.coord_list_) {
+    const std::uint16_t crossing = clue_cache_.slot_ids[other][coord.row][coord.col];
+    if (crossing != kNO_SLOT)
+      BlameSlot(trail, frame, crossing);
+  }
+}
+
+/**
+ * @brief Add to the conflict set of frame the frames behind the rejection of its current candidate.
+ *
+ * Placing the candidate only re-checked its own slot and the slots crossing it, so one of those is rejected,
+ * or holds a word that is now used twice. The earlier frames that wrote its cells explain the failure.
+ *
+ * @param trail
+ * @param state rejected
+ * @param frame index in trail.frames of the frame whose candidate is placed
+ */
+void Crossword::BlameRejection(SearchTrail &trail, SearchState const &state, const std::size_t frame) const {
+  const std::size_t slot = trail.frames[frame].slot;
+  Clue const &clue = Clues()[slot];
+  const WordDirection other = clue.GetDirection() == kACROSS ? kDOWN : kACROSS;
+
+  std::size_t suspects[kMAX_DIM + 1];
+  std::size_t suspect_count = 0;
+  suspects[suspect_count++] = slot;
+  for (auto const &coord: clue.coord_list_) {
+    const std::uint16_t crossing = clue_cache_.slot_ids[other][coord.row][coord.col];
+    if (crossing != kNO_SLOT)
+      suspects[suspect_count++] = crossing;
+  }
+
+  for (std::size_t i = 0; i < suspect_count; ++i) {
+    if (state.status[suspects[i]] != Solvability::Solvable) {
+      BlameSlot(trail, frame, suspects[i]);
       return;
+    }
+  }
+  for (std::size_t i = 0; i < suspect_count; ++i) {
+    const std::size_t suspect = suspects[i];
+    if (!state.counted[suspect] || state.word_counts.at(state.words[suspect]) < 2)
+      continue;
+    for (std::size_t other_slot = 0; other_slot < state.words.size(); ++other_slot) {
+      if (state.counted[other_slot] && state.words[other_slot] == state.words[suspect])
+        BlameSlot(trail, frame, other_slot);
+    }
+    return;
   }
-  crossword->StopAutofill();
+  BlameAll(trail, frame);
+}
+
+/**
+ * @brief Add to the conflict set of frame the frames behind a grid found in the nogood table.
+ *
+ * Its refutation rests on what Crossword::NogoodKey covers: the cells of the open slots, and the used words
+ * fitting them.
+ *
+ * @param trail open_slots as left by NogoodKey
+ * @param state in step with the current grid
+ * @param frame index in trail.frames of the frame whose candidate is placed
+ */
+void Crossword::BlameNogood(SearchTrail &trail, SearchState const &state, const std::size_t frame) const {
+  std::vector<Clue> const &all_clues = Clues();
+  for (std::size_t open: trail.open_slots)
+    BlameSlot(trail, frame, open);
+  for (std::size_t slot = 0; slot < all_clues.size(); ++slot) {
+    if (!all_clues[slot].IsFilled())
+      continue;
+    for (std::size_t open: trail.open_slots) {
+      if (all_clues[open].GetSize() == state.words[slot].size() && all_clues[open].FitsWord(state.words[slot])) {
+        BlameSlot(trail, frame, slot);
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Drop the top frame, which ran out of candidates, and undo every frame after the latest in its
+ * conflict set, which inherits the rest of the set.
+ *
+ * No word placed by the frames undone contributed to the failures, so their remaining candidates would
+ * fail the same way. With an empty conflict set every frame goes, as nothing the search placed is to blame.
+ *
+ * @param trail top frame complete, with no candidate placed
+ */
+void Crossword::Backjump(SearchTrail &trail) {
+  const std::size_t frame = trail.frames.size() - 1;
+  const std::size_t culprit = LatestCulprit(trail, frame);
+  if (culprit != kNO_FRAME) {
+    std::uint64_t const *from = &trail.conflicts[frame * trail.conflict_words];
+    std::uint64_t *into = &trail.conflicts[culprit * trail.conflict_words];
+    for (std::size_t word = 0; word < trail.conflict_words; ++word)
+      into[word] |= from[word];
+    into[culprit / 64] &= ~(std::uint64_t{1} << (culprit % 64));
+  }
+
+  PopFrame(trail);
+  const std::size_t keep = culprit == kNO_FRAME ? 0 : culprit + 1;
+  CROSSWORD_TRACE(kTRACE_SEARCH, TraceEventType::Backjump, frame, keep);
+  while (trail.frames.size() > keep) {
+    Unplace(trail);
+    PopFrame(trail);
+    trail.frames_backjumped++;
+  }
+}
+
+/**
+ * @brief Push a frame for the slot to branch on next, with its first candidates.
+ *
+ * Under SlotOrdering::UpperLeft candidates are streamed best ranked first from a database cursor,
+ * kCANDIDATE_WINDOW at a time, with entropy shuffling within each window. MostConstrained orders all
+ * candidates up front, so it still takes the whole list.
+ *
+ * @param trail
+ * @param state
+ * @param params
+ * @return true
+ * @return false there are no candidates; no frame is pushed, and trail.dead_end names the slot
+ */
+bool Crossword::Expand(SearchTrail &trail, SearchState const &state, AutofillParams const &params) const {
+  const std::size_t begin = trail.candidates.size();
+  if (params.ordering == SlotOrdering::UpperLeft) {
+    const std::size_t slot = FirstOpenSlot(Clues(), state.fill_order);
+    trail.dead_end = slot;
+    if (slot == Clues().size())
+      return false;
+    const std::size_t limit = params.branching_factor_limit == kNO_NUMBER
+                              ? SIZE_MAX : static_cast<std::size_t>(params.branching_factor_limit) + 1;
+    trail.frames.push_back(SearchFrame{slot, begin, begin, begin,
+                                       params.db->OpenCursor(Clues()[slot].ToWord(), params.score_min), limit,
+                                       params.branching_factor_limit == kNO_NUMBER, kNO_NOGOOD_KEY});
+    if (!Refill(trail, params)) {
+      trail.frames.pop_back();
+      return false;
+    }
+    return true;
+  }
+
+  const std::size_t slot = GetWordCandidates(Clues(), state.fill_order, params, trail.scratch);
+  trail.dead_end = slot;
+  if (trail.scratch.empty())
+    return false;
+  // Reversed, so that taking candidates from the end tries the best first.
+  trail.candidates.insert(trail.candidates.end(), trail.scratch.rbegin(), trail.scratch.rend());
+  trail.frames.push_back(SearchFrame{slot, begin, begin, trail.candidates.size(), SolutionCursor(), 0,
+                                     params.branching_factor_limit == kNO_NUMBER, kNO_NOGOOD_KEY});
+  return true;
+}
+
+/**
+ * @brief Replace the spent candidates of the top frame with the next window from its cursor.
+ *
+ * @param trail
+ * @param params
+ * @return true
+ * @return false the cursor had nothing more
+ */
+bool Crossword::Refill(SearchTrail &trail, AutofillParams const &params) const {
+  SearchFrame &frame = trail.frames.back();
+  assert(frame.begin == frame.end);
+  if (frame.budget == 0)
+    return false;
+
+  trail.scratch.clear();
+  Word word;
+  const std::size_t wanted = std::min(kCANDIDATE_WINDOW, frame.budget);
+  while (trail.scratch.size() < wanted && frame.cursor.Next(word)) {
+    if (domains_ == nullptr || domains_->Allows(frame.slot, word))
+      trail.scratch.push_back(word);
+  }
+  frame.budget = trail.scratch.size() < wanted ? 0 : frame.budget - wanted;
+  if (trail.scratch.empty())
+    return false;
+
+  // Same randomness as GetWordCandidates, applied within the window.
+  auto rng = std::default_random_engine{};
+  rng.seed(params.seed); // deterministic for debugging
+  const std::size_t shuffle_count = static_cast<std::size_t>(std::min(1., params.entropy / 100.) *
+                                                             static_cast<double>(trail.scratch.size()));
+  std::shuffle(std::begin(trail.scratch), std::begin(trail.scratch) + shuffle_count, rng);
+
+  trail.candidates.resize(frame.start);
+  trail.candidates.insert(trail.candidates.end(), trail.scratch.rbegin(), trail.scratch.rend());
+  frame.begin = frame.start;
+  frame.end = trail.candidates.size();
+  return true;
+}
+
+/**
+ * @brief Depth-first search below the current grid, which counts as the first node.
+ *
+ * The trail's path may hold placements leading to the current grid; they are left in place. On Found the
+ * path holds the whole solution; otherwise the grid is rewound to where it started.
+ *
+ * Stops when limit is reached, or with parallel set, once another worker finds a solution. While some worker
+ * is idle and this worker's deque is empty, hands the last candidate of the shallowest frame with any to spare
+ * to the deque as a task.
+ *
+ * With a nogood table, grids already refuted at this score minimum are skipped, and grids whose every
+ * candidate was searched here without success are recorded as refuted.
+ *
+ * With params.backjumping, each frame keeps a conflict set of the earlier frames its failures depended on,
+ * and a frame running out of candidates jumps back to the latest of them rather than to its parent.
+ *
+ * @param trail frames must be empty
+ * @param state in step with the current grid, up to touched slots
+ * @param params
+ * @param limit polled once per node
+ * @param nodes incremented per node visited
+ * @param parallel shared state of a parallel pass, or nullptr
+ * @param worker index of this worker's deque, if parallel
+ * @return SearchOutcome
+ */
+SearchOutcome Crossword::SearchFrom(SearchTrail &trail, SearchState &state, AutofillParams const &params,
+                                    SearchLimit &limit, std::uint64_t &nodes, ParallelSearch *parallel,
+                                    const std::size_t worker) {
+  assert(trail.frames.empty());
+  WordDatabase &db = *params.db;
+  const std::size_t base_depth = trail.path.size();
+  if (params.backjumping) {
+    trail.slot_frames.assign(Clues().size(), kNO_FRAME);
+    trail.conflict_words = (Clues().size() + 63) / 64;
+  } else {
+    trail.slot_frames.clear();
+  }
+
+  nodes++;
+  RefreshSearchState(state, db); // Leaf case 1: Invalid, we abandon this branch
+  if (state.IsRejected())
+    return SearchOutcome::Exhausted;
+  if (state.IsSolved()) // Leaf case 2: Solution found, exit
+    return SearchOutcome::Found;
+  const std::uint64_t root_key = nogoods_ != nullptr ? NogoodKey(state, trail.open_slots) : kNO_NOGOOD_KEY;
+  if (root_key != kNO_NOGOOD_KEY && nogoods_->IsRefuted(root_key, params.score_min)) {
+    CROSSWORD_TRACE(kTRACE_SEARCH, TraceEventType::NogoodPrune, base_depth, 0);
+    return SearchOutcome::Exhausted;
+  }
+  if (!Expand(trail, state, params)) // Leaf case 3: no valid fills from this direction.
+    return SearchOutcome::Exhausted;
+  CROSSWORD_TRACE(kTRACE_SEARCH, TraceEventType::NodeExpanded, base_depth, trail.frames.back().slot);
+  trail.frames.back().nogood_key = root_key;
+  if (params.backjumping)
+    OpenConflictSet(trail, params);
+
+  while (!trail.frames.empty()) {
+    if (limit.IsReached() || (parallel != nullptr && parallel->IsStopped())) {
+      while (trail.path.size() > base_depth)
+        Unplace(trail);
+      trail.frames.clear();
+      trail.candidates.clear();
+      return SearchOutcome::Stopped;
+    }
+
+    // Every frame but possibly the top one has its current candidate placed.
+    if (trail.path.size() == base_depth + trail.frames.size())
+      Unplace(trail);
+    if (trail.frames.back().begin == trail.frames.back().end && !Refill(trail, params)) {
+      // The grid is back where the frame branched from, and none of its candidates led anywhere.
+      CROSSWORD_TRACE(kTRACE_SEARCH, TraceEventType::Backtrack, trail.path.size(), trail.frames.back().slot);
+      const bool complete = trail.frames.back().complete;
+      if (complete && trail.frames.back().nogood_key != kNO_NOGOOD_KEY)
+        nogoods_->Refute(trail.frames.back().nogood_key, params.score_min);
+      if (complete && params.backjumping) {
+        Backjump(trail);
+        continue;
+      }
+      PopFrame(trail);
+      if (!complete && !trail.frames.empty())
+        trail.frames.back().complete = false;
+      continue;
+    }
+    SearchFrame &frame = trail.frames.back();
+
+    if (parallel != nullptr && parallel->idle_workers != 0 && parallel->deques[worker].IsEmpty()) {
+      for (std::size_t depth = 0; depth < trail.frames.size(); ++depth) {
+        SearchFrame &shallow = trail.frames[depth];
+        if (shallow.end - shallow.begin < (depth + 1 == trail.frames.size() ? 2u : 1u))
+          continue;
+        // The parent of a frame's candidates is the placement of the frame below it.
+        SearchTask donated(trail.path.begin(), trail.path.begin() + static_cast<std::ptrdiff_t>(base_depth + depth));
+        donated.push_back(Placement{shallow.slot, trail.candidates[shallow.begin]}); // Would be tried last.
+        shallow.begin++;
+        shallow.complete = false;
+        parallel->pending_tasks++;
+        parallel->deques[worker].PushBack(std::move(donated));
+        break;
+      }
+    }
+
+    const std::size_t depth = trail.frames.size() - 1;
+    Placement placement{frame.slot, trail.candidates[frame.end - 1]};
+    frame.end--;
+    Place(trail, placement);
+    nodes++;
+    if (params.progress != nullptr) {
+      if (nodes % kPROGRESS_NODE_BATCH == 0)
+        params.progress->AddNodes(kPROGRESS_NODE_BATCH);
+      params.progress->Offer(*this, trail.path.size(), params.score_min);
+    }
+
+    RefreshSearchState(state, db);
+    if (state.IsRejected()) {
+      if (params.backjumping)
+        BlameRejection(trail, state, depth);
+      continue;
+    }
+    if (state.IsSolved()) {
+      trail.frames.clear();
+      trail.candidates.clear();
+      return SearchOutcome::Found;
+    }
+    const std::uint64_t key = nogoods_ != nullptr ? NogoodKey(state, trail.open_slots) : kNO_NOGOOD_KEY;
+    if (key != kNO_NOGOOD_KEY && nogoods_->IsRefuted(key, params.score_min)) {
+      CROSSWORD_TRACE(kTRACE_SEARCH, TraceEventType::NogoodPrune, trail.path.size(), 0);
+      if (params.backjumping)
+        BlameNogood(trail, state, depth);
+      continue;
+    }
+    if (Expand(trail, state, params)) {
+      CROSSWORD_TRACE(kTRACE_SEARCH, TraceEventType::NodeExpanded, trail.path.size(), trail.frames.back().slot);
+      trail.frames.back().nogood_key = key;
+      if (params.backjumping)
+        OpenConflictSet(trail, params);
+    } else if (params.backjumping) {
+      if (trail.dead_end < Clues().size())
+        BlameNeighborhood(trail, depth, trail.dead_end);
+      else
+        BlameAll(trail, depth);
+    }
+  }
+  return SearchOutcome::Exhausted;
+}
+
+/**
+ * @brief Write placements from the search onto the grid, each word an edit of the undo history.
+ *
+ * @param placements
+ */
+void Crossword::ApplyPlacements(SearchTask const &placements) {
+  for (auto const &placement: placements) {
+    history_.BeginEdit();
+    FillClue_(Clues()[placement.slot], placement.word);
+    history_.EndEdit();
+  }
+}
+
+/**
+ * @brief Worker loop of a parallel search, run on a private copy of the grid.
+ *
+ * @param search shared state of the pass
+ * @param worker index of this worker's deque
+ * @param params
+ * @param limit this worker's copy of the pass's limit
+ */
+void Crossword::SearchSubtrees(ParallelSearch &search, const std::size_t worker, AutofillParams const &params,
+                               SearchLimit limit) {
+  const DictionaryPin pin(search.dictionary);
+  WordDatabase &db = *params.db;
+  SearchState state;
+  ResetSearchState(state, db, params.score_min);
+  search_state_ = &state;
+
+  SearchTrail trail;
+  std::uint64_t nodes = 0;
+  bool idle = false;
+
+  SearchTask task;
+  while (!search.IsStopped() && !limit.IsReached()) {
+    if (!search.Take(worker, task)) {
+      if (!idle) {
+        idle = true;
+        search.idle_workers++;
+      }
+      if (search.pending_tasks == 0)
+        break;
+      std::this_thread::yield();
+      continue;
+    }
+    if (idle) {
+      idle = false;
+      search.idle_workers--;
+    }
+
+    // Rewind to the longest common prefix of the current path and the task, then replay the rest.
+    std::size_t common = 0;
+    while (common < trail.path.size() && common < task.size() && trail.path[common].slot == task[common].slot &&
+           trail.path[common].word == task[common].word)
+      common++;
+    while (trail.path.size() > common)
+      Unplace(trail);
+    for (std::size_t i = common; i < task.size(); ++i)
+      Place(trail, task[i]);
+
+    const SearchOutcome outcome = SearchFrom(trail, state, params, limit, nodes, &search, worker);
+    if (outcome == SearchOutcome::Found) {
+      std::lock_guard<std::mutex> guard(search.solution_lock);
+      if (!search.found) {
+        search.solution = trail.path;
+        search.found = true;
+      }
+    } else if (outcome == SearchOutcome::Exhausted) {
+      search.pending_tasks--;
+    }
+  }
+
+  if (idle)
+    search.idle_workers--;
+  search.nodes += nodes;
+  search.frames_backjumped += trail.frames_backjumped;
+  search_state_ = nullptr;
+}
+
+/**
+ * @brief Run one pass of the search on params.threads workers, each on its own copy of the grid.
+ *
+ * If a solution is found, its words are placed on this grid as undoable actions.
+ *
+ * @param params
+ * @param limit copied to each worker
+ * @param nodes_searched incremented by the nodes visited across workers
+ * @param frames_backjumped incremented by the frames abandoned by backjumping across workers
+ * @return SearchOutcome
+ */
+SearchOutcome Crossword::SearchInParallel(AutofillParams const &params, SearchLimit const &limit,
+                                          std::uint64_t &nodes_searched, std::uint64_t &frames_backjumped) {
+  const std::size_t worker_count = static_cast<std::size_t>(params.threads);
+  ParallelSearch search(worker_count);
+  search.dictionary = DictionaryPin::Current();
+  search.pending_tasks = 1;
+  search.deques[0].PushBack(SearchTask()); // The whole tree.
+
+  std::vector<std::unique_ptr<Crossword>> workers;
+  for (std::size_t i = 0; i < worker_count; ++i) {
+    workers.emplace_back(new Crossword());
+    workers.back()->CopyGridFrom(*this);
+    workers.back()->nogoods_ = nogoods_;
+    workers.back()->domains_ = domains_;
+  }
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < worker_count; ++i) {
+    threads.emplace_back(&Crossword::SearchSubtrees, workers[i].get(), std::ref(search), i, std::cref(params),
+                         limit);
+  }
+  for (auto &thread: threads) {
+    thread.join();
+  }
+
+  nodes_searched += search.nodes;
+  frames_backjumped += search.frames_backjumped;
+  logger.Log(std::to_string(worker_count) + " workers, " + std::to_string(search.steals) + " tasks stolen");
+
+  if (!search.found)
+    return search.pending_tasks == 0 ? SearchOutcome::Exhausted : SearchOutcome::Stopped;
+  ApplyPlacements(search.solution);
+  return SearchOutcome::Found;
+}
+
+/**
+ * @brief Cache activity between two readings of its counters.
+ *
+ * @param before
+ * @param after
+ * @return CacheStatistics
+ */
+static CacheStatistics CacheDelta(CacheStatistics const &before, CacheStatistics const &after) {
+  CacheStatistics delta;
+  delta.hits = after.hits - before.hits;
+  delta.misses = after.misses - before.misses;
+  delta.evictions = after.evictions - before.evictions;
+  return delta;
+}
+
+/**
+ * @brief Describe cache activity.
+ *
+ * @param name
+ * @param delta
+ * @return std::string
+ */
+static std::string CacheReport(std::string const &name, CacheStatistics const &delta) {
+  return name + ": " + std::to_string(delta.hits) + " hits, " + std::to_string(delta.misses) + " misses, " +
+         std::to_string(delta.evictions) + " evictions (" + std::to_string(static_cast<int>(delta.HitRate() * 100)) +
+         "% hit rate)";
+}
+
+/**
+ * @brief Number of relaxation passes Autofill has left, counting the current one.
+ *
+ * @param score_min of the current pass
+ * @param score_min_decay
+ * @return int at least 1; kMAX_PASSES if the score never decays to 0
+ */
+static int PassesLeft(int score_min, const double score_min_decay) {
+  constexpr int kMAX_PASSES = 64;
+  int passes = 1;
+  while (passes < kMAX_PASSES && (score_min = static_cast<int>(score_min * score_min_decay)) > 0)
+    passes++;
+  return passes;
 }
 
 /**
@@ -213,7 +1324,7 @@ void StopSearchingAfterTime(Crossword *crossword, int msecs) {
  *
  */
 void Crossword::StopAutofill() {
-  stop_searching = true;
+  stop_searching_.Cancel();
 }
 
 /**
@@ -222,11 +1333,23 @@ void Crossword::StopAutofill() {
  * Database must be finished loading.
  *
  * TODO: use monte carlo algorithm to perform pertubations. measure performance
- * TODO: assure we do not revisit nodes? (hashing? does it depend on node ordering?)
+ *
+ * Grids refuted by one pass or worker are remembered in a nogood table of params.nogood_capacity entries,
+ * so that transpositions are not searched twice.
+ *
+ * If params.progress is set, the workers publish frames to it on request, so that another thread can
+ * watch the search without reading this grid while it changes.
+ *
+ * The whole search reads one snapshot of params.db, so the database may be edited meanwhile.
+ *
+ * With params.propagate, each pass first narrows the candidates of every slot by arc consistency, and is
+ * skipped outright if some slot is left with none. Propagation gets 1 / kPROPAGATION_SHARE of the pass, and the
+ * candidates it streams in carry over to the next, lower score, pass.
  *
  * @param params search parameters
+ * @return AutofillStatistics
  */
-void Crossword::Autofill(AutofillParams &params) {
+AutofillStatistics Crossword::Autofill(AutofillParams &params) {
   assert(params.db != NULL);
   assert(params.db->IsFinishedLoading());
   assert(IsValidPattern());
@@ -235,19 +1358,17 @@ void Crossword::Autofill(AutofillParams &params) {
   logger.Log("Autofilling...");
 
   WordDatabase &db = *params.db;
+  // Words added or removed during the search are only seen by later searches.
+  const DictionarySnapshot dictionary = db.Snapshot();
+  const DictionaryPin pin(&dictionary);
 
-  int *seconds_limit = &params.seconds_limit;
   int *hard_min = &params.score_min;
   double *hard_min_decay = &params.score_min_decay;
   int *entropy = &params.entropy;
   double *entropy_decay = &params.entropy_decay; // TODO: make this a function
   int *branching_factor_limit = &params.branching_factor_limit;
-  bool *rollback = &params.rollback;
-
 
-  stop_searching = false;
-  done_searching = false;
-  std::thread stop_thread(StopSearchingAfterTime, this, *seconds_limit * 1000);
+  stop_searching_.Reset();
 
   std::vector<Coord> locked_coords{};
   for (std::size_t row = 0; row < height_; ++row) {
@@ -265,107 +1386,111 @@ void Crossword::Autofill(AutofillParams &params) {
   CALLGRIND_START_INSTRUMENTATION;
   CALLGRIND_TOGGLE_COLLECT;
 
-  int nodes_searched = 0;
+  const CacheStatistics existence_before = db.GetExistenceCacheStatistics();
+  const CacheStatistics solutions_before = db.GetSolutionCacheStatistics();
+
+  std::unique_ptr<NogoodTable> nogoods;
+  if (params.nogood_capacity > 0)
+    nogoods.reset(new NogoodTable(params.nogood_capacity));
+  nogoods_ = nogoods.get();
+
+  if (params.progress != nullptr)
+    params.progress->Begin(*this, *hard_min);
+  CROSSWORD_TRACE(kTRACE_PASSES, TraceEventType::AutofillBegin, *hard_min, params.threads);
+
+  std::uint64_t nodes_searched = 0;
+  std::uint64_t frames_backjumped = 0;
+  std::uint64_t words_pruned = 0;
+  int passes_refuted = 0;
+  PropagationState propagation;
+  int passes = 0;
   auto start = std::chrono::high_resolution_clock::now();
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(params.seconds_limit);
   bool found = false;          // true if solution was found
   bool complete_search = true; // true if entire search completed
-  std::vector<std::unique_ptr<DFSNode>> dfs_stack{};
-  while (!found && !stop_searching && *hard_min > 0) {
+  SearchTrail trail;
+  while (!found && !stop_searching_.IsCancelled() && *hard_min > 0) {
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      complete_search = false;
+      logger.Log("Time limit reached with no solution found. Cleaning up");
+      break;
+    }
+    // Split the time left evenly over the passes left, so a hard pass cannot starve the relaxed ones.
+    const int passes_left = PassesLeft(*hard_min, *hard_min_decay);
+    const bool last_pass = passes_left == 1;
+    const auto pass_deadline = last_pass ? deadline : now + (deadline - now) / passes_left;
+    SearchLimit limit(&stop_searching_, pass_deadline);
+    passes++;
+    CROSSWORD_TRACE(kTRACE_PASSES, TraceEventType::PassBegin, *hard_min, *entropy);
+
     logger.Log("Searching with hard minimum score of " + std::to_string(*hard_min) + " and entropy score " +
-               std::to_string(*entropy));
+               std::to_string(*entropy) + " for up to " +
+               std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(pass_deadline - now).count()) +
+               " ms");
     if (*branching_factor_limit != kNO_NUMBER) {
       logger.Log("...with branching factor " + std::to_string(*branching_factor_limit));
     }
 
-    // TODO: fix cache so we don't have to do this...
-    db.FlushCaches();
-
-    dfs_stack.clear();
-
-    std::size_t initial_depth = action_stack_.GetSize();
-
-    CrosswordActionGroup *dummy = new CrosswordActionGroup();
-    dfs_stack.push_back(std::unique_ptr<DFSNode>(new DFSNode(dummy, initial_depth + 1)));
-
-    int iterations = 0;
-    complete_search = true;
-    while (!dfs_stack.empty()) {
-      iterations++;
-
-      if (stop_searching) {
-        logger.Log("Externally stopped with no solution found. Cleaning up");
-        complete_search = false;
-        break;
-      }
-
-      // TODO: log size of stack and memory usage.
-      // if (iterations % branching_factor_limit * 10)
-      // {
-      // log stack size to debug log
-      // }
-
-      int relative_depth = dfs_stack.back().get()->depth;
-      int current_depth = action_stack_.GetSize();
-
-      // roll back to necessary depth (1 less than popped node depth)
-      while (static_cast<int>(action_stack_.GetSize()) > relative_depth - 1) {
-        Undo();
-      }
-      ApplyAction(dfs_stack.back().get()->action);
-      dfs_stack.pop_back();
-      nodes_searched++;
-
-      std::vector<Clue> all_clues = Clues();
-
-      // Leaf case 1: Invalid, we abandon this branch
-      if (IsInvalidPartial(all_clues, db, *hard_min) != Solvability::Solvable) {
-        continue;
-      }
-
-      // Leaf case 2: Solution found, exit
-      if (IsSolved(all_clues, db)) {
-        logger.Log("Found solution! Exiting");
-        found = true;
-        break;
-      }
-
-      std::vector<CrosswordActionGroup *> adj = GetWordFills(all_clues, params);
-
-      // Leaf case 3: no valid fills from this direction.
-      if (adj.empty()) {
-        continue;
-      }
+    SearchOutcome outcome;
+    SlotDomains domains;
+    SearchLimit propagation_limit(&stop_searching_, now + (pass_deadline - now) / kPROPAGATION_SHARE);
+    if (params.propagate && !PropagateDomains(propagation, domains, db, *hard_min, propagation_limit,
+                                              words_pruned)) {
+      logger.Log("Propagation left a slot without candidates");
+      passes_refuted++;
+      outcome = SearchOutcome::Exhausted;
+    } else if (params.threads > 1) {
+      domains_ = params.propagate ? &domains : nullptr;
+      outcome = SearchInParallel(params, limit, nodes_searched, frames_backjumped);
+    } else {
+      domains_ = params.propagate ? &domains : nullptr;
+      // From here on, Set_ reports every changed cell, so each node only re-checks the slots it touched.
+      SearchState state;
+      ResetSearchState(state, db, *hard_min);
+      search_state_ = &state;
 
+      trail.Clear();
+      std::uint64_t nodes = 0;
+      outcome = SearchFrom(trail, state, params, limit, nodes, nullptr, 0);
+      nodes_searched += nodes;
+      frames_backjumped += trail.frames_backjumped;
 
-      // Reverse iterator because we want best on top of the stack.
-      for (auto it = adj.rbegin(); it != adj.rend(); ++it) {
-        dfs_stack.push_back(std::unique_ptr<DFSNode>(new DFSNode(*it, relative_depth + 1)));
+      if (outcome == SearchOutcome::Found) {
+        // Trade the trail for undoable actions.
+        SearchTask solution = trail.path;
+        while (!trail.path.empty())
+          Unplace(trail);
+        search_state_ = nullptr;
+        ApplyPlacements(solution);
+      } else {
+        search_state_ = nullptr;
       }
-    } // end DFS while
-
-    for (auto it = std::begin(dfs_stack); it != std::end(dfs_stack); ++it) {
-      delete (*it).get()->action;
     }
+    domains_ = nullptr;
+    complete_search = outcome != SearchOutcome::Stopped;
+    CROSSWORD_TRACE(kTRACE_PASSES, TraceEventType::PassEnd, static_cast<std::uint64_t>(outcome), nodes_searched);
 
-    if (!found) {
-      if (complete_search) {
-        logger.Log("Full tree search completed and no solution found. Relaxing constraints...");
-      }
-
-      if (rollback) {
-        assert(action_stack_.GetSize() >= initial_depth);
-        std::size_t depth_reached = action_stack_.GetSize() - initial_depth;
-        for (std::size_t i = 0; i < depth_reached; i++) {
-          Undo();
-        }
-      }
-    } // end if
+    if (outcome == SearchOutcome::Found) {
+      logger.Log("Found solution! Exiting");
+      found = true;
+    } else if (complete_search) {
+      logger.Log("Full tree search completed and no solution found. Relaxing constraints...");
+    } else if (limit.IsCancelled()) {
+      logger.Log("Externally stopped with no solution found. Cleaning up");
+    } else if (!last_pass) {
+      logger.Log("Pass time budget used up with no solution found. Relaxing constraints...");
+    } else {
+      logger.Log("Time limit reached with no solution found. Cleaning up");
+    }
 
     *hard_min = static_cast<int>(*hard_min * *hard_min_decay);
     *entropy = static_cast<int>(*entropy * *entropy_decay);
   } // end while
 
   auto stop = std::chrono::high_resolution_clock::now();
+  nogoods_ = nullptr;
+  CROSSWORD_TRACE(kTRACE_PASSES, TraceEventType::AutofillEnd, found, nodes_searched);
 
   CALLGRIND_TOGGLE_COLLECT;
   CALLGRIND_STOP_INSTRUMENTATION;
@@ -374,17 +1499,38 @@ void Crossword::Autofill(AutofillParams &params) {
     logger.Log("Autofill completed full tree search and did not find a solution");
   }
 
-  double msecs = static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count());
-  if (nodes_searched > 2) {
-    double npms = (static_cast<double>(nodes_searched)) / msecs;
-    double nps = npms * 1000.;
+  AutofillStatistics statistics;
+  statistics.found = found;
+  statistics.complete = complete_search;
+  statistics.passes = passes;
+  statistics.nodes = nodes_searched;
+  statistics.seconds = std::chrono::duration<double>(stop - start).count();
+  statistics.existence_cache = CacheDelta(existence_before, db.GetExistenceCacheStatistics());
+  statistics.solution_cache = CacheDelta(solutions_before, db.GetSolutionCacheStatistics());
+  if (nogoods != nullptr)
+    statistics.nogood_prunes = nogoods->GetPrunes();
+  statistics.frames_backjumped = frames_backjumped;
+  statistics.passes_refuted = passes_refuted;
+  statistics.words_pruned = words_pruned;
+
+  if (nodes_searched > 2 && statistics.seconds > 0) {
+    double nps = static_cast<double>(nodes_searched) / statistics.seconds;
     logger.Log("Nodes per second: " + std::to_string(static_cast<int>(nps)));
   }
+  logger.Log(CacheReport("Existence cache", statistics.existence_cache));
+  logger.Log(CacheReport("Solution cache", statistics.solution_cache));
+  if (nogoods != nullptr)
+    logger.Log("Nogood table: " + std::to_string(statistics.nogood_prunes) + " nodes pruned");
+  if (params.backjumping)
+    logger.Log("Backjumping: " + std::to_string(statistics.frames_backjumped) + " frames skipped");
+  if (params.propagate)
+    logger.Log("Propagation: " + std::to_string(statistics.words_pruned) + " words pruned, " +
+               std::to_string(statistics.passes_refuted) + " passes refuted");
 
   for (auto &coord: locked_coords) {
     ToggleLockCell(coord);
   }
-
-  done_searching = true;
-  stop_thread.join();
+  if (params.progress != nullptr)
+    params.progress->Finish(*this, nodes_searched);
+  return statistics;
 }
@@ -12,7 +12,79 @@
 #ifndef SEARCH_HPP
 #define SEARCH_HPP
 
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "crossword/cache.hpp"
+#include "crossword/cancellation.hpp"
+#include "crossword/tracing.hpp"
+
 namespace crossword_backend {
+  class SearchProgress;
+
+  /**
+   * @brief Number of candidate words pulled from the database at a time while branching, and the span over
+   * which entropy shuffles them.
+   *
+   */
+  constexpr std::size_t kCANDIDATE_WINDOW = 64;
+
+  /**
+   * @brief Default number of refuted grids an autofill remembers.
+   *
+   */
+  constexpr std::size_t kDEFAULT_NOGOOD_CAPACITY = 1 << 16;
+
+  /**
+   * @brief Most open slots a grid may have to be looked up in, or recorded in, the nogood table.
+   *
+   */
+  constexpr std::size_t kNOGOOD_MAX_OPEN_SLOTS = 8;
+
+  /**
+   * @brief Nogood key of a grid that is not tracked.
+   *
+   */
+  constexpr std::uint64_t kNO_NOGOOD_KEY = 0;
+
+  /**
+   * @brief Entry of SearchTrail::slot_frames for a slot no frame is branching on.
+   *
+   */
+  constexpr std::uint32_t kNO_FRAME = 0xFFFFFFFF;
+
+  /**
+   * @brief Propagation may take at most 1 / kPROPAGATION_SHARE of a pass's time; past that the pass searches
+   * without it.
+   *
+   */
+  constexpr int kPROPAGATION_SHARE = 4;
+
+  /**
+   * @brief How the search picks the next slot to fill and orders the words tried in it.
+   *
+   */
+  enum class SlotOrdering {
+    /**
+     * @brief Fill the open slot nearest the upper left, trying words best score first.
+     *
+     */
+    UpperLeft,
+
+    /**
+     * @brief Fill the open slot with the fewest candidate words, ties going to the slot crossing the most
+     * open slots. Try first the words leaving the most candidates to the crossing slots, and skip words
+     * leaving none.
+     *
+     */
+    MostConstrained,
+  };
+
   /**
    * @brief Search parameters.
    *
@@ -66,24 +138,707 @@ namespace crossword_backend {
      */
     bool rollback;
 
+    /**
+     * @brief Slot and word ordering heuristic.
+     *
+     */
+    SlotOrdering ordering;
+
+    /**
+     * @brief Number of threads searching in parallel. 1 searches on the calling thread alone.
+     *
+     */
+    int threads;
+
+    /**
+     * @brief Seed of the random shuffles applied per entropy. The same seed and parameters give the same fill.
+     *
+     */
+    unsigned int seed;
+
+    /**
+     * @brief Number of refuted grids remembered across the search, for pruning transpositions. 0 disables it.
+     *
+     */
+    std::size_t nogood_capacity;
+
+    /**
+     * @brief On running out of words for a slot, jump back to the latest slot whose word any of the failures
+     * depended on, instead of retrying the slot filled just before (conflict-directed backjumping).
+     *
+     * Only frames whose every candidate was searched can jump, so this has no effect under a branching
+     * factor limit, and less in parallel, where donating a candidate makes its frame backtrack in order.
+     *
+     */
+    bool backjumping;
+
+    /**
+     * @brief Before each pass, narrow every slot's candidates to the words whose letters the crossing slots can
+     * match (arc consistency), and only try those. A pass that leaves some slot without candidates is refuted
+     * without searching.
+     *
+     */
+    bool propagate;
+
+    /**
+     * @brief Where to publish the search's progress for another thread, or nullptr.
+     *
+     */
+    SearchProgress *progress;
+
     /**
      * @brief Autofill parameter construction
      *
      */
     explicit AutofillParams(WordDatabase *db) : db(db), entropy(100), entropy_decay(.9), score_min(100),
                                        score_min_decay(.9), branching_factor_limit(kNO_NUMBER),
-                                       rollback(true), seconds_limit(100) {};
+                                       rollback(true), seconds_limit(100),
+                                       ordering(SlotOrdering::UpperLeft), threads(1),
+                                       seed(0), nogood_capacity(kDEFAULT_NOGOOD_CAPACITY),
+                                       backjumping(false), propagate(false), progress(nullptr) {};
+  };
+
+  /**
+   * @brief What an autofill did, for logging and benchmarking.
+   *
+   */
+  struct AutofillStatistics {
+    /**
+     * @brief True iff a solution was placed on the grid.
+     *
+     */
+    bool found;
+
+    /**
+     * @brief True iff the last pass searched its whole tree, i.e. was not stopped by time or cancellation.
+     *
+     */
+    bool complete;
+
+    /**
+     * @brief Relaxation passes run.
+     *
+     */
+    int passes;
+
+    /**
+     * @brief Nodes visited, summed over passes and workers.
+     *
+     */
+    std::uint64_t nodes;
+
+    /**
+     * @brief Wall time of the search, excluding setup.
+     *
+     */
+    double seconds;
+
+    /**
+     * @brief Existence cache activity during the search.
+     *
+     */
+    CacheStatistics existence_cache;
+
+    /**
+     * @brief Solution cache activity during the search.
+     *
+     */
+    CacheStatistics solution_cache;
+
+    /**
+     * @brief Nodes skipped because their grid was already refuted.
+     *
+     */
+    std::uint64_t nogood_prunes;
+
+    /**
+     * @brief Frames abandoned by backjumping with candidates left untried, summed over passes and workers.
+     *
+     */
+    std::uint64_t frames_backjumped;
+
+    /**
+     * @brief Passes refuted by propagation without searching.
+     *
+     */
+    int passes_refuted;
+
+    /**
+     * @brief Candidate words removed by propagation, summed over passes.
+     *
+     */
+    std::uint64_t words_pruned;
+
+    AutofillStatistics() : found(false), complete(true), passes(0), nodes(0), seconds(0), nogood_prunes(0),
+                           frames_backjumped(0), passes_refuted(0), words_pruned(0) {};
+  };
+
+  /**
+   * @brief A word written into a slot, which any copy of the grid can replay.
+   *
+   */
+  struct Placement {
+    /**
+     * @brief Index of the slot in Crossword::Clues().
+     *
+     */
+    std::size_t slot;
+
+    /**
+     * @brief Word written into the slot.
+     *
+     */
+    Word word;
+  };
+
+  /**
+   * @brief One cell written by the search, as recorded on a SearchTrail.
+   *
+   */
+  struct CellChange {
+    /**
+     * @brief Cell written.
+     *
+     */
+    Coord coord;
+
+    /**
+     * @brief Contents before the write.
+     *
+     */
+    Atom previous;
+
+    /**
+     * @brief Contents after the write.
+     *
+     */
+    Atom next;
+  };
+
+  /**
+   * @brief A slot being branched on, with its candidate words kept in SearchTrail::candidates.
+   *
+   * Siblings are not materialized: candidates are stored worst first and tried from the back, so trying the
+   * next sibling is just decrementing end. Under SlotOrdering::UpperLeft they are also generated lazily,
+   * from a database cursor.
+   *
+   */
+  struct SearchFrame {
+    /**
+     * @brief Index of the slot in Crossword::Clues().
+     *
+     */
+    std::size_t slot;
+
+    /**
+     * @brief Where the frame's candidates start in the arena; it is cut back to here when the frame is done.
+     *
+     */
+    std::size_t start;
+
+    /**
+     * @brief First candidate still to try.
+     *
+     */
+    std::size_t begin;
+
+    /**
+     * @brief One past the last candidate still to try.
+     *
+     */
+    std::size_t end;
+
+    /**
+     * @brief Source of further candidates, pulled a window at a time once [begin, end) runs out.
+     *
+     */
+    SolutionCursor cursor;
+
+    /**
+     * @brief Number of further candidates the cursor may still supply; zero if it is exhausted or unused.
+     *
+     */
+    std::size_t budget;
+
+    /**
+     * @brief True iff every candidate of the slot is searched by this frame, so that running out of them
+     * refutes the grid the frame branches from, and its conflict set accounts for every failure below it.
+     * Cleared by a branching limit, by donating a candidate, or by a child frame that was itself incomplete.
+     *
+     */
+    bool complete;
+
+    /**
+     * @brief Crossword::NogoodKey of the grid the frame branches from, or kNO_NOGOOD_KEY if it is not tracked.
+     *
+     */
+    std::uint64_t nogood_key;
+  };
+
+  /**
+   * @brief How a depth-first search from some node ended.
+   *
+   */
+  enum class SearchOutcome {
+    /**
+     * @brief Every node below was rejected.
+     *
+     */
+    Exhausted,
+
+    /**
+     * @brief The grid holds a solution.
+     *
+     */
+    Found,
+
+    /**
+     * @brief Stopped from outside before either of the above.
+     *
+     */
+    Stopped,
+  };
+
+  /**
+   * @brief Undo trail and branching state of a depth-first search.
+   *
+   * Everything lives in a few flat buffers used as stacks. They are cleared, keeping their storage, at the
+   * start of each pass, so a long search allocates only while it goes deeper than before.
+   *
+   */
+  struct SearchTrail {
+    /**
+     * @brief Every cell written by the placements on path, oldest first.
+     *
+     */
+    std::vector<CellChange> changes;
+
+    /**
+     * @brief Size of changes before each placement on path.
+     *
+     */
+    std::vector<std::size_t> marks;
+
+    /**
+     * @brief Placements currently on the grid, from the starting grid down.
+     *
+     */
+    std::vector<Placement> path;
+
+    /**
+     * @brief Slots being branched on, shallowest first.
+     *
+     */
+    std::vector<SearchFrame> frames;
+
+    /**
+     * @brief Candidate words of every frame, each frame's contiguous.
+     *
+     */
+    std::vector<Word> candidates;
+
+    /**
+     * @brief Scratch buffer for candidates on their way into the arena.
+     *
+     */
+    std::vector<Word> scratch;
+
+    /**
+     * @brief Scratch buffer for Crossword::NogoodKey.
+     *
+     */
+    std::vector<std::size_t> open_slots;
+
+    /**
+     * @brief Index in frames of the frame branching on each slot, or kNO_FRAME. Only kept when backjumping.
+     *
+     */
+    std::vector<std::uint32_t> slot_frames;
+
+    /**
+     * @brief Conflict set of each frame, conflict_words words apiece: bit i is set iff the word placed by
+     * frame i helped rule out some candidate of the frame. Only kept when backjumping.
+     *
+     */
+    std::vector<std::uint64_t> conflicts;
+
+    /**
+     * @brief Words per conflict set.
+     *
+     */
+    std::size_t conflict_words;
+
+    /**
+     * @brief Slot the last failed Crossword::Expand had no candidates for, or Clues().size() if none was open.
+     *
+     */
+    std::size_t dead_end;
+
+    /**
+     * @brief Frames abandoned by backjumping with candidates left untried.
+     *
+     */
+    std::uint64_t frames_backjumped;
+
+    /**
+     * @brief Forget everything, keeping allocated storage. The grid must already be rewound.
+     *
+     */
+    void Clear() {
+      changes.clear();
+      marks.clear();
+      path.clear();
+      frames.clear();
+      candidates.clear();
+      slot_frames.clear();
+      conflicts.clear();
+      frames_backjumped = 0;
+    }
+
+    SearchTrail() : conflict_words(0), dead_end(0), frames_backjumped(0) {};
+  };
+
+  /**
+   * @brief Bounded memory of grids known to have no solution, shared by every pass and worker of an autofill.
+   *
+   * Keyed by Crossword::NogoodKey, which covers only the part of the grid the search below it depends on. Each
+   * entry holds the lowest score minimum at which the grid was refuted; a refutation also holds at any higher
+   * minimum, which only removes candidates.
+   *
+   * A direct-mapped table of packed atomic entries, so that the lookup made at every search node takes no
+   * lock. The low bits of a key pick its entry, which stores the high bits and the score minimum. A newer
+   * refutation replaces whatever shared its entry. Thread-safe.
+   *
+   */
+  class NogoodTable {
+  public:
+    /**
+     * @brief True iff a grid was refuted at a score minimum no higher than score_min.
+     *
+     * @param key
+     * @param score_min
+     * @return true
+     * @return false
+     */
+    bool IsRefuted(const std::uint64_t key, const int score_min) {
+      const std::uint64_t entry = entries_[key & mask_].load(std::memory_order_relaxed);
+      if ((entry & kTAG_MASK) != (key & kTAG_MASK) || (entry & ~kTAG_MASK) == 0 ||
+          static_cast<int>(entry & ~kTAG_MASK) - 1 > score_min)
+        return false;
+      prunes_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+
+    /**
+     * @brief Record that a grid has no solution at score_min, unless it is already known at a lower minimum.
+     *
+     * @param key
+     * @param score_min in [0, 254]
+     */
+    void Refute(const std::uint64_t key, const int score_min) {
+      assert(0 <= score_min && score_min < static_cast<int>(~kTAG_MASK));
+      std::atomic<std::uint64_t> &slot = entries_[key & mask_];
+      const std::uint64_t entry = slot.load(std::memory_order_relaxed);
+      if ((entry & kTAG_MASK) == (key & kTAG_MASK) && (entry & ~kTAG_MASK) != 0 &&
+          static_cast<int>(entry & ~kTAG_MASK) - 1 <= score_min)
+        return;
+      slot.store((key & kTAG_MASK) | static_cast<std::uint64_t>(score_min + 1), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Number of IsRefuted calls that returned true.
+     *
+     * @return std::uint64_t
+     */
+    [[nodiscard]] std::uint64_t GetPrunes() const { return prunes_; }
+
+    /**
+     * @brief Construct an empty table.
+     *
+     * @param capacity number of entries, rounded up to a power of two
+     */
+    explicit NogoodTable(const std::size_t capacity) : prunes_(0) {
+      std::size_t size = 1;
+      while (size < capacity)
+        size <<= 1;
+      entries_ = std::vector<std::atomic<std::uint64_t>>(size);
+      for (auto &entry: entries_)
+        entry.store(0, std::memory_order_relaxed);
+      mask_ = size - 1;
+    }
+
+  private:
+    /**
+     * @brief Bits of an entry holding the high bits of its key; the rest hold the score minimum plus one,
+     * or zero for an empty entry.
+     *
+     */
+    static constexpr std::uint64_t kTAG_MASK = ~std::uint64_t{0xFF};
+
+    /**
+     * @brief The entries.
+     *
+     */
+    std::vector<std::atomic<std::uint64_t>> entries_;
+
+    /**
+     * @brief Number of entries minus one.
+     *
+     */
+    std::size_t mask_;
+
+    /**
+     * @brief Number of IsRefuted calls that returned true.
+     *
+     */
+    std::atomic<std::uint64_t> prunes_;
+  };
+
+  /**
+   * @brief A checked cell of a slot, with the letters propagation left it.
+   *
+   */
+  struct LetterCheck {
+    /**
+     * @brief Position of the cell in the slot.
+     *
+     */
+    std::size_t position;
+
+    /**
+     * @brief Bit c is set iff atom code c may go in the cell.
+     *
+     */
+    std::uint32_t letters;
   };
 
   /**
-   * @brief DFS search node.
+   * @brief Candidate words of each slot that survived propagation, for one pass.
+   *
+   * A word the database offers a slot at the pass's score survived iff its letter at every checked cell is one
+   * the crossing slot can still match there, so only the cells that lost letters are kept. Slots are indexed
+   * like Crossword::Clues().
+   *
+   */
+  struct SlotDomains {
+    /**
+     * @brief The cells of each slot that lost letters; empty for slots that lost no words.
+     *
+     */
+    std::vector<std::vector<LetterCheck>> checks;
+
+    /**
+     * @brief True iff a word the database offers a slot may be tried in it.
+     *
+     * @param slot
+     * @param word
+     * @return true
+     * @return false propagation ruled it out
+     */
+    [[nodiscard]] bool Allows(const std::size_t slot, Word const &word) const {
+      for (auto const &check: checks[slot]) {
+        if ((check.letters >> word[check.position].GetCode() & 1) == 0)
+          return false;
+      }
+      return true;
+    }
+  };
+
+  /**
+   * @brief Candidates of the open slots, carried over the passes of one autofill of one grid.
+   *
+   * Ranked cursors yield the words above a higher score first, so the candidates at one pass's score are the
+   * first ones at any later, lower score: each pass only streams in the words its lower score admits.
+   *
+   */
+  struct PropagationState {
+    /**
+     * @brief Entry indices of each open slot's candidates, the first its cursor yields in some order. Empty for
+     * filled slots.
+     *
+     */
+    std::vector<std::vector<std::uint32_t>> candidates;
+  };
+
+  /**
+   * @brief Subtree of a parallel search, given as the placements leading to its root from the starting grid.
+   *
+   */
+  using SearchTask = std::vector<Placement>;
+
+  /**
+   * @brief Per-worker deque of subtrees. Its owner pushes and takes at the back, depth first; idle workers
+   * steal from the front, where the shallowest and so largest subtrees are.
+   *
+   * Tasks are coarse, so a mutex is cheap next to the work each one holds.
+   *
+   */
+  class TaskDeque {
+  public:
+    /**
+     * @brief Add a task at the back.
+     *
+     * @param task
+     */
+    void PushBack(SearchTask task) {
+      std::lock_guard<std::mutex> guard(lock_);
+      tasks_.push_back(std::move(task));
+    }
+
+    /**
+     * @brief Take the newest task.
+     *
+     * @param task output
+     * @return true a task was taken
+     * @return false the deque is empty
+     */
+    bool PopBack(SearchTask &task) {
+      std::lock_guard<std::mutex> guard(lock_);
+      if (tasks_.empty())
+        return false;
+      task = std::move(tasks_.back());
+      tasks_.pop_back();
+      return true;
+    }
+
+    /**
+     * @brief Take the oldest task.
+     *
+     * @param task output
+     * @return true a task was taken
+     * @return false the deque is empty
+     */
+    bool StealFront(SearchTask &task) {
+      std::lock_guard<std::mutex> guard(lock_);
+      if (tasks_.empty())
+        return false;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+      return true;
+    }
+
+    /**
+     * @brief True iff there are no tasks.
+     *
+     * @return true
+     * @return false
+     */
+    bool IsEmpty() {
+      std::lock_guard<std::mutex> guard(lock_);
+      return tasks_.empty();
+    }
+
+  private:
+    /**
+     * @brief Guards tasks_.
+     *
+     */
+    std::mutex lock_;
+
+    /**
+     * @brief Pending tasks, oldest first.
+     *
+     */
+    std::deque<SearchTask> tasks_;
+  };
+
+  /**
+   * @brief State shared by the workers of one parallel search pass.
    *
    */
-  struct DFSNode {
-    CrosswordAction *action;
-    int depth;
+  struct ParallelSearch {
+    /**
+     * @brief One deque per worker.
+     *
+     */
+    std::vector<TaskDeque> deques;
+
+    /**
+     * @brief Tasks pushed and not yet fully searched. The pass is over when this reaches zero.
+     *
+     */
+    std::atomic<std::size_t> pending_tasks;
+
+    /**
+     * @brief Workers currently looking for a task; others donate subtrees while this is non-zero.
+     *
+     */
+    std::atomic<std::size_t> idle_workers;
+
+    /**
+     * @brief Set by the first worker to reach a solution.
+     *
+     */
+    std::atomic<bool> found;
+
+    /**
+     * @brief Nodes visited, summed over workers.
+     *
+     */
+    std::atomic<std::uint64_t> nodes;
+
+    /**
+     * @brief Tasks taken from another worker's deque.
+     *
+     */
+    std::atomic<std::uint64_t> steals;
+
+    /**
+     * @brief Frames abandoned by backjumping, summed over workers.
+     *
+     */
+    std::atomic<std::uint64_t> frames_backjumped;
+
+    /**
+     * @brief Guards solution.
+     *
+     */
+    std::mutex solution_lock;
+
+    /**
+     * @brief Placements of the solution, once found.
+     *
+     */
+    SearchTask solution;
+
+    /**
+     * @brief Dictionary snapshot pinned by the searching thread, for the workers to pin too; may be nullptr.
+     *
+     */
+    DictionarySnapshot const *dictionary;
+
+    /**
+     * @brief Take a task, own deque first, then stealing round-robin from the others.
+     *
+     * @param worker
+     * @param task output
+     * @return true
+     * @return false no deque had a task
+     */
+    bool Take(const std::size_t worker, SearchTask &task) {
+      if (deques[worker].PopBack(task))
+        return true;
+      for (std::size_t offset = 1; offset < deques.size(); ++offset) {
+        if (deques[(worker + offset) % deques.size()].StealFront(task)) {
+          steals++;
+          CROSSWORD_TRACE(kTRACE_SEARCH, TraceEventType::TaskStolen, (worker + offset) % deques.size(), 0);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * @brief True iff another worker has already found a solution. Time limits are checked by each worker.
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsStopped() const { return found; }
 
-    DFSNode(CrosswordAction *action_pointer, int node_depth) : action(action_pointer), depth(node_depth) {};
+    explicit ParallelSearch(const std::size_t workers)
+            : deques(workers), pending_tasks(0), idle_workers(0), found(false), nodes(0), steals(0),
+              frames_backjumped(0), dictionary(nullptr) {};
   };
 }
 
@@ -0,0 +1,362 @@
+/**
+ * @file search_progress.hpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Wait-free publication of an autofill's progress to another thread.
+ * @version 0.1
+ * @date 2022-04-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SEARCH_PROGRESS_HPP
+#define SEARCH_PROGRESS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "crossword/crossword.hpp"
+
+namespace crossword_backend {
+  /**
+   * @brief Nodes a search worker counts locally before adding them to the shared progress counter.
+   *
+   */
+  constexpr std::uint64_t kPROGRESS_NODE_BATCH = 1024;
+
+  /**
+   * @brief Three copies of a value, handed from one writer at a time to one reader without either waiting.
+   *
+   * The writer fills the back copy and swaps it with the middle one; the reader swaps the middle copy
+   * with the front one when it is fresh, and reads the front copy at leisure.
+   *
+   * @tparam T
+   */
+  template<typename T>
+  class TripleBuffer {
+  public:
+    /**
+     * @brief The copy the writer may fill. Writer only.
+     *
+     * @return T&
+     */
+    T &Back() { return slots_[back_]; }
+
+    /**
+     * @brief Hand the back copy to the reader. Writer only.
+     *
+     */
+    void Publish() {
+      back_ = middle_.exchange(static_cast<std::uint8_t>(back_ | kFRESH), std::memory_order_acq_rel) & kINDEX_MASK;
+    }
+
+    /**
+     * @brief Take the latest published copy, if any was published since the last call. Reader only.
+     *
+     * @return true Front changed
+     * @return false nothing new
+     */
+    bool Update() {
+      if ((middle_.load(std::memory_order_relaxed) & kFRESH) == 0)
+        return false;
+      front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kINDEX_MASK;
+      return true;
+    }
+
+    /**
+     * @brief The copy taken by the last Update. Reader only.
+     *
+     * @return T const&
+     */
+    [[nodiscard]] T const &Front() const { return slots_[front_]; }
+
+    TripleBuffer() : slots_{}, back_(0), middle_(1), front_(2) {};
+
+  private:
+    /**
+     * @brief Set in middle_ when it holds a copy the reader has not taken.
+     *
+     */
+    static constexpr std::uint8_t kFRESH = 4;
+
+    /**
+     * @brief Bits of middle_ holding a slot index.
+     *
+     */
+    static constexpr std::uint8_t kINDEX_MASK = 3;
+
+    /**
+     * @brief The three copies.
+     *
+     */
+    std::array<T, 3> slots_;
+
+    /**
+     * @brief Index of the writer's copy.
+     *
+     */
+    std::uint8_t back_;
+
+    /**
+     * @brief Index of the copy in transit, and kFRESH.
+     *
+     */
+    std::atomic<std::uint8_t> middle_;
+
+    /**
+     * @brief Index of the reader's copy.
+     *
+     */
+    std::uint8_t front_;
+  };
+
+  /**
+   * @brief What an autofill looked like at one moment.
+   *
+   */
+  struct SearchProgressFrame {
+    /**
+     * @brief The grid of the node the frame was taken at.
+     *
+     */
+    GridSnapshot grid;
+
+    /**
+     * @brief The partial fill with the most words placed by the search so far.
+     *
+     */
+    GridSnapshot best;
+
+    /**
+     * @brief Words placed by the search at the node the frame was taken at.
+     *
+     */
+    std::size_t depth;
+
+    /**
+     * @brief Words placed in best.
+     *
+     */
+    std::size_t best_depth;
+
+    /**
+     * @brief Nodes visited so far, over passes and workers. While searching, up to kPROGRESS_NODE_BATCH per
+     * worker behind.
+     *
+     */
+    std::uint64_t nodes;
+
+    /**
+     * @brief Average rate since the autofill began.
+     *
+     */
+    double nodes_per_second;
+
+    /**
+     * @brief Score minimum of the current pass.
+     *
+     */
+    int score_min;
+
+    /**
+     * @brief False once the autofill is over.
+     *
+     */
+    bool searching;
+
+    SearchProgressFrame() : depth(0), best_depth(0), nodes(0), nodes_per_second(0), score_min(0),
+                            searching(false) {};
+  };
+
+  /**
+   * @brief Progress of an autofill, published by its workers for one reader, typically a UI thread.
+   *
+   * The reader asks for a frame with Request and picks up the latest one with Update; neither waits.
+   * Workers poll for requests once per node with a single relaxed load, and copy their grid only
+   * when one is pending or they reach a new best depth. Whichever worker claims a request first
+   * answers it; the others carry on.
+   *
+   */
+  class SearchProgress {
+  public:
+    /* Reader side */
+
+    /**
+     * @brief Ask the search for a new frame.
+     *
+     */
+    void Request() {
+      std::uint8_t expected = kIDLE;
+      state_.compare_exchange_strong(expected, kREQUESTED, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Take the latest published frame, if there is a new one.
+     *
+     * @return true Read changed
+     * @return false nothing new
+     */
+    bool Update() { return frames_.Update(); }
+
+    /**
+     * @brief The frame taken by the last Update.
+     *
+     * @return SearchProgressFrame const&
+     */
+    [[nodiscard]] SearchProgressFrame const &Read() const { return frames_.Front(); }
+
+    /* Search side */
+
+    /**
+     * @brief Start tracking an autofill and publish its first frame. Called before any worker starts.
+     *
+     * @param grid
+     * @param score_min
+     */
+    void Begin(Crossword const &grid, const int score_min) {
+      start_ = std::chrono::steady_clock::now();
+      nodes_.store(0, std::memory_order_relaxed);
+      best_depth_.store(0, std::memory_order_relaxed);
+      state_.exchange(kWRITING, std::memory_order_acquire);
+      grid.SaveSnapshot(best_);
+      Publish_(grid, 0, score_min, true);
+      state_.store(kIDLE, std::memory_order_release);
+    }
+
+    /**
+     * @brief Publish the final frame, with the score minimum of the last frame. Called after every worker
+     * has stopped.
+     *
+     * @param grid
+     * @param nodes exact node count, replacing the batched one
+     */
+    void Finish(Crossword const &grid, const std::uint64_t nodes) {
+      nodes_.store(nodes, std::memory_order_relaxed);
+      state_.exchange(kWRITING, std::memory_order_acquire);
+      Publish_(grid, 0, score_min_, false);
+      state_.store(kIDLE, std::memory_order_release);
+    }
+
+    /**
+     * @brief Add to the shared node counter.
+     *
+     * @param nodes
+     */
+    void AddNodes(const std::uint64_t nodes) { nodes_.fetch_add(nodes, std::memory_order_relaxed); }
+
+    /**
+     * @brief Called by a worker at every node: records a new best depth, and answers a pending request.
+     *
+     * @param grid the worker's grid
+     * @param depth words placed by the search
+     * @param score_min
+     */
+    void Offer(Crossword const &grid, const std::size_t depth, const int score_min) {
+      const std::uint8_t state = state_.load(std::memory_order_relaxed);
+      if (state == kWRITING || (state == kIDLE && depth <= best_depth_.load(std::memory_order_relaxed)))
+        return;
+      std::uint8_t claimed = state;
+      if (!state_.compare_exchange_strong(claimed, kWRITING, std::memory_order_acquire))
+        return; // Another worker got there first.
+      if (depth > best_depth_.load(std::memory_order_relaxed)) { // It may have set a deeper best meanwhile.
+        grid.SaveSnapshot(best_);
+        best_depth_.store(depth, std::memory_order_relaxed);
+      }
+      if (state == kREQUESTED)
+        Publish_(grid, depth, score_min, true);
+      state_.store(kIDLE, std::memory_order_release);
+    }
+
+    SearchProgress() : state_(kIDLE), nodes_(0), best_depth_(0), score_min_(0),
+                       start_(std::chrono::steady_clock::now()) {};
+
+  private:
+    /**
+     * @brief No frame is wanted.
+     *
+     */
+    static constexpr std::uint8_t kIDLE = 0;
+
+    /**
+     * @brief The reader wants a frame.
+     *
+     */
+    static constexpr std::uint8_t kREQUESTED = 1;
+
+    /**
+     * @brief A worker owns best_ and the back frame.
+     *
+     */
+    static constexpr std::uint8_t kWRITING = 2;
+
+    /**
+     * @brief Fill the back frame and hand it to the reader. Only called in the kWRITING state.
+     *
+     * @param grid
+     * @param depth
+     * @param score_min
+     * @param searching
+     */
+    void Publish_(Crossword const &grid, const std::size_t depth, const int score_min, const bool searching) {
+      SearchProgressFrame &frame = frames_.Back();
+      grid.SaveSnapshot(frame.grid);
+      frame.best = best_;
+      frame.depth = depth;
+      frame.best_depth = best_depth_.load(std::memory_order_relaxed);
+      frame.nodes = nodes_.load(std::memory_order_relaxed);
+      const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+      frame.nodes_per_second = seconds > 0 ? static_cast<double>(frame.nodes) / seconds : 0;
+      frame.score_min = score_min;
+      frame.searching = searching;
+      score_min_ = score_min;
+      frames_.Publish();
+    }
+
+    /**
+     * @brief kIDLE, kREQUESTED or kWRITING. Claiming kWRITING makes a worker the buffer's single writer.
+     *
+     */
+    std::atomic<std::uint8_t> state_;
+
+    /**
+     * @brief Nodes reported so far.
+     *
+     */
+    std::atomic<std::uint64_t> nodes_;
+
+    /**
+     * @brief Words placed in best_. Only written in the kWRITING state.
+     *
+     */
+    std::atomic<std::size_t> best_depth_;
+
+    /**
+     * @brief The deepest partial fill so far. Only touched in the kWRITING state.
+     *
+     */
+    GridSnapshot best_;
+
+    /**
+     * @brief Score minimum of the last published frame. Only touched in the kWRITING state.
+     *
+     */
+    int score_min_;
+
+    /**
+     * @brief When the autofill began.
+     *
+     */
+    std::chrono::steady_clock::time_point start_;
+
+    /**
+     * @brief Published frames.
+     *
+     */
+    TripleBuffer<SearchProgressFrame> frames_;
+  };
+}
+
+#endif
@@ -0,0 +1,319 @@
+/**
+ * @file tracing.cpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Trace buffers and the Chrome trace writer.
+ * @version 0.1
+ * @date 2022-04-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "crossword/tracing.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace crossword_backend;
+
+/**
+ * @brief Steady clock reading in nanoseconds.
+ *
+ * @return std::uint64_t
+ */
+static std::uint64_t NowNanoseconds() {
+  return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * @brief The calling thread's claim on a trace buffer, handed back when the thread exits.
+ *
+ */
+struct BufferClaim {
+  /**
+   * @brief Claimed buffer, or nullptr before the thread first records.
+   *
+   */
+  TraceBuffer *buffer = nullptr;
+
+  ~BufferClaim() {
+    if (buffer != nullptr)
+      buffer->Release();
+  }
+};
+
+/**
+ * @brief This thread's buffer.
+ *
+ */
+static thread_local BufferClaim claim;
+
+/**
+ * @brief Construct an empty buffer.
+ *
+ * @param track index in the tracer
+ */
+TraceBuffer::TraceBuffer(const std::uint32_t track)
+        : words_(new std::atomic<std::uint64_t>[kTRACE_BUFFER_EVENTS * kWORDS]), head_(0), reserved_(0),
+          owned_(false), track_(track) {}
+
+/**
+ * @brief Append the events still in the buffer, oldest first. Safe while the owner records.
+ *
+ * @param events appended to
+ */
+void TraceBuffer::Collect(std::vector<TraceEvent> &events) const {
+  const std::uint64_t head = head_.load(std::memory_order_acquire);
+  const std::uint64_t first = head > kTRACE_BUFFER_EVENTS ? head - kTRACE_BUFFER_EVENTS : 0;
+  const std::size_t begin = events.size();
+  for (std::uint64_t i = first; i < head; ++i) {
+    std::atomic<std::uint64_t> const *words = &words_[(i & (kTRACE_BUFFER_EVENTS - 1)) * kWORDS];
+    events.push_back(TraceEvent{words[0].load(std::memory_order_relaxed), words[1].load(std::memory_order_relaxed),
+                                words[2].load(std::memory_order_relaxed),
+                                static_cast<TraceEventType>(words[3].load(std::memory_order_relaxed)), track_});
+  }
+
+  // Slots reused by events begun since head was read may have been torn.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const std::uint64_t reserved = reserved_.load(std::memory_order_relaxed);
+  const std::uint64_t intact = reserved > kTRACE_BUFFER_EVENTS ? reserved - kTRACE_BUFFER_EVENTS : 0;
+  if (intact > first) {
+    const std::size_t torn = static_cast<std::size_t>(std::min(intact, head) - first);
+    events.erase(events.begin() + static_cast<std::ptrdiff_t>(begin),
+                 events.begin() + static_cast<std::ptrdiff_t>(begin + torn));
+  }
+}
+
+/**
+ * @brief The process-wide tracer.
+ *
+ * @return Tracer&
+ */
+Tracer &Tracer::Global() {
+  static Tracer *tracer = new Tracer(); // Never destroyed, as detached threads may still release buffers at exit.
+  return *tracer;
+}
+
+/**
+ * @brief Construct a tracer that is not recording.
+ *
+ */
+Tracer::Tracer() : recording_(false), start_nanoseconds_(NowNanoseconds()) {}
+
+/**
+ * @brief Forget every recorded event and start recording. Only while no probe is recording.
+ *
+ */
+void Tracer::Start() {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (auto &buffer: buffers_)
+    buffer->Clear();
+  start_nanoseconds_.store(NowNanoseconds(), std::memory_order_relaxed);
+  recording_.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Claim a free buffer for the calling thread, adding one if every buffer is owned.
+ *
+ * @return TraceBuffer&
+ */
+TraceBuffer &Tracer::ClaimBuffer() {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (auto &buffer: buffers_) {
+    if (buffer->Claim())
+      return *buffer;
+  }
+  buffers_.emplace_back(new TraceBuffer(static_cast<std::uint32_t>(buffers_.size())));
+  buffers_.back()->Claim();
+  return *buffers_.back();
+}
+
+/**
+ * @brief Record an event into the calling thread's buffer. Called through CROSSWORD_TRACE.
+ *
+ * @param type
+ * @param arg0
+ * @param arg1
+ */
+void Tracer::Record(const TraceEventType type, const std::uint64_t arg0, const std::uint64_t arg1) {
+  if (claim.buffer == nullptr)
+    claim.buffer = &ClaimBuffer();
+  claim.buffer->Record(NowNanoseconds() - start_nanoseconds_.load(std::memory_order_relaxed), type, arg0, arg1);
+}
+
+/**
+ * @brief Every event still buffered, by time.
+ *
+ * @return std::vector<TraceEvent>
+ */
+std::vector<TraceEvent> Tracer::Collect() {
+  std::vector<TraceEvent> events;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (auto const &buffer: buffers_)
+      buffer->Collect(events);
+  }
+  std::stable_sort(events.begin(), events.end(), [](TraceEvent const &a, TraceEvent const &b) {
+    return a.nanoseconds < b.nanoseconds;
+  });
+  return events;
+}
+
+/**
+ * @brief Events overwritten before they could be collected, since the last Start.
+ *
+ * @return std::uint64_t
+ */
+std::uint64_t Tracer::GetDropped() {
+  std::lock_guard<std::mutex> guard(lock_);
+  std::uint64_t dropped = 0;
+  for (auto const &buffer: buffers_) {
+    const std::uint64_t recorded = buffer->GetRecorded();
+    if (recorded > kTRACE_BUFFER_EVENTS)
+      dropped += recorded - kTRACE_BUFFER_EVENTS;
+  }
+  return dropped;
+}
+
+/**
+ * @brief Chrome trace name of an event type.
+ *
+ * @param type
+ * @return char const*
+ */
+static char const *EventName(const TraceEventType type) {
+  switch (type) {
+    case TraceEventType::AutofillBegin:
+    case TraceEventType::AutofillEnd:
+      return "autofill";
+    case TraceEventType::PassBegin:
+    case TraceEventType::PassEnd:
+      return "pass";
+    case TraceEventType::NodeExpanded:
+      return "expand";
+    case TraceEventType::Backtrack:
+      return "backtrack";
+    case TraceEventType::Backjump:
+      return "backjump";
+    case TraceEventType::NogoodPrune:
+      return "nogood prune";
+    case TraceEventType::TaskStolen:
+      return "steal";
+    case TraceEventType::CacheHit:
+      return "cache hit";
+    case TraceEventType::CacheMiss:
+      return "cache miss";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Chrome trace phase of an event type: span begin, span end, or instant.
+ *
+ * @param type
+ * @return char
+ */
+static char EventPhase(const TraceEventType type) {
+  switch (type) {
+    case TraceEventType::AutofillBegin:
+    case TraceEventType::PassBegin:
+      return 'B';
+    case TraceEventType::AutofillEnd:
+    case TraceEventType::PassEnd:
+      return 'E';
+    default:
+      return 'i';
+  }
+}
+
+/**
+ * @brief Names of an event type's two arguments, or nullptr for unused ones.
+ *
+ * @param type
+ * @param names output
+ */
+static void ArgumentNames(const TraceEventType type, char const *names[2]) {
+  names[0] = nullptr;
+  names[1] = nullptr;
+  switch (type) {
+    case TraceEventType::AutofillBegin:
+      names[0] = "score_min";
+      names[1] = "threads";
+      break;
+    case TraceEventType::AutofillEnd:
+      names[0] = "found";
+      names[1] = "nodes";
+      break;
+    case TraceEventType::PassBegin:
+      names[0] = "score_min";
+      names[1] = "entropy";
+      break;
+    case TraceEventType::PassEnd:
+      names[0] = "outcome";
+      names[1] = "nodes";
+      break;
+    case TraceEventType::NodeExpanded:
+    case TraceEventType::Backtrack:
+      names[0] = "placed";
+      names[1] = "slot";
+      break;
+    case TraceEventType::Backjump:
+      names[0] = "frame";
+      names[1] = "kept";
+      break;
+    case TraceEventType::NogoodPrune:
+      names[0] = "placed";
+      break;
+    case TraceEventType::TaskStolen:
+      names[0] = "victim";
+      break;
+    case TraceEventType::CacheHit:
+    case TraceEventType::CacheMiss:
+      names[0] = "cache";
+      break;
+  }
+}
+
+/**
+ * @brief Write a time in nanoseconds as microseconds with three decimals.
+ *
+ * @param out
+ * @param nanoseconds
+ */
+static void WriteMicroseconds(std::ostream &out, const std::uint64_t nanoseconds) {
+  const std::uint64_t fraction = nanoseconds % 1000;
+  out << nanoseconds / 1000 << "." << fraction / 100 << fraction / 10 % 10 << fraction % 10;
+}
+
+/**
+ * @brief Write every buffered event in the Chrome trace event format, for chrome://tracing or Perfetto.
+ *
+ * Each buffer is a thread of one process; times are in microseconds since Start.
+ *
+ * @param out
+ */
+void Tracer::WriteChromeTrace(std::ostream &out) {
+  const std::vector<TraceEvent> events = Collect();
+  out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    TraceEvent const &event = events[i];
+    const char phase = EventPhase(event.type);
+    out << (i == 0 ? "\n" : ",\n") << "{\"name\": \"" << EventName(event.type) << "\", \"ph\": \"" << phase
+        << "\", \"ts\": ";
+    WriteMicroseconds(out, event.nanoseconds);
+    out << ", \"pid\": 1, \"tid\": " << event.track;
+    if (phase == 'i')
+      out << ", \"s\": \"t\"";
+    char const *names[2];
+    ArgumentNames(event.type, names);
+    if (names[0] != nullptr) {
+      out << ", \"args\": {\"" << names[0] << "\": " << event.arg0;
+      if (names[1] != nullptr)
+        out << ", \"" << names[1] << "\": " << event.arg1;
+      out << "}";
+    }
+    out << "}";
+  }
+  out << "\n]}\n";
+}
@@ -0,0 +1,363 @@
+/**
+ * @file tracing.hpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Low-overhead event tracing for the search, with a Chrome trace dump.
+ * @version 0.1
+ * @date 2022-04-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef TRACING_HPP
+#define TRACING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+/**
+ * @brief Probes up to this level are compiled in; the rest cost nothing. Set with -DCROSSWORD_TRACE_LEVEL=n.
+ *
+ * 0 compiles out every probe, 1 keeps autofills and passes, 2 adds search nodes and backtracks, and 3 adds
+ * cache lookups.
+ *
+ */
+#ifndef CROSSWORD_TRACE_LEVEL
+#define CROSSWORD_TRACE_LEVEL 1
+#endif
+
+/**
+ * @brief Record an event if level is compiled in and the tracer is recording. The arguments are not
+ * evaluated otherwise.
+ *
+ */
+#define CROSSWORD_TRACE(level, type, arg0, arg1)                                                       \
+  do {                                                                                                 \
+    if constexpr ((level) <= CROSSWORD_TRACE_LEVEL) {                                                  \
+      if (::crossword_backend::Tracer::Global().IsRecording())                                         \
+        ::crossword_backend::Tracer::Global().Record((type), (arg0), (arg1));                          \
+    }                                                                                                  \
+  } while (false)
+
+namespace crossword_backend {
+  /**
+   * @brief Trace level of autofills and passes.
+   *
+   */
+  constexpr int kTRACE_PASSES = 1;
+
+  /**
+   * @brief Trace level of individual search nodes.
+   *
+   */
+  constexpr int kTRACE_SEARCH = 2;
+
+  /**
+   * @brief Trace level of cache lookups.
+   *
+   */
+  constexpr int kTRACE_CACHE = 3;
+
+  /**
+   * @brief Events each thread's ring buffer holds before overwriting its oldest.
+   *
+   */
+  constexpr std::size_t kTRACE_BUFFER_EVENTS = 1 << 16;
+
+  /**
+   * @brief Kinds of traced events. Begin and End events bracket a span on one thread.
+   *
+   */
+  enum class TraceEventType : std::uint32_t {
+    /**
+     * @brief arg0: score minimum, arg1: threads.
+     *
+     */
+    AutofillBegin,
+
+    /**
+     * @brief arg0: 1 iff found, arg1: nodes.
+     *
+     */
+    AutofillEnd,
+
+    /**
+     * @brief arg0: score minimum, arg1: entropy.
+     *
+     */
+    PassBegin,
+
+    /**
+     * @brief arg0: SearchOutcome, arg1: nodes so far.
+     *
+     */
+    PassEnd,
+
+    /**
+     * @brief A slot was branched on. arg0: words placed, arg1: slot.
+     *
+     */
+    NodeExpanded,
+
+    /**
+     * @brief A frame ran out of candidates. arg0: words placed, arg1: slot.
+     *
+     */
+    Backtrack,
+
+    /**
+     * @brief A frame backjumped. arg0: its index, arg1: frames kept below it.
+     *
+     */
+    Backjump,
+
+    /**
+     * @brief A node was skipped as already refuted. arg0: words placed.
+     *
+     */
+    NogoodPrune,
+
+    /**
+     * @brief A worker took a task from another's deque. arg0: victim worker.
+     *
+     */
+    TaskStolen,
+
+    /**
+     * @brief arg0: TraceCache.
+     *
+     */
+    CacheHit,
+
+    /**
+     * @brief arg0: TraceCache.
+     *
+     */
+    CacheMiss,
+  };
+
+  /**
+   * @brief Which database cache a CacheHit or CacheMiss was in.
+   *
+   */
+  enum TraceCache : std::uint64_t {
+    kTRACE_EXISTENCE_CACHE = 0,
+    kTRACE_COUNT_CACHE = 1,
+    kTRACE_SOLUTION_CACHE = 2,
+  };
+
+  /**
+   * @brief One recorded event, as read back from a trace buffer.
+   *
+   */
+  struct TraceEvent {
+    /**
+     * @brief Nanoseconds since the tracer started.
+     *
+     */
+    std::uint64_t nanoseconds;
+
+    /**
+     * @brief First argument, meaning per type.
+     *
+     */
+    std::uint64_t arg0;
+
+    /**
+     * @brief Second argument, meaning per type.
+     *
+     */
+    std::uint64_t arg1;
+
+    /**
+     * @brief Kind of event.
+     *
+     */
+    TraceEventType type;
+
+    /**
+     * @brief Index of the buffer the event was recorded in, standing for its thread.
+     *
+     */
+    std::uint32_t track;
+  };
+
+  /**
+   * @brief Ring of fixed-size events written by one thread at a time and read by any.
+   *
+   * Events are stored as relaxed atomic words, so that reading while the owner writes is not a race;
+   * events the owner may have overwritten during a read are discarded, as in a seqlock.
+   *
+   */
+  class TraceBuffer {
+  public:
+    /**
+     * @brief Append an event, overwriting the oldest if full. Owner only.
+     *
+     * @param nanoseconds
+     * @param type
+     * @param arg0
+     * @param arg1
+     */
+    void Record(std::uint64_t nanoseconds, TraceEventType type, std::uint64_t arg0, std::uint64_t arg1) {
+      const std::uint64_t head = head_.load(std::memory_order_relaxed);
+      reserved_.store(head + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release); // A reader that sees the new words sees reserved_.
+      std::atomic<std::uint64_t> *words = &words_[(head & (kTRACE_BUFFER_EVENTS - 1)) * kWORDS];
+      words[0].store(nanoseconds, std::memory_order_relaxed);
+      words[1].store(arg0, std::memory_order_relaxed);
+      words[2].store(arg1, std::memory_order_relaxed);
+      words[3].store(static_cast<std::uint64_t>(type), std::memory_order_relaxed);
+      head_.store(head + 1, std::memory_order_release);
+    }
+
+    void Collect(std::vector<TraceEvent> &events) const;
+
+    /**
+     * @brief Events recorded since the last clear, including overwritten ones.
+     *
+     * @return std::uint64_t
+     */
+    [[nodiscard]] std::uint64_t GetRecorded() const { return head_.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Forget every event. Only while nothing records into the buffer.
+     *
+     */
+    void Clear() {
+      reserved_.store(0, std::memory_order_relaxed);
+      head_.store(0, std::memory_order_release);
+    }
+
+    /**
+     * @brief Claim the buffer for the calling thread.
+     *
+     * @return true
+     * @return false another thread owns it
+     */
+    bool Claim() {
+      bool expected = false;
+      return owned_.compare_exchange_strong(expected, true, std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Hand the buffer back, keeping its events, for another thread to claim.
+     *
+     */
+    void Release() { owned_.store(false, std::memory_order_release); }
+
+    explicit TraceBuffer(std::uint32_t track);
+
+  private:
+    /**
+     * @brief Atomic words per event: timestamp, two arguments and type.
+     *
+     */
+    static constexpr std::size_t kWORDS = 4;
+
+    /**
+     * @brief kTRACE_BUFFER_EVENTS events of kWORDS words.
+     *
+     */
+    std::unique_ptr<std::atomic<std::uint64_t>[]> words_;
+
+    /**
+     * @brief Events recorded; the next one goes at head_ modulo the capacity.
+     *
+     */
+    std::atomic<std::uint64_t> head_;
+
+    /**
+     * @brief head_ plus one while an event is being written, so that readers can tell which slots it may
+     * have torn.
+     *
+     */
+    std::atomic<std::uint64_t> reserved_;
+
+    /**
+     * @brief Whether a thread is recording into the buffer.
+     *
+     */
+    std::atomic<bool> owned_;
+
+    /**
+     * @brief Index of the buffer in its tracer.
+     *
+     */
+    std::uint32_t track_;
+  };
+
+  /**
+   * @brief Process-wide event recorder, with one TraceBuffer per recording thread.
+   *
+   * Probes (see CROSSWORD_TRACE) take no lock: a thread finds its buffer through a thread-local pointer,
+   * taking the tracer's lock only the first time it records. Buffers of finished threads are reused by
+   * new ones, so a run with a worker pool per pass needs no more buffers than it has threads at once.
+   * Events are only formatted when dumped.
+   *
+   */
+  class Tracer {
+  public:
+    static Tracer &Global();
+
+    void Start();
+
+    /**
+     * @brief Stop recording. Recorded events are kept until the next Start.
+     *
+     */
+    void Stop() { recording_.store(false, std::memory_order_relaxed); }
+
+    /**
+     * @brief True iff probes record. A single relaxed load.
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsRecording() const { return recording_.load(std::memory_order_relaxed); }
+
+    void Record(TraceEventType type, std::uint64_t arg0, std::uint64_t arg1);
+
+    std::vector<TraceEvent> Collect();
+
+    std::uint64_t GetDropped();
+
+    void WriteChromeTrace(std::ostream &out);
+
+    Tracer();
+
+  private:
+    TraceBuffer &ClaimBuffer();
+
+    /**
+     * @brief Whether probes record.
+     *
+     */
+    std::atomic<bool> recording_;
+
+    /**
+     * @brief Steady clock reading, in nanoseconds, at the last Start.
+     *
+     */
+    std::atomic<std::uint64_t> start_nanoseconds_;
+
+    /**
+     * @brief Every buffer ever claimed.
+     *
+     */
+    std::vector<std::unique_ptr<TraceBuffer>> buffers_;
+
+    /**
+     * @brief Guards buffers_.
+     *
+     */
+    std::mutex lock_;
+  };
+}
+
+#endif
@@ -18,10 +18,11 @@ using namespace crossword_backend;
  *
  * @param word
  */
-Word::Word(std::string const &word) {
-  atoms_.reserve(word.size());
-  for (size_t i = 0; i < word.size(); ++i) {
-    atoms_.push_back(Atom(word.substr(i, 1)));
+Word::Word(std::string const &word) : limbs_{}, size_(0) {
+  for (const char c: word) {
+    const bool valid = c >= 'A' && c <= 'Z';
+    assert(valid);
+    push_back(valid ? Atom::FromCode(static_cast<unsigned char>(c - 'A' + 1)) : Atom());
   }
 }
 
@@ -32,11 +33,13 @@ Word::Word(std::string const &word) {
  */
 std::string Word::ToString() const {
   std::string s;
-  for (std::size_t i = 0; i < atoms_.size(); ++i) {
-    if (atoms_[i].IsEmpty())
+  s.reserve(size_);
+  for (std::size_t i = 0; i < size_; ++i) {
+    const Atom atom = (*this)[i];
+    if (atom.IsEmpty())
       s += " ";
     else
-      s += atoms_[i].ToString();
+      s += atom.ToString();
   }
   return s;
 }
@@ -50,39 +53,3 @@ std::string Word::ToString() const {
   return "Word{" + ToString() + "}";
 }
 
-
-/**
- * @brief Lexical comparator for Word.
- * 
- * @param word 
- * @return true 
- * @return false 
- */
-bool Word::operator<(const Word &word) const {
-  if (size() != word.size())
-    return size() < word.size();
-
-  for (std::size_t i = 0; i < size(); ++i) {
-    if (atoms_[i] != word.atoms_[i])
-      return atoms_[i] < word.atoms_[i];
-  }
-  return false;
-}
-
-/**
- * @brief Equality comparator between words.
- *
- * @param word
- * @return true
- * @return false
- */
-bool Word::operator==(const Word &word) const {
-  if (size() != word.size())
-    return false;
-
-  for (std::size_t i = 0; i < size(); ++i) {
-    if (this->atoms_[i] != word.atoms_[i])
-      return false;
-  }
-  return true;
-}
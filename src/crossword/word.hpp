@@ -13,10 +13,12 @@
 #define WORD_H
 
 #include "base.hpp"
+#include "bits.hpp"
 
 #include <vector>
 #include <array>
 #include <cassert>
+#include <cstdint>
 
 namespace crossword_backend {
   /**
@@ -75,6 +77,19 @@ namespace crossword_backend {
      */
     Atom() : code(0) {};
 
+    /**
+     * @brief Constructs an Atom from its underlying code.
+     *
+     * @param code in [0, kATOM_COUNT)
+     * @return Atom
+     */
+    static Atom FromCode(const unsigned char code) {
+      assert(code < kATOM_COUNT);
+      Atom atom;
+      atom.code = code;
+      return atom;
+    }
+
     /**
      * @brief Constructs a new Atom from a string.
      *
@@ -134,55 +149,150 @@ namespace crossword_backend {
     unsigned char code;
   };
 
+  /**
+   * @brief Number of atoms packed into each 64-bit limb of a Word.
+   *
+   */
+  constexpr std::size_t kATOMS_PER_LIMB = 12;
+
+  /**
+   * @brief Bits used per atom in a Word.
+   *
+   */
+  constexpr std::size_t kATOM_BITS = 5;
+
+  /**
+   * @brief Number of limbs needed to hold kMAX_DIM atoms.
+   *
+   */
+  constexpr std::size_t kWORD_LIMBS = (kMAX_DIM + kATOMS_PER_LIMB - 1) / kATOMS_PER_LIMB;
+
   /**
    * @brief A complete or partial word built from some atoms.
-   * 
+   *
+   * Atoms are stored inline as 5-bit codes, twelve to a 64-bit limb. Atom i lives in limb
+   * i / 12, with earlier atoms in higher bits, so comparing limbs numerically compares words
+   * lexicographically. Unused atoms are always zero.
+   *
    * Mirrors somewhat the std::vector API.
    *
    */
   class Word {
   public:
+    [[nodiscard]] std::string ToString() const;
+
+    [[maybe_unused]] [[nodiscard]] std::string ReprString() const;
+
     /**
-     * @brief Underlying vector of atoms that comprise a word.
+     * @brief Return the size of the word.
      *
-     * TODO: store this on the stack? small vector optimization
+     * Includes any empty letters.
      *
+     * @return int Exact length of word.
      */
-    std::vector<Atom> atoms_;
+    [[nodiscard]] std::size_t size() const { return size_; };
 
-    [[nodiscard]] std::string ToString() const;
+    /**
+     * @brief Append an atom to the end of the word.
+     *
+     * @param atom
+     */
+    void push_back(const Atom atom) {
+      assert(size_ < kMAX_DIM);
+      size_++;
+      Set(size_ - 1, atom);
+    }
 
-    [[maybe_unused]] [[nodiscard]] std::string ReprString() const;
+    /**
+     * @brief Replace the atom at index.
+     *
+     * @param index
+     * @param atom
+     */
+    void Set(const std::size_t index, const Atom atom) {
+      assert(index < size_);
+      const std::size_t shift = Shift(index);
+      std::uint64_t &limb = limbs_[index / kATOMS_PER_LIMB];
+      limb = (limb & ~(kATOM_MASK << shift)) | (static_cast<std::uint64_t>(atom.GetCode()) << shift);
+    }
 
     /**
-     * @brief Return the size of the word; i.e. the size of the underlying vector.
+     * @brief True iff this word has the same length as pattern and agrees with it on every
+     * non-empty atom of pattern.
      *
-     * Includes any empty letters.
+     * @param pattern
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool Matches(Word const &pattern) const {
+      if (size_ != pattern.size_)
+        return false;
+      for (std::size_t i = 0; i < kWORD_LIMBS; ++i) {
+        if (((limbs_[i] ^ pattern.limbs_[i]) & FilledMask(pattern.limbs_[i])) != 0)
+          return false;
+      }
+      return true;
+    }
+
+    /**
+     * @brief Number of empty atoms in the word.
      *
-     * @return int Exact length of word.
+     * @return std::size_t
+     */
+    [[nodiscard]] std::size_t CountEmpty() const {
+      std::size_t filled = 0;
+      for (std::size_t i = 0; i < kWORD_LIMBS; ++i)
+        filled += static_cast<std::size_t>(PopCount64(FilledMask(limbs_[i]) & kLOW_BITS));
+      return size_ - filled;
+    }
+
+    /**
+     * @brief Raw limb, for hashing.
+     *
+     * @param index
+     * @return std::uint64_t
      */
-    [[nodiscard]] std::size_t size() const { return atoms_.size(); };
+    [[nodiscard]] std::uint64_t GetLimb(const std::size_t index) const { return limbs_[index]; }
 
     explicit Word(std::string const &word);
 
     /**
      * @brief Construct a new Word object from vector of atoms.
      *
-     * Takes ownership of the vector.
-     *
      * @param vec
      */
-    explicit Word(std::vector<Atom> &vec) : atoms_{std::move(vec)} {};
+    explicit Word(std::vector<Atom> const &vec) : limbs_{}, size_(0) {
+      for (auto const atom: vec)
+        push_back(atom);
+    };
 
     /**
      * @brief Constructs an empty word.
      *
      */
-    Word() = default;
+    Word() : limbs_{}, size_(0) {};
 
-    bool operator==(const Word &word) const;
+    /**
+     * @brief Equality comparator between words.
+     *
+     * @param word
+     * @return true
+     * @return false
+     */
+    bool operator==(const Word &word) const { return size_ == word.size_ && limbs_ == word.limbs_; };
 
-    bool operator<(const Word &word) const;
+    /**
+     * @brief Lexical comparator for Word; shorter words come first.
+     *
+     * @param word
+     * @return true
+     * @return false
+     */
+    bool operator<(const Word &word) const {
+      if (size_ != word.size_)
+        return size_ < word.size_;
+      return limbs_ < word.limbs_;
+    };
 
     /**
      * @brief Subscript operator for word.
@@ -190,7 +300,55 @@ namespace crossword_backend {
      * @param index
      * @return Atom
      */
-    Atom operator[](const std::size_t index) const { return atoms_[index]; };
+    Atom operator[](const std::size_t index) const {
+      return Atom::FromCode(static_cast<unsigned char>(
+              (limbs_[index / kATOMS_PER_LIMB] >> Shift(index)) & kATOM_MASK));
+    };
+
+  private:
+    /**
+     * @brief Mask of one atom's bits.
+     *
+     */
+    static constexpr std::uint64_t kATOM_MASK = (std::uint64_t{1} << kATOM_BITS) - 1;
+
+    /**
+     * @brief Lowest bit of every atom in a limb.
+     *
+     */
+    static constexpr std::uint64_t kLOW_BITS = 0x0084210842108421ull;
+
+    /**
+     * @brief Bit offset of atom index within its limb.
+     *
+     * @param index
+     * @return std::size_t
+     */
+    static constexpr std::size_t Shift(const std::size_t index) {
+      return (kATOMS_PER_LIMB - 1 - index % kATOMS_PER_LIMB) * kATOM_BITS;
+    }
+
+    /**
+     * @brief All five bits set for every non-empty atom of a limb.
+     *
+     * @param limb
+     * @return std::uint64_t
+     */
+    static constexpr std::uint64_t FilledMask(const std::uint64_t limb) {
+      return ((limb | limb >> 1 | limb >> 2 | limb >> 3 | limb >> 4) & kLOW_BITS) * kATOM_MASK;
+    }
+
+    /**
+     * @brief Packed atom codes.
+     *
+     */
+    std::array<std::uint64_t, kWORD_LIMBS> limbs_;
+
+    /**
+     * @brief Number of atoms, including empty ones.
+     *
+     */
+    std::uint8_t size_;
   };
 
   /**
@@ -200,19 +358,18 @@ namespace crossword_backend {
   class WordHash {
   public:
     /**
-     * @brief Return the 32-bit hash of a given word.
-     * 
-     * TODO: make sure collisions aren't common.
+     * @brief Hash a word by mixing its limbs and length.
      *
      * @param word Word object to hash
-     * @return std::size_t 32-bit hash.
+     * @return std::size_t
      */
     std::size_t operator()(Word const &word) const {
-      std::size_t h{0};
-
-      for (auto const atom: word.atoms_)
-        h = (37 * h) + (atom.GetCode() + 64); // convert code to ASCII
-      return h;
+      std::uint64_t h = word.size();
+      for (std::size_t i = 0; i < kWORD_LIMBS; ++i) {
+        h = (h ^ word.GetLimb(i)) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+      }
+      return static_cast<std::size_t>(h);
     }
   };
 }
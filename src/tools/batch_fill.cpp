@@ -0,0 +1,585 @@
+/**
+ * @file batch_fill.cpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Headless autofill of many grids at once, sharing one database.
+ * @version 0.1
+ * @date 2022-04-24
+ *
+ * Usage: crossword-batch [-d database] [-o output] [-j jobs] [-s seconds] [-m score_min] [-p ordering] [-b] [-a]
+ *                        [-c] [-f manifest|-] [grid.crossword|directory ...]
+ *
+ * Every grid named on the command line, every .crossword or .cwpz file in a named directory, and every line of the
+ * manifest ("-" for stdin) is a job. A manifest line is a grid path followed by optional key=value overrides
+ * of the command line settings: seconds, score_min, entropy, seed, ordering (upper-left or most-constrained),
+ * backjump (0 or 1), propagate (0 or 1) and threads. Blank lines and lines starting with # are skipped.
+ *
+ * Jobs run on a pool of -j workers (one per hardware thread by default), each filling one grid at a time on a
+ * single search thread, so throughput grows with cores. Filled grids are written under their own name, and
+ * in the same format, to the -o directory; a name an earlier job already took gets -2, -3, ... appended to its
+ * stem. Each job prints one JSON object on its own line to stdout as it finishes, followed by a summary line.
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "crossword/crossword.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+using namespace crossword_backend;
+
+/**
+ * @brief Extension of text grid files picked up from directories.
+ *
+ */
+const std::string kGRID_EXTENSION = ".crossword";
+
+/**
+ * @brief Extension of binary puzzles, also picked up from directories.
+ *
+ */
+const std::string kBINARY_EXTENSION = kPUZZLE_EXTENSION;
+
+/**
+ * @brief Autofill settings of one job.
+ *
+ */
+struct JobSettings {
+  /**
+   * @brief Time budget of the job.
+   *
+   */
+  int seconds;
+
+  /**
+   * @brief Score minimum of the first pass.
+   *
+   */
+  int score_min;
+
+  /**
+   * @brief Randomness, see AutofillParams::entropy.
+   *
+   */
+  int entropy;
+
+  /**
+   * @brief Seed, see AutofillParams::seed.
+   *
+   */
+  unsigned int seed;
+
+  /**
+   * @brief Slot ordering.
+   *
+   */
+  SlotOrdering ordering;
+
+  /**
+   * @brief Whether to backjump, see AutofillParams::backjumping.
+   *
+   */
+  bool backjumping;
+
+  /**
+   * @brief Whether to propagate before each pass, see AutofillParams::propagate.
+   *
+   */
+  bool propagate;
+
+  /**
+   * @brief Search threads of the job itself. Jobs already run side by side, so 1 is usually best.
+   *
+   */
+  int threads;
+
+  /**
+   * @brief Whether to clear the letters of the grid before filling it.
+   *
+   */
+  bool clear;
+
+  JobSettings() : seconds(60), score_min(100), entropy(100), seed(0), ordering(SlotOrdering::MostConstrained),
+                  backjumping(true), propagate(false), threads(1), clear(false) {};
+};
+
+/**
+ * @brief A grid to fill and how.
+ *
+ */
+struct Job {
+  /**
+   * @brief Path of the grid file.
+   *
+   */
+  std::string path;
+
+  /**
+   * @brief Settings, after overrides.
+   *
+   */
+  JobSettings settings;
+
+  /**
+   * @brief Why the job cannot run, if its manifest line was bad.
+   *
+   */
+  std::string error;
+
+  /**
+   * @brief File name of the filled grid in the output directory, unique among the jobs.
+   *
+   */
+  std::string output;
+};
+
+/**
+ * @brief Totals over finished jobs.
+ *
+ */
+struct BatchSummary {
+  /**
+   * @brief Jobs whose grid was filled.
+   *
+   */
+  std::size_t filled = 0;
+
+  /**
+   * @brief Jobs that ran out of time or search space without a fill.
+   *
+   */
+  std::size_t unfilled = 0;
+
+  /**
+   * @brief Jobs that could not run, or whose result could not be written.
+   *
+   */
+  std::size_t errors = 0;
+
+  /**
+   * @brief Nodes searched over all jobs.
+   *
+   */
+  std::uint64_t nodes = 0;
+
+  /**
+   * @brief Search time summed over all jobs.
+   *
+   */
+  double search_seconds = 0;
+};
+
+/**
+ * @brief Escape a string for a JSON string literal.
+ *
+ * @param value
+ * @return std::string
+ */
+static std::string JsonString(std::string const &value) {
+  std::string out = "\"";
+  for (char c: value) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+/**
+ * @brief Parse a slot ordering name.
+ *
+ * @param name
+ * @param ordering output
+ * @return true
+ * @return false unknown name
+ */
+static bool ParseOrdering(std::string const &name, SlotOrdering &ordering) {
+  if (name == "upper-left")
+    ordering = SlotOrdering::UpperLeft;
+  else if (name == "most-constrained")
+    ordering = SlotOrdering::MostConstrained;
+  else
+    return false;
+  return true;
+}
+
+/**
+ * @brief Parse a whole string as a non-negative integer.
+ *
+ * @param text
+ * @param value output
+ * @return true
+ * @return false not a non-negative integer
+ */
+static bool ParseCount(std::string const &text, int &value) {
+  if (text.empty() || text.size() > 9 || !std::all_of(text.begin(), text.end(), ::isdigit))
+    return false;
+  value = std::atoi(text.c_str());
+  return true;
+}
+
+/**
+ * @brief Apply one key=value override to job settings.
+ *
+ * @param setting
+ * @param settings
+ * @return true
+ * @return false unknown key or bad value
+ */
+static bool ApplySetting(std::string const &setting, JobSettings &settings) {
+  const std::size_t equals = setting.find('=');
+  if (equals == std::string::npos)
+    return false;
+  const std::string key = setting.substr(0, equals);
+  const std::string value = setting.substr(equals + 1);
+  int number;
+  if (key == "ordering")
+    return ParseOrdering(value, settings.ordering);
+  if (!ParseCount(value, number))
+    return false;
+  if (key == "seconds" && number > 0)
+    settings.seconds = number;
+  else if (key == "score_min" && number > 0 && number <= 100)
+    settings.score_min = number;
+  else if (key == "entropy" && number <= 100)
+    settings.entropy = number;
+  else if (key == "seed")
+    settings.seed = static_cast<unsigned int>(number);
+  else if (key == "backjump" && number <= 1)
+    settings.backjumping = number == 1;
+  else if (key == "propagate" && number <= 1)
+    settings.propagate = number == 1;
+  else if (key == "threads" && number > 0)
+    settings.threads = number;
+  else
+    return false;
+  return true;
+}
+
+/**
+ * @brief Add the jobs listed in a manifest.
+ *
+ * @param in
+ * @param defaults settings before overrides
+ * @param jobs appended to
+ */
+static void ReadManifest(std::istream &in, JobSettings const &defaults, std::vector<Job> &jobs) {
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    Job job;
+    if (!(fields >> job.path) || job.path[0] == '#')
+      continue;
+    job.settings = defaults;
+    std::string setting;
+    while (fields >> setting) {
+      if (!ApplySetting(setting, job.settings) && job.error.empty())
+        job.error = "bad setting \"" + setting + "\"";
+    }
+    jobs.push_back(job);
+  }
+}
+
+/**
+ * @brief Add a job per grid file in a directory, by name, or a single job for a file.
+ *
+ * @param path
+ * @param defaults
+ * @param jobs appended to
+ */
+static void AddPath(std::string const &path, JobSettings const &defaults, std::vector<Job> &jobs) {
+  std::error_code error;
+  if (!std::filesystem::is_directory(path, error)) {
+    jobs.push_back(Job{path, defaults, ""});
+    return;
+  }
+  std::vector<std::string> files;
+  for (auto const &entry: std::filesystem::directory_iterator(path, error)) {
+    if (entry.path().extension() == kGRID_EXTENSION || entry.path().extension() == kBINARY_EXTENSION)
+      files.push_back(entry.path().string());
+  }
+  std::sort(files.begin(), files.end());
+  for (auto const &file: files)
+    jobs.push_back(Job{file, defaults, ""});
+}
+
+/**
+ * @brief Name each job's output after its grid file, numbering the names that clash with an earlier job's.
+ *
+ * @param jobs
+ */
+static void AssignOutputNames(std::vector<Job> &jobs) {
+  std::unordered_set<std::string> taken;
+  for (auto &job: jobs) {
+    const std::filesystem::path name = std::filesystem::path(job.path).filename();
+    job.output = name.string();
+    for (int copy = 2; !taken.insert(job.output).second; ++copy)
+      job.output = name.stem().string() + "-" + std::to_string(copy) + name.extension().string();
+  }
+}
+
+/**
+ * @brief True iff a grid file is a binary puzzle, by its extension.
+ *
+ * @param path
+ * @return true
+ * @return false a text grid
+ */
+static bool IsBinaryPuzzle(std::string const &path) {
+  return std::filesystem::path(path).extension() == kBINARY_EXTENSION;
+}
+
+/**
+ * @brief Read a grid file of either format.
+ *
+ * @param path
+ * @param crossword output
+ * @return true
+ * @return false the file is missing or malformed
+ */
+static bool ReadGrid(std::string const &path, Crossword &crossword) {
+  if (IsBinaryPuzzle(path)) {
+    std::ifstream in(path, std::ios::binary);
+    return crossword.ReadPuzzle(in);
+  }
+
+  std::vector<std::string> lines;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    lines.push_back(line);
+  }
+  return crossword.Unserialize(lines);
+}
+
+/**
+ * @brief Write a grid in the format its extension names: WritePuzzle, or one line per Serialize line.
+ *
+ * @param crossword
+ * @param path
+ * @return true
+ * @return false the file could not be written
+ */
+static bool WriteGrid(Crossword const &crossword, std::string const &path) {
+  if (IsBinaryPuzzle(path)) {
+    std::ofstream out(path, std::ios::binary);
+    return crossword.WritePuzzle(out);
+  }
+
+  std::ofstream out(path);
+  for (auto const &line: crossword.Serialize())
+    out << line << "\n";
+  return static_cast<bool>(out);
+}
+
+/**
+ * @brief Run one job and describe its outcome as a JSON object.
+ *
+ * @param db
+ * @param job
+ * @param output directory to write filled grids to, or empty
+ * @param summary updated with the outcome
+ * @return std::string
+ */
+static std::string RunJob(WordDatabase &db, Job const &job, std::string const &output, BatchSummary &summary) {
+  std::string result = "{\"grid\":" + JsonString(job.path);
+  if (!job.error.empty()) {
+    summary.errors++;
+    return result + ",\"error\":" + JsonString(job.error) + "}";
+  }
+
+  Crossword crossword;
+  crossword.logger.Silence();
+  if (!ReadGrid(job.path, crossword)) {
+    summary.errors++;
+    return result + ",\"error\":\"could not read grid\"}";
+  }
+  if (job.settings.clear)
+    crossword.ClearAtoms();
+  if (!crossword.IsValidPattern() ||
+      crossword.IsInvalidPartial(crossword.Clues(), db, 1) != Solvability::Solvable) {
+    summary.errors++;
+    return result + ",\"error\":\"unsolvable pattern\"}";
+  }
+
+  AutofillParams params(&db);
+  params.seconds_limit = job.settings.seconds;
+  params.score_min = job.settings.score_min;
+  params.entropy = job.settings.entropy;
+  params.seed = job.settings.seed;
+  params.ordering = job.settings.ordering;
+  params.backjumping = job.settings.backjumping;
+  params.propagate = job.settings.propagate;
+  params.threads = job.settings.threads;
+  const AutofillStatistics statistics = crossword.Autofill(params);
+
+  summary.nodes += statistics.nodes;
+  summary.search_seconds += statistics.seconds;
+  result += std::string(",\"found\":") + (statistics.found ? "true" : "false") + ",\"complete\":" +
+            (statistics.complete ? "true" : "false") + ",\"passes\":" + std::to_string(statistics.passes) +
+            ",\"seconds\":" + std::to_string(statistics.seconds) + ",\"nodes\":" + std::to_string(statistics.nodes);
+  if (!statistics.found) {
+    summary.unfilled++;
+    return result + "}";
+  }
+
+  if (!output.empty()) {
+    const std::string path = (std::filesystem::path(output) / job.output).string();
+    if (!WriteGrid(crossword, path)) {
+      summary.errors++;
+      return result + ",\"error\":" + JsonString("could not write \"" + path + "\"") + "}";
+    }
+    result += ",\"output\":" + JsonString(path);
+  }
+  summary.filled++;
+  return result + "}";
+}
+
+/**
+ * @brief Print usage.
+ *
+ * @param program
+ */
+static void Usage(char const *program) {
+  std::cerr << "usage: " << program
+            << " [-d database] [-o output] [-j jobs] [-s seconds] [-m score_min] [-p ordering] [-b] [-a] [-c]"
+               " [-f manifest|-] [grid.crossword|directory ...]\n"
+               "orderings: upper-left, most-constrained; -b disables backjumping, -a enables propagation,"
+               " -c clears letters first"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::string database = "resources/database.csv";
+  std::string output;
+  std::string manifest;
+  int workers = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  JobSettings defaults;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "-b") {
+      defaults.backjumping = false;
+    } else if (arg == "-a") {
+      defaults.propagate = true;
+    } else if (arg == "-c") {
+      defaults.clear = true;
+    } else if (arg.size() == 2 && arg[0] == '-' && i + 1 < argc) {
+      const std::string value = argv[++i];
+      bool ok = true;
+      if (arg == "-d")
+        database = value;
+      else if (arg == "-o")
+        output = value;
+      else if (arg == "-f")
+        manifest = value;
+      else if (arg == "-j")
+        ok = ParseCount(value, workers) && workers > 0;
+      else if (arg == "-s")
+        ok = ApplySetting("seconds=" + value, defaults);
+      else if (arg == "-m")
+        ok = ApplySetting("score_min=" + value, defaults);
+      else if (arg == "-p")
+        ok = ParseOrdering(value, defaults.ordering);
+      else
+        ok = false;
+      if (!ok) {
+        Usage(argv[0]);
+        return 2;
+      }
+    } else if (arg[0] == '-') {
+      Usage(argv[0]);
+      return 2;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+
+  std::vector<Job> jobs;
+  for (auto const &path: paths)
+    AddPath(path, defaults, jobs);
+  if (manifest == "-") {
+    ReadManifest(std::cin, defaults, jobs);
+  } else if (!manifest.empty()) {
+    std::ifstream in(manifest);
+    if (!in) {
+      std::cerr << "could not read \"" << manifest << "\"" << std::endl;
+      return 1;
+    }
+    ReadManifest(in, defaults, jobs);
+  }
+  if (jobs.empty()) {
+    Usage(argv[0]);
+    return 2;
+  }
+  AssignOutputNames(jobs);
+
+  std::error_code error;
+  if (!output.empty() && !std::filesystem::is_directory(output, error) &&
+      !std::filesystem::create_directories(output, error)) {
+    std::cerr << "could not create \"" << output << "\"" << std::endl;
+    return 1;
+  }
+
+  WordDatabase db;
+  const bool compiled = database.size() >= 5 && database.compare(database.size() - 5, 5, ".cwdb") == 0;
+  if (!(compiled ? db.LoadCompiled(database) : db.LoadFromFile(database))) {
+    std::cerr << "could not read \"" << database << "\"" << std::endl;
+    return 1;
+  }
+
+  // Workers take jobs in order; results are printed as they finish.
+  std::atomic<std::size_t> next_job(0);
+  std::mutex output_lock;
+  BatchSummary summary;
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  const std::size_t pool_size = std::min(jobs.size(), static_cast<std::size_t>(workers));
+  for (std::size_t worker = 0; worker < pool_size; ++worker) {
+    pool.emplace_back([&] {
+      for (std::size_t job = next_job++; job < jobs.size(); job = next_job++) {
+        BatchSummary outcome;
+        const std::string result = RunJob(db, jobs[job], output, outcome);
+        std::lock_guard<std::mutex> guard(output_lock);
+        std::cout << result << std::endl;
+        summary.filled += outcome.filled;
+        summary.unfilled += outcome.unfilled;
+        summary.errors += outcome.errors;
+        summary.nodes += outcome.nodes;
+        summary.search_seconds += outcome.search_seconds;
+      }
+    });
+  }
+  for (auto &thread: pool)
+    thread.join();
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << "{\"summary\":true,\"jobs\":" << jobs.size() << ",\"workers\":" << pool_size << ",\"filled\":"
+            << summary.filled << ",\"unfilled\":" << summary.unfilled << ",\"errors\":" << summary.errors
+            << ",\"nodes\":" << summary.nodes << ",\"seconds\":" << seconds << ",\"search_seconds\":"
+            << summary.search_seconds << ",\"jobs_per_second\":" << (seconds > 0 ? jobs.size() / seconds : 0.)
+            << "}" << std::endl;
+  return summary.errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,450 @@
+/**
+ * @file bench_autofill.cpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Headless autofill benchmark over a corpus of grids.
+ * @version 0.1
+ * @date 2022-04-23
+ *
+ * Usage: crossword-bench [-d database] [-r resources] [-p preset] [-s seconds] [-n repeats] [-t trace.json]
+ *                        [-k] [grid.crossword ...]
+ *
+ * Without grids, runs over resources/test1.crossword, resources/mini.crossword and generated 15x15 and 21x21
+ * patterns. Letters in the grids are cleared, so every run fills the whole pattern, unless -k keeps them, as
+ * for grids seeded with theme entries. Each run prints one JSON object on its own line to stdout. With -t, the
+ * traced events of all runs are written as a Chrome trace.
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "crossword/crossword.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+
+#include <windows.h>
+#include <psapi.h>
+
+#else
+
+#include <sys/resource.h>
+
+#endif
+
+using namespace crossword_backend;
+
+/**
+ * @brief Seed of every run, and of the generated patterns.
+ *
+ */
+constexpr unsigned int kBENCH_SEED = 0;
+
+/**
+ * @brief Longest slot allowed in a generated pattern.
+ *
+ */
+constexpr std::size_t kGENERATED_MAX_RUN = 9;
+
+/**
+ * @brief A named set of autofill parameters.
+ *
+ */
+struct BenchPreset {
+  /**
+   * @brief Name in the output.
+   *
+   */
+  std::string name;
+
+  /**
+   * @brief Slot ordering.
+   *
+   */
+  SlotOrdering ordering;
+
+  /**
+   * @brief Worker threads, or 0 for one per hardware thread.
+   *
+   */
+  int threads;
+
+  /**
+   * @brief Whether to backjump, see AutofillParams::backjumping.
+   *
+   */
+  bool backjumping;
+
+  /**
+   * @brief Whether to propagate before each pass, see AutofillParams::propagate.
+   *
+   */
+  bool propagate;
+};
+
+/**
+ * @brief A grid to fill.
+ *
+ */
+struct BenchGrid {
+  /**
+   * @brief Name in the output.
+   *
+   */
+  std::string name;
+
+  /**
+   * @brief Serialized grid, as read by Crossword::Unserialize.
+   *
+   */
+  std::vector<std::string> lines;
+};
+
+/**
+ * @brief Peak resident memory of this process so far, in kilobytes.
+ *
+ * @return long
+ */
+static long PeakMemoryKilobytes() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+#else
+  struct rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  return static_cast<long>(usage.ru_maxrss / 1024); // Bytes on macOS.
+#else
+  return static_cast<long>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+/**
+ * @brief Read a grid file.
+ *
+ * @param filename
+ * @param grid output
+ * @return true
+ * @return false the file could not be read
+ */
+static bool LoadGrid(std::string const &filename, BenchGrid &grid) {
+  std::ifstream file(filename);
+  if (!file)
+    return false;
+  std::string line;
+  while (std::getline(file, line))
+    grid.lines.push_back(line);
+  std::size_t slash = filename.find_last_of("/\\");
+  grid.name = filename.substr(slash == std::string::npos ? 0 : slash + 1);
+  return grid.lines.size() >= 2;
+}
+
+/**
+ * @brief True iff no row or column of the pattern has a run of open cells of length 2 or above max_run.
+ *
+ * @param barriers
+ * @param size
+ * @param max_run
+ * @return true
+ * @return false
+ */
+static bool IsGoodPattern(std::vector<std::vector<bool>> const &barriers, const std::size_t size,
+                          const std::size_t max_run) {
+  for (std::size_t direction = 0; direction < 2; ++direction) {
+    for (std::size_t i = 0; i < size; ++i) {
+      std::size_t run = 0;
+      for (std::size_t j = 0; j <= size; ++j) {
+        const bool open = j < size && !(direction == kACROSS ? barriers[i][j] : barriers[j][i]);
+        if (open) {
+          run++;
+          continue;
+        }
+        if (run == 2 || run > max_run)
+          return false;
+        run = 0;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Generate a rotationally symmetric square pattern with no two letter slots.
+ *
+ * Paired barriers are dropped at random, keeping only those that leave no two letter slot, until about one
+ * cell in six is a barrier and no slot is longer than kGENERATED_MAX_RUN.
+ *
+ * @param size
+ * @param seed
+ * @return BenchGrid
+ */
+static BenchGrid GeneratePattern(const std::size_t size, const unsigned int seed) {
+  std::mt19937 rng(seed);
+  std::vector<std::vector<bool>> barriers(size, std::vector<bool>(size, false));
+  std::uniform_int_distribution<std::size_t> pick(0, size - 1);
+
+  const std::size_t target = size * size / 6;
+  std::size_t count = 0;
+  for (std::size_t attempt = 0; attempt < 1000 * size * size; ++attempt) {
+    if (count >= target && IsGoodPattern(barriers, size, kGENERATED_MAX_RUN))
+      break;
+    const std::size_t row = pick(rng);
+    const std::size_t col = pick(rng);
+    if (barriers[row][col])
+      continue;
+    barriers[row][col] = true;
+    barriers[size - 1 - row][size - 1 - col] = true;
+    if (!IsGoodPattern(barriers, size, size)) {
+      barriers[row][col] = false;
+      barriers[size - 1 - row][size - 1 - col] = false;
+      continue;
+    }
+    count += (row == size - 1 - row && col == size - 1 - col) ? 1 : 2;
+  }
+
+  BenchGrid grid;
+  grid.name = "generated-" + std::to_string(size) + "x" + std::to_string(size);
+  grid.lines.push_back(std::to_string(size));
+  grid.lines.push_back(std::to_string(size));
+  for (std::size_t row = 0; row < size; ++row) {
+    std::string line;
+    for (std::size_t col = 0; col < size; ++col)
+      line += barriers[row][col] ? "-," : " ,";
+    grid.lines.push_back(line);
+  }
+  return grid;
+}
+
+/**
+ * @brief Escape a string for a JSON string literal.
+ *
+ * @param value
+ * @return std::string
+ */
+static std::string JsonString(std::string const &value) {
+  std::string out = "\"";
+  for (char c: value) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+/**
+ * @brief JSON fields describing one cache's activity.
+ *
+ * @param name
+ * @param statistics
+ * @return std::string
+ */
+static std::string JsonCache(std::string const &name, CacheStatistics const &statistics) {
+  return "\"" + name + "_hits\":" + std::to_string(statistics.hits) + ",\"" + name + "_misses\":" +
+         std::to_string(statistics.misses) + ",\"" + name + "_evictions\":" + std::to_string(statistics.evictions) +
+         ",\"" + name + "_hit_rate\":" + std::to_string(statistics.HitRate());
+}
+
+/**
+ * @brief Fill one grid with one preset and print the result.
+ *
+ * Caches are flushed first, so that runs do not depend on their order.
+ *
+ * @param db
+ * @param grid
+ * @param preset
+ * @param seconds
+ * @param repeat
+ * @param keep_letters fill around the grid's letters instead of clearing them
+ */
+static void RunOne(WordDatabase &db, BenchGrid grid, BenchPreset const &preset, const int seconds,
+                   const int repeat, const bool keep_letters) {
+  Crossword crossword;
+  crossword.logger.Silence();
+  std::string result = "{\"grid\":" + JsonString(grid.name) + ",\"preset\":" + JsonString(preset.name) +
+                       ",\"repeat\":" + std::to_string(repeat) + ",\"seed\":" + std::to_string(kBENCH_SEED);
+  if (!crossword.Unserialize(grid.lines)) {
+    std::cout << result << ",\"error\":\"malformed grid\"}" << std::endl;
+    return;
+  }
+  if (!keep_letters)
+    crossword.ClearAtoms();
+  if (!crossword.IsValidPattern() ||
+      crossword.IsInvalidPartial(crossword.Clues(), db, 1) != Solvability::Solvable) {
+    std::cout << result << ",\"error\":\"unsolvable pattern\"}" << std::endl;
+    return;
+  }
+
+  db.FlushCaches();
+  AutofillParams params(&db);
+  params.seconds_limit = seconds;
+  params.ordering = preset.ordering;
+  params.threads = preset.threads > 0 ? preset.threads
+                                      : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  params.seed = kBENCH_SEED;
+  params.backjumping = preset.backjumping;
+  params.propagate = preset.propagate;
+  const AutofillStatistics statistics = crossword.Autofill(params);
+
+  const bool valid = statistics.found && crossword.IsSolved(crossword.Clues(), db);
+  const double nodes_per_second =
+          statistics.seconds > 0 ? static_cast<double>(statistics.nodes) / statistics.seconds : 0.;
+  result += ",\"threads\":" + std::to_string(params.threads) + ",\"found\":" + (statistics.found ? "true" : "false") +
+            ",\"valid\":" + (valid ? "true" : "false") + ",\"complete\":" + (statistics.complete ? "true" : "false") +
+            ",\"passes\":" + std::to_string(statistics.passes) + ",\"seconds\":" +
+            std::to_string(statistics.seconds) + ",\"nodes\":" + std::to_string(statistics.nodes) +
+            ",\"nodes_per_second\":" + std::to_string(static_cast<long long>(nodes_per_second)) +
+            ",\"peak_memory_kb\":" + std::to_string(PeakMemoryKilobytes()) + "," +
+            JsonCache("existence_cache", statistics.existence_cache) + "," +
+            JsonCache("solution_cache", statistics.solution_cache) + ",\"nogood_prunes\":" +
+            std::to_string(statistics.nogood_prunes) + ",\"frames_backjumped\":" +
+            std::to_string(statistics.frames_backjumped) + ",\"passes_refuted\":" +
+            std::to_string(statistics.passes_refuted) + ",\"words_pruned\":" +
+            std::to_string(statistics.words_pruned) + "}";
+  std::cout << result << std::endl;
+}
+
+/**
+ * @brief Print usage.
+ *
+ * @param program
+ */
+static void Usage(char const *program) {
+  std::cerr << "usage: " << program
+            << " [-d database] [-r resources] [-p preset|all] [-s seconds] [-n repeats] [-t trace.json] [-k]"
+               " [grid.crossword ...]\n"
+               "presets: upper-left, most-constrained, parallel, upper-left-backjump, most-constrained-backjump,"
+               " parallel-backjump, upper-left-propagate, most-constrained-propagate" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  const std::vector<BenchPreset> kPRESETS{
+          {"upper-left",                 SlotOrdering::UpperLeft,       1, false, false},
+          {"most-constrained",           SlotOrdering::MostConstrained, 1, false, false},
+          {"parallel",                   SlotOrdering::UpperLeft,       0, false, false},
+          {"upper-left-backjump",        SlotOrdering::UpperLeft,       1, true,  false},
+          {"most-constrained-backjump",  SlotOrdering::MostConstrained, 1, true,  false},
+          {"parallel-backjump",          SlotOrdering::UpperLeft,       0, true,  false},
+          {"upper-left-propagate",       SlotOrdering::UpperLeft,       1, false, true},
+          {"most-constrained-propagate", SlotOrdering::MostConstrained, 1, false, true},
+  };
+
+  std::string database;
+  std::string resources = "resources";
+  std::string preset_name = "all";
+  int seconds = 10;
+  int repeats = 1;
+  std::string trace_file;
+  bool keep_letters = false;
+  std::vector<std::string> grid_files;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "-k") {
+      keep_letters = true;
+    } else if (arg.size() == 2 && arg[0] == '-' && i + 1 < argc) {
+      const std::string value = argv[++i];
+      if (arg == "-d") {
+        database = value;
+      } else if (arg == "-r") {
+        resources = value;
+      } else if (arg == "-p") {
+        preset_name = value;
+      } else if (arg == "-s") {
+        seconds = std::atoi(value.c_str());
+      } else if (arg == "-n") {
+        repeats = std::atoi(value.c_str());
+      } else if (arg == "-t") {
+        trace_file = value;
+      } else {
+        Usage(argv[0]);
+        return 2;
+      }
+    } else if (arg[0] == '-') {
+      Usage(argv[0]);
+      return 2;
+    } else {
+      grid_files.push_back(arg);
+    }
+  }
+
+  std::vector<BenchPreset> presets;
+  for (auto const &preset: kPRESETS) {
+    if (preset_name == "all" || preset_name == preset.name)
+      presets.push_back(preset);
+  }
+  if (presets.empty() || seconds <= 0 || repeats <= 0) {
+    Usage(argv[0]);
+    return 2;
+  }
+
+  if (database.empty())
+    database = resources + "/database.csv";
+  WordDatabase db;
+  const std::string kCOMPILED_EXTENSION = ".cwdb";
+  const bool compiled = database.size() >= kCOMPILED_EXTENSION.size() &&
+                        database.compare(database.size() - kCOMPILED_EXTENSION.size(), kCOMPILED_EXTENSION.size(),
+                                         kCOMPILED_EXTENSION) == 0;
+  if (!(compiled ? db.LoadCompiled(database) : db.LoadFromFile(database))) {
+    std::cerr << "could not read \"" << database << "\"" << std::endl;
+    return 1;
+  }
+
+  std::vector<BenchGrid> grids;
+  const bool default_corpus = grid_files.empty();
+  if (default_corpus) {
+    grid_files.push_back(resources + "/test1.crossword");
+    grid_files.push_back(resources + "/mini.crossword");
+  }
+  for (auto const &filename: grid_files) {
+    BenchGrid grid;
+    if (!LoadGrid(filename, grid)) {
+      std::cerr << "could not read \"" << filename << "\"" << std::endl;
+      return 1;
+    }
+    grids.push_back(grid);
+  }
+  if (default_corpus) {
+    grids.push_back(GeneratePattern(15, kBENCH_SEED));
+    grids.push_back(GeneratePattern(21, kBENCH_SEED));
+  }
+
+  if (!trace_file.empty())
+    Tracer::Global().Start();
+  for (auto const &grid: grids) {
+    for (auto const &preset: presets) {
+      for (int repeat = 0; repeat < repeats; ++repeat)
+        RunOne(db, grid, preset, seconds, repeat, keep_letters);
+    }
+  }
+  if (!trace_file.empty()) {
+    Tracer::Global().Stop();
+    std::ofstream out(trace_file);
+    Tracer::Global().WriteChromeTrace(out);
+    if (!out) {
+      std::cerr << "could not write \"" << trace_file << "\"" << std::endl;
+      return 1;
+    }
+    const std::uint64_t dropped = Tracer::Global().GetDropped();
+    if (dropped > 0)
+      std::cerr << dropped << " trace events overwritten; only the latest of each thread are kept" << std::endl;
+  }
+  return 0;
+}
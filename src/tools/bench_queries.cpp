@@ -0,0 +1,519 @@
+/**
+ * @file bench_queries.cpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Microbenchmarks of the dictionary query hot paths, on query distributions recorded from autofill.
+ * @version 0.1
+ * @date 2022-04-23
+ *
+ * Usage: crossword-microbench [-d database] [-r resources] [-q patterns] [-o patterns] [-s seconds]
+ *                             [-n passes] [grid.crossword ...]
+ *
+ * Without -q, the query distribution is recorded first: the grids (by default resources/test1.crossword and
+ * resources/mini.crossword) are autofilled with each slot ordering for a few seconds, and every wildcard query
+ * that misses the caches, i.e. reaches an index, is kept. -o saves the recording for later -q runs.
+ *
+ * Queries of lengths 3 to 15 are grouped by length and by where the wildcards are, then replayed against the
+ * trie, the bitset index and a linear scan of the packed entries. Each result is one JSON object per line:
+ * ns/query per operation, backend and group, and bytes/entry per index and length.
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "crossword/crossword.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace crossword_backend;
+
+/**
+ * @brief Shortest word length benchmarked.
+ *
+ */
+constexpr std::size_t kMIN_LENGTH = 3;
+
+/**
+ * @brief Longest word length benchmarked.
+ *
+ */
+constexpr std::size_t kMAX_LENGTH = 15;
+
+/**
+ * @brief Queries kept per group, sampled evenly from the recording.
+ *
+ */
+constexpr std::size_t kMAX_GROUP_QUERIES = 4096;
+
+/**
+ * @brief Queries per group replayed against the linear scan, which is orders of magnitude slower.
+ *
+ */
+constexpr std::size_t kMAX_SCAN_QUERIES = 128;
+
+/**
+ * @brief Exact words looked up per length; as many misses are looked up again.
+ *
+ */
+constexpr std::size_t kEXACT_SAMPLES = 4096;
+
+/**
+ * @brief Recorded queries of one word length and wildcard shape.
+ *
+ */
+struct QueryGroup {
+  /**
+   * @brief Word length.
+   *
+   */
+  std::size_t length;
+
+  /**
+   * @brief Where the wildcards are, see PatternShape.
+   *
+   */
+  std::string shape;
+
+  /**
+   * @brief The queries.
+   *
+   */
+  std::vector<ScoredPattern> patterns;
+
+  /**
+   * @brief The queries as clues, for the database methods taking clues.
+   *
+   */
+  std::vector<Clue> clues;
+};
+
+/**
+ * @brief Defeats dead code elimination of benchmarked results.
+ *
+ */
+static volatile std::size_t g_sink = 0;
+
+/**
+ * @brief Classify a partial word by the number and position of its wildcards.
+ *
+ * @param partial
+ * @return std::string "exact", "open" (all wildcards), "prefix" (letters, then only wildcards),
+ * "leading-wildcard" (starts with a wildcard) or "mixed"
+ */
+static std::string PatternShape(Word const &partial) {
+  const std::size_t empty = partial.CountEmpty();
+  if (empty == 0)
+    return "exact";
+  if (empty == partial.size())
+    return "open";
+  if (partial[0].IsEmpty())
+    return "leading-wildcard";
+  std::size_t first_empty = 0;
+  while (!partial[first_empty].IsEmpty())
+    first_empty++;
+  return first_empty + empty == partial.size() ? "prefix" : "mixed";
+}
+
+/**
+ * @brief Write a pattern as its score threshold and letters, with "." for wildcards.
+ *
+ * @param pattern
+ * @return std::string
+ */
+static std::string FormatPattern(ScoredPattern const &pattern) {
+  std::string letters;
+  for (std::size_t i = 0; i < pattern.partial.size(); ++i)
+    letters += pattern.partial[i].IsEmpty() ? "." : pattern.partial[i].ToString();
+  return std::to_string(pattern.score_min) + " " + letters;
+}
+
+/**
+ * @brief Read a pattern written by FormatPattern.
+ *
+ * @param line
+ * @param pattern output
+ * @return true
+ * @return false malformed
+ */
+static bool ParsePattern(std::string const &line, ScoredPattern &pattern) {
+  const std::size_t space = line.find(' ');
+  if (space == std::string::npos || space == 0)
+    return false;
+  pattern.score_min = std::atoi(line.substr(0, space).c_str());
+  pattern.partial = Word();
+  for (std::size_t i = space + 1; i < line.size(); ++i) {
+    const char c = line[i];
+    if (c == '.')
+      pattern.partial.push_back(Atom());
+    else if (c >= 'A' && c <= 'Z')
+      pattern.partial.push_back(Atom::FromCode(static_cast<unsigned char>(c - 'A' + 1)));
+    else
+      return false;
+  }
+  return pattern.partial.size() > 0 && pattern.partial.size() < kMAX_DIM;
+}
+
+/**
+ * @brief Autofill grids with every slot ordering and record the queries reaching the indices.
+ *
+ * @param db
+ * @param grid_files
+ * @param seconds per grid and ordering
+ * @param patterns output
+ * @return true
+ * @return false a grid could not be read
+ */
+static bool RecordPatterns(WordDatabase &db, std::vector<std::string> const &grid_files, const int seconds,
+                           std::vector<ScoredPattern> &patterns) {
+  QueryLog log;
+  db.SetQueryLog(&log);
+  for (auto const &filename: grid_files) {
+    std::vector<std::string> lines;
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line))
+      lines.push_back(line);
+    if (lines.size() < 2) {
+      std::cerr << "could not read \"" << filename << "\"" << std::endl;
+      db.SetQueryLog(nullptr);
+      return false;
+    }
+    for (SlotOrdering ordering: {SlotOrdering::UpperLeft, SlotOrdering::MostConstrained}) {
+      Crossword crossword;
+      crossword.logger.Silence();
+      if (!crossword.Unserialize(lines)) {
+        std::cerr << "malformed grid \"" << filename << "\"" << std::endl;
+        db.SetQueryLog(nullptr);
+        return false;
+      }
+      crossword.ClearAtoms();
+      if (!crossword.IsValidPattern() ||
+          crossword.IsInvalidPartial(crossword.Clues(), db, 1) != Solvability::Solvable)
+        continue;
+      db.FlushCaches();
+      AutofillParams params(&db);
+      params.seconds_limit = seconds;
+      params.ordering = ordering;
+      crossword.Autofill(params);
+    }
+  }
+  db.SetQueryLog(nullptr);
+  db.FlushCaches();
+  patterns = log.GetPatterns();
+  return true;
+}
+
+/**
+ * @brief Best time per query of several passes.
+ *
+ * @tparam Run callable running every query once
+ * @param count queries per pass
+ * @param passes
+ * @param run
+ * @return double nanoseconds
+ */
+template<typename Run>
+static double NanosPerQuery(const std::size_t count, const int passes, Run &&run) {
+  double best = std::numeric_limits<double>::infinity();
+  for (int pass = 0; pass < passes; ++pass) {
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    const auto stop = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::nano>(stop - start).count());
+  }
+  return count == 0 ? 0. : best / static_cast<double>(count);
+}
+
+/**
+ * @brief Print one timing.
+ *
+ * @param op
+ * @param backend
+ * @param length
+ * @param shape
+ * @param queries
+ * @param nanos
+ */
+static void PrintTiming(std::string const &op, std::string const &backend, const std::size_t length,
+                        std::string const &shape, const std::size_t queries, const double nanos) {
+  std::cout << "{\"type\":\"query\",\"op\":\"" << op << "\",\"backend\":\"" << backend << "\",\"length\":" << length
+            << ",\"shape\":\"" << shape << "\",\"queries\":" << queries << ",\"ns_per_query\":" << nanos << "}"
+            << std::endl;
+}
+
+/**
+ * @brief Time the wildcard operations on one group against every backend.
+ *
+ * @param sub sub-database of the group's length
+ * @param group
+ * @param passes
+ */
+static void BenchGroup(FixedSizeWordDatabase &sub, QueryGroup const &group, const int passes) {
+  const std::shared_ptr<DictionaryVersion const> version = sub.GetVersion();
+  CompiledWords const &base = *version->base;
+  std::vector<ScoredPattern> const &patterns = group.patterns;
+  const std::size_t scanned = std::min(patterns.size(), kMAX_SCAN_QUERIES);
+  std::vector<std::uint32_t> indices;
+
+  double wildcards = 0;
+  for (auto const &pattern: patterns)
+    wildcards += static_cast<double>(pattern.partial.CountEmpty());
+  std::cout << "{\"type\":\"distribution\",\"length\":" << group.length << ",\"shape\":\"" << group.shape
+            << "\",\"queries\":" << patterns.size() << ",\"mean_wildcards\":"
+            << wildcards / static_cast<double>(patterns.size()) << "}" << std::endl;
+
+  PrintTiming("contains", "trie", group.length, group.shape, patterns.size(),
+              NanosPerQuery(patterns.size(), passes, [&] {
+                for (auto const &pattern: patterns)
+                  g_sink = g_sink + base.trie.Contains(pattern.partial, pattern.score_min);
+              }));
+  PrintTiming("contains", "bitset", group.length, group.shape, patterns.size(),
+              NanosPerQuery(patterns.size(), passes, [&] {
+                for (auto const &pattern: patterns)
+                  g_sink = g_sink + base.bitset_index.Contains(pattern.partial, pattern.score_min);
+              }));
+  PrintTiming("contains", "scan", group.length, group.shape, scanned, NanosPerQuery(scanned, passes, [&] {
+    for (std::size_t i = 0; i < scanned; ++i) {
+      for (auto const &entry: base.entries) {
+        if (entry.frequency_score < patterns[i].score_min)
+          break; // Ranked, so the rest score lower still.
+        if (entry.entry.Matches(patterns[i].partial)) {
+          g_sink = g_sink + 1;
+          break;
+        }
+      }
+    }
+  }));
+
+  PrintTiming("find", "trie", group.length, group.shape, patterns.size(),
+              NanosPerQuery(patterns.size(), passes, [&] {
+                for (auto const &pattern: patterns) {
+                  indices.clear();
+                  base.trie.Find(pattern.partial, pattern.score_min, indices);
+                  g_sink = g_sink + indices.size();
+                }
+              }));
+  PrintTiming("find", "bitset", group.length, group.shape, patterns.size(),
+              NanosPerQuery(patterns.size(), passes, [&] {
+                for (auto const &pattern: patterns) {
+                  indices.clear();
+                  base.bitset_index.Find(pattern.partial, pattern.score_min, indices);
+                  g_sink = g_sink + indices.size();
+                }
+              }));
+  PrintTiming("find", "scan", group.length, group.shape, scanned, NanosPerQuery(scanned, passes, [&] {
+    for (std::size_t i = 0; i < scanned; ++i) {
+      indices.clear();
+      for (std::uint32_t k = 0; k < base.entries.size() && base.entries[k].frequency_score >= patterns[i].score_min;
+           ++k) {
+        if (base.entries[k].entry.Matches(patterns[i].partial))
+          indices.push_back(k);
+      }
+      g_sink = g_sink + indices.size();
+    }
+  }));
+
+  // Through the caches, flushed before every pass, as the search sees them.
+  for (MatcherBackend backend: {MatcherBackend::Trie, MatcherBackend::Bitset}) {
+    const std::string name = backend == MatcherBackend::Trie ? "trie" : "bitset";
+    sub.SetMatcherBackend(backend);
+    PrintTiming("has_solution", name, group.length, group.shape, patterns.size(),
+                NanosPerQuery(patterns.size(), passes, [&] {
+                  sub.FlushPartialCache();
+                  for (std::size_t i = 0; i < patterns.size(); ++i)
+                    g_sink = g_sink + sub.HasSolution(group.clues[i], patterns[i].score_min);
+                }));
+    PrintTiming("get_solutions", name, group.length, group.shape, patterns.size(),
+                NanosPerQuery(patterns.size(), passes, [&] {
+                  sub.FlushPartialCache();
+                  for (std::size_t i = 0; i < patterns.size(); ++i)
+                    g_sink = g_sink + sub.GetSolutions(group.clues[i], kNO_NUMBER, patterns[i].score_min).size();
+                }));
+  }
+  sub.SetMatcherBackend(MatcherBackend::Trie);
+  sub.FlushPartialCache();
+}
+
+/**
+ * @brief Time the exact word lookups of one length, and print the index sizes.
+ *
+ * Half of the looked up words are entries, the other half entries with their last letter changed.
+ *
+ * @param sub
+ * @param length
+ * @param passes
+ */
+static void BenchExact(FixedSizeWordDatabase &sub, const std::size_t length, const int passes) {
+  const std::shared_ptr<DictionaryVersion const> version = sub.GetVersion();
+  CompiledWords const &base = *version->base;
+  const std::size_t entry_count = base.entries.size();
+  std::cout << "{\"type\":\"memory\",\"length\":" << length << ",\"entries\":" << entry_count
+            << ",\"trie_bytes_per_entry\":"
+            << static_cast<double>(base.trie.ByteSize()) / static_cast<double>(entry_count)
+            << ",\"bitset_bytes_per_entry\":"
+            << static_cast<double>(base.bitset_index.ByteSize()) / static_cast<double>(entry_count)
+            << ",\"packed_entry_bytes\":" << sizeof(DatabaseEntry) << "}" << std::endl;
+
+  std::vector<Word> hits;
+  std::vector<Word> words;
+  const std::size_t stride = std::max<std::size_t>(1, entry_count / kEXACT_SAMPLES);
+  for (std::size_t i = 0; i < entry_count && hits.size() < kEXACT_SAMPLES; i += stride)
+    hits.push_back(base.entries[i].entry);
+  for (auto const &hit: hits) {
+    Word miss = hit;
+    miss.Set(length - 1, Atom::FromCode(static_cast<unsigned char>(hit[length - 1].GetCode() % 26 + 1)));
+    words.push_back(hit);
+    words.push_back(miss);
+  }
+  const std::size_t scanned = std::min(words.size(), kMAX_SCAN_QUERIES);
+
+  PrintTiming("contains_entry", "trie", length, "exact", words.size(), NanosPerQuery(words.size(), passes, [&] {
+    for (auto const &word: words)
+      g_sink = g_sink + sub.ContainsEntry(word);
+  }));
+  PrintTiming("contains_entry", "scan", length, "exact", scanned, NanosPerQuery(scanned, passes, [&] {
+    for (std::size_t i = 0; i < scanned; ++i) {
+      for (auto const &entry: base.entries) {
+        if (entry.entry == words[i]) {
+          g_sink = g_sink + 1;
+          break;
+        }
+      }
+    }
+  }));
+  PrintTiming("frequency_score", "trie", length, "exact", hits.size(), NanosPerQuery(hits.size(), passes, [&] {
+    for (auto const &word: hits)
+      g_sink = g_sink + static_cast<std::size_t>(sub.GetFrequencyScore(word));
+  }));
+}
+
+/**
+ * @brief Print usage.
+ *
+ * @param program
+ */
+static void Usage(char const *program) {
+  std::cerr << "usage: " << program
+            << " [-d database] [-r resources] [-q patterns] [-o patterns] [-s seconds] [-n passes]"
+               " [grid.crossword ...]" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::string database;
+  std::string resources = "resources";
+  std::string patterns_in;
+  std::string patterns_out;
+  int seconds = 2;
+  int passes = 3;
+  std::vector<std::string> grid_files;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.size() == 2 && arg[0] == '-' && i + 1 < argc) {
+      const std::string value = argv[++i];
+      if (arg == "-d") {
+        database = value;
+      } else if (arg == "-r") {
+        resources = value;
+      } else if (arg == "-q") {
+        patterns_in = value;
+      } else if (arg == "-o") {
+        patterns_out = value;
+      } else if (arg == "-s") {
+        seconds = std::atoi(value.c_str());
+      } else if (arg == "-n") {
+        passes = std::atoi(value.c_str());
+      } else {
+        Usage(argv[0]);
+        return 2;
+      }
+    } else if (arg[0] == '-') {
+      Usage(argv[0]);
+      return 2;
+    } else {
+      grid_files.push_back(arg);
+    }
+  }
+  if (seconds <= 0 || passes <= 0) {
+    Usage(argv[0]);
+    return 2;
+  }
+
+  if (database.empty())
+    database = resources + "/database.csv";
+  WordDatabase db;
+  const std::string kCOMPILED_EXTENSION = ".cwdb";
+  const bool compiled = database.size() >= kCOMPILED_EXTENSION.size() &&
+                        database.compare(database.size() - kCOMPILED_EXTENSION.size(), kCOMPILED_EXTENSION.size(),
+                                         kCOMPILED_EXTENSION) == 0;
+  if (!(compiled ? db.LoadCompiled(database) : db.LoadFromFile(database))) {
+    std::cerr << "could not read \"" << database << "\"" << std::endl;
+    return 1;
+  }
+
+  std::vector<ScoredPattern> patterns;
+  if (!patterns_in.empty()) {
+    std::ifstream file(patterns_in);
+    if (!file) {
+      std::cerr << "could not read \"" << patterns_in << "\"" << std::endl;
+      return 1;
+    }
+    std::string line;
+    ScoredPattern pattern{Word(), 0};
+    while (std::getline(file, line)) {
+      if (ParsePattern(line, pattern))
+        patterns.push_back(pattern);
+    }
+  } else {
+    if (grid_files.empty()) {
+      grid_files.push_back(resources + "/test1.crossword");
+      grid_files.push_back(resources + "/mini.crossword");
+    }
+    if (!RecordPatterns(db, grid_files, seconds, patterns))
+      return 1;
+  }
+  if (!patterns_out.empty()) {
+    std::ofstream file(patterns_out);
+    for (auto const &pattern: patterns)
+      file << FormatPattern(pattern) << "\n";
+    if (!file) {
+      std::cerr << "could not write \"" << patterns_out << "\"" << std::endl;
+      return 1;
+    }
+  }
+
+  std::map<std::pair<std::size_t, std::string>, std::vector<ScoredPattern>> recorded;
+  for (auto const &pattern: patterns) {
+    const std::size_t length = pattern.partial.size();
+    if (length >= kMIN_LENGTH && length <= kMAX_LENGTH)
+      recorded[{length, PatternShape(pattern.partial)}].push_back(pattern);
+  }
+
+  for (std::size_t length = kMIN_LENGTH; length <= kMAX_LENGTH; ++length) {
+    FixedSizeWordDatabase &sub = db.GetSubDatabase(length);
+    if (sub.GetVersion()->base->entries.empty())
+      continue;
+    BenchExact(sub, length, passes);
+    for (auto const &entry: recorded) {
+      if (entry.first.first != length)
+        continue;
+      QueryGroup group;
+      group.length = length;
+      group.shape = entry.first.second;
+      const std::size_t stride = std::max<std::size_t>(1, entry.second.size() / kMAX_GROUP_QUERIES);
+      for (std::size_t i = 0; i < entry.second.size() && group.patterns.size() < kMAX_GROUP_QUERIES; i += stride) {
+        group.patterns.push_back(entry.second[i]);
+        group.clues.emplace_back(kACROSS, Coord(0, 0), length, entry.second[i].partial,
+                                 std::vector<Coord>(length, Coord(0, 0)));
+      }
+      BenchGroup(sub, group, passes);
+    }
+  }
+  return 0;
+}
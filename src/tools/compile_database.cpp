@@ -0,0 +1,38 @@
+/**
+ * @file compile_database.cpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Offline compiler from a CSV word list to a compiled database file.
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * Usage: crossword-compile-db input.csv output.cwdb
+ *
+ * The output can then be given to crossword-gui with -d for near-instant startup.
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "crossword/database.hpp"
+
+#include <iostream>
+
+using namespace crossword_backend;
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " input.csv output.cwdb" << std::endl;
+    return 2;
+  }
+
+  WordDatabase db;
+  if (!db.LoadFromFile(argv[1])) {
+    std::cerr << "could not read \"" << argv[1] << "\"" << std::endl;
+    return 1;
+  }
+  if (!db.SaveCompiled(argv[2])) {
+    std::cerr << "could not write \"" << argv[2] << "\"" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file generate_patterns.cpp
+ * @author Jerome Wei (jeromejwei@gmail.com)
+ * @brief Generate valid symmetric barrier patterns, ranked by estimated fillability.
+ * @version 0.1
+ * @date 2022-04-25
+ *
+ * Usage: crossword-patterns [-d database] [-o output] [-n count] [-j threads] [-s seconds] [-w max_words]
+ *                           [-b max_barriers] [-l min_slot_length] [-m score_min] [-f min_fillability] [-r seed]
+ *                           [-u] height width
+ *
+ * Prints one JSON object per pattern, most fillable first, and writes each as pattern_<rank>.crossword to the
+ * -o directory, ready for crossword-batch. Without -d, patterns are not scored. -u allows unchecked cells.
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "crossword/crossword.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace crossword_backend;
+
+/**
+ * @brief Parse a whole string as a non-negative integer.
+ *
+ * @param text
+ * @param value output
+ * @return true
+ * @return false not a non-negative integer
+ */
+static bool ParseCount(std::string const &text, std::size_t &value) {
+  if (text.empty() || text.size() > 9 || !std::all_of(text.begin(), text.end(), ::isdigit))
+    return false;
+  value = static_cast<std::size_t>(std::atol(text.c_str()));
+  return true;
+}
+
+/**
+ * @brief The pattern's rows, "#" for barriers and "." for open cells, as a JSON array.
+ *
+ * @param board
+ * @return std::string
+ */
+static std::string JsonRows(PatternBoard const &board) {
+  std::string out = "[";
+  for (std::size_t r = 0; r < board.GetHeight(); ++r) {
+    out += r == 0 ? "\"" : ",\"";
+    for (std::size_t c = 0; c < board.GetWidth(); ++c)
+      out += board.IsBarrier(Coord(r, c)) ? '#' : '.';
+    out += "\"";
+  }
+  return out + "]";
+}
+
+/**
+ * @brief Print usage.
+ *
+ * @param program
+ */
+static void Usage(char const *program) {
+  std::cerr << "usage: " << program
+            << " [-d database] [-o output] [-n count] [-j threads] [-s seconds] [-w max_words] [-b max_barriers]"
+               " [-l min_slot_length] [-m score_min] [-f min_fillability] [-r seed] [-u] height width" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::string database;
+  std::string output;
+  std::vector<std::size_t> dimensions;
+  std::size_t count = 10;
+  std::size_t threads = 0;
+  std::size_t seconds = 10;
+  std::size_t max_words = 0;
+  std::size_t max_barriers = 0;
+  std::size_t min_slot_length = kPATTERN_MIN_SLOT;
+  std::size_t score_min = 50;
+  std::size_t seed = 0;
+  double min_fillability = kUNFILLABLE;
+  bool allow_unchecked = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "-u") {
+      allow_unchecked = true;
+    } else if (arg.size() == 2 && arg[0] == '-' && i + 1 < argc) {
+      const std::string value = argv[++i];
+      bool ok = true;
+      if (arg == "-d") {
+        database = value;
+      } else if (arg == "-o") {
+        output = value;
+      } else if (arg == "-f") {
+        char *end;
+        min_fillability = std::strtod(value.c_str(), &end);
+        ok = !value.empty() && *end == '\0';
+      } else {
+        std::size_t *target = arg == "-n" ? &count : arg == "-j" ? &threads : arg == "-s" ? &seconds :
+                              arg == "-w" ? &max_words : arg == "-b" ? &max_barriers :
+                              arg == "-l" ? &min_slot_length : arg == "-m" ? &score_min :
+                              arg == "-r" ? &seed : nullptr;
+        ok = target != nullptr && ParseCount(value, *target);
+      }
+      if (!ok) {
+        Usage(argv[0]);
+        return 2;
+      }
+    } else {
+      std::size_t dimension;
+      if (!ParseCount(arg, dimension)) {
+        Usage(argv[0]);
+        return 2;
+      }
+      dimensions.push_back(dimension);
+    }
+  }
+  if (dimensions.size() != 2 || dimensions[0] < 3 || dimensions[1] < 3 || dimensions[0] > kMAX_DIM ||
+      dimensions[1] > kMAX_DIM || min_slot_length < 2 || score_min > 100 || count == 0) {
+    Usage(argv[0]);
+    return 2;
+  }
+
+  PatternParams params(dimensions[0], dimensions[1]);
+  params.count = count;
+  params.threads = static_cast<int>(threads);
+  params.seconds_limit = static_cast<int>(seconds);
+  params.max_words = max_words;
+  if (max_barriers > 0)
+    params.max_barriers = max_barriers;
+  params.min_slot_length = min_slot_length;
+  params.allow_unchecked = allow_unchecked;
+  params.score_min = static_cast<int>(score_min);
+  params.seed = static_cast<unsigned int>(seed);
+  params.min_fillability = min_fillability;
+
+  WordDatabase db;
+  if (!database.empty()) {
+    const std::string kCOMPILED_EXTENSION = ".cwdb";
+    const bool compiled = database.size() >= kCOMPILED_EXTENSION.size() &&
+                          database.compare(database.size() - kCOMPILED_EXTENSION.size(),
+                                           kCOMPILED_EXTENSION.size(), kCOMPILED_EXTENSION) == 0;
+    if (!(compiled ? db.LoadCompiled(database) : db.LoadFromFile(database))) {
+      std::cerr << "could not read \"" << database << "\"" << std::endl;
+      return 1;
+    }
+    params.db = &db;
+  }
+
+  std::error_code error;
+  if (!output.empty() && !std::filesystem::is_directory(output, error) &&
+      !std::filesystem::create_directories(output, error)) {
+    std::cerr << "could not create \"" << output << "\"" << std::endl;
+    return 1;
+  }
+
+  const std::vector<GeneratedPattern> patterns = GeneratePatterns(params, nullptr);
+  Crossword crossword;
+  crossword.logger.Silence();
+  for (std::size_t rank = 0; rank < patterns.size(); ++rank) {
+    GeneratedPattern const &pattern = patterns[rank];
+    std::cout << "{\"rank\":" << rank << ",\"words\":" << pattern.words << ",\"barriers\":" << pattern.barriers;
+    if (params.db != nullptr)
+      std::cout << ",\"fillability\":" << pattern.fillability;
+    if (!output.empty()) {
+      const std::string path =
+              (std::filesystem::path(output) / ("pattern_" + std::to_string(rank) + ".crossword")).string();
+      crossword.SetPattern(pattern.board);
+      std::ofstream out(path);
+      for (auto const &line: crossword.Serialize())
+        out << line << "\n";
+      std::cout << ",\"output\":\"" << path << "\"";
+    }
+    std::cout << ",\"rows\":" << JsonRows(pattern.board) << "}" << std::endl;
+  }
+  return patterns.size() == count ? 0 : 1;
+}
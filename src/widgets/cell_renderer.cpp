@@ -16,10 +16,8 @@ using namespace crossword_backend;
 /**
  * @brief Custom grid cell drawing method.
  *
- * Ideally should be called when the grid is refreshed.
- * It may be the case that this is called more often than that.
- * 
- * TODO: optimize so we aren't doing too much work here; no more heap allocations; etc.
+ * Draws the cell as of the last CrosswordApp::UpdateGrid, from the state it pushed, rather than
+ * reading the crossword, which may be changing under a search. Does not allocate.
  *
  * @param grid
  * @param attr
@@ -31,19 +29,7 @@ using namespace crossword_backend;
  */
 void CellRenderer::Draw(wxGrid &grid, wxGridCellAttr &attr, wxDC &dc, const wxRect &rect, int row, int col,
                         bool isSelected) {
-  Coord cell_coord = Coord(row, col);
-  Crossword *crossword = &app->crossword;
-  Cell cell = crossword->Get(cell_coord);
-
-  if (cell.IsBarrier()) {
-    grid.SetCellValue(
-            wxGridCellCoords(row, col),
-            "");
-  } else {
-    grid.SetCellValue(
-            wxGridCellCoords(row, col),
-            cell.ToString());
-  }
+  const Cell cell = app->drawn_cells[row][col];
 
   wxColour bg_save = attr.GetBackgroundColour();
   if (!isSelected) {
@@ -56,8 +42,8 @@ void CellRenderer::Draw(wxGrid &grid, wxGridCellAttr &attr, wxDC &dc, const wxRe
 
   base_cell_renderer.Draw(grid, attr, dc, rect, row, col, isSelected);
 
-  int cell_number = crossword->GetClueNumber(cell_coord);
-  wxRect abs_rect = grid.BlockToDeviceRect(
+  const int cell_number = app->drawn_numbers[row][col];
+  const wxRect abs_rect = grid.BlockToDeviceRect(
           wxGridCellCoords(row, col),
           wxGridCellCoords(row, col));
   if (cell_number != kNO_NUMBER) {
@@ -66,19 +52,9 @@ void CellRenderer::Draw(wxGrid &grid, wxGridCellAttr &attr, wxDC &dc, const wxRe
   }
 
   // Draw in locked symbol
-  // TODO: this
   if (cell.IsLocked()) {
-    int num_font_size = std::max(1.0, ((double) app->CellSize()) * .3);
-    dc.SetFont(
-            wxFont(
-                    wxSize(0, num_font_size),
-                    wxFONTFAMILY_SWISS,
-                    wxFONTSTYLE_NORMAL,
-                    wxFONTWEIGHT_NORMAL,
-                    false,
-                    "",
-                    wxFONTENCODING_SYSTEM));
-    dc.DrawText("L", abs_rect.GetRight() - (num_font_size * .6), abs_rect.GetTop());
+    dc.SetFont(cell_number_font);
+    dc.DrawText("L", abs_rect.GetRight() - (cell_number_font_size * .6), abs_rect.GetTop());
   }
 
   // restore old attributes
@@ -13,7 +13,10 @@
 
 using namespace crossword_backend;
 
-static const std::size_t MAX_CHOICES = 2000;
+/**
+ * @brief Number of words WordListDialog lists per page.
+ */
+static const std::size_t MAX_CHOICES = 500;
 
 int ResizeGridDialog::GetHeight() {
   return std::stoi(tc_h->GetValue().ToStdString());
@@ -67,32 +70,38 @@ int WordListDialog::GetSelection() {
 }
 
 /**
- * @brief Displays to the user the first n=min(MAX_CHOICES, words.size()) elements of input vector.
+ * @brief Get a listed word.
+ *
+ * @param index as returned by GetSelection
+ * @return Word const&
+ */
+Word const &WordListDialog::GetWord(const int index) const {
+  return words_[static_cast<std::size_t>(index)];
+}
+
+/**
+ * @brief Displays to the user the first MAX_CHOICES words from the cursor, and more on request.
  * 
- * @param words vector of DatabaseEntry objects.
+ * @param cursor query whose words are listed
  */
-WordListDialog::WordListDialog(std::vector<Word> words)
+WordListDialog::WordListDialog(SolutionCursor cursor)
         : wxDialog(
         NULL,
         -1,
         "Select word",
         wxDefaultPosition,
-        wxSize(250, 330)) {
+        wxSize(250, 330)), cursor_(cursor) {
   wxPanel *panel = new wxPanel(this, -1);
 
   wxBoxSizer *vbox = new wxBoxSizer(wxVERTICAL);
   wxBoxSizer *hbox = new wxBoxSizer(wxHORIZONTAL);
 
-  wxString choices[MAX_CHOICES];
-  std::size_t list_size = std::min(MAX_CHOICES, words.size());
-
-  for (std::size_t i = 0; i < list_size; i++) {
-    choices[i] = words[i].ToString();
-  }
-
   lb = new wxListBox(panel, -1,
-                     wxPoint(5, 5), wxSize(240, 150),
-                     list_size, choices);
+                     wxPoint(5, 5), wxSize(240, 150));
+  more_button_ = new wxButton(panel, -1, "More", wxPoint(5, 160));
+  more_button_->Bind(wxEVT_BUTTON, &WordListDialog::OnMore, this);
+
+  LoadPage();
   lb->SetSelection(0);
 
   wxSizer *button_sizer = CreateButtonSizer(wxOK | wxCANCEL);
@@ -102,4 +111,32 @@ WordListDialog::WordListDialog(std::vector<Word> words)
   vbox->Add(button_sizer, 1);
 
   SetSizer(vbox);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Append the next MAX_CHOICES words from the cursor to the list.
+ *
+ * Disables the "More" button once the cursor runs out.
+ *
+ */
+void WordListDialog::LoadPage() {
+  wxArrayString page;
+  Word word;
+  while (page.GetCount() < MAX_CHOICES && cursor_.Next(word)) {
+    words_.push_back(word);
+    page.Add(word.ToString());
+  }
+  if (!page.IsEmpty())
+    lb->Append(page);
+  if (page.GetCount() < MAX_CHOICES)
+    more_button_->Disable();
+}
+
+/**
+ * @brief User asked for more words.
+ *
+ * @param event
+ */
+void WordListDialog::OnMore(wxCommandEvent &) {
+  LoadPage();
+}
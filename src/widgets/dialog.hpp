@@ -44,16 +44,39 @@ private:
 
 /**
  * @brief Dialog presented to the user for selecting a word from a list.
+ *
+ * Words are pulled from a cursor a page at a time, so long lists open without being built in full.
  * 
  */
 class WordListDialog : public wxDialog {
 public:
   int GetSelection();
 
-  WordListDialog(std::vector<crossword_backend::Word> words);
+  crossword_backend::Word const &GetWord(int index) const;
+
+  explicit WordListDialog(crossword_backend::SolutionCursor cursor);
 
 private:
+  void LoadPage();
+
+  void OnMore(wxCommandEvent &event);
+
   wxListBox *lb;
+
+  /**
+   * @brief Loads the next page of words.
+   */
+  wxButton *more_button_;
+
+  /**
+   * @brief Source of words not yet listed.
+   */
+  crossword_backend::SolutionCursor cursor_;
+
+  /**
+   * @brief Words listed so far, in list order.
+   */
+  std::vector<crossword_backend::Word> words_;
 };
 
 #endif
@@ -15,6 +15,7 @@
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 
@@ -158,6 +159,7 @@ void CrosswordApp::InitBindings() {
   Bind(GRID_REFRESH, &CrosswordApp::OnGridRefresh, this);
   Bind(SEARCHING, &CrosswordApp::OnSearching, this);
   Bind(DONE_SEARCHING, &CrosswordApp::OnDoneSearching, this);
+  Bind(LOAD_PROGRESS, &CrosswordApp::OnLoadProgress, this);
 
   /* Grid related */
   Bind(wxEVT_GRID_CELL_LEFT_CLICK, &CrosswordApp::OnGridCellLeftClick, this);
@@ -212,7 +214,7 @@ void CrosswordApp::OnKeyDown(wxKeyEvent &event) {
   {
     // move forward one
     Clue clue = GetCurrentClue();
-    int i = clue.IndexOfCoord(selected);
+    int i = SelectedOffsetIn(clue);
     if (i != kNO_NUMBER && (std::size_t) i < clue.GetSize() - 1) {
       SetGridCursor(clue.coord_list_[i + 1]);
     }
@@ -357,13 +359,12 @@ void CrosswordApp::OnFillWord(wxCommandEvent &) {
   int clue_size = GetCurrentClue().GetSize();
   if (clue_size > 0) {
     Clue clue = GetCurrentClue();
-    std::vector<Word> solutions = db.GetSolutions(clue, kNO_NUMBER, 1);
-    if (solutions.size() > 0) {
-      WordListDialog *dialog = new WordListDialog(solutions);
+    if (db.HasSolution(clue, 1)) {
+      WordListDialog *dialog = new WordListDialog(db.OpenCursor(clue.ToWord(), 1));
       if (dialog->ShowModal() == wxID_OK) {
         int sel = dialog->GetSelection();
         if (sel != wxNOT_FOUND) {
-          crossword.SetClue(GetCurrentClue(), solutions[sel]);
+          crossword.SetClue(GetCurrentClue(), dialog->GetWord(sel));
         }
       }
       dialog->Destroy();
@@ -440,16 +441,16 @@ void CrosswordApp::OnRedo(wxCommandEvent &) {
 /**
  * @brief Thread function for updating the grid periodically during a search.
  *
+ * Returns as soon as the search finishes, rather than at the next tick.
+ *
  * @param app
  */
 void UpdateGridThreadFunc(CrosswordApp *app) {
-  int ms = 1000; // frequency of grid update, higher hangs UI less and isn't noticeable?
-  // weirdly, the grid updates slowly so that changes are reflected *during* redraw; need to optimize drawing methods
-  while (app->is_searching) {
+  // Each tick asks the search for a frame, and draws the one it published since the last tick, if any.
+  do {
     wxCommandEvent evnt(GRID_REFRESH);
     wxPostEvent(app, evnt);
-    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
-  }
+  } while (!app->search_finished.WaitFor(std::chrono::milliseconds(kSEARCH_REFRESH_MS)));
 }
 
 /**
@@ -459,12 +460,15 @@ void UpdateGridThreadFunc(CrosswordApp *app) {
  */
 void AutofillThreadFunc(CrosswordApp *app) {
   AutofillParams params(&app->db);
+  params.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  params.progress = &app->search_progress;
 
   wxCommandEvent evnt(SEARCHING);
   wxPostEvent(app, evnt);
 
   app->crossword.Autofill(params);
   app->is_searching = false;
+  app->search_finished.Cancel();
 
   wxCommandEvent evnt1(DONE_SEARCHING);
   wxPostEvent(app, evnt1);
@@ -494,7 +498,6 @@ void CrosswordApp::OnAutofill(wxCommandEvent &) {
   if (!db.IsFinishedLoading()) {
     db.WaitForLock();
   }
-  db.FlushCaches(); // TODO: figure out why we need this here
 
   auto all_clues = crossword.Clues();
   Solvability current_solvable_status = crossword.IsInvalidPartial(all_clues, db, 1);
@@ -511,6 +514,7 @@ void CrosswordApp::OnAutofill(wxCommandEvent &) {
   }
 
   is_searching = true;
+  search_finished.Reset();
 
   std::thread autofill(AutofillThreadFunc, this);
   std::thread grid_func(UpdateGridThreadFunc, this);
@@ -562,11 +566,13 @@ void CrosswordApp::OnAddToDictionary(wxCommandEvent &) {
 /**
  * @brief Event handler for the custom event GRID_REFRESH.
  *
- * Updates the UI grid.
+ * Updates the UI grid. During a search, also asks it for a frame to draw on the next refresh.
  *
  * @param event
  */
 void CrosswordApp::OnGridRefresh(wxCommandEvent &) {
+  if (is_searching)
+    search_progress.Request();
   UpdateGrid();
 }
 
@@ -588,6 +594,18 @@ void CrosswordApp::OnDoneSearching(wxCommandEvent &) {
   SetStatusText("Ready");
 }
 
+/**
+ * @brief Custom event handler. Shows how far along a database load is.
+ *
+ * @param event
+ */
+void CrosswordApp::OnLoadProgress(wxCommandEvent &event) {
+  if (event.GetInt() >= 100)
+    SetStatusText("Ready");
+  else
+    SetStatusText("Loading database... " + std::to_string(event.GetInt()) + "%");
+}
+
 /**
  * @brief Show logging window
  * 
@@ -660,13 +678,14 @@ void CrosswordApp::OnLoadDatabase(wxCommandEvent &event) {
     return;
 
   wxFileDialog
-          openFileDialog(this, _("Open CSV file"), "", "",
-                         "CSV files (*.csv)|*.csv", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+          openFileDialog(this, _("Open database file"), "", "",
+                         "Database files (*.csv;*.cwdb)|*.csv;*.cwdb|CSV files (*.csv)|*.csv|"
+                         "Compiled databases (*.cwdb)|*.cwdb", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
   if (openFileDialog.ShowModal() == wxID_CANCEL)
     return;
 
   std::string filename = openFileDialog.GetPath().ToStdString();
-  LoadDatabaseFromCSV(filename);
+  LoadDatabase(filename);
 }
 
 void CrosswordApp::OnOpen(wxCommandEvent &) {
@@ -675,29 +694,13 @@ void CrosswordApp::OnOpen(wxCommandEvent &) {
 
   wxFileDialog
           openFileDialog(this, _("Open CROSSWORD file"), "", "",
-                         "CROSSWORD files (*.crossword)|*.crossword", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+                         "Puzzle files (*.crossword;*.cwpz)|*.crossword;*.cwpz|CROSSWORD files (*.crossword)|"
+                         "*.crossword|Binary puzzles (*.cwpz)|*.cwpz", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
   if (openFileDialog.ShowModal() == wxID_CANCEL)
     return;
 
   // proceed loading the file chosen by the user;
-  std::vector<std::string> lines;
-  lines.reserve(300000);
-  std::string line;
-  std::string filename = openFileDialog.GetPath().ToStdString();
-  std::ifstream db(filename);
-  if (db.is_open()) {
-    while (std::getline(db, line)) {
-      lines.push_back(line);
-    }
-    crossword.Unserialize(lines);
-    open_file = filename;
-    UpdateGrid();
-    SelectFirstClue();
-    ClearGridSelection();
-    crossword.logger.Log("Loaded from file \"" + filename + "\"");
-  } else {
-    crossword.logger.Log("Open failed");
-  }
+  OpenFile(openFileDialog.GetPath().ToStdString());
 }
 
 void CrosswordApp::OnSave(wxCommandEvent &) {
@@ -716,7 +719,8 @@ void CrosswordApp::OnSaveAs(wxCommandEvent &) {
 
   wxFileDialog
           saveFileDialog(this, _("Save CROSSWORD file"), "", "",
-                         "CROSSWORD files (*.crossword)|*.crossword", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+                         "CROSSWORD files (*.crossword)|*.crossword|Binary puzzles with hints (*.cwpz)|*.cwpz",
+                         wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
   if (saveFileDialog.ShowModal() == wxID_CANCEL)
     return;
 
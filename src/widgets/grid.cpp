@@ -54,6 +54,7 @@ void CrosswordApp::InitGrid() {
                                                    wxFONTWEIGHT_NORMAL, false, "", wxFONTENCODING_SYSTEM),
                                             num_font_size));
   grid->CreateGrid(crossword.GetHeight(), crossword.GetWidth());
+  grid_drawn = false;
 
   // Bind dynamic events
   grid->GetGridWindow()->Bind(wxEVT_MOTION, &CrosswordApp::OnGridDrag, this);
@@ -116,47 +117,109 @@ int CrosswordApp::CellSize() {
 /**
  * @brief Refresh state of grid to reflect underlying crossword state.
  *
+ * Only cells whose contents, clue number or color changed since the last update are repainted.
+ * While searching, the crossword belongs to the search, so the latest frame it published is drawn
+ * instead; colors and clue numbers are left as they were, and recomputed by the update after the search.
+ *
  */
 void CrosswordApp::UpdateGrid() {
-  // Calls custom cell renderer draw method
-  grid->ForceRefresh();
-
-  if (crossword.GetWidth() != static_cast<std::size_t>(grid->GetNumberCols()) ||
-      crossword.GetWidth() != static_cast<std::size_t>(grid->GetNumberRows())) {
+  if (crossword.GetHeight() != static_cast<std::size_t>(grid->GetNumberRows()) ||
+      crossword.GetWidth() != static_cast<std::size_t>(grid->GetNumberCols())) {
     delete grid;
     InitGrid();
     SelectFirstClue();
   }
 
-  ResetGridColors();
+  if (is_searching) {
+    if (!search_progress.Update() && grid_drawn)
+      return;
+    SearchProgressFrame const &frame = search_progress.Read();
+    if (frame.grid.GetHeight() == crossword.GetHeight() && frame.grid.GetWidth() == crossword.GetWidth()) {
+      for (std::size_t r = 0; r < frame.grid.GetHeight(); r++) {
+        for (std::size_t c = 0; c < frame.grid.GetWidth(); c++) {
+          PushCell(r, c, frame.grid.Get(Coord(r, c)), drawn_numbers[r][c]);
+        }
+      }
+      ShowSearchProgress(frame);
+    }
+  } else {
+    ResetGridColors();
+
+    // Grey out invalid states
+    auto all_clues = crossword.Clues();
+    if (!crossword.IsValidPattern() || (crossword.IsInvalidPartial(all_clues, db, 1) == Solvability::Invalid)) {
+      // TODO: figure out why invalid
+      for (std::size_t r = 0; r < crossword.GetHeight(); r++) {
+        for (std::size_t c = 0; c < crossword.GetWidth(); c++) {
+          grid_colors[r][c] = 2;
+        }
+      }
+    }
+
+    // Red for invalid clues
+    if (GetSpellcheck()) // spellcheck
+    {
+      std::vector<Clue> clues = crossword.Clues();
+      for (auto it = std::begin(clues); it != std::end(clues); ++it) {
+        if (it->IsValid(db))
+          continue;
+        for (auto c = std::begin(it->coord_list_); c != std::end(it->coord_list_); ++c) {
+          // 1 is red
+          grid_colors[c->row][c->col] = 1;
+        }
+      }
+    }
 
-  // Grey out invalid states
-  auto all_clues = crossword.Clues();
-  if (!crossword.IsValidPattern() || (crossword.IsInvalidPartial(all_clues, db, 1) == Solvability::Invalid)) {
-    // TODO: figure out why invalid
     for (std::size_t r = 0; r < crossword.GetHeight(); r++) {
       for (std::size_t c = 0; c < crossword.GetWidth(); c++) {
-        grid_colors[r][c] = 2;
+        const Coord coord(r, c);
+        PushCell(r, c, crossword.Get(coord), crossword.GetClueNumber(coord));
       }
     }
   }
 
-  // Red for invalid clues
-  if (GetSpellcheck()) // spellcheck
-  {
-    std::vector<Clue> clues = crossword.Clues();
-    for (auto it = std::begin(clues); it != std::end(clues); ++it) {
-      if (it->IsValid(db))
-        continue;
-      for (auto c = std::begin(it->coord_list_); c != std::end(it->coord_list_); ++c) {
-        // 1 is red
-        grid_colors[c->row][c->col] = 1;
-      }
-    }
+  // A new widget has nothing on screen worth keeping.
+  if (!grid_drawn) {
+    grid->ForceRefresh();
+    grid_drawn = true;
   }
+}
+
+/**
+ * @brief Hand a cell to the grid widget, repainting it if it changed since it was last drawn.
+ *
+ * The color is taken from grid_colors.
+ *
+ * @param row
+ * @param col
+ * @param cell
+ * @param number
+ */
+void CrosswordApp::PushCell(const std::size_t row, const std::size_t col, const Cell cell, const ClueNumber number) {
+  if (grid_drawn && cell == drawn_cells[row][col] && number == drawn_numbers[row][col] &&
+      grid_colors[row][col] == drawn_colors[row][col])
+    return;
 
-  // Calls custom cell renderer draw method
-  grid->ForceRefresh();
+  drawn_cells[row][col] = cell;
+  drawn_numbers[row][col] = number;
+  drawn_colors[row][col] = grid_colors[row][col];
+
+  const wxGridCellCoords cell_coords(static_cast<int>(row), static_cast<int>(col));
+  grid->SetCellValue(cell_coords, cell.IsBarrier() ? "" : cell.ToString());
+  if (grid_drawn)
+    grid->GetGridWindow()->RefreshRect(grid->BlockToDeviceRect(cell_coords, cell_coords), false);
+}
+
+/**
+ * @brief Show a search's statistics in the status bar.
+ *
+ * @param frame
+ */
+void CrosswordApp::ShowSearchProgress(SearchProgressFrame const &frame) {
+  SetStatusText("Searching: " + std::to_string(frame.depth) + " words placed (best " +
+                std::to_string(frame.best_depth) + "), " +
+                std::to_string(static_cast<long long>(frame.nodes_per_second)) + " nodes/s, minimum score " +
+                std::to_string(frame.score_min));
 }
 
 /**
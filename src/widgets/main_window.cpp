@@ -14,6 +14,7 @@
 
 #include "widgets/icon.xpm"
 
+#include <fstream>
 #include <thread>
 
 using namespace crossword_backend;
@@ -28,6 +29,29 @@ void CrosswordApp::ErrorDialog(std::string const &message) {
                "Error", wxOK | wxICON_ERROR);
 }
 
+/**
+ * @brief Load a database, compiled (.cwdb, replaces the current database) or CSV (adds to it).
+ *
+ * Compiled databases are mapped in place, so they load immediately on the calling thread.
+ *
+ * @param filename
+ */
+void CrosswordApp::LoadDatabase(const std::string &filename) {
+  const std::string kCOMPILED_EXTENSION = ".cwdb";
+  if (filename.size() < kCOMPILED_EXTENSION.size() ||
+      filename.compare(filename.size() - kCOMPILED_EXTENSION.size(), kCOMPILED_EXTENSION.size(),
+                       kCOMPILED_EXTENSION) != 0) {
+    LoadDatabaseFromCSV(filename);
+    return;
+  }
+
+  if (db.LoadCompiled(filename)) {
+    crossword.logger.Log("Loaded compiled database \"" + filename + "\".");
+  } else {
+    crossword.logger.Log("Could not load compiled database \"" + filename + "\".");
+  }
+}
+
 /**
  * @brief Load database from a CSV
  *
@@ -37,23 +61,84 @@ void CrosswordApp::ErrorDialog(std::string const &message) {
  */
 void CrosswordApp::LoadDatabaseFromCSV(const std::string &filename) {
   crossword.logger.Log("Loading database from file \"" + filename + "\"...");
-  db.LoadDeferred(filename);
-  std::thread db_load_callback([&] {
-    if (!db.IsFinishedLoading()) {
-      db.WaitForLock();
-    }
-    crossword.logger.Log("Done loading database.");
-    UpdateGrid();
+  db.LoadDeferred(filename, [this](double fraction) {
+    wxCommandEvent evnt(LOAD_PROGRESS);
+    evnt.SetInt(static_cast<int>(fraction * 100.));
+    wxPostEvent(this, evnt);
+  });
+  std::thread db_load_callback([this, filename] {
+    db.WaitForLock();
+    if (db.IsFinishedLoading())
+      crossword.logger.Log("Done loading database.");
+    else
+      crossword.logger.Log("Could not load database from file \"" + filename + "\".");
+    wxCommandEvent evnt(GRID_REFRESH);
+    wxPostEvent(this, evnt);
   });
   db_load_callback.detach();
 }
 
+/**
+ * @brief True iff a puzzle file is in the binary format, by its extension.
+ *
+ * @param filename
+ * @return true
+ * @return false a .crossword text file
+ */
+static bool IsBinaryPuzzle(std::string const &filename) {
+  const std::string kBINARY_EXTENSION = kPUZZLE_EXTENSION;
+  return filename.size() >= kBINARY_EXTENSION.size() &&
+         filename.compare(filename.size() - kBINARY_EXTENSION.size(), kBINARY_EXTENSION.size(),
+                          kBINARY_EXTENSION) == 0;
+}
+
+/**
+ * @brief Open a puzzle, binary (.cwpz, with hints and locks) or text (.crossword).
+ *
+ * @param filename
+ */
+void CrosswordApp::OpenFile(std::string const &filename) {
+  bool loaded = false;
+  if (IsBinaryPuzzle(filename)) {
+    std::ifstream in(filename, std::ios::binary);
+    loaded = crossword.ReadPuzzle(in);
+  } else {
+    std::ifstream in(filename);
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) {
+      lines.push_back(line);
+    }
+    loaded = in.is_open() && !lines.empty() && crossword.Unserialize(lines);
+  }
+
+  if (loaded) {
+    open_file = filename;
+    UpdateGrid();
+    SelectFirstClue();
+    ClearGridSelection();
+    crossword.logger.Log("Loaded from file \"" + filename + "\"");
+  } else {
+    crossword.logger.Log("Open failed");
+  }
+}
+
+/**
+ * @brief Save the puzzle, in the binary format if the file name ends in .cwpz and as text otherwise.
+ *
+ * @param filename
+ */
 void CrosswordApp::SaveToFile(const std::string &filename) {
   std::ofstream f;
-  f.open(filename);
-  auto lines = crossword.Serialize();
-  for (std::string const &line: lines) {
-    f << line << "\n";
+  if (IsBinaryPuzzle(filename)) {
+    f.open(filename, std::ios::binary);
+    crossword.WritePuzzle(f);
+  } else {
+    f.open(filename);
+    auto lines = crossword.Serialize();
+    for (std::string const &line: lines) {
+      f << line << "\n";
+    }
   }
   crossword.logger.Log("Wrote out to file \"" + filename + "\"");
   open_file = filename;
@@ -73,8 +158,8 @@ CrosswordApp::CrosswordApp(MainWindowOptions const &options)
         wxPoint(-1, -1),
         wxSize(600, 800)),
           crossword{}, selected{0, 0},
-          current_clue{kACROSS, Coord{0, 0}, 0, std::vector<Atom>{}, std::vector<Coord>{}},
-          user_selection(false), is_searching(false) {
+          current_clue{kACROSS, Coord{0, 0}, 0, Word(), std::vector<Coord>{}},
+          user_selection(false), is_searching(false), grid_drawn(false) {
   if (options.silent) {
     crossword.logger.Silence();
   }
@@ -84,7 +169,7 @@ CrosswordApp::CrosswordApp(MainWindowOptions const &options)
   CentreOnScreen();
 
   if (options.db) {
-    LoadDatabaseFromCSV(options.db_filename);
+    LoadDatabase(options.db_filename);
   }
 
   SetMinSize(wxSize(200, 200));
@@ -198,6 +283,19 @@ Clue &CrosswordApp::GetCurrentClue() {
   return current_clue;
 }
 
+/**
+ * @brief Position of the selected cell within a clue.
+ *
+ * @param clue
+ * @return int kNO_NUMBER if the clue does not pass through the selected cell
+ */
+int CrosswordApp::SelectedOffsetIn(Clue const &clue) const {
+  const std::size_t slot = crossword.SlotAt(clue.GetDirection(), selected);
+  if (slot == kNO_SLOT || !crossword.Clues()[slot].SameCoords(clue))
+    return kNO_NUMBER;
+  return static_cast<int>(crossword.SlotOffsetAt(clue.GetDirection(), selected));
+}
+
 /**
  * @brief Deletes the value of the currently selected cell.
  *
@@ -205,7 +303,7 @@ Clue &CrosswordApp::GetCurrentClue() {
 void CrosswordApp::DeleteOne() {
   crossword.Set(Atom(), selected);
   Clue clue = GetCurrentClue();
-  int i = clue.IndexOfCoord(selected);
+  int i = SelectedOffsetIn(clue);
   if (i > 0) {
     SetGridCursor(clue.coord_list_[i - 1]);
   }
@@ -224,7 +322,7 @@ void CrosswordApp::EnterCharacter(char c) {
   crossword.Set(new_value, selected);
   UpdateGrid(); // call here to make the UI snappier
   Clue clue = GetCurrentClue();
-  int i = clue.IndexOfCoord(selected);
+  int i = SelectedOffsetIn(clue);
   if (i != kNO_NUMBER && (std::size_t) i < clue.GetSize() - 1) {
     SetGridCursor(clue.coord_list_[i + 1]);
   }
@@ -23,6 +23,7 @@
 #include <wx/grid.h>
 
 #include "crossword/crossword.hpp"
+#include "crossword/search_progress.hpp"
 
 /**
  * @brief The background color for non-barrier cells.
@@ -54,6 +55,12 @@ const wxColor kGRAY = wxColour(100, 100, 100);
  */
 const wxColor COLOR_MAP[3] = {kWHITE, kRED, kGRAY};
 
+/**
+ * @brief Milliseconds between grid refreshes while a search is running.
+ *
+ */
+const int kSEARCH_REFRESH_MS = 33;
+
 /**
  * @brief Custom event that we fire when we want the grid to be refreshed.
  *
@@ -72,6 +79,12 @@ wxDEFINE_EVENT(SEARCHING, wxCommandEvent);
  */
 wxDEFINE_EVENT(DONE_SEARCHING, wxCommandEvent);
 
+/**
+ * @brief Custom event carrying database load progress, as a percentage in its int.
+ *
+ */
+wxDEFINE_EVENT(LOAD_PROGRESS, wxCommandEvent);
+
 enum {
   ID_Enforce_Symmetry = 2,
   ID_Resize_Grid = 3,
@@ -138,6 +151,32 @@ public:
    */
   std::atomic<bool> is_searching;
 
+  /**
+   * @brief Signalled when a search ends, waking the grid refresh thread.
+   *
+   */
+  crossword_backend::CancellationToken search_finished;
+
+  /**
+   * @brief Where an autofill publishes its progress. The grid is drawn from here while searching, as the
+   * crossword itself is being written by the search.
+   *
+   */
+  crossword_backend::SearchProgress search_progress;
+
+  /**
+   * @brief Cells as last pushed to the grid widget, which is what the cell renderer draws.
+   *
+   */
+  std::array<std::array<crossword_backend::Cell, crossword_backend::kMAX_DIM>, crossword_backend::kMAX_DIM> drawn_cells;
+
+  /**
+   * @brief Clue numbers as last pushed to the grid widget.
+   *
+   */
+  std::array<std::array<crossword_backend::ClueNumber, crossword_backend::kMAX_DIM>, crossword_backend::kMAX_DIM>
+          drawn_numbers;
+
   int CellSize();
 
   CrosswordApp(MainWindowOptions const &options);
@@ -192,20 +231,44 @@ private:
    */
   wxMenuBar *menuBar;
 
+  /**
+   * @brief Colors as last pushed to the grid widget.
+   *
+   */
+  std::array<std::array<int, crossword_backend::kMAX_DIM>, crossword_backend::kMAX_DIM> drawn_colors;
+
+  /**
+   * @brief Whether the drawn state matches the grid widget, so that only changed cells need repainting.
+   *
+   * Cleared whenever the widget is recreated.
+   *
+   */
+  bool grid_drawn;
+
   void ExportPDF(std::string const &filename);
 
+  void OpenFile(std::string const &filename);
+
   void SaveToFile(std::string const &filename);
 
   void UpdateGrid();
 
+  void PushCell(std::size_t row, std::size_t col, crossword_backend::Cell cell, crossword_backend::ClueNumber number);
+
+  void ShowSearchProgress(crossword_backend::SearchProgressFrame const &frame);
+
   bool GetRotationalSymmetry();
 
+  void LoadDatabase(std::string const &filename);
+
   void LoadDatabaseFromCSV(std::string const &filename);
 
   bool GetSpellcheck();
 
   crossword_backend::Clue &GetCurrentClue();
 
+  int SelectedOffsetIn(crossword_backend::Clue const &clue) const;
+
   crossword_backend::Coord GetGridCursor();
 
   /* Initialization */
@@ -272,6 +335,8 @@ private:
 
   void OnDoneSearching(wxCommandEvent &event);
 
+  void OnLoadProgress(wxCommandEvent &event);
+
   void OnShowLogs(wxCommandEvent &event);
 
   void OnWordInfo(wxCommandEvent &event);
@@ -318,7 +383,16 @@ public:
    */
   CrosswordApp *app;
 
+  /**
+   * @brief Font for clue numbers and the lock mark, built once per cell size.
+   *
+   */
   wxFont cell_number_font;
+
+  /**
+   * @brief Height of cell_number_font.
+   *
+   */
   int cell_number_font_size;
 
   /**